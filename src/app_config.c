@@ -25,6 +25,18 @@ light_config_t g_light_config_default = {
     .dimming_mode = DIMMING_MODE_ADVANCED,
     .dimming_strategy = DIMMING_STRATEGY_MOVE_TO_LEVEL,
     .step_table_size = 30,
+    .override_timeout = 60,
+    .loop_target = 0,
+    .loop_period_ms = 1000,
+    .loop_kp = 0.0002,
+    .loop_ki = 0.0001,
+    .flicker_limit = 0,
+    .output = LIGHT_OUTPUT_ZIGBEE,
+    .latency_1 = 0,
+    .latency_2 = 0,
+    .scene_points = 2,
+    .ledc_gpio_1 = 18,
+    .ledc_gpio_2 = 19,
 };
 
 // Fitted in normalized space: yScaled = 0.557 * xScaled^(1.018)
@@ -79,4 +91,101 @@ esp_err_t reset_light_config_to_default()
 {
     save_light_config_to_nvs(&g_light_config_default);
     return load_light_config_from_nvs();
-}
\ No newline at end of file
+}
+
+esp_err_t load_zigbee_channel_from_nvs(uint8_t *channel)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle)) == ESP_OK)
+    {
+        err = nvs_get_u8(nvs_handle, NVS_KEY_ZB_CHANNEL, channel);
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t save_zigbee_channel_to_nvs(uint8_t channel)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle)) == ESP_OK)
+    {
+        if ((err = nvs_set_u8(nvs_handle, NVS_KEY_ZB_CHANNEL, channel)) == ESP_OK)
+        {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t load_power_mode_from_nvs(uint8_t *mode)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle)) == ESP_OK)
+    {
+        err = nvs_get_u8(nvs_handle, NVS_KEY_PM_MODE, mode);
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t save_power_mode_to_nvs(uint8_t mode)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle)) == ESP_OK)
+    {
+        if ((err = nvs_set_u8(nvs_handle, NVS_KEY_PM_MODE, mode)) == ESP_OK)
+        {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t load_time_sync_from_nvs(uint8_t *role, uint8_t *domain)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle)) == ESP_OK)
+    {
+        if ((err = nvs_get_u8(nvs_handle, NVS_KEY_SYNC_ROLE, role)) == ESP_OK)
+        {
+            err = nvs_get_u8(nvs_handle, NVS_KEY_SYNC_DOMAIN, domain);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t save_time_sync_to_nvs(uint8_t role, uint8_t domain)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle)) == ESP_OK)
+    {
+        if ((err = nvs_set_u8(nvs_handle, NVS_KEY_SYNC_ROLE, role)) == ESP_OK &&
+            (err = nvs_set_u8(nvs_handle, NVS_KEY_SYNC_DOMAIN, domain)) == ESP_OK)
+        {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
@@ -26,6 +26,18 @@ typedef struct {
     double gamma_log_value;
     curve_type_t curve_type;
     uint16_t step_table_size;
+    uint32_t override_timeout;  // seconds a manual level holds before the fade resumes
+    uint16_t loop_target;       // ambient level to hold in raw sensor counts, 0 = open loop
+    uint16_t loop_period_ms;    // brightness loop rate
+    double loop_kp;             // scale per count of error
+    double loop_ki;             // scale per count-second of error
+    double flicker_limit;       // percent flicker a fade level may show before it is stepped around, 0 = off
+    light_output_t output;      // where the fade levels go
+    double latency_1;           // ms to send lamp 1's commands early by, -1 = measured from APS confirms
+    double latency_2;
+    uint8_t scene_points;       // table entries stored as scenes in DIMMING_STRATEGY_SCENE_RECALL, 2 = endpoints only
+    uint8_t ledc_gpio_1;        // LEDC output pin of lamp 1, clear of the sensor pads (GPIO0-7)
+    uint8_t ledc_gpio_2;
 
 } light_config_t;
 
@@ -35,6 +47,10 @@ extern esp_zb_ieee_addr_t lamp1_long_address, lamp2_long_address;
 
 #define NVS_NAMESPACE "storage"
 #define NVS_KEY "light_config"
+#define NVS_KEY_ZB_CHANNEL "zb_channel"
+#define NVS_KEY_PM_MODE "pm_mode"
+#define NVS_KEY_SYNC_ROLE "sync_role"
+#define NVS_KEY_SYNC_DOMAIN "sync_domain"
 
 // Function to load the configuration from flash
 esp_err_t load_light_config_from_nvs();
@@ -45,4 +61,16 @@ esp_err_t save_light_config_to_nvs(const light_config_t *config);
 // Function to reset the configuration to defaults
 esp_err_t reset_light_config_to_default();
 
-esp_err_t save_current_light_config_to_nvs();
\ No newline at end of file
+esp_err_t save_current_light_config_to_nvs();
+
+// Zigbee channel picked by the energy scan at first formation
+esp_err_t load_zigbee_channel_from_nvs(uint8_t *channel);
+esp_err_t save_zigbee_channel_to_nvs(uint8_t channel);
+
+// Power management mode selected with the `pm` command
+esp_err_t load_power_mode_from_nvs(uint8_t *mode);
+esp_err_t save_power_mode_to_nvs(uint8_t mode);
+
+// Time sync role and domain selected with the `sync` command
+esp_err_t load_time_sync_from_nvs(uint8_t *role, uint8_t *domain);
+esp_err_t save_time_sync_to_nvs(uint8_t role, uint8_t domain);
\ No newline at end of file
@@ -0,0 +1,199 @@
+#include "brightness_loop.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "app_config.h"
+#include "light_control.h"
+#include "light_sensor.h"
+
+static const char *TAG = "BRIGHTNESS_LOOP";
+
+typedef struct {
+    uint32_t ticks;
+    uint32_t stale;             // no fresh sensor average, correction skipped
+    uint32_t corrections;       // scale changes applied
+    uint32_t commands;          // hold re-commands caused by corrections
+    uint32_t max_commands;      // most re-commands from one correction
+    int64_t sample_age_us;      // sensor average age when the loop read it
+    int64_t sample_age_max_us;
+    int64_t apply_us;           // read to command queued
+    int64_t apply_max_us;
+    int64_t started_us;
+} brightness_loop_stats_t;
+
+static TaskHandle_t s_task;
+static volatile bool s_stop;
+static brightness_loop_stats_t s_stats;
+static uint32_t s_measured;
+static float s_integral;
+
+/* Mean of the sensor averages published during the last period */
+static bool read_measurement(uint32_t period_ms, int64_t now_us, uint32_t *out)
+{
+    int64_t value_time_us = light_sensor_value_time_us(0);
+    s_stats.sample_age_us = now_us - value_time_us;
+    if (value_time_us == 0 || s_stats.sample_age_us > 2 * (int64_t)period_ms * 1000 + 100000)
+        return false;
+    if (s_stats.sample_age_us > s_stats.sample_age_max_us)
+        s_stats.sample_age_max_us = s_stats.sample_age_us;
+
+    uint16_t history[SENSOR_HISTORY_LEN];
+    int want = period_ms / SENSOR_AVERAGE_WINDOW_MS;
+    if (want < 1)
+        want = 1;
+    int n = light_sensor_get_history(0, history, want);
+    if (n == 0)
+        return false;
+
+    uint32_t sum = 0;
+    for (int i = 0; i < n; i++)
+        sum += history[i];
+    *out = sum / n;
+    return true;
+}
+
+static void brightness_loop_task(void *pvParameters)
+{
+    uint32_t period_ms = g_light_config.loop_period_ms > 0 ? g_light_config.loop_period_ms : 1000;
+    if (period_ms > BRIGHTNESS_LOOP_PERIOD_MAX_MS)
+    {
+        ESP_LOGW(TAG, "Period %" PRIu32 " ms is longer than the sensor history, using %d ms",
+                 period_ms, BRIGHTNESS_LOOP_PERIOD_MAX_MS);
+        period_ms = BRIGHTNESS_LOOP_PERIOD_MAX_MS;
+    }
+    TickType_t next_wake = xTaskGetTickCount();
+    int64_t last_resend_us = 0;
+    float applied = lights_get_brightness_scale();
+
+    s_integral = applied - 1.0f;
+    s_stats = (brightness_loop_stats_t){.started_us = esp_timer_get_time()};
+
+    while (!s_stop)
+    {
+        // Fixed rate; a notification only ends the wait early to stop
+        next_wake += pdMS_TO_TICKS(period_ms);
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(next_wake - now) > 0)
+            ulTaskNotifyTake(pdTRUE, next_wake - now);
+        else
+            next_wake = now;
+        if (s_stop)
+            break;
+
+        s_stats.ticks++;
+        int64_t start_us = esp_timer_get_time();
+        uint32_t measured;
+        if (!read_measurement(period_ms, start_us, &measured))
+        {
+            s_stats.stale++;
+            continue;
+        }
+        s_measured = measured;
+
+        // PI on the scale: too dark (positive error) raises it. The integral is
+        // the steady-state trim and is clamped to the reachable range (anti-windup).
+        float dt = period_ms / 1000.0f;
+        float error = (float)g_light_config.loop_target - (float)measured;
+        s_integral += (float)g_light_config.loop_ki * error * dt;
+        if (s_integral > 0)
+            s_integral = 0;
+        if (s_integral < BRIGHTNESS_LOOP_SCALE_MIN - 1.0f)
+            s_integral = BRIGHTNESS_LOOP_SCALE_MIN - 1.0f;
+
+        float scale = 1.0f + (float)g_light_config.loop_kp * error + s_integral;
+        if (scale > 1.0f)
+            scale = 1.0f;
+        if (scale < BRIGHTNESS_LOOP_SCALE_MIN)
+            scale = BRIGHTNESS_LOOP_SCALE_MIN;
+
+        if (scale - applied < BRIGHTNESS_LOOP_DEADBAND && applied - scale < BRIGHTNESS_LOOP_DEADBAND)
+            continue;
+
+        bool resend = start_us - last_resend_us >= BRIGHTNESS_LOOP_RESEND_MS * 1000LL;
+        int commands = lights_set_brightness_scale(scale, resend);
+        applied = scale;
+
+        // The fade tasks outrank this one, so any re-command is queued by now
+        s_stats.apply_us = esp_timer_get_time() - start_us;
+        if (s_stats.apply_us > s_stats.apply_max_us)
+            s_stats.apply_max_us = s_stats.apply_us;
+        s_stats.corrections++;
+        s_stats.commands += commands;
+        if (commands > s_stats.max_commands)
+            s_stats.max_commands = commands;
+        if (commands > 0)
+            last_resend_us = start_us;
+    }
+
+    // Only the exiting task clears the handle, so a start can never overlap it
+    s_task = NULL;
+    vTaskDelete(NULL);
+}
+
+/* False if the task is still running after the timeout; s_stop stays set */
+static bool brightness_loop_stop(void)
+{
+    if (s_task == NULL)
+        return true;
+
+    s_stop = true;
+    xTaskNotifyGive(s_task);
+    for (int i = 0; i < 100 && s_task != NULL; i++)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    return s_task == NULL;
+}
+
+void brightness_loop_apply_config(void)
+{
+    if (!brightness_loop_stop())
+    {
+        ESP_LOGE(TAG, "Loop task did not stop, not reconfiguring");
+        return;
+    }
+
+    if (g_light_config.loop_target == 0)
+    {
+        // Open loop: the pattern runs at full range again
+        lights_set_brightness_scale(1.0f, true);
+        return;
+    }
+
+    // The loop needs a continuous sample stream
+    start_light_sensor_task();
+    sensor_mode_t mode = light_sensor_get_mode();
+    if (mode == SENSOR_MODE_SEGMENT)
+        ESP_LOGW(TAG, "Sensor is in segment mode; the loop only corrects after segment bursts");
+    else if (mode == SENSOR_MODE_EVENT)
+        ESP_LOGW(TAG, "Sensor is in event mode; the loop only sees one value a second and on threshold events");
+
+    s_stop = false;
+    xTaskCreate(brightness_loop_task, "brightness_loop", 3072, NULL, 3, &s_task);
+    ESP_LOGI(TAG, "Holding %u counts, period %u ms", g_light_config.loop_target, g_light_config.loop_period_ms);
+}
+
+bool brightness_loop_running(void)
+{
+    return s_task != NULL;
+}
+
+void brightness_loop_print_status(void)
+{
+    if (s_task == NULL)
+    {
+        printf("Brightness loop: off, scale %.2f\n", lights_get_brightness_scale());
+        return;
+    }
+
+    int64_t running_us = esp_timer_get_time() - s_stats.started_us;
+    printf("Brightness loop: target %u, measured %" PRIu32 ", scale %.3f (integral %+.3f)\n",
+           g_light_config.loop_target, s_measured, lights_get_brightness_scale(), s_integral);
+    printf("  ticks %" PRIu32 ", stale %" PRIu32 ", corrections %" PRIu32 "\n",
+           s_stats.ticks, s_stats.stale, s_stats.corrections);
+    printf("  lamp commands %" PRIu32 " (%.1f/min), at most %" PRIu32 " per correction\n", s_stats.commands,
+           running_us > 0 ? s_stats.commands * 60e6 / running_us : 0.0, s_stats.max_commands);
+    printf("  latency: sample age %" PRId64 " ms (max %" PRId64 "), read to command %" PRId64 " us (max %" PRId64 ")\n",
+           s_stats.sample_age_us / 1000, s_stats.sample_age_max_us / 1000, s_stats.apply_us, s_stats.apply_max_us);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "light_sensor.h"
+
+/*
+ * Closed-loop ambient brightness: a PI controller on sensor 0 that trims the
+ * global brightness scale of the fades so the room averages loop_target
+ * (raw ADC counts) while the fade pattern keeps running. Corrections reach
+ * the lamps with the next segment command; only lamps sitting in a hold are
+ * re-commanded, at most once per BRIGHTNESS_LOOP_RESEND_MS.
+ */
+#define BRIGHTNESS_LOOP_SCALE_MIN  0.05f   /* never dim the pattern below this */
+#define BRIGHTNESS_LOOP_DEADBAND   0.01f   /* smaller scale changes are not applied */
+#define BRIGHTNESS_LOOP_RESEND_MS  5000    /* minimum gap between hold re-commands */
+/* longest period whose measurement the sensor history still covers */
+#define BRIGHTNESS_LOOP_PERIOD_MAX_MS (SENSOR_HISTORY_LEN * SENSOR_AVERAGE_WINDOW_MS)
+
+/**
+ * @brief Start the loop if g_light_config.loop_target is set, stop it otherwise.
+ */
+void brightness_loop_apply_config(void);
+
+bool brightness_loop_running(void);
+
+/**
+ * @brief Print target, measurement, scale, latency and command counts.
+ */
+void brightness_loop_print_status(void);
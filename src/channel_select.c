@@ -0,0 +1,88 @@
+#include "channel_select.h"
+#include <string.h>
+
+int channel_energy_of(const channel_energy_t *results, int count, uint8_t channel)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (results[i].channel == channel)
+            return results[i].energy;
+    }
+    return INT8_MIN;
+}
+
+static int neighbour_energy(const channel_energy_t *results, int count, uint8_t channel)
+{
+    int sum = 0;
+    int below = channel_energy_of(results, count, channel - 1);
+    int above = channel_energy_of(results, count, channel + 1);
+    if (below != INT8_MIN)
+        sum += below;
+    if (above != INT8_MIN)
+        sum += above;
+    return sum;
+}
+
+int channel_select_quietest(const channel_energy_t *results, int count, uint32_t allowed_mask)
+{
+    int best = -1;
+    int best_energy = 0;
+    int best_neighbours = 0;
+
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t channel = results[i].channel;
+        if (channel < ZB_CHANNEL_MIN || channel > ZB_CHANNEL_MAX || !(allowed_mask & (1UL << channel)))
+            continue;
+
+        int energy = results[i].energy;
+        int neighbours = neighbour_energy(results, count, channel);
+
+        if (best < 0 || energy < best_energy ||
+            (energy == best_energy && neighbours < best_neighbours) ||
+            (energy == best_energy && neighbours == best_neighbours && channel < best))
+        {
+            best = channel;
+            best_energy = energy;
+            best_neighbours = neighbours;
+        }
+    }
+    return best;
+}
+
+int channel_select_migration(const channel_energy_t *results, int count, uint32_t allowed_mask, uint8_t current,
+                             int margin)
+{
+    int best = channel_select_quietest(results, count, allowed_mask);
+    int current_energy = channel_energy_of(results, count, current);
+
+    if (best < 0 || best == current || current_energy == INT8_MIN)
+        return -1;
+    return channel_energy_of(results, count, best) + margin < current_energy ? best : -1;
+}
+
+void channel_monitor_init(channel_monitor_t *monitor, uint32_t window_frames, uint8_t threshold_pct)
+{
+    memset(monitor, 0, sizeof(*monitor));
+    monitor->window_frames = window_frames ? window_frames : 1;
+    monitor->threshold_pct = threshold_pct;
+}
+
+bool channel_monitor_record(channel_monitor_t *monitor, bool success)
+{
+    monitor->sent++;
+    monitor->total_sent++;
+    if (!success)
+    {
+        monitor->failed++;
+        monitor->total_failed++;
+    }
+
+    if (monitor->sent < monitor->window_frames)
+        return false;
+
+    monitor->last_failure_pct = (uint8_t)(monitor->failed * 100 / monitor->sent);
+    monitor->sent = 0;
+    monitor->failed = 0;
+    return monitor->last_failure_pct > monitor->threshold_pct;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * Channel choice from energy-detect results, and the failure-rate monitor
+ * that decides when to re-scan. Plain C: the radio is only seen through the
+ * scan results handed in, so a host build can feed it fake scans.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ZB_CHANNEL_MIN 11
+#define ZB_CHANNEL_MAX 26
+
+typedef struct {
+    uint8_t channel;
+    int8_t energy;      // energy detected, as reported by the MAC (higher is busier)
+} channel_energy_t;
+
+/**
+ * @brief Pick the quietest channel allowed by `allowed_mask`.
+ *
+ * Ties are broken by the energy on the adjacent channels, then by the lower
+ * channel number. Returns -1 if no result falls inside the mask.
+ */
+int channel_select_quietest(const channel_energy_t *results, int count, uint32_t allowed_mask);
+
+/**
+ * @brief Energy reported for `channel`, or INT8_MIN if it was not scanned.
+ */
+int channel_energy_of(const channel_energy_t *results, int count, uint8_t channel);
+
+/**
+ * @brief Channel to migrate to after a re-scan, or -1 to stay on `current`.
+ *
+ * Moves only to the quietest allowed channel, and only if its energy is
+ * more than `margin` below the current one's (a current channel missing
+ * from the scan never migrates).
+ */
+int channel_select_migration(const channel_energy_t *results, int count, uint32_t allowed_mask, uint8_t current,
+                             int margin);
+
+typedef struct {
+    uint32_t window_frames;     // frames per evaluation window
+    uint8_t threshold_pct;      // failure percentage that triggers a re-scan
+    uint32_t sent;              // frames in the current window
+    uint32_t failed;            // failures in the current window
+    uint32_t total_sent;
+    uint32_t total_failed;
+    uint8_t last_failure_pct;   // result of the last closed window
+} channel_monitor_t;
+
+void channel_monitor_init(channel_monitor_t *monitor, uint32_t window_frames, uint8_t threshold_pct);
+
+/**
+ * @brief Count one send result.
+ * @return true when this closes a window whose failure rate is above threshold.
+ */
+bool channel_monitor_record(channel_monitor_t *monitor, bool success);
@@ -9,6 +9,21 @@
 #include "app_config.h"
 #include "light_control.h"
 #include "light_sensor.h"
+#include "deferred_log.h"
+#include "zigbee_main.h"
+#include "lamp_state.h"
+#include "serial_ota.h"
+#include "power.h"
+#include "profiler.h"
+#include "time_sync_espnow.h"
+#include "brightness_loop.h"
+#include "zb_bench_zigbee.h"
+#include "fade_stats.h"
+#include "preset_bank.h"
+#include "flicker_monitor.h"
+#include "light_output.h"
+#include "metrics_store.h"
+#include "zigbee_topology.h"
 
 static const char *TAG = "CONSOLE_CMD";
 
@@ -29,6 +44,18 @@ int cmd_get_config(int argc, char **argv)
     printf("VALUE gamma_pow_scale %.2f\n", g_light_config.gamma_pow_scale);
     printf("VALUE gamma_log_value %.2f\n", g_light_config.gamma_log_value);
     printf("VALUE curve_type %u\n", g_light_config.curve_type);
+    printf("VALUE override_timeout %lu\n", (unsigned long)g_light_config.override_timeout);
+    printf("VALUE loop_target %u\n", g_light_config.loop_target);
+    printf("VALUE loop_period_ms %u\n", g_light_config.loop_period_ms);
+    printf("VALUE loop_kp %.6f\n", g_light_config.loop_kp);
+    printf("VALUE loop_ki %.6f\n", g_light_config.loop_ki);
+    printf("VALUE flicker_limit %.2f\n", g_light_config.flicker_limit);
+    printf("VALUE output %u\n", g_light_config.output);
+    printf("VALUE latency_1 %.1f\n", g_light_config.latency_1);
+    printf("VALUE latency_2 %.1f\n", g_light_config.latency_2);
+    printf("VALUE scene_points %u\n", g_light_config.scene_points);
+    printf("VALUE ledc_gpio_1 %u\n", g_light_config.ledc_gpio_1);
+    printf("VALUE ledc_gpio_2 %u\n", g_light_config.ledc_gpio_2);
     return 0;
 }
 
@@ -104,6 +131,54 @@ static int cmd_set_config(int argc, char **argv)
     {
         g_light_config.step_table_size = (uint16_t)value;
     }
+    else if (strcmp(param, "override_timeout") == 0)
+    {
+        g_light_config.override_timeout = (uint32_t)value;
+    }
+    else if (strcmp(param, "loop_target") == 0)
+    {
+        g_light_config.loop_target = (uint16_t)value;
+    }
+    else if (strcmp(param, "loop_period_ms") == 0)
+    {
+        g_light_config.loop_period_ms = (uint16_t)value;
+    }
+    else if (strcmp(param, "loop_kp") == 0)
+    {
+        g_light_config.loop_kp = value;
+    }
+    else if (strcmp(param, "loop_ki") == 0)
+    {
+        g_light_config.loop_ki = value;
+    }
+    else if (strcmp(param, "flicker_limit") == 0)
+    {
+        g_light_config.flicker_limit = value;
+    }
+    else if (strcmp(param, "output") == 0)
+    {
+        g_light_config.output = (light_output_t)value;
+    }
+    else if (strcmp(param, "latency_1") == 0)
+    {
+        g_light_config.latency_1 = value;
+    }
+    else if (strcmp(param, "latency_2") == 0)
+    {
+        g_light_config.latency_2 = value;
+    }
+    else if (strcmp(param, "scene_points") == 0)
+    {
+        g_light_config.scene_points = (uint8_t)value;
+    }
+    else if (strcmp(param, "ledc_gpio_1") == 0)
+    {
+        g_light_config.ledc_gpio_1 = (uint8_t)value;
+    }
+    else if (strcmp(param, "ledc_gpio_2") == 0)
+    {
+        g_light_config.ledc_gpio_2 = (uint8_t)value;
+    }
     else
     {
         ESP_LOGW(TAG, "Unknown parameter: %s", param);
@@ -112,6 +187,18 @@ static int cmd_set_config(int argc, char **argv)
 
     ESP_LOGI(TAG, "Updated %s to %f", param, value);
 
+    // The brightness loop does not touch the fade schedule
+    if (strncmp(param, "loop_", 5) == 0)
+    {
+        brightness_loop_apply_config();
+        return 0;
+    }
+
+    // Read by the fade tasks as they go: flicker_limit at every step, a
+    // changed latency from the next cycle (the lead is latched per cycle)
+    if (strcmp(param, "flicker_limit") == 0 || strncmp(param, "latency_", 8) == 0)
+        return 0;
+
     // Re-initialize the lights to apply new settings
     lights_init();
     return 0;
@@ -130,6 +217,7 @@ static int cmd_reset_config(int argc, char **argv)
     ESP_LOGI(TAG, "Resetting configuration to default values...");
     reset_light_config_to_default();
     lights_init(); // Re-initialize the lights with default settings
+    brightness_loop_apply_config();
     cmd_get_config(0, NULL);
     return 0;
 }
@@ -139,6 +227,7 @@ static int cmd_reload_config(int argc, char **argv)
     ESP_LOGI(TAG, "Reloading configuration from non-volatile storage...");
     load_light_config_from_nvs();
     lights_init(); // Re-initialize the lights with reloaded settings
+    brightness_loop_apply_config();
     cmd_get_config(0, NULL);
     return 0;
 }
@@ -150,12 +239,464 @@ static int cmd_start_sensor(int argc, char **argv)
     return 0;
 }
 
+static int cmd_sensor_mode(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        for (int m = 0; m < SENSOR_MODE_COUNT; m++)
+        {
+            if (strcmp(argv[1], light_sensor_mode_name(m)) == 0)
+            {
+                if (light_sensor_set_mode(m) != 0)
+                    return 1;
+                ESP_LOGI(TAG, "Sensor mode set to %s", argv[1]);
+                return 0;
+            }
+        }
+        ESP_LOGW(TAG, "Usage: sensor_mode <stream|segment|background|lp|event>");
+        return 1;
+    }
+
+    light_sensor_print_stats();
+    return 0;
+}
+
+static int cmd_sensor_channels(int argc, char **argv)
+{
+    adc_channel_t channels[SENSOR_MAX_CHANNELS];
+    int count;
+
+    if (argc > 1)
+    {
+        count = argc - 1;
+        if (count > SENSOR_MAX_CHANNELS)
+        {
+            ESP_LOGW(TAG, "At most %d channels", SENSOR_MAX_CHANNELS);
+            return 1;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            channels[i] = (adc_channel_t)atoi(argv[i + 1]);
+        }
+        if (light_sensor_set_channels(channels, count) != 0)
+        {
+            ESP_LOGW(TAG, "Invalid channel list");
+            return 1;
+        }
+    }
+
+    count = light_sensor_get_channels(channels);
+    for (int i = 0; i < count; i++)
+    {
+        uint16_t history[SENSOR_HISTORY_LEN];
+        int n = light_sensor_get_history(i, history, SENSOR_HISTORY_LEN);
+        printf("sensor %d: ADC channel %d, value %ld, history", i, channels[i], get_sensor_value(i));
+        for (int h = 0; h < n; h++)
+        {
+            printf(" %u", history[h]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
+
+static int cmd_sensor_threshold(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        ESP_LOGW(TAG, "Usage: sensor_threshold <low> <high>");
+        return 1;
+    }
+    light_sensor_set_lp_thresholds(atoi(argv[1]), atoi(argv[2]));
+    return 0;
+}
+
 static int cmd_stop_sensor(int argc, char **argv)
 {
     ESP_LOGI(TAG, "Stopping sensor task...");
-    stop_light_sensor_task();
+    if (!stop_light_sensor_task())
+    {
+        ESP_LOGW(TAG, "Sensor task is still stopping");
+        return 1;
+    }
+    return 0;
+}
+static int cmd_dlog_bench(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 1000;
+    deferred_log_benchmark(iterations);
+    return 0;
+}
+
+static int cmd_curve_bench(int argc, char **argv)
+{
+    int iterations = (argc > 1) ? atoi(argv[1]) : 10;
+    lights_curve_benchmark(iterations);
+    return 0;
+}
+
+static int cmd_channel(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "scan") == 0)
+    {
+        ESP_LOGI(TAG, "Re-scanning channels...");
+        zigbee_channel_rescan();
+    }
+    else if (argc > 2 && strcmp(argv[1], "auto") == 0)
+    {
+        zigbee_channel_set_auto_migrate(atoi(argv[2]) != 0);
+    }
+    else if (argc > 1)
+    {
+        ESP_LOGW(TAG, "Usage: channel [scan|auto <0|1>]");
+        return 1;
+    }
+
+    zigbee_channel_print_status();
+    return 0;
+}
+
+static int cmd_lamps(int argc, char **argv)
+{
+    lamp_state_print();
+    return 0;
+}
+
+static int cmd_fade_status(int argc, char **argv)
+{
+    lights_print_status();
+    light_output_print_status();
+    return 0;
+}
+
+static int cmd_level(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        ESP_LOGW(TAG, "Usage: level <lamp|0> <level|resume> [hold_s]");
+        return 1;
+    }
+
+    int lamp = atoi(argv[1]);
+    if (lamp < 0 || lamp > 2)
+    {
+        ESP_LOGW(TAG, "Lamp must be 1, 2 or 0 for both");
+        return 1;
+    }
+
+    if (strcmp(argv[2], "resume") == 0)
+    {
+        lights_override_cancel((uint8_t)lamp);
+        return 0;
+    }
+
+    int level = atoi(argv[2]);
+    if (level < 0 || level > 255)
+    {
+        ESP_LOGW(TAG, "Level must be 0..255");
+        return 1;
+    }
+    uint32_t hold_s = (argc > 3) ? strtoul(argv[3], NULL, 10) : 0;
+    lights_override((uint8_t)lamp, (uint8_t)level, hold_s);
+    return 0;
+}
+
+static int cmd_pm(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "stats") == 0)
+    {
+        power_print_stats();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "probe") == 0)
+    {
+        int samples = (argc > 2) ? atoi(argv[2]) : 20;
+        int period_ms = (argc > 3) ? atoi(argv[3]) : 100;
+        power_measure_wake_latency(samples, period_ms);
+        return 0;
+    }
+    if (argc > 1)
+    {
+        for (int m = 0; m < POWER_MODE_COUNT; m++)
+        {
+            if (strcmp(argv[1], power_mode_name(m)) == 0)
+            {
+                return power_set_mode(m) == ESP_OK ? 0 : 1;
+            }
+        }
+        ESP_LOGW(TAG, "Usage: pm [off|dfs|sleep|stats|probe [samples] [period_ms]]");
+        return 1;
+    }
+
+    printf("Power mode: %s\n", power_mode_name(power_get_mode()));
+    return 0;
+}
+
+static int cmd_top(int argc, char **argv)
+{
+    uint32_t window_ms = (argc > 1) ? strtoul(argv[1], NULL, 10) : 1000;
+    int repeat = (argc > 2) ? atoi(argv[2]) : 1;
+    profiler_top(window_ms, repeat);
+    return 0;
+}
+
+static int cmd_prof(int argc, char **argv)
+{
+    esp_err_t err = ESP_OK;
+
+    if (argc > 1 && strcmp(argv[1], "start") == 0)
+    {
+        err = profiler_start((argc > 2) ? strtoul(argv[2], NULL, 10) : 0);
+    }
+    else if (argc > 1 && strcmp(argv[1], "stop") == 0)
+    {
+        err = profiler_stop();
+    }
+    else if (argc > 1 && strcmp(argv[1], "dump") == 0)
+    {
+        profiler_dump();
+    }
+    else if (argc > 1 && strcmp(argv[1], "clear") == 0)
+    {
+        profiler_clear();
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Usage: prof <start [period_us]|stop|dump|clear>");
+        return 1;
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "prof %s: %s", argv[1], esp_err_to_name(err));
+        return 1;
+    }
+    return 0;
+}
+
+static int cmd_sync(int argc, char **argv)
+{
+    if (argc > 1)
+    {
+        for (int r = 0; r < TIME_SYNC_ROLE_COUNT; r++)
+        {
+            if (strcmp(argv[1], time_sync_role_name(r)) == 0)
+            {
+                uint8_t domain = (argc > 2) ? (uint8_t)atoi(argv[2]) : TIME_SYNC_DEFAULT_DOMAIN;
+                return time_sync_espnow_set_role(r, domain) == ESP_OK ? 0 : 1;
+            }
+        }
+        ESP_LOGW(TAG, "Usage: sync [off|master|slave [domain]]");
+        return 1;
+    }
+
+    time_sync_espnow_print_status();
+    return 0;
+}
+
+static int cmd_loop(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "off") == 0)
+    {
+        g_light_config.loop_target = 0;
+        brightness_loop_apply_config();
+        return 0;
+    }
+    if (argc > 1)
+    {
+        int target = atoi(argv[1]);
+        if (target <= 0 || target > 4095)
+        {
+            ESP_LOGW(TAG, "Usage: loop [<target 1..4095>|off]");
+            return 1;
+        }
+        g_light_config.loop_target = (uint16_t)target;
+        brightness_loop_apply_config();
+        return 0;
+    }
+
+    brightness_loop_print_status();
+    return 0;
+}
+
+static int cmd_zbbench(int argc, char **argv)
+{
+    zb_bench_config_t config = {
+        .count = ZB_BENCH_DEFAULT_COUNT,
+        .rate_hz = ZB_BENCH_DEFAULT_RATE_HZ,
+        .max_inflight = ZB_BENCH_DEFAULT_MAX_INFLIGHT,
+        .timeout_ms = ZB_BENCH_CONFIRM_TIMEOUT_MS,
+    };
+
+    int pattern = -1;
+    for (int i = 0; argc > 1 && i < ZB_BENCH_PATTERN_COUNT; i++)
+    {
+        if (strcmp(argv[1], zb_bench_pattern_name(i)) == 0)
+            pattern = i;
+    }
+    if (pattern < 0)
+    {
+        ESP_LOGW(TAG, "Usage: zbbench <burst|paced|rr> [count] [rate_hz] [max_inflight] [lamp]");
+        return 1;
+    }
+    config.pattern = pattern;
+    if (argc > 2)
+        config.count = strtoul(argv[2], NULL, 10);
+    if (argc > 3)
+        config.rate_hz = strtoul(argv[3], NULL, 10);
+    if (argc > 4)
+        config.max_inflight = atoi(argv[4]);
+    if (argc > 5)
+        config.lamp = atoi(argv[5]);
+    if (config.pattern == ZB_BENCH_BURST)
+        config.rate_hz = 0;
+
+    return zb_bench_zigbee_run(&config) == ESP_OK ? 0 : 1;
+}
+
+static int cmd_segstats(int argc, char **argv)
+{
+    int lamp = argc > 1 ? atoi(argv[1]) : 1;
+    if (lamp < 1 || lamp > FADE_STATS_LAMPS)
+    {
+        ESP_LOGW(TAG, "Usage: segstats [lamp 1..%d]", FADE_STATS_LAMPS);
+        return 1;
+    }
+    fade_stats_print(lamp);
+    return 0;
+}
+
+static int cmd_preset(int argc, char **argv)
+{
+    if (argc == 1)
+    {
+        preset_bank_print();
+        return 0;
+    }
+
+    bool save = strcmp(argv[1], "save") == 0;
+    bool erase = strcmp(argv[1], "erase") == 0;
+    int slot = atoi(argv[(save || erase) && argc > 2 ? 2 : 1]);
+    if (slot < 0 || slot >= PRESET_SLOTS || ((save || erase) && argc < 3) || (save && argc < 4))
+    {
+        ESP_LOGW(TAG, "Usage: preset [<n> | save <n> <name> | erase <n>]");
+        return 1;
+    }
+
+    esp_err_t err;
+    if (save)
+        err = preset_bank_save(slot, argv[3]);
+    else if (erase)
+        err = preset_bank_erase(slot);
+    else
+        err = preset_bank_apply(slot);
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "preset %d: %s", slot, esp_err_to_name(err));
+        return 1;
+    }
+    return 0;
+}
+
+static int cmd_flicker(int argc, char **argv)
+{
+    if (argc > 1 && strcmp(argv[1], "reset") == 0)
+    {
+        flicker_monitor_reset();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "bench") == 0)
+    {
+        flicker_monitor_benchmark();
+        return 0;
+    }
+
+    int lamp = argc > 1 ? atoi(argv[1]) : 1;
+    float min_pct = argc > 2 ? atof(argv[2]) : 1.0f;
+    if (lamp < 1 || lamp > FLICKER_LAMPS)
+    {
+        ESP_LOGW(TAG, "Usage: flicker [lamp 1..%d] [min_pct] | reset | bench", FLICKER_LAMPS);
+        return 1;
+    }
+    flicker_monitor_print(lamp, min_pct);
     return 0;
 }
+
+static int cmd_metrics(int argc, char **argv)
+{
+    esp_err_t err = ESP_OK;
+    if (argc == 1)
+    {
+        metrics_store_print_status();
+        return 0;
+    }
+    else if (strcmp(argv[1], "flush") == 0)
+    {
+        err = metrics_store_flush();
+    }
+    else if (strcmp(argv[1], "dump") == 0)
+    {
+        uint32_t from_minute = argc > 2 ? strtoul(argv[2], NULL, 10) : 0;
+        uint32_t to_minute = argc > 3 ? strtoul(argv[3], NULL, 10) : UINT32_MAX;
+        err = metrics_store_dump(from_minute, to_minute);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Usage: metrics [flush | dump [from_minute] [to_minute]]");
+        return 1;
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGW(TAG, "metrics %s: %s", argv[1], esp_err_to_name(err));
+        return 1;
+    }
+    return 0;
+}
+
+static int cmd_scenes(int argc, char **argv)
+{
+    lights_print_scenes();
+    return 0;
+}
+
+static int cmd_topology(int argc, char **argv)
+{
+    if (argc == 2 && strcmp(argv[1], "refresh") == 0)
+    {
+        ESP_LOGI(TAG, "Walking the mesh...");
+        zigbee_topology_refresh();
+        return 0;
+    }
+    else if (argc == 3 && strcmp(argv[1], "slotting") == 0 &&
+             (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0))
+    {
+        zigbee_topology_set_slotting(strcmp(argv[2], "on") == 0);
+    }
+    else if (argc > 1)
+    {
+        ESP_LOGW(TAG, "Usage: topology [refresh | slotting <on|off>]");
+        return 1;
+    }
+
+    zigbee_topology_print();
+    return 0;
+}
+
+static int cmd_ota_recv(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        ESP_LOGW(TAG, "Usage: ota_recv <size> [z] [baud]");
+        return 1;
+    }
+    uint32_t size = strtoul(argv[1], NULL, 10);
+    bool compressed = argc > 2 && strcmp(argv[2], "z") == 0;
+    uint32_t baud = (argc > 3) ? strtoul(argv[3], NULL, 10) : 0;
+
+    return serial_ota_receive(size, compressed, baud) == ESP_OK ? 0 : 1;
+}
+
 void register_console_commands(void)
 {
     register_system();
@@ -223,4 +764,202 @@ void register_console_commands(void)
         .func = &cmd_stop_sensor,
     };
     ESP_ERROR_CHECK(esp_console_cmd_register(&stop_sensor_cmd));
+
+    // "sensor_mode" command
+    const esp_console_cmd_t sensor_mode_cmd = {
+        .command = "sensor_mode",
+        .help = "Set the sampling mode, or show CPU load per mode. Usage: sensor_mode [stream|segment|background|lp|event]",
+        .hint = NULL,
+        .func = &cmd_sensor_mode,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&sensor_mode_cmd));
+
+    // "sensor_channels" command
+    const esp_console_cmd_t sensor_channels_cmd = {
+        .command = "sensor_channels",
+        .help = "Set or show the ADC channels sampled together (one per lamp/zone). Usage: sensor_channels [ch ...]",
+        .hint = NULL,
+        .func = &cmd_sensor_channels,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&sensor_channels_cmd));
+
+    // "sensor_threshold" command
+    const esp_console_cmd_t sensor_threshold_cmd = {
+        .command = "sensor_threshold",
+        .help = "Brightness band for LP and event sensor modes; leaving it wakes the main core at once (0 0 = off). Usage: sensor_threshold <low> <high>",
+        .hint = NULL,
+        .func = &cmd_sensor_threshold,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&sensor_threshold_cmd));
+
+    // "dlog_bench" command
+    const esp_console_cmd_t dlog_bench_cmd = {
+        .command = "dlog_bench",
+        .help = "Compare per-segment cost of formatted vs. deferred logging. Usage: dlog_bench [iterations]",
+        .hint = NULL,
+        .func = &cmd_dlog_bench,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&dlog_bench_cmd));
+
+    // "curve_bench" command
+    const esp_console_cmd_t curve_bench_cmd = {
+        .command = "curve_bench",
+        .help = "Time and check fade tables for every gamma mode, curve type and size. Usage: curve_bench [iterations]",
+        .hint = NULL,
+        .func = &cmd_curve_bench,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&curve_bench_cmd));
+
+    // "channel" command
+    const esp_console_cmd_t channel_cmd = {
+        .command = "channel",
+        .help = "Show Zigbee channel and failure rate, re-scan, or toggle auto migration. Usage: channel [scan|auto <0|1>]",
+        .hint = NULL,
+        .func = &cmd_channel,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&channel_cmd));
+
+    // "lamps" command
+    const esp_console_cmd_t lamps_cmd = {
+        .command = "lamps",
+        .help = "Show the reported level and on/off state of every lamp",
+        .hint = NULL,
+        .func = &cmd_lamps,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&lamps_cmd));
+
+    // "fade_status" command
+    const esp_console_cmd_t fade_status_cmd = {
+        .command = "fade_status",
+        .help = "Show fade clock, whether the phase was resumed after a reset, boot-to-first-command latency and the output backend (set output 0 = Zigbee, 1 = LEDC PWM on ledc_gpio_1/ledc_gpio_2)",
+        .hint = NULL,
+        .func = &cmd_fade_status,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&fade_status_cmd));
+
+    // "level" command
+    const esp_console_cmd_t level_cmd = {
+        .command = "level",
+        .help = "Set a lamp level now, pausing its fade for hold_s seconds (default: override_timeout), or hand it back early. Usage: level <lamp|0> <level|resume> [hold_s]",
+        .hint = NULL,
+        .func = &cmd_level,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&level_cmd));
+
+    // "pm" command
+    const esp_console_cmd_t pm_cmd = {
+        .command = "pm",
+        .help = "Set power mode (off, dfs = frequency scaling, sleep = DFS + automatic light sleep), show residency and estimated current, or measure wake-up latency. Usage: pm [off|dfs|sleep|stats|probe [samples] [period_ms]]",
+        .hint = NULL,
+        .func = &cmd_pm,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&pm_cmd));
+
+    // "top" command
+    const esp_console_cmd_t top_cmd = {
+        .command = "top",
+        .help = "Per-task CPU share over a sliding window. Usage: top [window_ms] [repeat]",
+        .hint = NULL,
+        .func = &cmd_top,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&top_cmd));
+
+    // "prof" command
+    const esp_console_cmd_t prof_cmd = {
+        .command = "prof",
+        .help = "Timer-interrupt PC sampler; dump prints PROF lines for tools/prof_symbolize.py. Usage: prof <start [period_us]|stop|dump|clear>",
+        .hint = NULL,
+        .func = &cmd_prof,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&prof_cmd));
+
+    // "sync" command
+    const esp_console_cmd_t sync_cmd = {
+        .command = "sync",
+        .help = "Keep several coordinators' fades in phase over ESP-NOW: one master, the rest slaves of the same domain. Without arguments shows offset, delay and frequency. Usage: sync [off|master|slave [domain]]",
+        .hint = NULL,
+        .func = &cmd_sync,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&sync_cmd));
+
+    // "loop" command
+    const esp_console_cmd_t loop_cmd = {
+        .command = "loop",
+        .help = "Hold the sensor reading at a target by scaling the fade brightness (PI loop; tune with set loop_kp/loop_ki/loop_period_ms, keep with save). Without arguments shows latency and command counts. Usage: loop [<target>|off]",
+        .hint = NULL,
+        .func = &cmd_loop,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&loop_cmd));
+
+    // "zbbench" command
+    const esp_console_cmd_t zbbench_cmd = {
+        .command = "zbbench",
+        .help = "Send a pattern of move_to_level frames (burst to one lamp, paced at rate_hz, or rr round-robin over all lamps at rate_hz, 0 = back to back) and print rate, confirm latency percentiles and failures. Stops the fades while running. Usage: zbbench <burst|paced|rr> [count] [rate_hz] [max_inflight] [lamp]",
+        .hint = NULL,
+        .func = &cmd_zbbench,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&zbbench_cmd));
+
+    // "segstats" command
+    const esp_console_cmd_t segstats_cmd = {
+        .command = "segstats",
+        .help = "Per-segment sensor statistics of the last fade cycle (sensor n-1 watches lamp n): mean, slope, overshoot and step visibility (p95/mean of the sample-to-sample change, 100% = even ramp). Usage: segstats [lamp]",
+        .hint = NULL,
+        .func = &cmd_segstats,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&segstats_cmd));
+
+    // "preset" command
+    const esp_console_cmd_t preset_cmd = {
+        .command = "preset",
+        .help = "Switch the running fade to a preset in one step (its table is computed when it is saved), list the bank, or save the current settings to a slot. Usage: preset [<n> | save <n> <name> | erase <n>]",
+        .hint = NULL,
+        .func = &cmd_preset,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&preset_cmd));
+
+    // "flicker" command
+    const esp_console_cmd_t flicker_cmd = {
+        .command = "flicker",
+        .help = "Flicker of the lamps from the raw sensor samples (Goertzel bank at mains ripple and PWM frequencies, percent flicker from the block min/max), per-level table of a lamp above min_pct (default 1), CPU cost; set flicker_limit to step the fades around bad levels. Usage: flicker [lamp] [min_pct] | reset | bench",
+        .hint = NULL,
+        .func = &cmd_flicker,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&flicker_cmd));
+
+    // "metrics" command
+    const esp_console_cmd_t metrics_cmd = {
+        .command = "metrics",
+        .help = "Per-minute history in the metrics partition (sensor means, lamp levels, frames sent and failed, confirm time): show use, close the open page now, or stream the pages of a minute range in binary (read with tools/metrics_dump.py). Usage: metrics [flush | dump [from_minute] [to_minute]]",
+        .hint = NULL,
+        .func = &cmd_metrics,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&metrics_cmd));
+
+    // "scenes" command
+    const esp_console_cmd_t scenes_cmd = {
+        .command = "scenes",
+        .help = "Scenes the lamps hold for dimming_strategy 4 (one groupcast Recall Scene per step, scene_points table entries) and the frames per cycle against stepped move_to_level fades",
+        .hint = NULL,
+        .func = &cmd_scenes,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&scenes_cmd));
+
+    // "topology" command
+    const esp_console_cmd_t topology_cmd = {
+        .command = "topology",
+        .help = "Mesh map from the neighbour and routing tables and Mgmt_Lqi, each lamp's path and time slot, and the level frame failure rate and confirm time with slotting off and on. Usage: topology [refresh | slotting <on|off>]",
+        .hint = NULL,
+        .func = &cmd_topology,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&topology_cmd));
+
+    // "ota_recv" command
+    const esp_console_cmd_t ota_recv_cmd = {
+        .command = "ota_recv",
+        .help = "Receive a firmware image over this UART into the spare OTA slot (driven by tools/serial_ota.py). Usage: ota_recv <size> [z] [baud]",
+        .hint = NULL,
+        .func = &cmd_ota_recv,
+    };
+    ESP_ERROR_CHECK(esp_console_cmd_register(&ota_recv_cmd));
 }
@@ -0,0 +1,206 @@
+#include "deferred_log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_cpu.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "DEFERRED_LOG";
+
+typedef struct {
+    esp_log_level_t level;
+    const char *tag;
+    const char *format;
+} deferred_log_entry_t;
+
+/* The dictionary. Tags and texts match the old inline ESP_LOGx calls, so the
+   web controller keeps parsing "LIGHT_CONTROL: Setting ..." and "LIGHT_SENSOR: Value: ..." */
+static const deferred_log_entry_t s_dictionary[DLOG_ID_COUNT] = {
+    [DLOG_FADE_SEGMENT] = {ESP_LOG_DEBUG, "FADE",
+        "Segment %" PRId32 "->%" PRId32 ": fraction %" PRId32 "->%" PRId32 " (x1000), level %" PRId32 "->%" PRId32},
+    [DLOG_FADE_SET_LEVEL] = {ESP_LOG_INFO, "LIGHT_CONTROL",
+        "Setting Lamp%" PRId32 " to %" PRId32 " within %" PRId32 "ms"},
+    [DLOG_FADE_WAIT] = {ESP_LOG_INFO, "LIGHT_CONTROL",
+        "Lamp%" PRId32 " waiting for %" PRId32 "ms"},
+    [DLOG_FADE_CYCLE_DONE] = {ESP_LOG_INFO, "FADE",
+        "Gamma fade complete (Lamp%" PRId32 ")"},
+    [DLOG_FADE_OVERRIDE] = {ESP_LOG_INFO, "LIGHT_CONTROL",
+        "Lamp%" PRId32 " overridden to %" PRId32 " for %" PRId32 "ms"},
+    [DLOG_FADE_RESUME] = {ESP_LOG_INFO, "LIGHT_CONTROL",
+        "Lamp%" PRId32 " back on the fade schedule"},
+    [DLOG_FADE_CYCLE_STATS] = {ESP_LOG_INFO, "FADE_STATS",
+        "Lamp%" PRId32 " cycle: %" PRId32 " segments, step visibility avg %" PRId32 "%% max %" PRId32
+        "%% at segment %" PRId32 ", overshoot max %" PRId32},
+    [DLOG_MOVE_TO_LEVEL] = {ESP_LOG_DEBUG, "ZIGBEE",
+        "To level %" PRId32 " with transition time %" PRId32 " for address %08" PRIx32 "%08" PRIx32},
+    [DLOG_SENSOR_VALUE] = {ESP_LOG_INFO, "LIGHT_SENSOR",
+        "Value: %" PRId32},
+    [DLOG_SENSOR_CHANNEL_VALUE] = {ESP_LOG_INFO, "LIGHT_SENSOR",
+        "Channel %" PRId32 " value: %" PRId32},
+    [DLOG_SENSOR_THRESHOLD] = {ESP_LOG_INFO, "LIGHT_SENSOR",
+        "Threshold crossed, bright=%" PRId32 ", value: %" PRId32},
+};
+
+typedef struct {
+    uint16_t id;
+    uint16_t argc;
+    int32_t args[DEFERRED_LOG_MAX_ARGS];
+} deferred_log_record_t;
+
+typedef struct {
+    deferred_log_record_t records[DEFERRED_LOG_RING_SIZE];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t dropped;
+} deferred_log_ring_t;
+
+static deferred_log_ring_t s_ring;
+static portMUX_TYPE s_ring_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_drain_task;
+
+static bool ring_push(deferred_log_ring_t *ring, deferred_log_id_t id, const int32_t *args, size_t argc)
+{
+    if (ring->head - ring->tail >= DEFERRED_LOG_RING_SIZE)
+    {
+        ring->dropped++;
+        return false;
+    }
+
+    deferred_log_record_t *rec = &ring->records[ring->head % DEFERRED_LOG_RING_SIZE];
+    if (argc > DEFERRED_LOG_MAX_ARGS)
+        argc = DEFERRED_LOG_MAX_ARGS;
+    rec->id = id;
+    rec->argc = argc;
+    memcpy(rec->args, args, argc * sizeof(int32_t));
+    ring->head++;
+    return true;
+}
+
+void deferred_log_write(deferred_log_id_t id, const int32_t *args, size_t argc)
+{
+    // Records the tag's level would drop must not take ring slots from the ones it prints
+    const deferred_log_entry_t *entry = &s_dictionary[id];
+    if (esp_log_level_get(entry->tag) < entry->level)
+        return;
+
+    portENTER_CRITICAL(&s_ring_lock);
+    bool pushed = ring_push(&s_ring, id, args, argc);
+    portEXIT_CRITICAL(&s_ring_lock);
+
+    if (pushed && s_drain_task != NULL)
+    {
+        xTaskNotifyGive(s_drain_task);
+    }
+}
+
+uint32_t deferred_log_dropped(void)
+{
+    return s_ring.dropped;
+}
+
+static void format_record(const deferred_log_record_t *rec, char *buf, size_t len)
+{
+    int32_t a[DEFERRED_LOG_MAX_ARGS] = {0};
+    memcpy(a, rec->args, rec->argc * sizeof(int32_t));
+    snprintf(buf, len, s_dictionary[rec->id].format, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+
+static void deferred_log_drain_task(void *pvParameters)
+{
+    char line[160];
+    uint32_t reported_drops = 0;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (1)
+        {
+            deferred_log_record_t rec;
+
+            portENTER_CRITICAL(&s_ring_lock);
+            bool empty = (s_ring.head == s_ring.tail);
+            if (!empty)
+            {
+                rec = s_ring.records[s_ring.tail % DEFERRED_LOG_RING_SIZE];
+                s_ring.tail++;
+            }
+            portEXIT_CRITICAL(&s_ring_lock);
+
+            if (empty)
+                break;
+
+            const deferred_log_entry_t *entry = &s_dictionary[rec.id];
+            if (esp_log_level_get(entry->tag) < entry->level)
+                continue;
+
+            format_record(&rec, line, sizeof(line));
+            ESP_LOG_LEVEL(entry->level, entry->tag, "%s", line);
+        }
+
+        if (s_ring.dropped != reported_drops)
+        {
+            ESP_LOGW(TAG, "%" PRIu32 " records dropped (ring full)", s_ring.dropped - reported_drops);
+            reported_drops = s_ring.dropped;
+        }
+    }
+}
+
+void deferred_log_init(void)
+{
+    if (s_drain_task == NULL)
+    {
+        xTaskCreate(deferred_log_drain_task, "deferred_log", 3072, NULL, 1, &s_drain_task);
+    }
+}
+
+void deferred_log_benchmark(int iterations)
+{
+    if (iterations <= 0)
+        iterations = 1000;
+
+    deferred_log_ring_t *ring = calloc(1, sizeof(deferred_log_ring_t));
+    if (ring == NULL)
+    {
+        ESP_LOGE(TAG, "Out of memory");
+        return;
+    }
+
+    char line[160];
+    volatile float fraction_start = 0.25f, fraction_end = 0.30f, seg_duration_s = 0.333f;
+    uint32_t formatted_cycles = 0, deferred_cycles = 0;
+
+    for (int i = 0; i < iterations; i++)
+    {
+        /* What one segment used to cost: the ESP_LOGD and ESP_LOGI bodies, formatting only. */
+        uint32_t t0 = esp_cpu_get_cycle_count();
+        snprintf(line, sizeof(line), "Segment %d->%d: fraction %.2f->%.2f, level %d->%d, seg_duration=%.2fs",
+                 i, i + 1, fraction_start, fraction_end, 10, 12, seg_duration_s);
+        snprintf(line, sizeof(line), "Setting Lamp%d to %d within %dms", 1, 12, (int)(seg_duration_s * 1000));
+        uint32_t t1 = esp_cpu_get_cycle_count();
+
+        /* What it costs now: two ring records, including the lock. */
+        if (ring->head - ring->tail >= DEFERRED_LOG_RING_SIZE - 2)
+            ring->tail = ring->head;
+        portENTER_CRITICAL(&s_ring_lock);
+        ring_push(ring, DLOG_FADE_SEGMENT,
+                  (const int32_t[]){i, i + 1, (int32_t)(fraction_start * 1000), (int32_t)(fraction_end * 1000), 10, 12}, 6);
+        portEXIT_CRITICAL(&s_ring_lock);
+        portENTER_CRITICAL(&s_ring_lock);
+        ring_push(ring, DLOG_FADE_SET_LEVEL, (const int32_t[]){1, 12, (int32_t)(seg_duration_s * 1000)}, 3);
+        portEXIT_CRITICAL(&s_ring_lock);
+        uint32_t t2 = esp_cpu_get_cycle_count();
+
+        formatted_cycles += t1 - t0;
+        deferred_cycles += t2 - t1;
+    }
+    free(ring);
+
+    printf("Per-segment logging cost over %d segments:\n", iterations);
+    printf("  formatted: %" PRIu32 " cycles\n", formatted_cycles / iterations);
+    printf("  deferred:  %" PRIu32 " cycles\n", deferred_cycles / iterations);
+    printf("  dropped records so far: %" PRIu32 "\n", s_ring.dropped);
+}
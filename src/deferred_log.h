@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Dictionary IDs for deferred log lines.
+ *
+ * Hot paths only record one of these IDs plus up to DEFERRED_LOG_MAX_ARGS
+ * raw integer arguments. The format strings live in a table in
+ * deferred_log.c and are expanded later by a low-priority drain task.
+ */
+typedef enum {
+    DLOG_FADE_SEGMENT,
+    DLOG_FADE_SET_LEVEL,
+    DLOG_FADE_WAIT,
+    DLOG_FADE_CYCLE_DONE,
+    DLOG_FADE_OVERRIDE,
+    DLOG_FADE_RESUME,
+    DLOG_FADE_CYCLE_STATS,
+    DLOG_MOVE_TO_LEVEL,
+    DLOG_SENSOR_VALUE,
+    DLOG_SENSOR_CHANNEL_VALUE,
+    DLOG_SENSOR_THRESHOLD,
+    DLOG_ID_COUNT
+} deferred_log_id_t;
+
+#define DEFERRED_LOG_MAX_ARGS 6
+#define DEFERRED_LOG_RING_SIZE 64
+
+/**
+ * @brief Record a log line without formatting it.
+ *
+ * Usage: DLOG(DLOG_FADE_SET_LEVEL, lamp_id, level, duration_ms);
+ * All arguments are stored as int32_t, so floats must be scaled by the caller.
+ */
+#define DLOG(id, ...) \
+    deferred_log_write((id), (const int32_t[]){__VA_ARGS__}, \
+                       sizeof((int32_t[]){__VA_ARGS__}) / sizeof(int32_t))
+
+/**
+ * @brief Start the drain task that formats and prints recorded lines.
+ */
+void deferred_log_init(void);
+
+/**
+ * @brief Push one record into the ring, unless its tag's log level drops it.
+ *        Safe to call from any task.
+ */
+void deferred_log_write(deferred_log_id_t id, const int32_t *args, size_t argc);
+
+/**
+ * @brief Number of records dropped because the ring was full.
+ */
+uint32_t deferred_log_dropped(void);
+
+/**
+ * @brief Compare per-segment cost of formatting vs. recording (prints a summary).
+ */
+void deferred_log_benchmark(int iterations);
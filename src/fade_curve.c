@@ -0,0 +1,218 @@
+#include "fade_curve.h"
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+double log_transform(double x, double B)
+{
+    // Safeguard: If B <= 0, the transform doesn't make sense as intended.
+    if (B <= 0.0)
+    {
+        // Return x unchanged or handle as an error
+        return x;
+    }
+
+    // Safeguard: If x < 0, clamp to 0; if x > 1, clamp to 1.
+    if (x < 0.0)
+        x = 0.0;
+    if (x > 1.0)
+        x = 1.0;
+
+    // Compute denominator
+    double denom = log(1.0 + B);
+    // Compute numerator
+    double numerator = log(1.0 + B * x);
+
+    // Because x is in [0,1], numerator <= denom. So out in [0,1].
+    return numerator / denom;
+}
+
+float fade_curve_shape(curve_type_t curve_type, float x)
+{
+    switch (curve_type)
+    {
+    case CURVE_TYPE_SINE:
+        return 0.5f * (1.0f - cosf(x * (float)M_PI));
+    case CURVE_TYPE_QUADRATIC:
+        return x * x;
+    case CURVE_TYPE_CUBIC:
+        return x * x * x;
+    case CURVE_TYPE_QUARTIC:
+        return x * x * x * x;
+    case CURVE_TYPE_LINEAR:
+    default:
+        return x;
+    }
+}
+
+float fade_curve_gamma(const fade_curve_params_t *params, float fraction)
+{
+    float corrected = fraction;
+
+    if (params->gamma_mode == GAMMA_MODE_EXPONENTIAL)
+    {
+        float scale = params->gamma_pow_scale;
+        float value = params->gamma_pow_value;
+        if (value <= 0)
+            value = 1;
+
+        corrected = scale * pow(fraction, 1 / value) - scale + 1; // 0..1
+    }
+    else if (params->gamma_mode == GAMMA_MODE_LOGARITHMIC)
+    {
+        corrected = log_transform(fraction, params->gamma_log_value);
+    }
+
+    if (corrected < 0.0f)
+        corrected = 0.0f;
+    if (corrected > 1.0f)
+        corrected = 1.0f;
+    return corrected;
+}
+
+/* Level of one table fraction: curve, then gamma, then the level range */
+static uint8_t fraction_level(const fade_curve_params_t *params, uint8_t min_level, uint8_t max_level, float fraction)
+{
+    // The curve and gamma work on the normalised fraction; the level range
+    // is applied once, below. (This used to pre-scale the fraction with
+    // uint8_t divisions, which broke narrowed level ranges.)
+    float corrected = fade_curve_gamma(params, fade_curve_shape(params->curve_type, fraction));
+
+    // Then map to 8-bit level [min_level..max_level]
+    float level_f = min_level + (max_level - min_level) * corrected;
+    if (level_f > max_level)
+        level_f = max_level; // clamp
+    if (level_f < min_level)
+        level_f = min_level;
+    return (uint8_t)roundf(level_f);
+}
+
+void fade_curve_build_table(const fade_curve_params_t *params, int segments, fade_segment_t *table)
+{
+    uint8_t min_level = params->level_min;
+    uint8_t max_level = params->level_max;
+    if (max_level < min_level)
+        max_level = min_level;
+
+    if (segments < 2)
+    {
+        if (segments == 1)
+        {
+            table[0].fraction_of_fade = 1.0f;
+            table[0].level = max_level;
+        }
+        return;
+    }
+
+    for (int i = 0; i < segments; i++)
+    {
+        // Calculate fraction based on linear index
+        float fraction = (float)i / (float)(segments - 1);
+
+        table[i].fraction_of_fade = fraction;
+        table[i].level = fraction_level(params, min_level, max_level, fraction);
+    }
+}
+
+bool fade_curve_check_table(const fade_curve_params_t *params, const fade_segment_t *table, int segments)
+{
+    if (segments < 2)
+        return segments == 1;
+
+    uint8_t min_level = params->level_min;
+    uint8_t max_level = params->level_max < min_level ? min_level : params->level_max;
+
+    if (table[0].level != fraction_level(params, min_level, max_level, 0.0f) ||
+        table[segments - 1].level != max_level)
+        return false;
+    if (table[0].fraction_of_fade != 0.0f || table[segments - 1].fraction_of_fade != 1.0f)
+        return false;
+
+    for (int i = 1; i < segments; i++)
+    {
+        if (table[i].level < table[i - 1].level || table[i].level < min_level || table[i].level > max_level)
+            return false;
+        if (table[i].fraction_of_fade <= table[i - 1].fraction_of_fade)
+            return false;
+    }
+    return true;
+}
+
+uint32_t fade_cycle_length_ms(const fade_cycle_t *cycle)
+{
+    return 2 * cycle->fade_ms + cycle->on_ms + cycle->off_ms;
+}
+
+static uint32_t segment_start_ms(const fade_segment_t *table, int i, uint32_t fade_ms)
+{
+    return (uint32_t)(table[i].fraction_of_fade * fade_ms + 0.5f);
+}
+
+void fade_curve_step_at(const fade_cycle_t *cycle, const fade_segment_t *table, int segments,
+                        uint32_t t_ms, fade_step_t *step)
+{
+    uint32_t length = fade_cycle_length_ms(cycle);
+    uint32_t down_start = cycle->fade_ms + cycle->on_ms;
+    uint32_t down_end = down_start + cycle->fade_ms;
+
+    if (length == 0 || segments < 2)
+    {
+        step->level = table[segments > 0 ? segments - 1 : 0].level;
+        step->transition_ms = 0;
+        step->end_ms = length;
+        step->segment = -1;
+        step->rising = true;
+        return;
+    }
+    t_ms %= length;
+
+    if (t_ms < cycle->fade_ms)
+    {
+        // Last segment whose start is at or before t: it runs towards the next entry
+        int lo = 0, hi = segments - 2;
+        while (lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+            if (segment_start_ms(table, mid, cycle->fade_ms) <= t_ms)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        uint32_t end = segment_start_ms(table, lo + 1, cycle->fade_ms);
+        step->segment = lo + 1;
+        step->rising = true;
+        step->transition_ms = end - t_ms;
+    }
+    else if (t_ms >= down_start && t_ms < down_end)
+    {
+        // Same table walked backwards; pos is the distance from level_min in fade time
+        uint32_t pos = down_end - t_ms;
+        int lo = 1, hi = segments - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (segment_start_ms(table, mid, cycle->fade_ms) >= pos)
+                hi = mid;
+            else
+                lo = mid + 1;
+        }
+        uint32_t end = segment_start_ms(table, lo - 1, cycle->fade_ms);
+        step->segment = lo - 1;
+        step->rising = false;
+        step->transition_ms = pos - end;
+    }
+    else
+    {
+        step->rising = t_ms < down_start;
+        step->segment = -1;
+        step->level = step->rising ? table[segments - 1].level : table[0].level;
+        step->transition_ms = 0;
+        step->end_ms = step->rising ? down_start : length;
+        return;
+    }
+
+    step->level = table[step->segment].level;
+    step->end_ms = t_ms + step->transition_ms;
+}
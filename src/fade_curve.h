@@ -0,0 +1,113 @@
+#pragma once
+
+/*
+ * Fade curve and gamma math. Plain C with no ESP-IDF dependencies, so the
+ * same file builds on the host (gcc/clang) as well as in the firmware.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MAX_SEGMENTS 255
+
+typedef struct {
+    float fraction_of_fade;   // e.g. 0.0, 0.25, 0.5, 0.75, 1.0
+    uint8_t level;           // the 8-bit Zigbee level for that fraction
+} fade_segment_t;
+
+typedef enum {
+    GAMMA_MODE_LINEAR,
+    GAMMA_MODE_EXPONENTIAL,
+    GAMMA_MODE_LOGARITHMIC
+} gamma_mode_t;
+
+typedef enum {
+    CURVE_TYPE_LINEAR,
+    CURVE_TYPE_SINE,
+    CURVE_TYPE_QUADRATIC,
+    CURVE_TYPE_CUBIC,
+    CURVE_TYPE_QUARTIC
+} curve_type_t;
+
+#define GAMMA_MODE_COUNT (GAMMA_MODE_LOGARITHMIC + 1)
+#define CURVE_TYPE_COUNT (CURVE_TYPE_QUARTIC + 1)
+
+/**
+ * @brief Everything the table builder needs, decoupled from light_config_t.
+ */
+typedef struct {
+    uint8_t level_min;
+    uint8_t level_max;
+    curve_type_t curve_type;
+    gamma_mode_t gamma_mode;
+    double gamma_pow_value;
+    double gamma_pow_scale;
+    double gamma_log_value;
+} fade_curve_params_t;
+
+/**
+ * @brief Map x in [0,1] through log(1 + B*x) / log(1 + B).
+ */
+double log_transform(double x, double B);
+
+/**
+ * @brief Apply the curve shape (time -> fraction), x in [0,1].
+ */
+float fade_curve_shape(curve_type_t curve_type, float x);
+
+/**
+ * @brief Apply gamma correction to a fraction, result clamped to [0,1].
+ */
+float fade_curve_gamma(const fade_curve_params_t *params, float fraction);
+
+/**
+ * @brief Build a table of `segments` points from level_min to level_max.
+ *
+ * The last entry is always level_max. Entry 0 is level_min, except with
+ * GAMMA_MODE_EXPONENTIAL and gamma_pow_scale below 1: that gamma maps 0 to
+ * 1 - scale, so the table starts that far up the range (scale 0.5 on
+ * 0..250 starts at 125).
+ */
+void fade_curve_build_table(const fade_curve_params_t *params, int segments, fade_segment_t *table);
+
+/**
+ * @brief Check the table invariants: endpoints as documented for
+ *        fade_curve_build_table(), range and monotonicity.
+ */
+bool fade_curve_check_table(const fade_curve_params_t *params, const fade_segment_t *table, int segments);
+
+/**
+ * @brief Timing of one fade cycle: fade up, hold on, fade down, hold off.
+ */
+typedef struct {
+    uint32_t fade_ms;
+    uint32_t on_ms;
+    uint32_t off_ms;
+} fade_cycle_t;
+
+/**
+ * @brief The command that is due at a given point of the cycle.
+ */
+typedef struct {
+    uint8_t level;            // level to move to
+    uint32_t transition_ms;   // time left until the lamp should be there
+    uint32_t end_ms;          // cycle time at which the next step starts
+    int segment;              // table index of `level`, -1 while holding
+    bool rising;
+} fade_step_t;
+
+/**
+ * @brief Total cycle length in ms.
+ */
+uint32_t fade_cycle_length_ms(const fade_cycle_t *cycle);
+
+/**
+ * @brief Find the step that covers cycle time `t_ms` (taken modulo the cycle length).
+ *
+ * Segment i of the table starts at fraction_of_fade[i] * fade_ms on the way
+ * up and mirrors that on the way down. Starting in the middle of a segment
+ * gives that segment's target with only the remaining transition time, so a
+ * schedule can be picked up at any phase.
+ */
+void fade_curve_step_at(const fade_cycle_t *cycle, const fade_segment_t *table, int segments,
+                        uint32_t t_ms, fade_step_t *step);
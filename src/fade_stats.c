@@ -0,0 +1,172 @@
+#include "fade_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+#include "deferred_log.h"
+#include "fade_curve.h"
+#include "segment_stats.h"
+
+typedef struct {
+    segment_stats_result_t result;
+    uint32_t cycle;     // cycle the result belongs to, 0 = never measured
+} fade_stats_entry_t;
+
+typedef struct {
+    bool measuring;
+    int segment;
+    bool rising;
+    segment_stats_t current;
+    uint32_t cycles;
+    segment_stats_cycle_t cycle;        // in progress
+    segment_stats_cycle_t last_cycle;   // last complete one
+    fade_stats_entry_t table[2][MAX_SEGMENTS];   // [rising][segment]
+} lamp_stats_t;
+
+static lamp_stats_t s_lamps[FADE_STATS_LAMPS];
+// A mutex, not a spinlock: the P² and slope updates are soft-float on the
+// C6 and would keep interrupts off for their whole run
+static SemaphoreHandle_t s_stats_lock;
+
+void fade_stats_init(void)
+{
+    if (s_stats_lock == NULL)
+        s_stats_lock = xSemaphoreCreateMutex();
+}
+
+static lamp_stats_t *stats_of(uint8_t lamp_id)
+{
+    return lamp_id >= 1 && lamp_id <= FADE_STATS_LAMPS ? &s_lamps[lamp_id - 1] : NULL;
+}
+
+/* Call with s_stats_lock held. */
+static void close_segment(lamp_stats_t *ls)
+{
+    if (!ls->measuring)
+        return;
+    ls->measuring = false;
+
+    fade_stats_entry_t *entry = &ls->table[ls->rising][ls->segment];
+    if (segment_stats_end(&ls->current, &entry->result))
+    {
+        entry->cycle = ls->cycle.cycle;
+        segment_stats_cycle_add(&ls->cycle, ls->segment, ls->rising, &entry->result);
+    }
+    else
+    {
+        segment_stats_cycle_skip(&ls->cycle);
+    }
+}
+
+void fade_stats_segment(uint8_t lamp_id, int segment, bool rising)
+{
+    lamp_stats_t *ls = stats_of(lamp_id);
+    if (ls == NULL)
+        return;
+
+    int64_t now_us = esp_timer_get_time();
+    xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+    close_segment(ls);
+    if (segment >= 0 && segment < MAX_SEGMENTS)
+    {
+        if (ls->cycle.cycle == 0)
+            segment_stats_cycle_reset(&ls->cycle, ++ls->cycles);
+        ls->measuring = true;
+        ls->segment = segment;
+        ls->rising = rising;
+        segment_stats_begin(&ls->current, rising, now_us);
+    }
+    xSemaphoreGive(s_stats_lock);
+}
+
+void fade_stats_cycle_done(uint8_t lamp_id)
+{
+    lamp_stats_t *ls = stats_of(lamp_id);
+    if (ls == NULL)
+        return;
+
+    xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+    close_segment(ls);
+    segment_stats_cycle_t done = ls->cycle;
+    bool complete = done.cycle != 0 && done.segments > 0;
+    if (complete)
+        ls->last_cycle = done;
+    segment_stats_cycle_reset(&ls->cycle, ++ls->cycles);
+    xSemaphoreGive(s_stats_lock);
+
+    if (complete)
+    {
+        DLOG(DLOG_FADE_CYCLE_STATS, lamp_id, done.segments, segment_stats_cycle_visibility_mean(&done),
+             done.visibility_max, done.worst_segment, done.overshoot_max);
+    }
+}
+
+void fade_stats_interrupt(uint8_t lamp_id)
+{
+    lamp_stats_t *ls = stats_of(lamp_id);
+    if (ls == NULL)
+        return;
+
+    xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+    ls->measuring = false;
+    segment_stats_cycle_reset(&ls->cycle, 0);   // the next segment opens a fresh cycle
+    xSemaphoreGive(s_stats_lock);
+}
+
+void fade_stats_reset(void)
+{
+    xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+    memset(s_lamps, 0, sizeof(s_lamps));
+    xSemaphoreGive(s_stats_lock);
+}
+
+void fade_stats_sample(int sensor_index, uint16_t value)
+{
+    lamp_stats_t *ls = stats_of(sensor_index + 1);
+    if (ls == NULL)
+        return;
+
+    int64_t now_us = esp_timer_get_time();
+    xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+    if (ls->measuring)
+        segment_stats_add(&ls->current, value, now_us);
+    xSemaphoreGive(s_stats_lock);
+}
+
+void fade_stats_print(uint8_t lamp_id)
+{
+    lamp_stats_t *ls = stats_of(lamp_id);
+    if (ls == NULL)
+        return;
+
+    xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+    segment_stats_cycle_t last = ls->last_cycle;
+    xSemaphoreGive(s_stats_lock);
+
+    if (last.cycle == 0)
+    {
+        printf("Lamp%d: no complete cycle measured (sensor %d)\n", lamp_id, lamp_id - 1);
+        return;
+    }
+    printf("Lamp%d cycle %" PRIu32 ": %u segments (%u too short), visibility avg %u%% max %u%%, overshoot max %u\n",
+           lamp_id, last.cycle, last.segments, last.skipped, segment_stats_cycle_visibility_mean(&last),
+           last.visibility_max, last.overshoot_max);
+    // Rows the running cycle has measured again show the newer value, marked '*'
+    printf("dir  seg samples  mean  slope/s  overshoot  visibility%%\n");
+    for (int rising = 1; rising >= 0; rising--)
+    {
+        for (int seg = 0; seg < MAX_SEGMENTS; seg++)
+        {
+            xSemaphoreTake(s_stats_lock, portMAX_DELAY);
+            fade_stats_entry_t entry = ls->table[rising][seg];
+            xSemaphoreGive(s_stats_lock);
+            if (entry.cycle < last.cycle)
+                continue;
+            printf("%-4s %3d %7u %5u %8d %10u %11u%s\n", rising ? "up" : "down", seg, entry.result.samples,
+                   entry.result.mean, entry.result.slope, entry.result.overshoot, entry.result.visibility,
+                   entry.cycle > last.cycle ? " *" : "");
+        }
+    }
+}
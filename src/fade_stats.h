@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Labels sensor averages with the fade segment of the lamp they watch
+ * (sensor n-1 watches lamp n) and keeps segment_stats per segment. Each
+ * completed cycle is logged as one summary line; the per-segment table of
+ * the last cycle is kept for `segstats`.
+ */
+#define FADE_STATS_LAMPS 2
+
+/**
+ * @brief Create the lock; call once before the sensor and fade tasks start.
+ */
+void fade_stats_init(void);
+
+/**
+ * @brief A fade segment started (segment >= 0) or the lamp entered a hold (segment < 0).
+ */
+void fade_stats_segment(uint8_t lamp_id, int segment, bool rising);
+
+/**
+ * @brief The lamp finished a full cycle: log the summary and start the next one.
+ */
+void fade_stats_cycle_done(uint8_t lamp_id);
+
+/**
+ * @brief Something other than the schedule moved the lamp; drop the cycle in progress.
+ */
+void fade_stats_interrupt(uint8_t lamp_id);
+
+/**
+ * @brief Forget everything, e.g. after the fade table changed.
+ */
+void fade_stats_reset(void);
+
+/**
+ * @brief Feed one published sensor average.
+ */
+void fade_stats_sample(int sensor_index, uint16_t value);
+
+/**
+ * @brief Print the last complete cycle of a lamp, one line per segment.
+ */
+void fade_stats_print(uint8_t lamp_id);
@@ -0,0 +1,114 @@
+#include "flicker.h"
+#include <math.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* Rectified 50/60 Hz mains and its harmonics, then PWM frequencies common in cheap drivers */
+static const uint16_t s_bank_hz[FLICKER_BINS] = {
+    100, 120, 200, 240, 300, 360, 500, 600, 800, 1000, 1250, 1600, 2000, 2500, 3200, 4000,
+};
+
+#define FLICKER_SMOOTHING 4     /* per-level EMA weight is 1/4 */
+
+void flicker_bank_init(flicker_bank_t *bank, uint32_t sample_hz, uint32_t block)
+{
+    memset(bank, 0, sizeof(*bank));
+    bank->sample_hz = sample_hz;
+    bank->block = block ? block : 1;
+
+    // k is rounded to a whole bin, which makes every bin blind to the block's DC
+    for (int i = 0; i < FLICKER_BINS; i++)
+    {
+        uint32_t k = (uint32_t)((double)s_bank_hz[i] * bank->block / sample_hz + 0.5);
+        if (k == 0 || 2 * k >= bank->block)
+            continue;
+        int n = bank->bins++;
+        bank->coeff[n] = (int32_t)lround(2 * cos(2 * M_PI * k / bank->block) * (1 << FLICKER_COEFF_SHIFT));
+        bank->bin_hz[n] = (uint16_t)((double)k * sample_hz / bank->block + 0.5);
+    }
+}
+
+void flicker_bank_finish(flicker_bank_t *bank, flicker_result_t *out)
+{
+    double mean = (double)bank->sum / bank->count;
+
+    // |X|^2 = s1^2 + s2^2 - coeff s1 s2; a sine of amplitude A gives |X| = A N / 2
+    double best = 0;
+    int best_bin = -1;
+    for (int i = 0; i < bank->bins; i++)
+    {
+        double s1 = bank->s1[i], s2 = bank->s2[i];
+        double coeff = (double)bank->coeff[i] / (1 << FLICKER_COEFF_SHIFT);
+        double power = s1 * s1 + s2 * s2 - coeff * s1 * s2;
+        if (power > best)
+        {
+            best = power;
+            best_bin = i;
+        }
+    }
+
+    // Peak to peak less the ramp of a lamp still fading (the change of the
+    // mean since the previous block) and less the spread the ADC noise adds
+    // to the extremes of n samples
+    double n = bank->count;
+    double trend_span = bank->dc_valid ? fabs(mean - bank->dc) * (n - 1) / n : 0;
+    double noise_span = n > 1 ? 2 * FLICKER_NOISE_RMS * sqrt(2 * log(n)) : 0;
+    double swing = (double)(bank->max - bank->min) - trend_span - noise_span;
+    double level_sum = (double)bank->max + bank->min;
+
+    out->mean = (uint16_t)(mean + 0.5);
+    out->flicker_pct = swing > 0 && level_sum > 0 ? (float)fmin(100, 100 * swing / level_sum) : 0;
+    out->peak_pct = bank->max + bank->min > 0 ? 100.0f * (bank->max - bank->min) / (bank->max + bank->min) : 0;
+    out->dominant_pct = mean > 0 ? (float)fmin(100, 100 * 2 * sqrt(best) / bank->count / mean) : 0;
+    // A bin that explains less than half of the flicker is not the source: off-bin PWM
+    out->dominant_hz = best_bin >= 0 && out->flicker_pct > 0 && out->dominant_pct * 2 >= out->flicker_pct ? bank->bin_hz[best_bin] : 0;
+
+    bank->dc = out->mean;
+    bank->dc_valid = true;
+    bank->count = 0;
+    bank->sum = 0;
+    memset(bank->s1, 0, sizeof(bank->s1));
+    memset(bank->s2, 0, sizeof(bank->s2));
+}
+
+void flicker_table_add(flicker_table_t *table, uint8_t level, const flicker_result_t *result)
+{
+    flicker_level_t *entry = &table->level[level];
+    float pct_x10 = result->flicker_pct * 10;
+    if (pct_x10 > UINT16_MAX)
+        pct_x10 = UINT16_MAX;
+
+    if (entry->blocks == 0)
+        entry->pct_x10 = (uint16_t)pct_x10;
+    else
+        entry->pct_x10 = (uint16_t)(entry->pct_x10 + (pct_x10 - entry->pct_x10) / FLICKER_SMOOTHING);
+    entry->hz = result->dominant_hz;
+    if (entry->blocks < UINT16_MAX)
+        entry->blocks++;
+}
+
+static bool level_ok(const flicker_table_t *table, int level, uint16_t limit_x10)
+{
+    const flicker_level_t *entry = &table->level[level];
+    return entry->blocks == 0 || entry->pct_x10 <= limit_x10;
+}
+
+uint8_t flicker_table_avoid(const flicker_table_t *table, uint8_t level, uint8_t lo, uint8_t hi,
+                            uint16_t limit_x10)
+{
+    if (level_ok(table, level, limit_x10))
+        return level;
+
+    for (int d = 1; d <= FLICKER_AVOID_RANGE; d++)
+    {
+        // Prefer brighter: cheap drivers flicker most at the bottom of the range
+        if (level + d <= hi && level_ok(table, level + d, limit_x10))
+            return level + d;
+        if (level - d >= lo && level_ok(table, level - d, limit_x10))
+            return level - d;
+    }
+    return level;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+/*
+ * Flicker analysis of the raw photodiode stream: a bank of fixed-point
+ * Goertzel filters at the usual mains-ripple and PWM frequencies, run over
+ * blocks of samples, plus a per-level table of the results. Plain C with
+ * no ESP-IDF dependencies, so it also builds on the host.
+ *
+ * Flicker is given as percent flicker, 100 * (max - min) / (max + min),
+ * taken from the extremes of the block so a PWM square wave reads the same
+ * as a sine of the same swing. The bins only see their own frequency, so
+ * they tell which frequency it is, not how much.
+ * Frequencies above half the sample rate show up as aliases (the ADC has
+ * no anti-alias filter), so a 25 kHz PWM is reported where it folds to.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define FLICKER_BINS 16
+#define FLICKER_COEFF_SHIFT 16      /* Goertzel coefficients are Q16 */
+#define FLICKER_NOISE_RMS   2.0f    /* ADC noise in counts; its expected spread is taken off the swing */
+
+typedef struct {
+    uint32_t sample_hz;
+    uint32_t block;                 // samples per analysis block
+    int bins;                       // bins below Nyquist
+    int32_t coeff[FLICKER_BINS];    // 2 cos(2 pi k / block), Q16
+    uint16_t bin_hz[FLICKER_BINS];  // centre of each bin after rounding k
+
+    /* Running block */
+    int32_t dc;                     // mean of the previous block, taken off every sample
+    bool dc_valid;                  // a block has completed, so dc is a measurement
+    uint32_t count;
+    uint32_t sum;
+    uint16_t min, max;
+    int32_t s1[FLICKER_BINS], s2[FLICKER_BINS];
+} flicker_bank_t;
+
+typedef struct {
+    uint16_t mean;
+    float flicker_pct;          // from min/max less the fade's ramp and the noise spread, all frequencies
+    float peak_pct;             // from min/max of the block, noise included
+    float dominant_pct;         // strongest bin alone
+    uint16_t dominant_hz;       // 0 if no bin explains the flicker
+} flicker_result_t;
+
+/**
+ * @brief Set up the bank for a sample rate and block length (one published average, say).
+ */
+void flicker_bank_init(flicker_bank_t *bank, uint32_t sample_hz, uint32_t block);
+
+/**
+ * @brief Analyse the completed block and start the next one (called by flicker_bank_push).
+ */
+void flicker_bank_finish(flicker_bank_t *bank, flicker_result_t *out);
+
+/**
+ * @brief Feed one sample.
+ *
+ * @return true when it completed a block and `out` holds the result
+ */
+static inline bool flicker_bank_push(flicker_bank_t *bank, uint16_t sample, flicker_result_t *out)
+{
+    if (bank->count == 0 || sample < bank->min)
+        bank->min = sample;
+    if (bank->count == 0 || sample > bank->max)
+        bank->max = sample;
+    bank->sum += sample;
+
+    // s = x + coeff * s1 - s2, with 64-bit products so a full-scale resonance cannot overflow
+    int32_t x = (int32_t)sample - bank->dc;
+    for (int i = 0; i < bank->bins; i++)
+    {
+        int32_t s = x + (int32_t)(((int64_t)bank->coeff[i] * bank->s1[i]) >> FLICKER_COEFF_SHIFT) - bank->s2[i];
+        bank->s2[i] = bank->s1[i];
+        bank->s1[i] = s;
+    }
+
+    if (++bank->count < bank->block)
+        return false;
+    flicker_bank_finish(bank, out);
+    return true;
+}
+
+/**
+ * @brief What is known about one lamp level.
+ */
+typedef struct {
+    uint16_t pct_x10;       // smoothed flicker_pct, 0.1 %
+    uint16_t hz;            // dominant frequency of the last block
+    uint16_t blocks;        // blocks measured (saturates)
+} flicker_level_t;
+
+typedef struct {
+    flicker_level_t level[256];
+} flicker_table_t;
+
+void flicker_table_add(flicker_table_t *table, uint8_t level, const flicker_result_t *result);
+
+/**
+ * @brief The level nearest to `level` within [lo, hi] that is not known to
+ *        flicker more than `limit_x10`; `level` itself if none is found
+ *        within FLICKER_AVOID_RANGE.
+ */
+#define FLICKER_AVOID_RANGE 12
+uint8_t flicker_table_avoid(const flicker_table_t *table, uint8_t level, uint8_t lo, uint8_t hi,
+                            uint16_t limit_x10);
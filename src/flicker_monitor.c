@@ -0,0 +1,149 @@
+#include "flicker_monitor.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "power.h"
+#include "app_config.h"
+#include "flicker.h"
+#include "light_control.h"
+
+#define BENCH_SAMPLE_HZ 20000
+#define BENCH_BLOCK     1000
+
+static flicker_bank_t s_banks[FLICKER_LAMPS];
+static uint8_t s_block_level[FLICKER_LAMPS];   // lamp level when the running block started
+static bool s_configured;
+
+static flicker_table_t s_tables[FLICKER_LAMPS];
+static flicker_result_t s_last[FLICKER_LAMPS];
+static uint32_t s_blocks[FLICKER_LAMPS], s_blocks_filed[FLICKER_LAMPS];
+static uint64_t s_cycles, s_samples;
+static portMUX_TYPE s_flicker_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void flicker_monitor_configure(uint32_t sample_hz, uint32_t block)
+{
+    s_configured = sample_hz > 0;
+    for (int i = 0; i < FLICKER_LAMPS; i++)
+        flicker_bank_init(&s_banks[i], sample_hz ? sample_hz : 1, block);
+}
+
+static void block_done(int slot, const flicker_result_t *result)
+{
+    uint8_t lamp_id = slot + 1;
+    uint8_t level = lights_last_level(lamp_id);
+    bool steady = level == s_block_level[slot] && lights_running();
+
+    portENTER_CRITICAL(&s_flicker_lock);
+    s_last[slot] = *result;
+    s_blocks[slot]++;
+    if (steady)
+    {
+        flicker_table_add(&s_tables[slot], level, result);
+        s_blocks_filed[slot]++;
+    }
+    portEXIT_CRITICAL(&s_flicker_lock);
+}
+
+void flicker_monitor_push(int slot, uint16_t sample)
+{
+    if (!s_configured || slot >= FLICKER_LAMPS)
+        return;
+
+    uint32_t start = esp_cpu_get_cycle_count();
+    flicker_bank_t *bank = &s_banks[slot];
+    if (bank->count == 0)
+        s_block_level[slot] = lights_last_level(slot + 1);
+
+    flicker_result_t result;
+    if (flicker_bank_push(bank, sample, &result))
+        block_done(slot, &result);
+
+    s_cycles += esp_cpu_get_cycle_count() - start;
+    s_samples++;
+}
+
+uint8_t flicker_monitor_avoid(uint8_t lamp_id, uint8_t level)
+{
+    if (g_light_config.flicker_limit <= 0 || lamp_id < 1 || lamp_id > FLICKER_LAMPS)
+        return level;
+
+    portENTER_CRITICAL(&s_flicker_lock);
+    uint8_t chosen = flicker_table_avoid(&s_tables[lamp_id - 1], level, g_light_config.level_min,
+                                         g_light_config.level_max, (uint16_t)(g_light_config.flicker_limit * 10));
+    portEXIT_CRITICAL(&s_flicker_lock);
+    return chosen;
+}
+
+void flicker_monitor_reset(void)
+{
+    portENTER_CRITICAL(&s_flicker_lock);
+    memset(s_tables, 0, sizeof(s_tables));
+    memset(s_blocks, 0, sizeof(s_blocks));
+    memset(s_blocks_filed, 0, sizeof(s_blocks_filed));
+    s_cycles = 0;
+    s_samples = 0;
+    portEXIT_CRITICAL(&s_flicker_lock);
+}
+
+static float cpu_pct_at(uint32_t cycles_per_sample, uint32_t sample_hz)
+{
+    return 100.0f * cycles_per_sample * sample_hz / (POWER_MAX_FREQ_MHZ * 1000000.0f);
+}
+
+void flicker_monitor_print(uint8_t lamp_id, float min_pct)
+{
+    for (int slot = 0; slot < FLICKER_LAMPS; slot++)
+    {
+        portENTER_CRITICAL(&s_flicker_lock);
+        flicker_result_t last = s_last[slot];
+        uint32_t blocks = s_blocks[slot], filed = s_blocks_filed[slot];
+        portEXIT_CRITICAL(&s_flicker_lock);
+        if (blocks == 0)
+            continue;
+        printf("Sensor %d (lamp%d): mean %u, flicker %.1f%% (peak %.1f%%), dominant %u Hz at %.1f%%, "
+               "%" PRIu32 " blocks, %" PRIu32 " filed by level\n",
+               slot, slot + 1, last.mean, last.flicker_pct, last.peak_pct, last.dominant_hz, last.dominant_pct,
+               blocks, filed);
+    }
+
+    uint32_t per_sample = s_samples ? (uint32_t)(s_cycles / s_samples) : 0;
+    printf("Cost: %" PRIu32 " cycles/sample over %d bins, %.2f%% CPU at %d kHz\n", per_sample,
+           s_banks[0].bins, cpu_pct_at(per_sample, BENCH_SAMPLE_HZ), BENCH_SAMPLE_HZ / 1000);
+
+    if (lamp_id < 1 || lamp_id > FLICKER_LAMPS)
+        return;
+    printf("Lamp%d levels flickering %.1f%% or more (limit %.1f%%):\n", lamp_id, min_pct, g_light_config.flicker_limit);
+    printf("level flicker%%     hz blocks\n");
+    for (int level = 0; level < 256; level++)
+    {
+        portENTER_CRITICAL(&s_flicker_lock);
+        flicker_level_t entry = s_tables[lamp_id - 1].level[level];
+        portEXIT_CRITICAL(&s_flicker_lock);
+        if (entry.blocks == 0 || entry.pct_x10 < min_pct * 10)
+            continue;
+        printf("%5d %7u.%u %6u %6u\n", level, entry.pct_x10 / 10, entry.pct_x10 % 10, entry.hz, entry.blocks);
+    }
+}
+
+void flicker_monitor_benchmark(void)
+{
+    static flicker_bank_t bank;
+    flicker_result_t result;
+    flicker_bank_init(&bank, BENCH_SAMPLE_HZ, BENCH_BLOCK);
+
+    // 1 kHz square-wave PWM at 30 % duty on a mid-scale reading
+    uint32_t start = esp_cpu_get_cycle_count();
+    for (int n = 0; n < BENCH_SAMPLE_HZ; n++)
+    {
+        uint16_t sample = (n % 20) < 6 ? 2600 : 1400;
+        flicker_bank_push(&bank, sample, &result);
+    }
+    uint32_t per_sample = (esp_cpu_get_cycle_count() - start) / BENCH_SAMPLE_HZ;
+
+    printf("Flicker bank: %d bins, block %d, %" PRIu32 " cycles/sample, %.2f%% CPU at %d kHz\n", bank.bins,
+           BENCH_BLOCK, per_sample, cpu_pct_at(per_sample, BENCH_SAMPLE_HZ), BENCH_SAMPLE_HZ / 1000);
+    printf("Last block: flicker %.1f%%, dominant %u Hz at %.1f%%\n", result.flicker_pct, result.dominant_hz,
+           result.dominant_pct);
+}
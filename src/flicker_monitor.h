@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Runs the flicker bank (flicker.c) over the raw samples of each sensor,
+ * one block per published average, and files every block under the level
+ * its lamp was at (sensor n-1 watches lamp n). Blocks during which the
+ * lamp was sent a new level are not filed.
+ */
+#define FLICKER_LAMPS 2
+
+/**
+ * @brief Sensor task: the per-channel sample rate or block length changed (0 Hz = stopped).
+ */
+void flicker_monitor_configure(uint32_t sample_hz, uint32_t block);
+
+/**
+ * @brief Sensor task: one raw sample of sensor `slot`.
+ */
+void flicker_monitor_push(int slot, uint16_t sample);
+
+/**
+ * @brief Fade planner: `level`, or the nearest level that does not flicker
+ *        more than g_light_config.flicker_limit (0 = off).
+ */
+uint8_t flicker_monitor_avoid(uint8_t lamp_id, uint8_t level);
+
+void flicker_monitor_reset(void);
+
+/**
+ * @brief Print the last block of every sensor, the CPU cost, and the levels of a lamp above `min_pct`.
+ */
+void flicker_monitor_print(uint8_t lamp_id, float min_pct);
+
+/**
+ * @brief Time the bank on one second of synthetic 20 kHz samples and print the CPU share.
+ */
+void flicker_monitor_benchmark(void);
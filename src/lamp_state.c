@@ -0,0 +1,431 @@
+#include "lamp_state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "LAMP_STATE";
+
+#define LAMP_ENDPOINT 1
+#define REPORTING_LEVEL  0x01
+#define REPORTING_ON_OFF 0x02
+#define REPORTING_ALL    (REPORTING_LEVEL | REPORTING_ON_OFF)
+
+static lamp_state_t s_lamps[MAX_LAMPS];
+static int s_lamp_count;
+static portMUX_TYPE s_lamps_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/* Call with s_lamps_lock held. */
+static lamp_state_t *find_by_address(const esp_zb_ieee_addr_t address)
+{
+    for (int i = 0; i < s_lamp_count; i++)
+    {
+        if (memcmp(s_lamps[i].address, address, sizeof(esp_zb_ieee_addr_t)) == 0)
+            return &s_lamps[i];
+    }
+    return NULL;
+}
+
+/* Call with s_lamps_lock held. */
+static lamp_state_t *find_by_short(uint16_t short_addr)
+{
+    for (int i = 0; i < s_lamp_count; i++)
+    {
+        if (s_lamps[i].short_addr == short_addr)
+            return &s_lamps[i];
+    }
+    return NULL;
+}
+
+void lamp_state_register(uint8_t id, const esp_zb_ieee_addr_t address)
+{
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    if (lamp == NULL && s_lamp_count < MAX_LAMPS)
+    {
+        lamp = &s_lamps[s_lamp_count++];
+        memset(lamp, 0, sizeof(*lamp));
+        memcpy(lamp->address, address, sizeof(esp_zb_ieee_addr_t));
+        lamp->short_addr = SHORT_ADDR_UNKNOWN;
+    }
+    if (lamp != NULL)
+        lamp->id = id;
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+bool lamp_state_get(const esp_zb_ieee_addr_t address, lamp_state_t *out)
+{
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    if (lamp != NULL)
+        *out = *lamp;
+    portEXIT_CRITICAL(&s_lamps_lock);
+    return lamp != NULL;
+}
+
+int lamp_state_list(lamp_state_t *out, int max)
+{
+    portENTER_CRITICAL(&s_lamps_lock);
+    int n = s_lamp_count < max ? s_lamp_count : max;
+    memcpy(out, s_lamps, n * sizeof(lamp_state_t));
+    portEXIT_CRITICAL(&s_lamps_lock);
+    return n;
+}
+
+void lamp_state_totals(uint32_t *sent, uint32_t *failed, uint32_t *confirms, uint64_t *confirm_total_us)
+{
+    *sent = *failed = *confirms = 0;
+    *confirm_total_us = 0;
+    portENTER_CRITICAL(&s_lamps_lock);
+    for (int i = 0; i < s_lamp_count; i++)
+    {
+        *sent += s_lamps[i].sent;
+        *failed += s_lamps[i].failed;
+        *confirms += s_lamps[i].confirms;
+        *confirm_total_us += s_lamps[i].confirm_total_us;
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+bool lamp_state_command_needed(const esp_zb_ieee_addr_t address, uint8_t level, bool with_on_off)
+{
+    bool needed = true;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    if (lamp != NULL && lamp->reporting_configured && (!with_on_off || (lamp->on_off_known && lamp->on)))
+    {
+        bool idle = !lamp->commanded_valid || now >= lamp->commanded_done_us;
+        bool at_level = lamp->level_known && lamp->level == level;
+        bool near_commanded = lamp->commanded_valid && lamp->commanded_level == level &&
+                              (!lamp->level_known || abs(lamp->level - level) <= LAMP_LEVEL_REPORT_CHANGE);
+
+        needed = !(idle && (at_level || near_commanded));
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+
+    return needed;
+}
+
+void lamp_state_note_command(const esp_zb_ieee_addr_t address, uint8_t level, uint16_t transition_time, bool with_on_off)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    if (lamp != NULL)
+    {
+        lamp->commanded_valid = true;
+        lamp->commanded_level = level;
+        lamp->commanded_done_us = now + (int64_t)transition_time * 100000;
+        if (with_on_off && level > 0)
+        {
+            lamp->on_off_known = true;
+            lamp->on = true;
+        }
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+void lamp_state_note_sent(const esp_zb_ieee_addr_t address, uint8_t tsn)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    if (lamp != NULL)
+    {
+        lamp->confirm_pending = true;
+        lamp->confirm_tsn = tsn;
+        lamp->confirm_sent_us = now;
+        lamp->sent++;
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+void lamp_state_on_send_status(uint8_t tsn, bool ok)
+{
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    for (int i = 0; i < s_lamp_count; i++)
+    {
+        lamp_state_t *lamp = &s_lamps[i];
+        if (!lamp->confirm_pending || lamp->confirm_tsn != tsn)
+            continue;
+        lamp->confirm_pending = false;
+        // A failed frame only tells how long the retries took
+        if (!ok)
+        {
+            lamp->failed++;
+            break;
+        }
+        uint32_t rtt_us = (uint32_t)(now - lamp->confirm_sent_us);
+        if (lamp->confirms == 0)
+            lamp->confirm_ema_us = rtt_us;
+        else
+            lamp->confirm_ema_us += ((int32_t)rtt_us - (int32_t)lamp->confirm_ema_us) / LAMP_CONFIRM_SMOOTHING;
+        lamp->confirms++;
+        lamp->confirm_total_us += rtt_us;
+        break;
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+uint32_t lamp_state_confirm_us(const esp_zb_ieee_addr_t address)
+{
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    uint32_t confirm_us = lamp != NULL ? lamp->confirm_ema_us : 0;
+    portEXIT_CRITICAL(&s_lamps_lock);
+    return confirm_us;
+}
+
+void lamp_state_invalidate_command(const esp_zb_ieee_addr_t address)
+{
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_address(address);
+    if (lamp != NULL)
+        lamp->commanded_valid = false;
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+void lamp_state_on_attribute(uint16_t short_addr, uint16_t cluster_id, uint16_t attr_id, const void *value)
+{
+    if (value == NULL)
+        return;
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_short(short_addr);
+    if (lamp != NULL)
+    {
+        if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL && attr_id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID)
+        {
+            lamp->level = *(const uint8_t *)value;
+            lamp->level_known = true;
+        }
+        else if (cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF && attr_id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID)
+        {
+            lamp->on = *(const bool *)value;
+            lamp->on_off_known = true;
+        }
+        lamp->last_report_us = esp_timer_get_time();
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+}
+
+static void bind_cb(esp_zb_zdp_status_t zdo_status, void *user_ctx)
+{
+    if (zdo_status != ESP_ZB_ZDP_STATUS_SUCCESS)
+    {
+        ESP_LOGW(TAG, "Bind for cluster 0x%04x failed: %d", (unsigned)(uintptr_t)user_ctx, zdo_status);
+    }
+}
+
+static void bind_cluster(const lamp_state_t *lamp, uint16_t cluster_id)
+{
+    esp_zb_zdo_bind_req_param_t bind_req = {0};
+    bind_req.req_dst_addr = lamp->short_addr;
+    memcpy(bind_req.src_address, lamp->address, sizeof(esp_zb_ieee_addr_t));
+    bind_req.src_endp = LAMP_ENDPOINT;
+    bind_req.cluster_id = cluster_id;
+    bind_req.dst_addr_mode = ESP_ZB_ZDO_BIND_DST_ADDR_MODE_64_BIT_EXTENDED;
+    esp_zb_get_long_address(bind_req.dst_address_u.addr_long);
+    bind_req.dst_endp = ESP_ZB_GATEWAY_ENDPOINT;
+    esp_zb_zdo_device_bind_req(&bind_req, bind_cb, (void *)(uintptr_t)cluster_id);
+}
+
+static void configure_reporting(const lamp_state_t *lamp)
+{
+    int16_t level_change = LAMP_LEVEL_REPORT_CHANGE;
+    int16_t on_off_change = 1;
+
+    esp_zb_zcl_config_report_record_t level_record = {
+        .direction = ESP_ZB_ZCL_REPORT_DIRECTION_SEND,
+        .attributeID = ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
+        .attrType = ESP_ZB_ZCL_ATTR_TYPE_U8,
+        .min_interval = LAMP_LEVEL_REPORT_MIN_S,
+        .max_interval = LAMP_LEVEL_REPORT_MAX_S,
+        .reportable_change = &level_change,
+    };
+    esp_zb_zcl_config_report_record_t on_off_record = {
+        .direction = ESP_ZB_ZCL_REPORT_DIRECTION_SEND,
+        .attributeID = ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
+        .attrType = ESP_ZB_ZCL_ATTR_TYPE_BOOL,
+        .min_interval = 0,
+        .max_interval = LAMP_ONOFF_REPORT_MAX_S,
+        .reportable_change = &on_off_change,
+    };
+
+    esp_zb_zcl_config_report_cmd_t report_cmd = {0};
+    report_cmd.zcl_basic_cmd.src_endpoint = ESP_ZB_GATEWAY_ENDPOINT;
+    report_cmd.zcl_basic_cmd.dst_endpoint = LAMP_ENDPOINT;
+    report_cmd.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+    memcpy(report_cmd.zcl_basic_cmd.dst_addr_u.addr_long, lamp->address, sizeof(esp_zb_ieee_addr_t));
+    report_cmd.record_number = 1;
+
+    report_cmd.clusterID = ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL;
+    report_cmd.record_field = &level_record;
+    esp_zb_zcl_config_report_cmd_req(&report_cmd);
+
+    report_cmd.clusterID = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF;
+    report_cmd.record_field = &on_off_record;
+    esp_zb_zcl_config_report_cmd_req(&report_cmd);
+}
+
+static void read_state(const lamp_state_t *lamp)
+{
+    uint16_t level_attr = ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID;
+    uint16_t on_off_attr = ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID;
+
+    esp_zb_zcl_read_attr_cmd_t read_req = {0};
+    read_req.zcl_basic_cmd.src_endpoint = ESP_ZB_GATEWAY_ENDPOINT;
+    read_req.zcl_basic_cmd.dst_endpoint = LAMP_ENDPOINT;
+    read_req.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+    memcpy(read_req.zcl_basic_cmd.dst_addr_u.addr_long, lamp->address, sizeof(esp_zb_ieee_addr_t));
+    read_req.attr_number = 1;
+
+    read_req.clusterID = ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL;
+    read_req.attr_field = &level_attr;
+    esp_zb_zcl_read_attr_cmd_req(&read_req);
+
+    read_req.clusterID = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF;
+    read_req.attr_field = &on_off_attr;
+    esp_zb_zcl_read_attr_cmd_req(&read_req);
+}
+
+static void configure_lamp(lamp_state_t *lamp);
+
+/* Try again while a lamp has not accepted reporting: it refused, or the request or its answer got lost */
+static void configure_retry_cb(uint8_t index)
+{
+    lamp_state_t *lamp = &s_lamps[index];
+    if (index >= s_lamp_count || lamp->reporting_configured)
+        return;
+    if (lamp->configure_attempts >= LAMP_CONFIGURE_MAX_ATTEMPTS)
+    {
+        ESP_LOGW(TAG, "Lamp%d did not accept reporting after %d attempts, every level is sent",
+                 lamp->id, lamp->configure_attempts);
+        return;
+    }
+    configure_lamp(lamp);
+}
+
+static void configure_lamp(lamp_state_t *lamp)
+{
+    uint8_t index = (uint8_t)(lamp - s_lamps);
+
+    lamp->configure_attempts++;
+    esp_zb_scheduler_alarm_cancel((esp_zb_callback_t)configure_retry_cb, index);
+    esp_zb_scheduler_alarm((esp_zb_callback_t)configure_retry_cb, index, LAMP_CONFIGURE_RETRY_MS);
+
+    if (lamp->short_addr == SHORT_ADDR_UNKNOWN)
+    {
+        uint16_t short_addr = esp_zb_address_short_by_ieee(lamp->address);
+        if (short_addr == 0xFFFF || short_addr == 0xFFFE)
+        {
+            ESP_LOGW(TAG, "Lamp%d is not in the address table yet", lamp->id);
+            return;
+        }
+        lamp->short_addr = short_addr;
+    }
+
+    // Until the responses say otherwise the lamp may not report, so the mirror is not trusted
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp->reporting_configured = false;
+    lamp->reporting_accepted = 0;
+    portEXIT_CRITICAL(&s_lamps_lock);
+
+    bind_cluster(lamp, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL);
+    bind_cluster(lamp, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF);
+    configure_reporting(lamp);
+    read_state(lamp);
+
+    ESP_LOGI(TAG, "Lamp%d (0x%04x) reporting requested", lamp->id, lamp->short_addr);
+}
+
+void lamp_state_on_report_config(uint16_t short_addr, uint16_t cluster_id, bool ok)
+{
+    uint8_t bit = cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL ? REPORTING_LEVEL
+                : cluster_id == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF      ? REPORTING_ON_OFF
+                                                                   : 0;
+    bool configured = false;
+    uint8_t id = 0;
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp_state_t *lamp = find_by_short(short_addr);
+    if (lamp != NULL && ok && !lamp->reporting_configured)
+    {
+        lamp->reporting_accepted |= bit;
+        lamp->reporting_configured = configured = lamp->reporting_accepted == REPORTING_ALL;
+        id = lamp->id;
+    }
+    portEXIT_CRITICAL(&s_lamps_lock);
+
+    if (configured)
+        ESP_LOGI(TAG, "Lamp%d (0x%04x) reporting configured", id, short_addr);
+}
+
+void lamp_state_on_device_annce(uint16_t short_addr, const esp_zb_ieee_addr_t address)
+{
+    lamp_state_t *lamp = NULL;
+
+    portENTER_CRITICAL(&s_lamps_lock);
+    lamp = find_by_address(address);
+    if (lamp != NULL)
+        lamp->short_addr = short_addr;
+    portEXIT_CRITICAL(&s_lamps_lock);
+
+    if (lamp != NULL)
+    {
+        lamp->configure_attempts = 0;
+        configure_lamp(lamp);
+    }
+}
+
+void lamp_state_configure_all(void)
+{
+    for (int i = 0; i < s_lamp_count; i++)
+    {
+        configure_lamp(&s_lamps[i]);
+    }
+}
+
+void lamp_state_print(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    printf("id address          short  level  on   reporting  confirm_ms  last report\n");
+    for (int i = 0; i < s_lamp_count; i++)
+    {
+        lamp_state_t lamp;
+        portENTER_CRITICAL(&s_lamps_lock);
+        lamp = s_lamps[i];
+        portEXIT_CRITICAL(&s_lamps_lock);
+
+        char level[8], on[8], age[16], confirm[16];
+        if (lamp.level_known)
+            snprintf(level, sizeof(level), "%d", lamp.level);
+        else
+            snprintf(level, sizeof(level), "?");
+        snprintf(on, sizeof(on), "%s", lamp.on_off_known ? (lamp.on ? "on" : "off") : "?");
+        if (lamp.last_report_us)
+            snprintf(age, sizeof(age), "%" PRId64 "s ago", (now - lamp.last_report_us) / 1000000);
+        else
+            snprintf(age, sizeof(age), "never");
+        if (lamp.confirms)
+            snprintf(confirm, sizeof(confirm), "%.1f", lamp.confirm_ema_us / 1000.0f);
+        else
+            snprintf(confirm, sizeof(confirm), "?");
+
+        printf("%-2d %02x%02x%02x%02x%02x%02x%02x%02x 0x%04x %-6s %-4s %-10s %-11s %s\n",
+               lamp.id,
+               lamp.address[7], lamp.address[6], lamp.address[5], lamp.address[4],
+               lamp.address[3], lamp.address[2], lamp.address[1], lamp.address[0],
+               lamp.short_addr, level, on, lamp.reporting_configured ? "yes" : "no", confirm, age);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "zigbee_main.h"
+
+#define MAX_LAMPS MAX_CHILDREN
+#define SHORT_ADDR_UNKNOWN 0xFFFF
+
+/* Level reports: at most every 2 s, at least every 5 min, on a change of 5 steps */
+#define LAMP_LEVEL_REPORT_MIN_S 2
+#define LAMP_LEVEL_REPORT_MAX_S 300
+#define LAMP_LEVEL_REPORT_CHANGE 5
+#define LAMP_ONOFF_REPORT_MAX_S 300
+
+/* Configuring a lamp is repeated until both clusters accept the reporting setup */
+#define LAMP_CONFIGURE_RETRY_MS 30000
+#define LAMP_CONFIGURE_MAX_ATTEMPTS 5
+
+/* APS confirm round trip of move_to_level frames, smoothed with weight 1/8 */
+#define LAMP_CONFIRM_SMOOTHING 8
+
+/**
+ * @brief What the coordinator knows about one lamp.
+ *
+ * `level`/`on` come from attribute reports and read responses; `commanded_*`
+ * is what we last asked for and when that transition will be finished.
+ */
+typedef struct {
+    esp_zb_ieee_addr_t address;
+    uint8_t id;
+    uint16_t short_addr;
+    bool reporting_configured;  // both clusters accepted the configure-reporting request
+    uint8_t reporting_accepted; // clusters that did so far (bit per cluster)
+    uint8_t configure_attempts;
+    bool level_known;
+    uint8_t level;
+    bool on_off_known;
+    bool on;
+    int64_t last_report_us;
+    bool commanded_valid;
+    uint8_t commanded_level;
+    int64_t commanded_done_us;
+    bool confirm_pending;
+    uint8_t confirm_tsn;
+    int64_t confirm_sent_us;
+    uint32_t confirm_ema_us;    // 0 until the first confirm
+    uint32_t confirms;
+    uint32_t sent, failed;      // level frames and failed confirms since boot
+    uint64_t confirm_total_us;  // sum of all confirm round trips, for means over any period
+} lamp_state_t;
+
+/**
+ * @brief Add a lamp to the mirror (idempotent).
+ */
+void lamp_state_register(uint8_t id, const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief Copy the mirror entry of a lamp, returns false if unknown.
+ */
+bool lamp_state_get(const esp_zb_ieee_addr_t address, lamp_state_t *out);
+
+/**
+ * @brief Copy up to `max` mirror entries in registration order, returns how many.
+ */
+int lamp_state_list(lamp_state_t *out, int max);
+
+/**
+ * @brief Sum the level frame counters of all lamps, read in one go.
+ */
+void lamp_state_totals(uint32_t *sent, uint32_t *failed, uint32_t *confirms, uint64_t *confirm_total_us);
+
+/**
+ * @brief False if the lamp is already at `level` (and on, if `with_on_off`) and idle.
+ */
+bool lamp_state_command_needed(const esp_zb_ieee_addr_t address, uint8_t level, bool with_on_off);
+
+/**
+ * @brief Remember a move-to-level we sent (transition in 1/10 s).
+ */
+void lamp_state_note_command(const esp_zb_ieee_addr_t address, uint8_t level, uint16_t transition_time, bool with_on_off);
+
+/**
+ * @brief A level frame to the lamp went out with `tsn`; time its confirm.
+ *        Call under the Zigbee lock, so the confirm cannot come first.
+ */
+void lamp_state_note_sent(const esp_zb_ieee_addr_t address, uint8_t tsn);
+
+/**
+ * @brief Feed a send confirm; called from the Zigbee send status handler.
+ */
+void lamp_state_on_send_status(uint8_t tsn, bool ok);
+
+/**
+ * @brief Smoothed confirm round trip of the lamp in microseconds, 0 if none yet.
+ */
+uint32_t lamp_state_confirm_us(const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief Forget the commanded level, e.g. after a level move/stop.
+ */
+void lamp_state_invalidate_command(const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief Update from an attribute report or read response (Zigbee context).
+ */
+void lamp_state_on_attribute(uint16_t short_addr, uint16_t cluster_id, uint16_t attr_id, const void *value);
+
+/**
+ * @brief Feed a configure-reporting response (Zigbee context); the lamp counts
+ *        as configured once both clusters have accepted.
+ */
+void lamp_state_on_report_config(uint16_t short_addr, uint16_t cluster_id, bool ok);
+
+/**
+ * @brief A device announced itself; refresh its short address and reporting.
+ */
+void lamp_state_on_device_annce(uint16_t short_addr, const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief Bind, configure reporting and read current state of every lamp (Zigbee context).
+ */
+void lamp_state_configure_all(void);
+
+/**
+ * @brief Print the mirror to the console.
+ */
+void lamp_state_print(void);
@@ -4,204 +4,777 @@
 #include "esp_check.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "app_config.h"
 #include "zigbee_main.h"
 #include <math.h>
 #include "stdlib.h"
 #include "light_helper.h"
+#include "deferred_log.h"
+#include "lamp_state.h"
+#include "light_sensor.h"
+#include "fade_stats.h"
+#include "flicker_monitor.h"
+#include "light_output.h"
+#include "scene_plan.h"
+#include "power.h"
+#include "time_sync_espnow.h"
+#include "esp_cpu.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include <inttypes.h>
+#include <sys/time.h>
 
 static const char *TAG = "LIGHT_CONTROL";
 
 /* For demonstration, define two lights. */
 static light_fade_t lamp1_fade, lamp2_fade;
 
+#define FADE_RESUME_MAGIC 0x46414445 /* "FADE" */
+#define LIGHTS_STOP_TIMEOUT_MS 1000
+#define LIGHTS_SCHEDULE_ACK_WARN_MS 1000    /* a switch waiting this long for the tasks is logged */
+#define BRIGHTNESS_RESEND_TRANSITION_MS 500  /* soften scale corrections during holds */
+#define LIGHTS_MAX_LEAD_MS 2000
+#define LIGHTS_SCENE_GROUP 0x4C46           /* group both lamps join for scene recalls */
+#define LIGHTS_SCENE_RESPONSE_MS 1000       /* wait for each setup frame's ZCL response, one frame in flight */
 
+/**
+ * Kept in RTC memory, which is not cleared by a soft reset: the clock origin
+ * of the running schedule and the last level sent to each lamp.
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t config_hash;
+    int64_t clock_origin_us;
+    uint8_t level[2];
+} fade_resume_t;
 
-double log_transform(double x, double B)
+static light_fade_t *lamp_by_id(uint8_t lamp_id)
 {
-    // Safeguard: If B <= 0, the transform doesn't make sense as intended.
-    if (B <= 0.0)
+    switch (lamp_id)
     {
-        // Return x unchanged or handle as an error
-        return x;
+    case 1:
+        return &lamp1_fade;
+    case 2:
+        return &lamp2_fade;
+    default:
+        return NULL;
     }
+}
 
-    // Safeguard: If x < 0, clamp to 0; if x > 1, clamp to 1.
-    if (x < 0.0)
-        x = 0.0;
-    if (x > 1.0)
-        x = 1.0;
+/**
+ * The schedule both fade tasks follow. A switch fills the spare copy and
+ * swaps the pointer, so the tasks pick it up at their next wake-up without
+ * being restarted. Each task reports the epoch it read the pointer at;
+ * the spare is only refilled once every running task has moved past it,
+ * and s_schedule_lock keeps two switches from filling it at once.
+ */
+typedef struct {
+    fade_segment_t table[MAX_SEGMENTS];
+    int segments;
+    fade_cycle_t cycle;
+    int64_t cycle_ms;
+} fade_schedule_t;
 
-    // Compute denominator
-    double denom = log(1.0 + B);
-    // Compute numerator
-    double numerator = log(1.0 + B * x);
+static fade_schedule_t s_schedules[2];
+static fade_schedule_t *volatile s_schedule = &s_schedules[0];
+static volatile uint32_t s_schedule_epoch;   /* bumped when the schedule is switched */
+static SemaphoreHandle_t s_schedule_lock;
+static portMUX_TYPE s_schedule_lock_init = portMUX_INITIALIZER_UNLOCKED;
 
-    // Because x is in [0,1], numerator <= denom. So out in [0,1].
-    return numerator / denom;
-}
+static RTC_NOINIT_ATTR fade_resume_t s_resume;
+static bool s_resumed;
+static int64_t s_lights_start_us;
+static int64_t s_first_command_us;
+static volatile uint32_t s_clock_epoch;   /* bumped when the fade clock jumps */
+static volatile float s_brightness_scale = 1.0f;
 
+/* Scene-recall fade: one task recalls the plan's scenes for both lamps */
+typedef struct {
+    uint32_t groupcasts;    // recalls to the group
+    uint32_t unicasts;      // recalls to single lamps while the other is overridden or stepped
+    uint32_t catch_ups;     // move_to_level sent to join mid-slot
+    uint32_t stepped;       // move_to_level sent instead of a recall to lamps without the scenes
+    uint32_t setup;         // group and scene frames
+} scene_stats_t;
 
+static scene_plan_t s_scene_plan;
+static TaskHandle_t s_scene_task;
+static volatile bool s_scene_stop;
+static scene_stats_t s_scene_stats;
+static bool s_scene_ready[2];   // the lamp joined the group and stored every scene
 
+/* The setup response the scene task is waiting for */
+static esp_zb_ieee_addr_t s_scene_wait_address;
+static int s_scene_wait_id = -1;                // scene id, 0 for any setup response, -1 when not waiting
+static volatile int s_scene_wait_status = -1;   // ZCL status once it arrives
+static portMUX_TYPE s_scene_wait_lock = portMUX_INITIALIZER_UNLOCKED;
 
-static void build_gamma_fade_table(int segments, light_fade_t *light_fade, fade_segment_t *fade_table)
+static void light_config_to_curve_params(fade_curve_params_t *params)
 {
+    params->level_min = g_light_config.level_min;
+    params->level_max = g_light_config.level_max;
+    params->curve_type = g_light_config.curve_type;
+    params->gamma_mode = g_light_config.gamma_mode;
+    params->gamma_pow_value = g_light_config.gamma_pow_value;
+    params->gamma_pow_scale = g_light_config.gamma_pow_scale;
+    params->gamma_log_value = g_light_config.gamma_log_value;
+}
 
-    for (int i = 0; i < segments; i++)
-    {
-        // Calculate fraction based on linear index
-        float fraction = (float)i / (float)(segments - 1);
-        
-        if(g_light_config.curve_type == CURVE_TYPE_SINE){
-            // Use sinusoidal function to calculate fraction
-            fraction = 0.5f * (1.0f - cosf(fraction * (float)M_PI));
-        }
+static void build_gamma_fade_table(int segments, fade_segment_t *fade_table)
+{
+    fade_curve_params_t params;
+    light_config_to_curve_params(&params);
+    fade_curve_build_table(&params, segments, fade_table);
 
-        uint8_t abs_max_level = 255;
+    if (!fade_curve_check_table(&params, fade_table, segments))
+    {
+        ESP_LOGW(TAG, "Fade table is not monotonic within [%d..%d]", params.level_min, params.level_max);
+    }
+}
 
-        uint8_t min_level = g_light_config.level_min;
-        uint8_t max_level = g_light_config.level_max;
+/* Fade clock: time since the schedule origin. gettimeofday() runs on the RTC
+   timer, which keeps counting through soft resets, so together with the
+   origin kept in s_resume the phase survives a reboot. */
+int64_t lights_clock_now_us(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000000 + tv.tv_usec - s_resume.clock_origin_us;
+}
 
-        fraction *= abs_max_level / (max_level - min_level);
-        fraction += g_light_config.level_min / abs_max_level;
+static int64_t fade_clock_now_ms(void)
+{
+    // A slaved coordinator runs its fades on the master's clock once locked
+    int64_t synced_us;
+    if (time_sync_espnow_now_us(&synced_us))
+        return synced_us / 1000;
+    return lights_clock_now_us() / 1000;
+}
 
-        // Apply gamma correction
-        float corrected = fraction;
+static void light_config_to_cycle(fade_cycle_t *cycle)
+{
+    cycle->fade_ms = (uint32_t)(g_light_config.transition_time * 1000);
+    cycle->on_ms = (uint32_t)(g_light_config.on_time * g_light_config.transition_time * 1000);
+    cycle->off_ms = (uint32_t)(g_light_config.off_time * g_light_config.transition_time * 1000);
+}
 
-        if (g_light_config.gamma_mode == GAMMA_MODE_EXPONENTIAL)
+/* Serialises schedule switches; the first caller creates the mutex */
+static void schedule_lock(void)
+{
+    if (s_schedule_lock == NULL)
+    {
+        SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+        portENTER_CRITICAL(&s_schedule_lock_init);
+        if (s_schedule_lock == NULL)
         {
-            float scale = g_light_config.gamma_pow_scale;
-            float value = g_light_config.gamma_pow_value;
-            if (value == 0)
-                value = 1;
+            s_schedule_lock = mutex;
+            mutex = NULL;
+        }
+        portEXIT_CRITICAL(&s_schedule_lock_init);
+        if (mutex != NULL)
+            vSemaphoreDelete(mutex);
+    }
+    xSemaphoreTake(s_schedule_lock, portMAX_DELAY);
+}
+
+static void schedule_unlock(void)
+{
+    xSemaphoreGive(s_schedule_lock);
+}
 
-            corrected = scale * pow(fraction, 1 / value) - scale + 1; // 0..1
-            // corrected = pow(fraction, 1/value);
+/* The spare schedule, to be filled and then published (call with the schedule
+   lock held). Waits until no running task still reads it from before the last switch. */
+static fade_schedule_t *spare_schedule(void)
+{
+    uint32_t epoch = s_schedule_epoch;
+    int64_t start_us = esp_timer_get_time();
+    bool warned = false;
+    while (true)
+    {
+        bool current = true;
+        for (uint8_t id = 1; id <= 2; id++)
+        {
+            light_fade_t *light_fade = lamp_by_id(id);
+            TaskHandle_t task = light_fade->task_handle;
+            if (task != NULL && light_fade->schedule_epoch != epoch)
+            {
+                current = false;
+                xTaskNotifyGive(task);
+            }
         }
-        else if (g_light_config.gamma_mode == GAMMA_MODE_LOGARITHMIC)
+        if (current)
+            break;
+        if (!warned && esp_timer_get_time() - start_us > LIGHTS_SCHEDULE_ACK_WARN_MS * 1000LL)
         {
-            corrected = log_transform(fraction, g_light_config.gamma_log_value);
+            ESP_LOGW(TAG, "Schedule switch still waiting for the fade tasks");
+            warned = true;
         }
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return s_schedule == &s_schedules[0] ? &s_schedules[1] : &s_schedules[0];
+}
+
+static void publish_schedule(fade_schedule_t *schedule)
+{
+    light_config_to_cycle(&schedule->cycle);
+    schedule->cycle_ms = fade_cycle_length_ms(&schedule->cycle);
+    if (schedule->cycle_ms == 0)
+        schedule->cycle_ms = 1;
+    s_schedule = schedule;
+    s_schedule_epoch++;
+}
+
+/* Everything that shapes the schedule; a resume is only valid if this is unchanged */
+static uint32_t light_config_hash(void)
+{
+    uint32_t hash = 2166136261u;
+#define HASH_FIELD(f)                                              \
+    for (size_t i = 0; i < sizeof(g_light_config.f); i++)          \
+        hash = (hash ^ ((const uint8_t *)&g_light_config.f)[i]) * 16777619u;
+    HASH_FIELD(offset_1)
+    HASH_FIELD(offset_2)
+    HASH_FIELD(level_min)
+    HASH_FIELD(level_max)
+    HASH_FIELD(on_time)
+    HASH_FIELD(off_time)
+    HASH_FIELD(transition_time)
+    HASH_FIELD(gamma_mode)
+    HASH_FIELD(gamma_pow_value)
+    HASH_FIELD(gamma_pow_scale)
+    HASH_FIELD(gamma_log_value)
+    HASH_FIELD(curve_type)
+    HASH_FIELD(step_table_size)
+#undef HASH_FIELD
+    return hash;
+}
 
-        // Then map to 8-bit level [min_level..max_level]
-        float level_f = min_level + (max_level - min_level) * corrected;
-        if (level_f > max_level)
-            level_f = max_level; // clamp
-        if (level_f < min_level)
-            level_f = min_level;
+// Dimming never takes a lamp below level_min; only an explicit 0 turns it off
+static uint8_t scale_level(uint8_t level, float scale)
+{
+    if (level == 0)
+        return 0;
+    uint8_t scaled = (uint8_t)(level * scale + 0.5f);
+    return scaled < g_light_config.level_min ? g_light_config.level_min : scaled;
+}
 
-        fade_table[i].fraction_of_fade = (float)i / (float)(segments - 1);
-        fade_table[i].level = (uint8_t)roundf(level_f);
+static void send_fade_level(light_fade_t *light_fade, uint8_t level, uint32_t transition_ms)
+{
+    // Step around levels the sensor has seen flicker (off stays off)
+    if (level != 0)
+        level = flicker_monitor_avoid(light_fade->id, level);
+    light_output_set_level(light_fade->id, light_fade->address, level, transition_ms);
+    s_resume.level[light_fade->id - 1] = level;
+
+    if (s_first_command_us == 0)
+    {
+        s_first_command_us = esp_timer_get_time();
     }
 }
 
-static void do_piecewise_fade_blocking(light_fade_t *light_fade,
-                                       fade_segment_t *segments,
-                                       int segment_count,
-                                       float total_fade_s)
+/* Block until the fade clock reaches `deadline_ms`, rounding up so we never wake
+   early. lights_override() and lights_stop() notify the task to cut the wait short. */
+static void wait_until_ms(int64_t deadline_ms)
 {
-    for (int dir = 0; dir < 2; dir++) // Two directions: up and down
+    int64_t remaining_ms = deadline_ms - fade_clock_now_ms();
+    TickType_t ticks = remaining_ms > 0 ? (remaining_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS : 0;
+    ulTaskNotifyTake(pdTRUE, ticks > 0 ? ticks : 1);
+}
+
+/* Milliseconds left on a manual override, 0 once the fade owns the lamp again */
+static int64_t override_remaining_ms(const light_fade_t *light_fade)
+{
+    int64_t until_us = light_fade->override_until_us;
+    if (until_us == 0)
+        return 0;
+    int64_t remaining_us = until_us - esp_timer_get_time();
+    return remaining_us > 0 ? (remaining_us + 999) / 1000 : 0;
+}
+
+/* How early a lamp's commands go out, so its light changes on the fade clock
+   rather than when the frame leaves: configured, or measured if negative */
+static int64_t lamp_lead_ms(const light_fade_t *light_fade)
+{
+    double configured = light_fade->id == 1 ? g_light_config.latency_1 : g_light_config.latency_2;
+    int64_t lead_ms = configured >= 0 ? (int64_t)configured : light_output_measured_delay_ms(light_fade->address);
+    return lead_ms < LIGHTS_MAX_LEAD_MS ? lead_ms : LIGHTS_MAX_LEAD_MS;
+}
+
+static void light_fade_rtos_task(void *pvParameters)
+{
+
+    light_fade_t *light_fade = (light_fade_t *)pvParameters;
+
+    // Each step is computed from the clock, so the schedule does not drift and
+    // can start anywhere in the cycle (after a reboot, mid-segment)
+    bool first = true;
+    bool off_hold = false;
+    bool overridden = false;
+    uint32_t clock_epoch = s_clock_epoch;
+    uint32_t schedule_epoch = s_schedule_epoch;
+    // The lead is re-read once per cycle, not per pass: a lead that moved
+    // between passes would put the wake back inside the step just sent (a
+    // duplicate command) or past the next one (a skipped step)
+    int64_t lead_ms = 0;
+    int64_t planned_end_ms = 0;   // fade clock + lead at which the step sent last ends
+    uint32_t last_t_ms = 0;
+    while (!light_fade->stop)
     {
-        int start = (dir == 0) ? 0 : segment_count - 1;
-        int end = (dir == 0) ? segment_count - 1 : 0;
-        int step = (dir == 0) ? 1 : -1;
+        // Full speed while computing and queueing the command, low clock while waiting
+        power_busy_begin();
 
-        // Iterate through the segments based on direction
-        for (int i = start; (dir == 0 ? i < end : i > end); i += step)
+        if (clock_epoch != s_clock_epoch || schedule_epoch != s_schedule_epoch)
         {
-            float fraction_start = segments[i].fraction_of_fade;
-            float fraction_end = segments[i + step].fraction_of_fade;
+            // The clock jumped (time sync) or the schedule was switched (preset):
+            // treat it like a fresh start at the new phase
+            clock_epoch = s_clock_epoch;
+            schedule_epoch = s_schedule_epoch;
+            fade_stats_interrupt(light_fade->id);
+            first = true;
+            off_hold = false;
+        }
+        // Read the pointer after the epoch, so the epoch reported never runs ahead of it
+        const fade_schedule_t *schedule = s_schedule;
+        light_fade->schedule_epoch = schedule_epoch;
+        const fade_segment_t *fade_table = schedule->table;
+        int64_t cycle_ms = schedule->cycle_ms;
+        int64_t phase_ms = (int64_t)(light_fade->offset * cycle_ms);
 
-            // How long this piece of the fade should take
-            float seg_duration_s = fabsf(fraction_end - fraction_start) * total_fade_s;
-            // The final level for the next segment
-            uint8_t target_level = segments[i + step].level;
+        // Plan at the time the lamp will act on what we send now
+        if (first)
+            lead_ms = lamp_lead_ms(light_fade);
+        int64_t now_ms = fade_clock_now_ms() + lead_ms;
 
-            // Zigbee transition_time is in 1/10ths of a second
-            uint16_t transition_time_1_10s = (uint16_t)(seg_duration_s * 10.0f);
+        // A manual level owns the lamp until it expires; nothing from the schedule is sent meanwhile
+        int64_t override_ms = override_remaining_ms(light_fade);
+        if (override_ms > 0)
+        {
+            if (light_fade->override_pending)
+            {
+                light_fade->override_pending = false;
+                fade_stats_interrupt(light_fade->id);
+                send_fade_level(light_fade, light_fade->override_level, 0);
+            }
+            overridden = true;
+            power_busy_end();
+            wait_until_ms(now_ms - lead_ms + override_ms);
+            continue;
+        }
+        if (overridden)
+        {
+            // Pick the schedule up where the clock is now, as after a reboot
+            DLOG(DLOG_FADE_RESUME, light_fade->id);
+            light_fade->override_until_us = 0;
+            overridden = false;
+            first = true;
+            off_hold = false;
+        }
 
-            ESP_LOGD("FADE", "Segment %d->%d: fraction %.2f->%.2f, level %d->%d, seg_duration=%.2fs",
-                     i, i + step,
-                     fraction_start, fraction_end,
-                     segments[i].level, target_level,
-                     seg_duration_s);
+        // A notification can wake us before the step we planned ends; planning
+        // again then would repeat that step, so go back to waiting (a hold still
+        // follows a brightness correction at once)
+        if (!first && now_ms < planned_end_ms && !(light_fade->resend && light_fade->holding))
+        {
+            power_busy_end();
+            wait_until_ms(planned_end_ms - lead_ms + light_output_slot_ms(light_fade->address));
+            continue;
+        }
+
+        uint32_t t_ms = (uint32_t)(((now_ms + phase_ms) % cycle_ms + cycle_ms) % cycle_ms);
+
+        fade_step_t step;
+        fade_curve_step_at(&schedule->cycle, fade_table, schedule->segments, t_ms, &step);
+        uint8_t level = scale_level(step.level, s_brightness_scale);
+
+        if (step.segment >= 0)
+        {
+            int from = step.rising ? step.segment - 1 : step.segment + 1;
+            DLOG(DLOG_FADE_SEGMENT, from, step.segment,
+                 (int32_t)(fade_table[from].fraction_of_fade * 1000),
+                 (int32_t)(fade_table[step.segment].fraction_of_fade * 1000),
+                 fade_table[from].level, step.level);
+
+            DLOG(DLOG_FADE_SET_LEVEL, light_fade->id, level, (int32_t)step.transition_ms);
 
-            ESP_LOGI(TAG, "Setting Lamp%d to %d within %dms",
-                     light_fade->id, target_level, (int)(seg_duration_s * 1000));
+            // Capture the lamp response if the sensor is in segment mode
+            light_sensor_segment_boundary();
+            if (off_hold)
+                fade_stats_cycle_done(light_fade->id);
+            fade_stats_segment(light_fade->id, step.segment, step.rising);
 
-            // Send the command
-            move_to_level(target_level, transition_time_1_10s, light_fade->address);
+            light_fade->holding = false;
+            send_fade_level(light_fade, level, step.transition_ms);
 
-            // Block the task until this segment is done
-            vTaskDelay(pdMS_TO_TICKS((int)(seg_duration_s * 1000)));
+            if (off_hold)
+                DLOG(DLOG_FADE_CYCLE_DONE, light_fade->id);
+            off_hold = false;
+        }
+        else
+        {
+            // Holds need no command, except to catch up after starting inside one
+            // or to follow a brightness correction
+            light_fade->hold_level = step.level;
+            light_fade->holding = true;
+            fade_stats_segment(light_fade->id, -1, step.rising);
+            if (first || light_fade->resend)
+                send_fade_level(light_fade, level, first ? 0 : BRIGHTNESS_RESEND_TRANSITION_MS);
+            DLOG(DLOG_FADE_WAIT, light_fade->id, (int32_t)(step.end_ms - t_ms));
+            off_hold = !step.rising;
         }
+        planned_end_ms = now_ms + (step.end_ms - t_ms);
+        // A new cycle: take up a changed lead from here on, waking by the new
+        // one so the next step is planned at its boundary all the same
+        if (t_ms < last_t_ms)
+            lead_ms = lamp_lead_ms(light_fade);
+        last_t_ms = t_ms;
+        first = false;
+        light_fade->resend = false;
 
-        // Wait at the end of the segment traversal
-        float wait_time = (dir == 0) ? g_light_config.on_time : g_light_config.off_time;
-        wait_time = wait_time * g_light_config.transition_time;
-        ESP_LOGI(TAG, "Lamp%d waiting for %.2fs", light_fade->id, wait_time);
+        power_busy_end();
+        // Wake in our topology slot a little past the boundary; the step is then
+        // planned from there with a shorter transition, so the lamp keeps time
+        wait_until_ms(planned_end_ms - lead_ms + light_output_slot_ms(light_fade->address));
+    }
+
+    // Leave on our own so a lights_stop() never cuts a Zigbee command in half
+    light_fade->task_handle = NULL;
+    vTaskDelete(NULL);
+}
 
-        vTaskDelay(pdMS_TO_TICKS((int)(wait_time * 1000)));
+static bool scene_mode_configured(void)
+{
+    return g_light_config.dimming_strategy == DIMMING_STRATEGY_SCENE_RECALL && light_output_uses_radio();
+}
+
+/* The scene timeline for the current config, from a table of scene_points entries */
+static bool build_scene_plan(scene_plan_t *plan)
+{
+    fade_segment_t table[SCENE_PLAN_MAX_SLOTS];
+    int points = g_light_config.scene_points;
+    if (points < 2)
+        points = 2;
+    if (points > SCENE_PLAN_MAX_SLOTS)
+        points = SCENE_PLAN_MAX_SLOTS;
+    build_gamma_fade_table(points, table);
+
+    fade_cycle_t cycle;
+    light_config_to_cycle(&cycle);
+    uint32_t cycle_ms = fade_cycle_length_ms(&cycle);
+    uint32_t phase_ms[2] = {(uint32_t)(g_light_config.offset_1 * cycle_ms),
+                            (uint32_t)(g_light_config.offset_2 * cycle_ms)};
+    return scene_plan_build(plan, &cycle, table, points, phase_ms, 2);
+}
+
+/* Scenes carry whole seconds of transition; scene_plan_build() refuses moving slots under a second */
+static uint16_t scene_transition_s(const scene_slot_t *slot)
+{
+    return (uint16_t)((slot->length_ms + 500) / 1000);
+}
+
+/* Arm the wait before the frame goes out, so a quick response is not missed */
+static void scene_response_expect(const light_fade_t *light_fade, int scene_id)
+{
+    portENTER_CRITICAL(&s_scene_wait_lock);
+    memcpy(s_scene_wait_address, light_fade->address, sizeof(esp_zb_ieee_addr_t));
+    s_scene_wait_id = scene_id;
+    s_scene_wait_status = -1;
+    portEXIT_CRITICAL(&s_scene_wait_lock);
+}
+
+/* The ZCL status of the expected response, -1 if none came in LIGHTS_SCENE_RESPONSE_MS */
+static int scene_response_wait(void)
+{
+    int64_t deadline_us = esp_timer_get_time() + LIGHTS_SCENE_RESPONSE_MS * 1000;
+    int status = -1;
+    while (!s_scene_stop)
+    {
+        status = s_scene_wait_status;
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (status >= 0 || remaining_us <= 0)
+            break;
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(remaining_us / 1000) + 1);
     }
+    portENTER_CRITICAL(&s_scene_wait_lock);
+    s_scene_wait_id = -1;
+    portEXIT_CRITICAL(&s_scene_wait_lock);
+    return status;
 }
 
-static void light_fade_rtos_task(void *pvParameters)
+void lights_scene_response(const esp_zb_ieee_addr_t address, int scene_id, uint8_t status)
 {
+    portENTER_CRITICAL(&s_scene_wait_lock);
+    bool match = s_scene_wait_id >= 0 && memcmp(address, s_scene_wait_address, sizeof(esp_zb_ieee_addr_t)) == 0 &&
+                 (scene_id < 0 || s_scene_wait_id == 0 || scene_id == s_scene_wait_id);
+    if (match)
+        s_scene_wait_status = status;
+    portEXIT_CRITICAL(&s_scene_wait_lock);
+    TaskHandle_t task = s_scene_task;
+    if (match && task != NULL)
+        xTaskNotifyGive(task);
+}
 
-    light_fade_t *light_fade = (light_fade_t *)pvParameters;
+/**
+ * Store every slot as a scene on every lamp, replacing what the group held.
+ * Each frame waits for the lamp's response before the next goes out. A lamp
+ * that refuses the group or a scene (a full scene table, no Scenes server)
+ * or does not answer gets no further setup and is stepped with
+ * move_to_level, since it would silently ignore the recalls.
+ */
+static void program_scenes(const scene_plan_t *plan)
+{
+    for (uint8_t id = 1; id <= 2 && !s_scene_stop; id++)
+    {
+        light_fade_t *light_fade = lamp_by_id(id);
+        s_scene_ready[id - 1] = false;
 
-    // You can tweak gamma, # of segments, etc.
-    static fade_segment_t fade_table[MAX_SEGMENTS];
+        // Fails on a lamp not in the group yet, which is fine
+        scene_response_expect(light_fade, 0);
+        remove_all_scenes(LIGHTS_SCENE_GROUP, light_fade->address);
+        scene_response_wait();
 
-    int segments = g_light_config.step_table_size;
-    build_gamma_fade_table(segments, light_fade, fade_table);
+        scene_response_expect(light_fade, 0);
+        add_group(LIGHTS_SCENE_GROUP, light_fade->address);
+        int status = scene_response_wait();
+        s_scene_stats.setup += 2;
+        if (status != ESP_ZB_ZCL_STATUS_SUCCESS && status != ESP_ZB_ZCL_STATUS_DUPE_EXISTS)
+        {
+            if (!s_scene_stop)
+                ESP_LOGW(TAG, "Lamp%d did not join group 0x%04x (status %d, -1 = no response), stepping it instead",
+                         id, LIGHTS_SCENE_GROUP, status);
+            continue;
+        }
 
-    // Calculate the cycle time using transition_time, on_time and off_time
-    float total_transition_time_s = g_light_config.transition_time * 2;
-    // Calculate on_time and off_time as fractions of transition_time
-    float on_time_s = g_light_config.on_time * g_light_config.transition_time;
-    float off_time_s = g_light_config.off_time * g_light_config.transition_time;
+        int k;
+        for (k = 0; k < plan->slots && !s_scene_stop; k++)
+        {
+            scene_response_expect(light_fade, k + 1);
+            add_scene(LIGHTS_SCENE_GROUP, k + 1, plan->slot[k].level[id - 1], scene_transition_s(&plan->slot[k]),
+                      light_fade->address);
+            status = scene_response_wait();
+            s_scene_stats.setup++;
+            if (status != ESP_ZB_ZCL_STATUS_SUCCESS)
+                break;
+        }
+        if (k < plan->slots && !s_scene_stop)
+        {
+            ESP_LOGW(TAG, "Lamp%d did not store scene %d of %d (status %d, -1 = no response), stepping it instead",
+                     id, k + 1, plan->slots, status);
+            continue;
+        }
+        s_scene_ready[id - 1] = !s_scene_stop;
+    }
+}
 
-    // Calculate the cycle time using transition_time, on_time, and off_time
-    float cycle_time_s = total_transition_time_s + on_time_s + off_time_s;
-    vTaskDelay(light_fade->offset * cycle_time_s * 1000 / portTICK_PERIOD_MS);
+/**
+ * Scene-recall fade for both lamps. After programming the scenes it sends
+ * one groupcast Recall Scene per slot. A lamp that starts or rejoins
+ * mid-slot first gets a move_to_level for the rest of the slot. While one
+ * lamp is overridden, or stepped because it refused its scenes, the other
+ * gets its recalls unicast. The brightness scale cannot reach stored scenes
+ * and is not applied.
+ */
+static void scene_fade_rtos_task(void *pvParameters)
+{
+    const scene_plan_t *plan = &s_scene_plan;
+    program_scenes(plan);
 
-    while (1)
+    bool joined[2] = {false, false};
+    int last_slot = -1;
+    uint32_t clock_epoch = s_clock_epoch;
+    while (!s_scene_stop)
     {
-        do_piecewise_fade_blocking(light_fade, fade_table, segments, g_light_config.transition_time);
+        power_busy_begin();
+
+        if (clock_epoch != s_clock_epoch)
+        {
+            clock_epoch = s_clock_epoch;
+            joined[0] = joined[1] = false;
+        }
+
+        // One frame reaches both lamps, so it goes out early by the shorter lead
+        int64_t lead_ms = lamp_lead_ms(&lamp1_fade);
+        if (lamp_lead_ms(&lamp2_fade) < lead_ms)
+            lead_ms = lamp_lead_ms(&lamp2_fade);
+        int64_t now_ms = fade_clock_now_ms() + lead_ms;
+        uint32_t t_ms = (uint32_t)((now_ms % plan->cycle_ms + plan->cycle_ms) % plan->cycle_ms);
+        int k = scene_plan_slot_at(plan, t_ms);
+        const scene_slot_t *slot = &plan->slot[k];
+        uint32_t remaining_ms = (slot->start_ms + slot->length_ms - t_ms + plan->cycle_ms) % plan->cycle_ms;
+        if (remaining_ms == 0)
+            remaining_ms = slot->length_ms;
+
+        int64_t wait_ms = remaining_ms;
+        bool overridden[2];
+        for (uint8_t id = 1; id <= 2; id++)
+        {
+            light_fade_t *light_fade = lamp_by_id(id);
+            int64_t override_ms = override_remaining_ms(light_fade);
+            overridden[id - 1] = override_ms > 0;
+            if (override_ms > 0)
+            {
+                if (light_fade->override_pending)
+                {
+                    light_fade->override_pending = false;
+                    send_fade_level(light_fade, light_fade->override_level, 0);
+                }
+                joined[id - 1] = false;
+                if (override_ms < wait_ms)
+                    wait_ms = override_ms;
+            }
+            else if (light_fade->override_until_us != 0)
+            {
+                DLOG(DLOG_FADE_RESUME, id);
+                light_fade->override_until_us = 0;
+            }
+        }
+
+        // The group recall only suits lamps that are both on the plan already
+        bool new_slot = k != last_slot;
+        bool group = new_slot && joined[0] && joined[1] && !overridden[0] && !overridden[1] &&
+                     s_scene_ready[0] && s_scene_ready[1];
+        if (group)
+        {
+            recall_scene(LIGHTS_SCENE_GROUP, k + 1, NULL);
+            s_scene_stats.groupcasts++;
+        }
+        for (uint8_t id = 1; id <= 2; id++)
+        {
+            light_fade_t *light_fade = lamp_by_id(id);
+            if (overridden[id - 1])
+                continue;
+            if (!joined[id - 1] || (new_slot && !s_scene_ready[id - 1]))
+            {
+                // Straight to where the slot ends, in the time that is left of it
+                send_fade_level(light_fade, slot->level[id - 1], remaining_ms);
+                if (joined[id - 1])
+                    s_scene_stats.stepped++;
+                else
+                    s_scene_stats.catch_ups++;
+                joined[id - 1] = true;
+                continue;
+            }
+            if (!new_slot)
+                continue;
+            if (!group)
+            {
+                recall_scene(LIGHTS_SCENE_GROUP, k + 1, light_fade->address);
+                s_scene_stats.unicasts++;
+            }
+            // Keep the mirror right, so a later move_to_level is not skipped as redundant
+            lamp_state_note_command(light_fade->address, slot->level[id - 1], scene_transition_s(slot) * 10, true);
+            s_resume.level[id - 1] = slot->level[id - 1];
+        }
+        if (new_slot)
+            light_sensor_segment_boundary();
+        last_slot = k;
 
-        ESP_LOGI("FADE", "Gamma fade complete");
+        power_busy_end();
+        wait_until_ms(now_ms - lead_ms + wait_ms);
     }
+
+    s_scene_task = NULL;
+    vTaskDelete(NULL);
 }
 
-void lights_init(void)
+/* Start the scene-recall fade instead of the lamp tasks; false if the plan needs too many scenes */
+static bool scene_fade_start(void)
+{
+    if (!build_scene_plan(&s_scene_plan))
+    {
+        ESP_LOGW(TAG, "Cycle needs more than %d scenes or steps under %d ms, fading in steps instead",
+                 SCENE_PLAN_MAX_SLOTS, SCENE_PLAN_MIN_SLOT_MS);
+        return false;
+    }
+    memset(&s_scene_stats, 0, sizeof(s_scene_stats));
+    s_scene_ready[0] = s_scene_ready[1] = false;
+    s_scene_stop = false;
+    ESP_LOGI(TAG, "Scene fade: %d scenes per lamp in group 0x%04x", s_scene_plan.slots, LIGHTS_SCENE_GROUP);
+    xTaskCreate(scene_fade_rtos_task, "scene_fade_task", 4096, NULL, 4, &s_scene_task);
+    return true;
+}
+
+static void scene_fade_stop(void)
+{
+    if (s_scene_task == NULL)
+        return;
+
+    s_scene_stop = true;
+    xTaskNotifyGive(s_scene_task);
+    for (int i = 0; i < LIGHTS_STOP_TIMEOUT_MS / 10 && s_scene_task != NULL; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (s_scene_task != NULL)
+    {
+        ESP_LOGW(TAG, "Scene fade task did not stop, deleting it");
+        vTaskDelete(s_scene_task);
+        s_scene_task = NULL;
+    }
+}
+
+/* (Re)start both fade tasks on the published schedule */
+static void lights_start(void)
 {
     /* Stop any running tasks first, just to be safe. */
     lights_stop();
+    fade_stats_reset();
 
     /* You’d set each lamp’s address, offset, etc.
        For demonstration, we do a static address. */
 
-    // Lamp 1
-    memcpy(lamp1_fade.address,
-           (uint8_t[]){0x5d, 0x23, 0x38, 0xfe, 0xff, 0xf8, 0xe2, 0x44},
-           sizeof(esp_zb_ieee_addr_t));
+    // Lamp 1 (a running override is kept across a re-init)
+    memcpy(lamp1_fade.address, lamp1_long_address, sizeof(esp_zb_ieee_addr_t));
 
     lamp1_fade.offset = g_light_config.offset_1;
     lamp1_fade.id = 1;
+    lamp1_fade.stop = false;
 
     // Lamp 2
-    memcpy(&lamp2_fade, &lamp1_fade, sizeof(light_fade_t));
-    memcpy(lamp2_fade.address,
-           (uint8_t[]){0xd0, 0x46, 0x3a, 0xfe, 0xff, 0xf8, 0xe2, 0x44},
-           sizeof(esp_zb_ieee_addr_t));
+    memcpy(lamp2_fade.address, lamp2_long_address, sizeof(esp_zb_ieee_addr_t));
     lamp2_fade.offset = g_light_config.offset_2;
     lamp2_fade.id = 2;
+    lamp2_fade.stop = false;
 
-    // Move both to some safe level first
-    move_to_level_with_onoff(10, 0, lamp1_fade.address);
-    move_to_level_with_onoff(10, 0, lamp2_fade.address);
+    lamp_state_register(lamp1_fade.id, lamp1_fade.address);
+    lamp_state_register(lamp2_fade.id, lamp2_fade.address);
+    light_output_init();
+
+    // Keep the phase if the RTC copy survived (soft reset or re-init) and the schedule is unchanged
+    uint32_t hash = light_config_hash();
+    esp_reset_reason_t reason = esp_reset_reason();
+    s_resumed = s_resume.magic == FADE_RESUME_MAGIC && s_resume.config_hash == hash &&
+                reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT;
+    if (s_resumed && fade_clock_now_ms() < 0)
+        s_resumed = false;
+
+    if (!s_resumed)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        s_resume.magic = FADE_RESUME_MAGIC;
+        s_resume.config_hash = hash;
+        s_resume.clock_origin_us = (int64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+        memset(s_resume.level, 0, sizeof(s_resume.level));
+
+        // Move both to some safe level first (skipped if the mirror says they are already there)
+        light_output_set_level_on(lamp1_fade.id, lamp1_fade.address, 10);
+        light_output_set_level_on(lamp2_fade.id, lamp2_fade.address, 10);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Resuming fade at %" PRId64 " ms, lamp levels %d/%d",
+                 fade_clock_now_ms(), s_resume.level[0], s_resume.level[1]);
+    }
+
+    if (s_lights_start_us == 0)
+    {
+        s_lights_start_us = esp_timer_get_time();
+    }
+
+    if (scene_mode_configured() && scene_fade_start())
+        return;
 
     // Start tasks
     xTaskCreate(light_fade_rtos_task,
@@ -219,19 +792,287 @@ void lights_init(void)
                 &lamp2_fade.task_handle);
 }
 
-void lights_stop(void)
+void lights_init(void)
+{
+    lights_stop();
+
+    // You can tweak gamma, # of segments, etc.
+    schedule_lock();
+    fade_schedule_t *schedule = spare_schedule();
+    int segments = g_light_config.step_table_size;
+    if (segments < 2)
+        segments = 2;
+    if (segments > MAX_SEGMENTS)
+        segments = MAX_SEGMENTS;
+    build_gamma_fade_table(segments, schedule->table);
+    schedule->segments = segments;
+    publish_schedule(schedule);
+    schedule_unlock();
+
+    lights_start();
+}
+
+void lights_apply_table(const fade_segment_t *table, int segments)
+{
+    schedule_lock();
+    fade_schedule_t *schedule = spare_schedule();
+    memcpy(schedule->table, table, segments * sizeof(fade_segment_t));
+    schedule->segments = segments;
+
+    if (lamp1_fade.task_handle == NULL && lamp2_fade.task_handle == NULL)
+    {
+        publish_schedule(schedule);
+        schedule_unlock();
+        lights_start();
+        return;
+    }
+
+    // Running: switch in place, the tasks re-plan from the current clock
+    lamp1_fade.offset = g_light_config.offset_1;
+    lamp2_fade.offset = g_light_config.offset_2;
+    s_resume.config_hash = light_config_hash();
+    fade_stats_reset();
+    publish_schedule(schedule);
+    schedule_unlock();
+    for (uint8_t id = 1; id <= 2; id++)
+    {
+        TaskHandle_t task = lamp_by_id(id)->task_handle;
+        if (task != NULL)
+            xTaskNotifyGive(task);
+    }
+}
+
+int lights_set_brightness_scale(float scale, bool resend)
+{
+    if (scale < 0)
+        scale = 0;
+    if (scale > 1)
+        scale = 1;
+    s_brightness_scale = scale;
+    if (!resend)
+        return 0;
+
+    int commands = 0;
+    for (uint8_t id = 1; id <= 2; id++)
+    {
+        light_fade_t *light_fade = lamp_by_id(id);
+        TaskHandle_t task = light_fade->task_handle;
+        if (task == NULL || !light_fade->holding || override_remaining_ms(light_fade) > 0)
+            continue;
+        if (scale_level(light_fade->hold_level, scale) == s_resume.level[id - 1])
+            continue;
+
+        light_fade->resend = true;
+        xTaskNotifyGive(task);
+        commands++;
+    }
+    return commands;
+}
+
+float lights_get_brightness_scale(void)
+{
+    return s_brightness_scale;
+}
+
+bool lights_running(void)
+{
+    return s_lights_start_us != 0;
+}
+
+uint8_t lights_last_level(uint8_t lamp_id)
 {
-    // Stop lamp1
-    if (lamp1_fade.task_handle != NULL)
+    return lamp_by_id(lamp_id) != NULL ? s_resume.level[lamp_id - 1] : 0;
+}
+
+void lights_clock_changed(void)
+{
+    s_clock_epoch++;
+    for (uint8_t id = 1; id <= 2; id++)
+    {
+        TaskHandle_t task = lamp_by_id(id)->task_handle;
+        if (task != NULL)
+            xTaskNotifyGive(task);
+    }
+    if (s_scene_task != NULL)
+        xTaskNotifyGive(s_scene_task);
+}
+
+void lights_print_status(void)
+{
+    int64_t synced_us;
+    printf("Fade clock: %" PRId64 " ms, %s%s\n", fade_clock_now_ms(),
+           s_resumed ? "resumed after reset" : "started from phase 0",
+           time_sync_espnow_now_us(&synced_us) ? ", slaved to the sync master" : "");
+    printf("Last levels: lamp1 %d, lamp2 %d\n", s_resume.level[0], s_resume.level[1]);
+    printf("Commands sent early by: lamp1 %" PRId64 " ms%s, lamp2 %" PRId64 " ms%s\n",
+           lamp_lead_ms(&lamp1_fade), g_light_config.latency_1 < 0 ? " (measured)" : "",
+           lamp_lead_ms(&lamp2_fade), g_light_config.latency_2 < 0 ? " (measured)" : "");
+    for (uint8_t id = 1; id <= 2; id++)
+    {
+        int64_t override_ms = override_remaining_ms(lamp_by_id(id));
+        if (override_ms > 0)
+            printf("Lamp%d overridden to %d, fade resumes in %" PRId64 " ms\n", id,
+                   lamp_by_id(id)->override_level, override_ms);
+    }
+    if (s_scene_task != NULL)
+        printf("Scene fade: %d scenes, %" PRIu32 " group recalls\n", s_scene_plan.slots, s_scene_stats.groupcasts);
+    printf("Boot to fade start: %" PRId64 " ms, boot to first lamp command: %" PRId64 " ms\n",
+           s_lights_start_us / 1000, s_first_command_us / 1000);
+}
+
+void lights_print_scenes(void)
+{
+    static scene_plan_t plan;
+    bool running = s_scene_task != NULL;
+    if (running)
+    {
+        plan = s_scene_plan;
+    }
+    else if (!build_scene_plan(&plan))
     {
-        vTaskDelete(lamp1_fade.task_handle);
-        lamp1_fade.task_handle = NULL;
+        printf("Cycle needs more than %d scenes, or steps under %d ms, with scene_points %u\n",
+               SCENE_PLAN_MAX_SLOTS, SCENE_PLAN_MIN_SLOT_MS, g_light_config.scene_points);
+        return;
     }
 
-    // Stop lamp2
-    if (lamp2_fade.task_handle != NULL)
+    printf("Scene fade: %s, group 0x%04x, %d scenes per lamp\n",
+           running ? "running" : scene_mode_configured() ? "selected, not running" : "off",
+           LIGHTS_SCENE_GROUP, plan.slots);
+    printf("scene start_ms length_ms transition_s lamp1 lamp2\n");
+    for (int k = 0; k < plan.slots; k++)
     {
-        vTaskDelete(lamp2_fade.task_handle);
-        lamp2_fade.task_handle = NULL;
+        const scene_slot_t *slot = &plan.slot[k];
+        printf("%5d %8" PRIu32 " %9" PRIu32 " %12u %5u %5u\n", k + 1, slot->start_ms, slot->length_ms,
+               scene_transition_s(slot), slot->level[0], slot->level[1]);
+    }
+
+    // Frames on air per cycle: a unicast is answered by an APS ack, a groupcast is not
+    // (but every router relays it once)
+    schedule_lock();
+    const fade_schedule_t *schedule = s_schedule;
+    int stepped = 2 * scene_plan_stepped_commands(&schedule->cycle, schedule->table, schedule->segments);
+    schedule_unlock();
+    uint32_t cycles_per_hour = 3600000 / plan.cycle_ms;
+    printf("Per %" PRIu32 " ms cycle: stepped %d move_to_level + %d APS acks, scenes %d group recalls + relays\n",
+           plan.cycle_ms, stepped, stepped, plan.slots);
+    printf("Per hour: stepped %" PRIu32 " frames, scenes %" PRIu32 " frames, setup %d frames + acks once\n",
+           2 * stepped * cycles_per_hour, plan.slots * cycles_per_hour, 2 * (2 + plan.slots));
+    if (running)
+    {
+        printf("Scenes stored: lamp1 %s, lamp2 %s\n", s_scene_ready[0] ? "yes" : "no, stepped",
+               s_scene_ready[1] ? "yes" : "no, stepped");
+        printf("Sent: %" PRIu32 " group recalls, %" PRIu32 " unicast recalls, %" PRIu32 " catch-up levels, %" PRIu32
+               " stepped levels, %" PRIu32 " setup frames\n", s_scene_stats.groupcasts, s_scene_stats.unicasts,
+               s_scene_stats.catch_ups, s_scene_stats.stepped, s_scene_stats.setup);
+    }
+}
+
+void lights_override(uint8_t lamp_id, uint8_t level, uint32_t hold_s)
+{
+    if (hold_s == 0)
+        hold_s = g_light_config.override_timeout;
+
+    for (uint8_t id = 1; id <= 2; id++)
+    {
+        light_fade_t *light_fade = lamp_by_id(id);
+        if (lamp_id != 0 && lamp_id != id)
+            continue;
+
+        light_fade->override_level = level;
+        light_fade->override_pending = true;
+        light_fade->override_until_us = esp_timer_get_time() + (int64_t)hold_s * 1000000;
+        DLOG(DLOG_FADE_OVERRIDE, id, level, (int32_t)(hold_s * 1000));
+
+        // The fade task sends the level itself: this is safe from the Zigbee task, and it
+        // outranks the console, so a console override goes out before this returns
+        TaskHandle_t task = light_fade->task_handle;
+        if (task != NULL)
+            xTaskNotifyGive(task);
+    }
+    if (s_scene_task != NULL)
+        xTaskNotifyGive(s_scene_task);
+}
+
+void lights_override_cancel(uint8_t lamp_id)
+{
+    for (uint8_t id = 1; id <= 2; id++)
+    {
+        light_fade_t *light_fade = lamp_by_id(id);
+        if ((lamp_id != 0 && lamp_id != id) || light_fade->override_until_us == 0)
+            continue;
+
+        // Expire it rather than clear it, so the task still sees the hand-back
+        light_fade->override_pending = false;
+        light_fade->override_until_us = 1;
+        TaskHandle_t task = light_fade->task_handle;
+        if (task != NULL)
+            xTaskNotifyGive(task);
+    }
+    if (s_scene_task != NULL)
+        xTaskNotifyGive(s_scene_task);
+}
+
+static void stop_fade_task(light_fade_t *light_fade)
+{
+    TaskHandle_t task = light_fade->task_handle;
+    if (task == NULL)
+        return;
+
+    light_fade->stop = true;
+    xTaskNotifyGive(task);
+
+    // The task clears its handle on the way out; only force it if it is stuck
+    for (int i = 0; i < LIGHTS_STOP_TIMEOUT_MS / 10 && light_fade->task_handle != NULL; i++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (light_fade->task_handle != NULL)
+    {
+        ESP_LOGW(TAG, "Lamp%d fade task did not stop, deleting it", light_fade->id);
+        vTaskDelete(light_fade->task_handle);
+        light_fade->task_handle = NULL;
+    }
+}
+
+void lights_stop(void)
+{
+    stop_fade_task(&lamp1_fade);
+    stop_fade_task(&lamp2_fade);
+    scene_fade_stop();
+}
+
+void lights_curve_benchmark(int iterations)
+{
+    static const int sizes[] = {8, 16, 30, 64, 128, MAX_SEGMENTS};
+    static fade_segment_t table[MAX_SEGMENTS];
+
+    if (iterations <= 0)
+        iterations = 10;
+
+    fade_curve_params_t params;
+    light_config_to_curve_params(&params);
+
+    printf("gamma curve size cycles/table cycles/point ok\n");
+    for (int gamma = 0; gamma < GAMMA_MODE_COUNT; gamma++)
+    {
+        for (int curve = 0; curve < CURVE_TYPE_COUNT; curve++)
+        {
+            for (int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+            {
+                params.gamma_mode = (gamma_mode_t)gamma;
+                params.curve_type = (curve_type_t)curve;
+
+                uint32_t start = esp_cpu_get_cycle_count();
+                for (int i = 0; i < iterations; i++)
+                {
+                    fade_curve_build_table(&params, sizes[s], table);
+                }
+                uint32_t cycles = (esp_cpu_get_cycle_count() - start) / iterations;
+
+                printf("%d %d %d %" PRIu32 " %" PRIu32 " %s\n", gamma, curve, sizes[s],
+                       cycles, cycles / sizes[s],
+                       fade_curve_check_table(&params, table, sizes[s]) ? "yes" : "NO");
+            }
+        }
     }
 }
@@ -4,8 +4,7 @@
 #include "zigbee_main.h"
 #include <math.h>
 #include <stdint.h>
-
-#define MAX_SEGMENTS 255
+#include "fade_curve.h"
 
 /**
  * @brief Enum to define dimming modes.
@@ -19,28 +18,18 @@ typedef enum {
     DIMMING_STRATEGY_MOVE_TO_LEVEL_WITH_OFF_OFF,
     DIMMING_STRATEGY_MOVE_TO_LEVEL,
     DIMMING_STRATEGY_LEVEL_MOVE_WITH_ON_OFF,
-    DIMMING_STRATEGY_LEVEL_MOVE
+    DIMMING_STRATEGY_LEVEL_MOVE,
+    DIMMING_STRATEGY_SCENE_RECALL       // lamps hold the cycle as scenes, one groupcast recall per step
 } dimming_strategy_t;
 
-typedef struct {
-    float fraction_of_fade;   // e.g. 0.0, 0.25, 0.5, 0.75, 1.0
-    uint8_t level;           // the 8-bit Zigbee level for that fraction
-} fade_segment_t;
-
-
-typedef enum {
-    GAMMA_MODE_LINEAR,
-    GAMMA_MODE_EXPONENTIAL,
-    GAMMA_MODE_LOGARITHMIC
-} gamma_mode_t;
-
+/**
+ * @brief Where the fade levels go (see light_output.h).
+ */
 typedef enum {
-    CURVE_TYPE_LINEAR,
-    CURVE_TYPE_SINE,
-    CURVE_TYPE_QUADRATIC,
-    CURVE_TYPE_CUBIC,
-    CURVE_TYPE_QUARTIC
-} curve_type_t;
+    LIGHT_OUTPUT_ZIGBEE,    // move_to_level to the paired lamps
+    LIGHT_OUTPUT_LEDC,      // PWM on the local GPIOs, no radio traffic
+    LIGHT_OUTPUT_COUNT
+} light_output_t;
 
 /**
  * @brief Basic structure to hold fade parameters for a single light.
@@ -51,6 +40,14 @@ typedef struct {
     double offset;
     TaskHandle_t task_handle;
     fade_segment_t * fade_table;
+    volatile bool stop;                 /* set by lights_stop(), the task exits at its next wake-up */
+    volatile bool override_pending;     /* override_level still has to be sent */
+    volatile uint8_t override_level;
+    volatile int64_t override_until_us; /* esp_timer time the fade takes over again, 0 = no override */
+    volatile bool holding;              /* between segments, showing hold_level */
+    volatile uint8_t hold_level;        /* schedule level before the brightness scale */
+    volatile bool resend;               /* re-send the hold level at the new brightness scale */
+    volatile uint32_t schedule_epoch;   /* schedule switch the task last read the schedule at */
 } light_fade_t;
 
 /**
@@ -60,6 +57,87 @@ void lights_stop(void);
 
 void lights_init(void);
 
+/**
+ * @brief Run g_light_config with a table computed beforehand (a preset).
+ *
+ * Running fade tasks switch in place and continue at the current clock
+ * phase; nothing is rebuilt or restarted. Starts the fade if it is stopped.
+ */
+void lights_apply_table(const fade_segment_t *table, int segments);
+
+/**
+ * @brief Take a lamp off the fade schedule and set it to `level` right away.
+ *
+ * The fade task is woken immediately and sends the level; after `hold_s`
+ * seconds (0 = g_light_config.override_timeout) the fade continues at the
+ * phase the schedule has reached by then.
+ *
+ * @param lamp_id  1 or 2, or 0 for both lamps
+ */
+void lights_override(uint8_t lamp_id, uint8_t level, uint32_t hold_s);
+
+/**
+ * @brief End an override early and hand the lamp back to the fade (0 = both).
+ */
+void lights_override_cancel(uint8_t lamp_id);
+
+/**
+ * @brief Scale every fade level by `scale` (0..1) from the next command on.
+ *
+ * Levels inside a segment pick the scale up at the next boundary for free.
+ * With `resend`, lamps sitting in a hold whose scaled level changed are
+ * re-commanded right away (the fade tasks preempt the caller).
+ *
+ * @return number of lamp commands this caused
+ */
+int lights_set_brightness_scale(float scale, bool resend);
+
+float lights_get_brightness_scale(void);
+
+/**
+ * @brief The local fade clock: microseconds since the schedule origin.
+ *
+ * A time sync master hands this out; slaves run their fades on it.
+ */
+int64_t lights_clock_now_us(void);
+
+/**
+ * @brief True once lights_init() has set the clock origin.
+ */
+bool lights_running(void);
+
+/**
+ * @brief Last level sent to a lamp (by the schedule or an override), 0 before any.
+ */
+uint8_t lights_last_level(uint8_t lamp_id);
+
+/**
+ * @brief The fade clock jumped; wake the fade tasks to re-plan from the new phase.
+ */
+void lights_clock_changed(void);
+
+/**
+ * @brief Print fade clock, resume state and boot-to-first-command latency.
+ */
+void lights_print_status(void);
+
+/**
+ * @brief Print the scene plan of DIMMING_STRATEGY_SCENE_RECALL and its radio cost against stepped fades.
+ */
+void lights_print_scenes(void);
+
+/**
+ * @brief A lamp answered a Groups or Scenes command (Zigbee context): the
+ *        scene id it names (-1 for a default response) and the ZCL status.
+ *        The scene fade checks each setup frame against these.
+ */
+void lights_scene_response(const esp_zb_ieee_addr_t address, int scene_id, uint8_t status);
+
+/**
+ * @brief Time and validate every gamma mode x curve type x table size (prints a table).
+ */
+void lights_curve_benchmark(int iterations);
+
 
 /**
  * @brief Sends a move-to-level with on/off command (common usage).
@@ -1,8 +1,8 @@
 #include "light_helper.h"
+#include "deferred_log.h"
+#include "lamp_state.h"
 
 
-static const char *TAG = "ZIGBEE";
-
 /* Some simplified ZCL commands. You can unify them if you like. */
 void level_move(uint8_t mode, uint8_t rate, esp_zb_ieee_addr_t long_address)
 {
@@ -17,6 +17,7 @@ void level_move(uint8_t mode, uint8_t rate, esp_zb_ieee_addr_t long_address)
     esp_zb_lock_acquire(portMAX_DELAY);
     esp_zb_zcl_level_move_cmd_req(&cmd_move);
     esp_zb_lock_release();
+    lamp_state_invalidate_command(long_address);
 }
 
 /* Some simplified ZCL commands. You can unify them if you like. */
@@ -33,6 +34,7 @@ void level_move_with_onoff(uint8_t mode, uint8_t rate, esp_zb_ieee_addr_t long_a
     esp_zb_lock_acquire(portMAX_DELAY);
     esp_zb_zcl_level_move_with_onoff_cmd_req(&cmd_move);
     esp_zb_lock_release();
+    lamp_state_invalidate_command(long_address);
 }
 void level_stop(esp_zb_ieee_addr_t long_address)
 {
@@ -45,6 +47,7 @@ void level_stop(esp_zb_ieee_addr_t long_address)
     esp_zb_lock_acquire(portMAX_DELAY);
     esp_zb_zcl_level_stop_cmd_req(&cmd_stop);
     esp_zb_lock_release();
+    lamp_state_invalidate_command(long_address);
 }
 
 void move_to_level_with_onoff(uint8_t level, uint16_t transition_time, esp_zb_ieee_addr_t long_address)
@@ -58,8 +61,10 @@ void move_to_level_with_onoff(uint8_t level, uint16_t transition_time, esp_zb_ie
     cmd_move_to.transition_time = transition_time;
 
     esp_zb_lock_acquire(portMAX_DELAY);
-    esp_zb_zcl_level_move_to_level_with_onoff_cmd_req(&cmd_move_to);
+    uint8_t tsn = esp_zb_zcl_level_move_to_level_with_onoff_cmd_req(&cmd_move_to);
+    lamp_state_note_sent(long_address, tsn);
     esp_zb_lock_release();
+    lamp_state_note_command(long_address, level, transition_time, true);
 }
 
 void move_to_level(uint8_t level, uint16_t transition_time, esp_zb_ieee_addr_t long_address)
@@ -72,13 +77,14 @@ void move_to_level(uint8_t level, uint16_t transition_time, esp_zb_ieee_addr_t l
     cmd_move_to.level = level;
     cmd_move_to.transition_time = transition_time;
 
-    ESP_LOGD(TAG, "To level %d with transition time %dms for address %02x:%02x:%02x:%02x:%02x:%02x:%02x:%02x",
-             level, transition_time,
-             long_address[0], long_address[1], long_address[2], long_address[3],
-             long_address[4], long_address[5], long_address[6], long_address[7]);
+    DLOG(DLOG_MOVE_TO_LEVEL, level, transition_time,
+         (int32_t)((uint32_t)long_address[0] << 24 | long_address[1] << 16 | long_address[2] << 8 | long_address[3]),
+         (int32_t)((uint32_t)long_address[4] << 24 | long_address[5] << 16 | long_address[6] << 8 | long_address[7]));
     esp_zb_lock_acquire(portMAX_DELAY);
-    esp_zb_zcl_level_move_to_level_cmd_req(&cmd_move_to);
+    uint8_t tsn = esp_zb_zcl_level_move_to_level_cmd_req(&cmd_move_to);
+    lamp_state_note_sent(long_address, tsn);
     esp_zb_lock_release();
+    lamp_state_note_command(long_address, level, transition_time, false);
 }
 
 
@@ -88,3 +94,87 @@ void move_to_level_immediate(uint8_t level, esp_zb_ieee_addr_t addr)
     // For a “snap” update, set transition_time=0
     move_to_level_with_onoff(level, 0, addr);
 }
+
+void add_group(uint16_t group_id, esp_zb_ieee_addr_t long_address)
+{
+    esp_zb_zcl_groups_add_group_cmd_t cmd_add = {0};
+    cmd_add.zcl_basic_cmd.src_endpoint = 1;
+    cmd_add.zcl_basic_cmd.dst_endpoint = 1;
+    cmd_add.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+    memcpy(cmd_add.zcl_basic_cmd.dst_addr_u.addr_long, long_address, sizeof(esp_zb_ieee_addr_t));
+    cmd_add.group_id = group_id;
+
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_zcl_groups_add_group_cmd_req(&cmd_add);
+    esp_zb_lock_release();
+}
+
+void remove_all_scenes(uint16_t group_id, esp_zb_ieee_addr_t long_address)
+{
+    esp_zb_zcl_scenes_remove_all_cmd_t cmd_remove = {0};
+    cmd_remove.zcl_basic_cmd.src_endpoint = 1;
+    cmd_remove.zcl_basic_cmd.dst_endpoint = 1;
+    cmd_remove.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+    memcpy(cmd_remove.zcl_basic_cmd.dst_addr_u.addr_long, long_address, sizeof(esp_zb_ieee_addr_t));
+    cmd_remove.group_id = group_id;
+
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_zcl_scenes_remove_all_cmd_req(&cmd_remove);
+    esp_zb_lock_release();
+}
+
+/* A scene holding the lamp on at `level`; recalling it moves there over transition_s seconds */
+void add_scene(uint16_t group_id, uint8_t scene_id, uint8_t level, uint16_t transition_s,
+               esp_zb_ieee_addr_t long_address)
+{
+    uint8_t on = 1;
+    esp_zb_zcl_scenes_extension_field_t level_field = {
+        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+        .length = 1,
+        .extension_field_attribute_value_list = &level,
+    };
+    esp_zb_zcl_scenes_extension_field_t on_off_field = {
+        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
+        .length = 1,
+        .extension_field_attribute_value_list = &on,
+        .next = &level_field,
+    };
+
+    esp_zb_zcl_scenes_add_cmd_t cmd_add = {0};
+    cmd_add.zcl_basic_cmd.src_endpoint = 1;
+    cmd_add.zcl_basic_cmd.dst_endpoint = 1;
+    cmd_add.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+    memcpy(cmd_add.zcl_basic_cmd.dst_addr_u.addr_long, long_address, sizeof(esp_zb_ieee_addr_t));
+    cmd_add.group_id = group_id;
+    cmd_add.scene_id = scene_id;
+    cmd_add.transition_time = transition_s;
+    cmd_add.extension_field = &on_off_field;
+
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_zcl_scenes_add_cmd_req(&cmd_add);
+    esp_zb_lock_release();
+}
+
+/* Groupcast to every member of `group_id` when long_address is NULL, else to that lamp only */
+void recall_scene(uint16_t group_id, uint8_t scene_id, esp_zb_ieee_addr_t long_address)
+{
+    esp_zb_zcl_scenes_recall_cmd_t cmd_recall = {0};
+    cmd_recall.zcl_basic_cmd.src_endpoint = 1;
+    if (long_address == NULL)
+    {
+        cmd_recall.address_mode = ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT;
+        cmd_recall.zcl_basic_cmd.dst_addr_u.addr_short = group_id;
+    }
+    else
+    {
+        cmd_recall.zcl_basic_cmd.dst_endpoint = 1;
+        cmd_recall.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+        memcpy(cmd_recall.zcl_basic_cmd.dst_addr_u.addr_long, long_address, sizeof(esp_zb_ieee_addr_t));
+    }
+    cmd_recall.group_id = group_id;
+    cmd_recall.scene_id = scene_id;
+
+    esp_zb_lock_acquire(portMAX_DELAY);
+    esp_zb_zcl_scenes_recall_cmd_req(&cmd_recall);
+    esp_zb_lock_release();
+}
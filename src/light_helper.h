@@ -9,3 +9,8 @@ void level_stop(esp_zb_ieee_addr_t long_address);
 void move_to_level_with_onoff(uint8_t level, uint16_t transition_time, esp_zb_ieee_addr_t long_address);
 void move_to_level(uint8_t level, uint16_t transition_time, esp_zb_ieee_addr_t long_address);
 void move_to_level_immediate(uint8_t level, esp_zb_ieee_addr_t addr);
+void add_group(uint16_t group_id, esp_zb_ieee_addr_t long_address);
+void remove_all_scenes(uint16_t group_id, esp_zb_ieee_addr_t long_address);
+void add_scene(uint16_t group_id, uint8_t scene_id, uint8_t level, uint16_t transition_s,
+               esp_zb_ieee_addr_t long_address);
+void recall_scene(uint16_t group_id, uint8_t scene_id, esp_zb_ieee_addr_t long_address);
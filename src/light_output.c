@@ -0,0 +1,96 @@
+#include "light_output.h"
+#include <stdio.h>
+#include "esp_log.h"
+#include "app_config.h"
+#include "light_helper.h"
+#include "lamp_state.h"
+#include "light_output_ledc.h"
+#include "zigbee_topology.h"
+
+static const char *TAG = "LIGHT_OUTPUT";
+
+static const char *s_output_names[LIGHT_OUTPUT_COUNT] = {"zigbee", "ledc"};
+
+/* Backend currently brought up; g_light_config.output can be ahead of it until the next init */
+static light_output_t s_output = LIGHT_OUTPUT_ZIGBEE;
+
+void light_output_init(void)
+{
+    light_output_t output = g_light_config.output;
+    if (output >= LIGHT_OUTPUT_COUNT)
+    {
+        ESP_LOGW(TAG, "Unknown output %d, using zigbee", output);
+        output = LIGHT_OUTPUT_ZIGBEE;
+    }
+
+    if (output != LIGHT_OUTPUT_LEDC)
+        light_output_ledc_deinit();
+    if (output == LIGHT_OUTPUT_LEDC && light_output_ledc_init() != ESP_OK)
+        output = LIGHT_OUTPUT_ZIGBEE;
+
+    if (output != s_output)
+        ESP_LOGI(TAG, "Fades go to %s", s_output_names[output]);
+    s_output = output;
+}
+
+void light_output_set_level(uint8_t lamp_id, const esp_zb_ieee_addr_t address, uint8_t level,
+                            uint32_t transition_ms)
+{
+    switch (s_output)
+    {
+    case LIGHT_OUTPUT_LEDC:
+        light_output_ledc_set_level(lamp_id, level, transition_ms);
+        break;
+    default:
+        if (lamp_state_command_needed(address, level, false))
+        {
+            // Zigbee transition_time is in 1/10ths of a second
+            move_to_level(level, (uint16_t)(transition_ms / 100), (uint8_t *)address);
+        }
+        break;
+    }
+}
+
+void light_output_set_level_on(uint8_t lamp_id, const esp_zb_ieee_addr_t address, uint8_t level)
+{
+    switch (s_output)
+    {
+    case LIGHT_OUTPUT_LEDC:
+        light_output_ledc_set_level(lamp_id, level, 0);
+        break;
+    default:
+        if (lamp_state_command_needed(address, level, true))
+            move_to_level_with_onoff(level, 0, (uint8_t *)address);
+        break;
+    }
+}
+
+uint32_t light_output_measured_delay_ms(const esp_zb_ieee_addr_t address)
+{
+    if (s_output == LIGHT_OUTPUT_LEDC)
+        return 0;
+    // The confirm follows the APS ack, so the frame reached the lamp about halfway
+    return lamp_state_confirm_us(address) / 2000;
+}
+
+uint32_t light_output_slot_ms(const esp_zb_ieee_addr_t address)
+{
+    return s_output == LIGHT_OUTPUT_LEDC ? 0 : zigbee_topology_slot_ms(address);
+}
+
+bool light_output_uses_radio(void)
+{
+    return g_light_config.output != LIGHT_OUTPUT_LEDC;
+}
+
+const char *light_output_name(light_output_t output)
+{
+    return output < LIGHT_OUTPUT_COUNT ? s_output_names[output] : "?";
+}
+
+void light_output_print_status(void)
+{
+    printf("Output: %s\n", s_output_names[s_output]);
+    if (s_output == LIGHT_OUTPUT_LEDC)
+        light_output_ledc_print_status();
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "zigbee_main.h"
+#include "light_control.h"
+
+/*
+ * The fade engine's output: every level it plans goes through here to the
+ * backend selected by g_light_config.output (light_output_t). Zigbee sends
+ * move_to_level frames to the paired lamps (100 ms transition steps, the
+ * lamp mirror skips redundant frames); LEDC drives LEDs wired to the local
+ * GPIOs with hardware fades (light_output_ledc.h).
+ */
+
+/**
+ * @brief Bring up the backend in g_light_config.output and release the other one.
+ *        Called by lights_start(), so `set output` takes effect at once.
+ */
+void light_output_init(void);
+
+/**
+ * @brief Move a lamp to `level` over `transition_ms`.
+ */
+void light_output_set_level(uint8_t lamp_id, const esp_zb_ieee_addr_t address, uint8_t level,
+                            uint32_t transition_ms);
+
+/**
+ * @brief Switch a lamp on at `level` at once, unless it is known to be there.
+ */
+void light_output_set_level_on(uint8_t lamp_id, const esp_zb_ieee_addr_t address, uint8_t level);
+
+/**
+ * @brief Measured delay from sending a level to the lamp acting on it: half
+ *        the smoothed APS confirm round trip on Zigbee (0 before the first
+ *        confirm), 0 on the local output.
+ */
+uint32_t light_output_measured_delay_ms(const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief How long after a segment boundary the lamp's command goes out, so
+ *        lamps behind the same router do not arrive there together
+ *        (zigbee_topology.h); 0 on the local output.
+ */
+uint32_t light_output_slot_ms(const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief True if the backend needs the Zigbee network to be up.
+ */
+bool light_output_uses_radio(void);
+
+const char *light_output_name(light_output_t output);
+
+void light_output_print_status(void);
@@ -0,0 +1,301 @@
+#include "light_output_ledc.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "app_config.h"
+
+static const char *TAG = "LEDC_OUTPUT";
+
+#define LEDC_OUTPUT_MODE    LEDC_LOW_SPEED_MODE
+#define LEDC_OUTPUT_TIMER   LEDC_TIMER_0
+#define LEDC_LAMPS          2
+#define LEDC_LEVEL_MAX      254     /* Zigbee's top level */
+#define DUTY_MAX            ((1u << LEDC_OUTPUT_DUTY_BITS) - 1)
+#define FRAC_ONE            (1u << LEDC_DITHER_FRAC_BITS)
+
+typedef struct {
+    int gpio;
+    ledc_channel_t channel;
+    uint32_t duty;          // last duty written, whole steps
+
+    /* Software ramp, duty in 1/FRAC_ONE steps */
+    bool software;          // the dither timer owns the channel
+    uint32_t from, to;
+    int64_t start_us, end_us;
+    uint32_t error;         // sigma-delta remainder
+
+    bool hardware;          // a hardware fade may still be running
+    uint32_t hw_fades, sw_fades;
+} ledc_lamp_t;
+
+static ledc_lamp_t s_lamps[LEDC_LAMPS] = {
+    {.gpio = -1, .channel = LEDC_CHANNEL_0},
+    {.gpio = -1, .channel = LEDC_CHANNEL_1},
+};
+
+static uint32_t s_level_duty[256];  // level -> duty in 1/FRAC_ONE steps
+static bool s_ready;
+static SemaphoreHandle_t s_mutex;   // lamps and channels; fade tasks vs. the dither timer
+static esp_timer_handle_t s_dither_timer;
+static bool s_dither_running;
+static esp_pm_lock_handle_t s_pm_lock;  // the XTAL clock stops in light sleep
+
+static uint32_t ramp_position(const ledc_lamp_t *lamp, int64_t now_us)
+{
+    if (now_us >= lamp->end_us)
+        return lamp->to;
+    if (now_us <= lamp->start_us)
+        return lamp->from;
+    int64_t delta = (int64_t)lamp->to - lamp->from;
+    return (uint32_t)(lamp->from + delta * (now_us - lamp->start_us) / (lamp->end_us - lamp->start_us));
+}
+
+static void write_duty(ledc_lamp_t *lamp, uint32_t duty)
+{
+    if (duty > DUTY_MAX)
+        duty = DUTY_MAX;
+    if (duty == lamp->duty)
+        return;
+    ledc_set_duty_and_update(LEDC_OUTPUT_MODE, lamp->channel, duty, 0);
+    lamp->duty = duty;
+}
+
+/* One dither period of a software ramp */
+static void dither_step(ledc_lamp_t *lamp, int64_t now_us)
+{
+    uint32_t position = ramp_position(lamp, now_us);
+    uint32_t duty = position / FRAC_ONE;
+    lamp->error += position % FRAC_ONE;
+    if (lamp->error >= FRAC_ONE)
+    {
+        lamp->error -= FRAC_ONE;
+        duty++;
+    }
+    write_duty(lamp, duty);
+
+    // A ramp that ends on a whole step needs nothing more; one between two keeps dithering
+    if (now_us >= lamp->end_us && position % FRAC_ONE == 0)
+        lamp->software = false;
+}
+
+static void dither_timer_cb(void *arg)
+{
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+    bool needed = false;
+    for (int i = 0; i < LEDC_LAMPS; i++)
+    {
+        if (!s_lamps[i].software)
+            continue;
+        dither_step(&s_lamps[i], now_us);
+        needed |= s_lamps[i].software;
+    }
+    if (!needed)
+    {
+        esp_timer_stop(s_dither_timer);
+        s_dither_running = false;
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+esp_err_t light_output_ledc_init(void)
+{
+    int gpio[LEDC_LAMPS] = {g_light_config.ledc_gpio_1, g_light_config.ledc_gpio_2};
+    if (s_ready && s_lamps[0].gpio == gpio[0] && s_lamps[1].gpio == gpio[1])
+        return ESP_OK;
+
+    // Driving a sensor rail through the lamp driver would short it
+    for (int i = 0; i < LEDC_LAMPS; i++)
+    {
+        if (gpio[i] <= LEDC_SENSOR_PADS_LAST_GPIO || !GPIO_IS_VALID_OUTPUT_GPIO(gpio[i]) ||
+            gpio[i] == gpio[1 - i])
+        {
+            ESP_LOGE(TAG, "ledc_gpio_%d = %d: not an output, shared, or a sensor pad (GPIO0-%d)", i + 1, gpio[i],
+                     LEDC_SENSOR_PADS_LAST_GPIO);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    // Moving: the old pins go back to inputs rather than staying driven low
+    light_output_ledc_deinit();
+    for (int i = 0; i < LEDC_LAMPS; i++)
+    {
+        if (s_lamps[i].gpio >= 0 && s_lamps[i].gpio != gpio[i])
+            gpio_reset_pin(s_lamps[i].gpio);
+    }
+
+    // Same perceived curve as a bulb: duty = level^2.2, in sub-steps so the dark end is not lost
+    for (int level = 0; level < 256; level++)
+    {
+        double x = level < LEDC_LEVEL_MAX ? (double)level / LEDC_LEVEL_MAX : 1.0;
+        s_level_duty[level] = (uint32_t)lround(pow(x, LEDC_OUTPUT_GAMMA) * DUTY_MAX * FRAC_ONE);
+    }
+
+    if (s_mutex == NULL)
+    {
+        s_mutex = xSemaphoreCreateMutex();
+        const esp_timer_create_args_t timer_args = {
+            .callback = dither_timer_cb,
+            .name = "ledc_dither",
+        };
+        ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &s_dither_timer), TAG, "dither timer");
+        ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "ledc", &s_pm_lock), TAG, "pm lock");
+    }
+
+    ledc_timer_config_t timer_config = {
+        .speed_mode = LEDC_OUTPUT_MODE,
+        .duty_resolution = LEDC_OUTPUT_DUTY_BITS,
+        .timer_num = LEDC_OUTPUT_TIMER,
+        .freq_hz = LEDC_OUTPUT_FREQ_HZ,
+        .clk_cfg = LEDC_USE_XTAL_CLK,
+    };
+    ESP_RETURN_ON_ERROR(ledc_timer_config(&timer_config), TAG, "timer");
+
+    for (int i = 0; i < LEDC_LAMPS; i++)
+    {
+        ledc_lamp_t *lamp = &s_lamps[i];
+        lamp->gpio = gpio[i];
+        ledc_channel_config_t channel_config = {
+            .gpio_num = lamp->gpio,
+            .speed_mode = LEDC_OUTPUT_MODE,
+            .channel = lamp->channel,
+            .intr_type = LEDC_INTR_DISABLE,
+            .timer_sel = LEDC_OUTPUT_TIMER,
+            .duty = 0,
+            .hpoint = 0,
+        };
+        ESP_RETURN_ON_ERROR(ledc_channel_config(&channel_config), TAG, "channel %d", i);
+        lamp->duty = 0;
+        lamp->software = false;
+        lamp->hardware = false;
+    }
+    ESP_RETURN_ON_ERROR(ledc_fade_func_install(0), TAG, "fade service");
+
+    esp_pm_lock_acquire(s_pm_lock);
+    s_ready = true;
+    ESP_LOGI(TAG, "LEDC output on GPIO %d/%d, %d-bit at %d Hz", s_lamps[0].gpio, s_lamps[1].gpio,
+             LEDC_OUTPUT_DUTY_BITS, LEDC_OUTPUT_FREQ_HZ);
+    return ESP_OK;
+}
+
+void light_output_ledc_deinit(void)
+{
+    if (!s_ready)
+        return;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    esp_timer_stop(s_dither_timer);
+    s_dither_running = false;
+    for (int i = 0; i < LEDC_LAMPS; i++)
+    {
+        ledc_lamp_t *lamp = &s_lamps[i];
+        if (lamp->hardware)
+            ledc_fade_stop(LEDC_OUTPUT_MODE, lamp->channel);
+        ledc_stop(LEDC_OUTPUT_MODE, lamp->channel, 0);
+        lamp->software = false;
+        lamp->hardware = false;
+    }
+    ledc_fade_func_uninstall();
+    s_ready = false;
+    xSemaphoreGive(s_mutex);
+
+    esp_pm_lock_release(s_pm_lock);
+}
+
+void light_output_ledc_set_level(uint8_t lamp_id, uint8_t level, uint32_t transition_ms)
+{
+    if (!s_ready || lamp_id < 1 || lamp_id > LEDC_LAMPS)
+        return;
+
+    ledc_lamp_t *lamp = &s_lamps[lamp_id - 1];
+    uint32_t target = s_level_duty[level];
+    // Higher up a sixteenth of a step is invisible: round it and leave the fade to the hardware
+    if (target >= LEDC_DITHER_BELOW * FRAC_ONE)
+        target = (target + FRAC_ONE / 2) / FRAC_ONE * FRAC_ONE;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int64_t now_us = esp_timer_get_time();
+
+    // Start from wherever the channel is now, mid-fade included
+    uint32_t from;
+    if (lamp->software)
+    {
+        from = ramp_position(lamp, now_us);
+    }
+    else
+    {
+        if (lamp->hardware)
+        {
+            ledc_fade_stop(LEDC_OUTPUT_MODE, lamp->channel);
+            lamp->duty = ledc_get_duty(LEDC_OUTPUT_MODE, lamp->channel);
+            lamp->hardware = false;
+        }
+        from = lamp->duty * FRAC_ONE;
+    }
+    lamp->software = false;
+
+    uint32_t steps = target / FRAC_ONE > from / FRAC_ONE ? target / FRAC_ONE - from / FRAC_ONE
+                                                         : from / FRAC_ONE - target / FRAC_ONE;
+    uint64_t cycles = (uint64_t)transition_ms * LEDC_OUTPUT_FREQ_HZ / 1000;
+    bool whole = target % FRAC_ONE == 0;
+
+    if (whole && (transition_ms == 0 || steps == 0))
+    {
+        write_duty(lamp, target / FRAC_ONE);
+    }
+    else if (whole && cycles / steps <= LEDC_FADE_MAX_CYCLES)
+    {
+        ledc_set_fade_with_time(LEDC_OUTPUT_MODE, lamp->channel, target / FRAC_ONE, transition_ms);
+        ledc_fade_start(LEDC_OUTPUT_MODE, lamp->channel, LEDC_FADE_NO_WAIT);
+        lamp->hardware = true;
+        lamp->hw_fades++;
+    }
+    else
+    {
+        lamp->from = from;
+        lamp->to = target;
+        lamp->start_us = now_us;
+        lamp->end_us = now_us + (int64_t)transition_ms * 1000;
+        lamp->error = 0;
+        lamp->software = true;
+        lamp->sw_fades++;
+        if (!s_dither_running)
+        {
+            esp_timer_start_periodic(s_dither_timer, 1000000 / LEDC_DITHER_HZ);
+            s_dither_running = true;
+        }
+    }
+    xSemaphoreGive(s_mutex);
+}
+
+void light_output_ledc_print_status(void)
+{
+    if (!s_ready)
+    {
+        printf("LEDC output not running\n");
+        return;
+    }
+
+    printf("lamp gpio  duty/%u  state     hw_fades sw_fades\n", DUTY_MAX);
+    for (int i = 0; i < LEDC_LAMPS; i++)
+    {
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        ledc_lamp_t lamp = s_lamps[i];
+        if (lamp.hardware)
+            lamp.duty = ledc_get_duty(LEDC_OUTPUT_MODE, lamp.channel);
+        xSemaphoreGive(s_mutex);
+
+        const char *state = lamp.software ? (esp_timer_get_time() < lamp.end_us ? "ramp" : "dither")
+                                          : lamp.hardware ? "hardware" : "steady";
+        printf("%4d %4d %10" PRIu32 "  %-9s %8" PRIu32 " %8" PRIu32 "\n", i + 1, lamp.gpio, lamp.duty, state,
+               lamp.hw_fades, lamp.sw_fades);
+    }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * LEDC output backend: lamps on g_light_config.ledc_gpio_1/2, 13-bit PWM at
+ * LEDC_OUTPUT_FREQ_HZ from the XTAL clock (which also runs at the DFS low
+ * clock). GPIO0-7 are refused: they are the ADC pads, the photodiode
+ * rails main.c drives (GPIO4 high, GPIO5 and GPIO1 low) and LP I2C SCL. Levels map to duty through a 2.2 power curve, like a Zigbee bulb
+ * does internally, so the same fade table looks the same on both.
+ *
+ * A fade runs in the LEDC fade hardware when it can: a whole target duty
+ * and at most LEDC_FADE_MAX_CYCLES PWM periods per duty step. Below
+ * LEDC_DITHER_BELOW steps the curve keeps its sixteenths, and the slow,
+ * shallow fades down there do not fit the hardware either; those are
+ * ramped by a periodic timer that dithers between the two neighbouring
+ * duties (first-order sigma-delta), which stops once nothing needs it.
+ */
+#define LEDC_OUTPUT_FREQ_HZ     4000
+#define LEDC_OUTPUT_DUTY_BITS   13
+#define LEDC_OUTPUT_GAMMA       2.2
+#define LEDC_FADE_MAX_CYCLES    1023    /* fade hardware: PWM periods per duty step, 10 bits */
+#define LEDC_DITHER_HZ          2000
+#define LEDC_DITHER_FRAC_BITS   4
+#define LEDC_DITHER_BELOW       256     /* duty steps; above this targets are rounded */
+#define LEDC_SENSOR_PADS_LAST_GPIO 7    /* GPIO0..this belong to the light sensor */
+
+/**
+ * @brief Configure the timer and both channels and install the fade service
+ *        (idempotent; moves the channels if the configured pins changed).
+ *
+ * @return ESP_ERR_INVALID_ARG if a pin is a sensor pad, not an output, or shared
+ */
+esp_err_t light_output_ledc_init(void);
+
+/**
+ * @brief Stop the channels (outputs low) and the dither timer, if running.
+ */
+void light_output_ledc_deinit(void);
+
+void light_output_ledc_set_level(uint8_t lamp_id, uint8_t level, uint32_t transition_ms);
+
+/**
+ * @brief Print duty, ramp state and hardware/software fade counts of both channels.
+ */
+void light_output_ledc_print_status(void);
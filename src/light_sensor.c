@@ -5,6 +5,12 @@
  */
 
  #include "light_sensor.h"
+ #include "deferred_log.h"
+ #include "power.h"
+ #include "light_sensor_lp.h"
+ #include "fade_stats.h"
+ #include "flicker_monitor.h"
+ #include "metrics_store.h"
  #include <string.h>
  #include <stdio.h>
  #include "esp_log.h"
@@ -12,6 +18,12 @@
  #include "freertos/task.h"
  #include "freertos/semphr.h"
  #include "esp_adc/adc_continuous.h"
+ #include "esp_adc/adc_filter.h"
+ #include "esp_adc/adc_monitor.h"
+ #include "hal/adc_ll.h"
+ #include "esp_check.h"
+ #include "esp_timer.h"
+ #include <inttypes.h>
  
  #define EXAMPLE_ADC_UNIT                    ADC_UNIT_1
  #define _EXAMPLE_ADC_UNIT_STR(unit)         #unit
@@ -26,31 +38,122 @@
 
 #define EXAMPLE_ADC1_CHAN0 ADC_CHANNEL_6
 #define EXAMPLE_ADC_ATTEN  ADC_ATTEN_DB_6
+
+#define SENSOR_HIGH_RATE_HZ        (20 * 1000)
+#define SENSOR_LOW_RATE_HZ         1000     /* just above SOC_ADC_SAMPLE_FREQ_THRES_LOW */
+#define SENSOR_BURST_MS            250      /* capture length after each segment boundary */
+#define SENSOR_STOP_TIMEOUT_MS     1000     /* longest wait for the task to release the ADC */
+#define SENSOR_EVENT_READ_MS       1000     /* event mode: one filtered value per sensor this often */
+#define SENSOR_EVENT_BAND          64       /* event mode without thresholds: wake on a change this big */
+#define SENSOR_EVENT_IIR_COEFF     ADC_DIGI_IIR_FILTER_COEFF_64
+#define SENSOR_EVENT_IIR_DEPTH     64       /* samples per time constant of that coefficient */
+#define SENSOR_RAW_MAX             ((1 << EXAMPLE_ADC_BIT_WIDTH) - 1)
  
 
 
- static adc_channel_t channel[1] = {ADC_CHANNEL_6};
+ /* Channels sampled in one pattern; index in this list is the sensor index (lamp/zone) */
+ static adc_channel_t s_channels[SENSOR_MAX_CHANNELS] = {ADC_CHANNEL_6};
+ static uint8_t s_channel_count = 1;
 
  static volatile bool s_stop_task = false;
+ static volatile sensor_mode_t s_mode = SENSOR_MODE_STREAM;
+ static volatile int64_t s_burst_until_us = 0;
+
+ typedef struct {
+     int64_t wall_us;        // time spent in this mode
+     int64_t busy_us;        // time spent processing frames
+     uint32_t wakeups;
+     uint32_t samples;
+ } sensor_mode_stats_t;
+
+ static sensor_mode_stats_t s_stats[SENSOR_MODE_COUNT];
+ static const char *s_mode_names[SENSOR_MODE_COUNT] = {"stream", "segment", "background", "lp", "event"};
+ static uint16_t s_lp_threshold_low, s_lp_threshold_high;
+
+ /**
+  * Event mode: the ADC's IIR filters smooth the first sensors in hardware and
+  * its threshold monitors interrupt when a filtered value leaves its band.
+  * The task sleeps between those interrupts and a slow periodic read.
+  */
+ static adc_iir_filter_handle_t s_iir[SOC_ADC_DIGI_IIR_FILTER_NUM];
+ static adc_monitor_handle_t s_monitor[SOC_ADC_DIGI_MONITOR_NUM];
+ static bool s_event_bright[SOC_ADC_DIGI_MONITOR_NUM];
+ static volatile uint32_t s_event_bits;      // per monitor: bit 2*i went over high, bit 2*i+1 went below low
+ static volatile bool s_event_rearm;
+ static bool s_event_armed;                  // thresholds programmed; off while the filters settle
+ static int64_t s_event_settle_until_us;
+ static uint32_t s_event_count;
+ static portMUX_TYPE s_event_lock = portMUX_INITIALIZER_UNLOCKED;
 
  static TaskHandle_t s_task_handle;
  static const char *TAG = "LIGHT_SENSOR";
 
- long int current_value = 0;
+ typedef struct {
+     uint32_t sum;
+     uint32_t count;
+     volatile long int value;
+     volatile int64_t value_time_us;
+     uint16_t history[SENSOR_HISTORY_LEN];
+     volatile uint32_t history_head;
+ } sensor_channel_state_t;
+
+ static sensor_channel_state_t s_channel_state[SENSOR_MAX_CHANNELS];
 
 
  long int get_current_value(void){
-    return current_value;
+    return get_sensor_value(0);
+ }
+
+ long int get_sensor_value(int index){
+    if (index < 0 || index >= s_channel_count) {
+        return 0;
+    }
+    return s_channel_state[index].value;
+ }
+
+ int64_t light_sensor_value_time_us(int index){
+    if (index < 0 || index >= s_channel_count) {
+        return 0;
+    }
+    return s_channel_state[index].value_time_us;
  }
  
  static bool IRAM_ATTR s_conv_done_cb(adc_continuous_handle_t handle, const adc_continuous_evt_data_t *edata, void *user_data)
  {
      BaseType_t mustYield = pdFALSE;
+     /* Event mode reads frames on its own schedule */
+     if (s_mode == SENSOR_MODE_EVENT) {
+         return false;
+     }
      //Notify that ADC continuous driver has done enough number of conversions
      vTaskNotifyGiveFromISR(s_task_handle, &mustYield);
  
      return (mustYield == pdTRUE);
  }
+
+ static bool IRAM_ATTR s_monitor_event(uint32_t bit)
+ {
+     BaseType_t mustYield = pdFALSE;
+     portENTER_CRITICAL_ISR(&s_event_lock);
+     bool first = (s_event_bits & bit) == 0;
+     s_event_bits |= bit;
+     portEXIT_CRITICAL_ISR(&s_event_lock);
+     /* The monitor fires on every conversion past the threshold until the task moves its band */
+     if (first) {
+         vTaskNotifyGiveFromISR(s_task_handle, &mustYield);
+     }
+     return (mustYield == pdTRUE);
+ }
+
+ static bool IRAM_ATTR s_over_high_cb(adc_monitor_handle_t monitor, const adc_monitor_evt_data_t *edata, void *user_data)
+ {
+     return s_monitor_event(1u << (2 * (intptr_t)user_data));
+ }
+
+ static bool IRAM_ATTR s_below_low_cb(adc_monitor_handle_t monitor, const adc_monitor_evt_data_t *edata, void *user_data)
+ {
+     return s_monitor_event(2u << (2 * (intptr_t)user_data));
+ }
  
  static void continuous_adc_init(adc_channel_t *channel, uint8_t channel_num, adc_continuous_handle_t *out_handle)
  {
@@ -62,8 +165,14 @@
      };
      ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_config, &handle));
  
+     *out_handle = handle;
+ }
+
+ /* The ADC must be stopped while it is reconfigured. */
+ static void continuous_adc_set_rate(adc_continuous_handle_t handle, adc_channel_t *channel, uint8_t channel_num, uint32_t sample_freq_hz)
+ {
      adc_continuous_config_t dig_cfg = {
-         .sample_freq_hz = 20 * 1000,
+         .sample_freq_hz = sample_freq_hz,
          .conv_mode = EXAMPLE_ADC_CONV_MODE,
          .format = EXAMPLE_ADC_OUTPUT_TYPE,
      };
@@ -76,16 +185,182 @@
          adc_pattern[i].unit = EXAMPLE_ADC_UNIT;
          adc_pattern[i].bit_width = EXAMPLE_ADC_BIT_WIDTH;
  
-         ESP_LOGI(TAG, "adc_pattern[%d].atten is :%"PRIx8, i, adc_pattern[i].atten);
-         ESP_LOGI(TAG, "adc_pattern[%d].channel is :%"PRIx8, i, adc_pattern[i].channel);
-         ESP_LOGI(TAG, "adc_pattern[%d].unit is :%"PRIx8, i, adc_pattern[i].unit);
+         ESP_LOGD(TAG, "adc_pattern[%d].atten is :%"PRIx8, i, adc_pattern[i].atten);
+         ESP_LOGD(TAG, "adc_pattern[%d].channel is :%"PRIx8, i, adc_pattern[i].channel);
+         ESP_LOGD(TAG, "adc_pattern[%d].unit is :%"PRIx8, i, adc_pattern[i].unit);
      }
      dig_cfg.adc_pattern = adc_pattern;
      ESP_ERROR_CHECK(adc_continuous_config(handle, &dig_cfg));
- 
-     *out_handle = handle;
+ }
+
+ /**
+  * Thresholds for the monitor of sensor `slot`. With a band set
+  * (sensor_threshold) only the edge that flips bright/dark, as in LP mode;
+  * otherwise a window round the last value, so any real change wakes the task.
+  * An edge that must not fire sits at the end of the range (nothing reads
+  * over SENSOR_RAW_MAX or below 0) rather than at -1, which would leave its
+  * interrupt off for the life of the monitor.
+  */
+ static void sensor_event_band(int slot, int32_t *low, int32_t *high)
+ {
+     if (s_lp_threshold_high > s_lp_threshold_low) {
+         *high = s_event_bright[slot] ? SENSOR_RAW_MAX : s_lp_threshold_high;
+         *low = s_event_bright[slot] ? s_lp_threshold_low : 0;
+         return;
+     }
+     int32_t value = s_channel_state[slot].value;
+     *high = value + SENSOR_EVENT_BAND < SENSOR_RAW_MAX ? value + SENSOR_EVENT_BAND : SENSOR_RAW_MAX;
+     *low = value - SENSOR_EVENT_BAND > 0 ? value - SENSOR_EVENT_BAND : 0;
+ }
+
+ static void sensor_events_teardown(void)
+ {
+     for (int i = 0; i < SOC_ADC_DIGI_MONITOR_NUM; i++) {
+         if (s_monitor[i] != NULL) {
+             adc_continuous_monitor_disable(s_monitor[i]);
+             adc_del_continuous_monitor(s_monitor[i]);
+             s_monitor[i] = NULL;
+         }
+     }
+     for (int i = 0; i < SOC_ADC_DIGI_IIR_FILTER_NUM; i++) {
+         if (s_iir[i] != NULL) {
+             adc_continuous_iir_filter_disable(s_iir[i]);
+             adc_del_continuous_iir_filter(s_iir[i]);
+             s_iir[i] = NULL;
+         }
+     }
+ }
+
+ /* Filters and monitors for the first sensors the hardware has units for. The ADC must be stopped. */
+ static esp_err_t sensor_events_setup(adc_continuous_handle_t handle, const adc_channel_t *channel, uint8_t channel_num)
+ {
+     for (int i = 0; i < channel_num && i < SOC_ADC_DIGI_IIR_FILTER_NUM; i++) {
+         adc_continuous_iir_filter_config_t filter_cfg = {
+             .unit = EXAMPLE_ADC_UNIT,
+             .channel = channel[i] & 0x7,
+             .coeff = SENSOR_EVENT_IIR_COEFF,
+         };
+         ESP_RETURN_ON_ERROR(adc_new_continuous_iir_filter(handle, &filter_cfg, &s_iir[i]), TAG, "IIR filter %d", i);
+         ESP_RETURN_ON_ERROR(adc_continuous_iir_filter_enable(s_iir[i]), TAG, "IIR filter %d", i);
+     }
+
+     adc_monitor_evt_cbs_t cbs = {
+         .on_over_high_thresh = s_over_high_cb,
+         .on_below_low_thresh = s_below_low_cb,
+     };
+     for (int i = 0; i < channel_num && i < SOC_ADC_DIGI_MONITOR_NUM; i++) {
+         adc_monitor_config_t monitor_cfg = {
+             .adc_unit = EXAMPLE_ADC_UNIT,
+             .channel = channel[i] & 0x7,
+         };
+         /* Created quiet; sensor_events_arm() sets the band once the filter has settled */
+         monitor_cfg.h_threshold = SENSOR_RAW_MAX;
+         monitor_cfg.l_threshold = 0;
+         ESP_RETURN_ON_ERROR(adc_new_continuous_monitor(handle, &monitor_cfg, &s_monitor[i]), TAG, "monitor %d", i);
+         ESP_RETURN_ON_ERROR(adc_continuous_monitor_register_event_callbacks(s_monitor[i], &cbs, (void *)(intptr_t)i),
+                             TAG, "monitor %d", i);
+         ESP_RETURN_ON_ERROR(adc_continuous_monitor_enable(s_monitor[i]), TAG, "monitor %d", i);
+     }
+     return ESP_OK;
+ }
+
+ /**
+  * Move every monitor to the band round its sensor's latest value, with the
+  * ADC, filters and monitors left running. The driver only takes thresholds
+  * when a monitor is created, which needs the ADC stopped and would restart
+  * the filters from 0, so the registers are written directly. Monitors get
+  * hardware ids in the order they are created, so s_monitor[i] is id i.
+  */
+ static void sensor_events_arm(const adc_channel_t *channel, uint8_t channel_num)
+ {
+     for (int i = 0; i < channel_num && i < SOC_ADC_DIGI_MONITOR_NUM; i++) {
+         if (s_monitor[i] == NULL) {
+             continue;
+         }
+         int32_t low, high;
+         sensor_event_band(i, &low, &high);
+         adc_ll_digi_monitor_set_thres((adc_monitor_id_t)(ADC_MONITOR_0 + i), EXAMPLE_ADC_UNIT, channel[i] & 0x7, high, low);
+     }
+     portENTER_CRITICAL(&s_event_lock);
+     s_event_bits = 0;
+     portEXIT_CRITICAL(&s_event_lock);
+     s_event_rearm = false;
+     s_event_armed = true;
+ }
+
+ /* Sample rate wanted right now; 0 means the ADC can be stopped. */
+ static uint32_t desired_sample_rate(void)
+ {
+     switch (s_mode) {
+     case SENSOR_MODE_SEGMENT:
+         return esp_timer_get_time() < s_burst_until_us ? SENSOR_HIGH_RATE_HZ : 0;
+     case SENSOR_MODE_BACKGROUND:
+     case SENSOR_MODE_EVENT:
+         return SENSOR_LOW_RATE_HZ;
+     case SENSOR_MODE_LP:
+         return 0;   /* the LP core does the sampling */
+     case SENSOR_MODE_STREAM:
+     default:
+         return SENSOR_HIGH_RATE_HZ;
+     }
  }
  
+ /* Store one finished average of sensor `slot` and log it */
+ static void publish_average(int slot, uint32_t average)
+ {
+     sensor_channel_state_t *st = &s_channel_state[slot];
+     st->value = average;
+     st->value_time_us = esp_timer_get_time();
+     st->history[st->history_head % SENSOR_HISTORY_LEN] = average;
+     st->history_head++;
+     fade_stats_sample(slot, average);
+     metrics_store_sensor_sample(slot, average);
+     if (slot == 0) {
+         DLOG(DLOG_SENSOR_VALUE, average);
+     } else {
+         DLOG(DLOG_SENSOR_CHANNEL_VALUE, slot, average);
+     }
+ }
+
+ /**
+  * Event mode read: drop what piled up in the pool and take one fresh frame.
+  * Filtered sensors publish their last sample, which is already the IIR
+  * output; the others the mean of the frame.
+  */
+ static void event_mode_read(adc_continuous_handle_t handle, const int8_t *slot_of_channel, uint8_t channel_num,
+                             uint32_t rate, uint8_t *result, sensor_mode_stats_t *stats)
+ {
+     uint32_t sum[SENSOR_MAX_CHANNELS] = {0};
+     uint32_t count[SENSOR_MAX_CHANNELS] = {0};
+     uint32_t last[SENSOR_MAX_CHANNELS] = {0};
+     uint32_t ret_num = 0;
+     uint32_t frame_ms = EXAMPLE_READ_LEN / SOC_ADC_DIGI_RESULT_BYTES * 1000 / rate;
+
+     adc_continuous_flush_pool(handle);
+     if (adc_continuous_read(handle, result, EXAMPLE_READ_LEN, &ret_num, 2 * frame_ms + 10) != ESP_OK) {
+         return;
+     }
+
+     int64_t busy_start = esp_timer_get_time();
+     for (int i = 0; i < ret_num; i += SOC_ADC_DIGI_RESULT_BYTES) {
+         adc_digi_output_data_t *p = (adc_digi_output_data_t*)&result[i];
+         uint32_t chan_num = EXAMPLE_ADC_GET_CHANNEL(p);
+         if (chan_num < SOC_ADC_CHANNEL_NUM(EXAMPLE_ADC_UNIT) && slot_of_channel[chan_num] >= 0) {
+             int slot = slot_of_channel[chan_num];
+             last[slot] = EXAMPLE_ADC_GET_DATA(p);
+             sum[slot] += last[slot];
+             count[slot]++;
+         }
+     }
+     for (int slot = 0; slot < channel_num; slot++) {
+         if (count[slot] > 0) {
+             publish_average(slot, slot < SOC_ADC_DIGI_IIR_FILTER_NUM ? last[slot] : sum[slot] / count[slot]);
+         }
+     }
+     stats->samples += ret_num / SOC_ADC_DIGI_RESULT_BYTES;
+     stats->busy_us += esp_timer_get_time() - busy_start;
+ }
+
  static void light_sensor_rtos_task(void *pvParameters)
  {
      esp_err_t ret;
@@ -96,32 +371,166 @@
      s_task_handle = xTaskGetCurrentTaskHandle();
  
      adc_continuous_handle_t handle = NULL;
-     continuous_adc_init(channel, sizeof(channel) / sizeof(adc_channel_t), &handle);
+     adc_channel_t channel[SENSOR_MAX_CHANNELS];
+     uint8_t channel_num = s_channel_count;
+     memcpy(channel, s_channels, sizeof(channel));
+     continuous_adc_init(channel, channel_num, &handle);
+
+     /* ADC channel number -> sensor index, so each sample is routed in one lookup */
+     int8_t slot_of_channel[SOC_ADC_CHANNEL_NUM(EXAMPLE_ADC_UNIT)];
+     memset(slot_of_channel, -1, sizeof(slot_of_channel));
+     for (int i = 0; i < channel_num; i++) {
+         slot_of_channel[channel[i] & 0x7] = i;
+     }
+     memset(s_channel_state, 0, sizeof(s_channel_state));
  
      adc_continuous_evt_cbs_t cbs = {
          .on_conv_done = s_conv_done_cb,
      };
      ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(handle, &cbs, NULL));
-     ESP_ERROR_CHECK(adc_continuous_start(handle));
- 
+
+     uint32_t current_rate = 0;
+     uint32_t average_count = 1;
+     int64_t mode_since_us = esp_timer_get_time();
+     bool lp_running = false;
+     uint32_t lp_crossings = 0;
+     bool event_mode = false;
+
      while (!s_stop_task) {
- 
+
+         /* Follow demand: full rate, low rate, or stopped */
+         uint32_t rate = desired_sample_rate();
+         bool want_events = (s_mode == SENSOR_MODE_EVENT);
+         if (rate != current_rate || want_events != event_mode) {
+             if (current_rate != 0) {
+                 ESP_ERROR_CHECK(adc_continuous_stop(handle));
+             }
+             /* Filters and monitors can only change while the ADC is stopped */
+             sensor_events_teardown();
+             s_event_bits = 0;
+             s_event_armed = false;
+             event_mode = want_events;
+             if (rate != 0) {
+                 continuous_adc_set_rate(handle, channel, channel_num, rate);
+                 if (event_mode && sensor_events_setup(handle, channel, channel_num) != ESP_OK) {
+                     ESP_LOGW(TAG, "No ADC filter/monitor, event mode only reads every %d ms", SENSOR_EVENT_READ_MS);
+                     sensor_events_teardown();
+                 }
+                 ESP_ERROR_CHECK(adc_continuous_start(handle));
+                 /* The filters start from 0: about five time constants before their output can be trusted */
+                 s_event_settle_until_us = esp_timer_get_time() +
+                     5LL * SENSOR_EVENT_IIR_DEPTH * channel_num * 1000000 / rate;
+             }
+         }
+         if (rate != current_rate) {
+             current_rate = rate;
+             average_count = rate * SENSOR_AVERAGE_WINDOW_MS / 1000 / channel_num;
+             if (average_count == 0) {
+                 average_count = 1;
+             }
+             for (int c = 0; c < channel_num; c++) {
+                 s_channel_state[c].sum = 0;
+                 s_channel_state[c].count = 0;
+             }
+             /* One flicker block per published average */
+             flicker_monitor_configure(rate / channel_num, average_count);
+         }
+
+         /* LP mode: hand sampling to the LP core, which only wakes us for full result blocks */
+         if ((s_mode == SENSOR_MODE_LP) != lp_running) {
+             if (lp_running) {
+                 light_sensor_lp_stop();
+                 lp_running = false;
+             } else {
+                 lp_running = light_sensor_lp_start(SENSOR_AVERAGE_WINDOW_MS,
+                                                    s_lp_threshold_low, s_lp_threshold_high) == ESP_OK;
+                 lp_crossings = 0;
+             }
+         }
+
+         /**
+          * Block until the ADC driver has a frame, or until a segment boundary
+          * asks for a burst. While a burst is running, also wake when it ends.
+          */
+         TickType_t timeout = portMAX_DELAY;
+         if (s_mode == SENSOR_MODE_SEGMENT && current_rate != 0) {
+             int64_t remaining_us = s_burst_until_us - esp_timer_get_time();
+             timeout = remaining_us > 0 ? pdMS_TO_TICKS(remaining_us / 1000) + 1 : 0;
+         } else if (lp_running) {
+             timeout = pdMS_TO_TICKS(light_sensor_lp_block_ms());
+         } else if (event_mode && !s_event_armed) {
+             int64_t remaining_us = s_event_settle_until_us - esp_timer_get_time();
+             timeout = remaining_us > 0 ? pdMS_TO_TICKS(remaining_us / 1000) + 1 : 0;
+         } else if (event_mode) {
+             timeout = pdMS_TO_TICKS(SENSOR_EVENT_READ_MS);
+         }
+         ulTaskNotifyTake(pdTRUE, timeout);
+
+         int64_t now = esp_timer_get_time();
+         sensor_mode_stats_t *stats = &s_stats[s_mode];
+         stats->wall_us += now - mode_since_us;
+         mode_since_us = now;
+         stats->wakeups++;
+
+         if (lp_running) {
+             uint16_t averages[LP_SENSOR_RING_LEN];
+             int n = light_sensor_lp_read(averages, LP_SENSOR_RING_LEN);
+             for (int i = 0; i < n; i++) {
+                 publish_average(0, averages[i]);
+             }
+             stats->samples += n * (SENSOR_AVERAGE_WINDOW_MS * 1000 / LP_SENSOR_PERIOD_US);
+
+             bool bright;
+             uint32_t crossings = light_sensor_lp_crossings(&bright);
+             if (crossings != lp_crossings && n > 0) {
+                 DLOG(DLOG_SENSOR_THRESHOLD, bright, averages[n - 1]);
+             }
+             lp_crossings = crossings;
+             continue;
+         }
+
+         if (current_rate == 0 || s_stop_task) {
+             continue;
+         }
+
          /**
-          * This is to show you the way to use the ADC continuous mode driver event callback.
-          * This `ulTaskNotifyTake` will block when the data processing in the task is fast.
-          * However in this example, the data processing (print) is slow, so you barely block here.
-          *
-          * Without using this event callback (to notify this task), you can still just call
-          * `adc_continuous_read()` here in a loop, with/without a certain block timeout.
+          * Event mode: publish fresh filtered values, then move the monitors
+          * that fired to the new band. Nothing is armed until the filters
+          * have settled after a restart, or their ramp up from 0 would read
+          * as a crossing.
           */
-         ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+         if (event_mode) {
+             power_busy_begin();
+             event_mode_read(handle, slot_of_channel, channel_num, current_rate, result, stats);
+             power_busy_end();
+
+             if (!s_event_armed) {
+                 if (esp_timer_get_time() >= s_event_settle_until_us) {
+                     sensor_events_arm(channel, channel_num);
+                 }
+                 continue;
+             }
+             uint32_t bits = s_event_bits;
+             for (int i = 0; i < channel_num && i < SOC_ADC_DIGI_MONITOR_NUM; i++) {
+                 uint32_t fired = (bits >> (2 * i)) & 3;
+                 if (fired == 0) {
+                     continue;
+                 }
+                 s_event_bright[i] = (fired & 1) != 0;
+                 s_event_count++;
+                 DLOG(DLOG_SENSOR_THRESHOLD, s_event_bright[i], s_channel_state[i].value);
+             }
+             if (bits != 0 || s_event_rearm) {
+                 sensor_events_arm(channel, channel_num);
+             }
+             continue;
+         }
  
          char unit[] = EXAMPLE_ADC_UNIT_STR(EXAMPLE_ADC_UNIT);
- 
-         uint32_t sum = 0;
-         uint32_t count = 0;
 
+         power_busy_begin();
          while (!s_stop_task) {
+             int64_t busy_start = esp_timer_get_time();
              ret = adc_continuous_read(handle, result, EXAMPLE_READ_LEN, &ret_num, 0);
              if (ret == ESP_OK) {
                  for (int i = 0; i < ret_num; i += SOC_ADC_DIGI_RESULT_BYTES) {
@@ -130,23 +539,25 @@
                      uint32_t data = EXAMPLE_ADC_GET_DATA(p);
 
                      /* Check the channel number validation, the data is invalid if the channel num exceed the maximum channel */
-                     if (chan_num < SOC_ADC_CHANNEL_NUM(EXAMPLE_ADC_UNIT)) {
-                         sum += data;
-                         count++;
-
-                         /* Log average value every 100 readings */
-                         if (count == 1024) {
-                             uint32_t average = sum / 1024;
-                             current_value = average;
-                             ESP_LOGI(TAG, "Value: %ld", average);
-                             sum = 0;
-                             count = 0;
-                             vTaskDelay(1);
+                     if (chan_num < SOC_ADC_CHANNEL_NUM(EXAMPLE_ADC_UNIT) && slot_of_channel[chan_num] >= 0) {
+                         int slot = slot_of_channel[chan_num];
+                         sensor_channel_state_t *st = &s_channel_state[slot];
+                         st->sum += data;
+                         st->count++;
+                         flicker_monitor_push(slot, data);
+
+                         /* Publish the average of every window */
+                         if (st->count == average_count) {
+                             publish_average(slot, st->sum / average_count);
+                             st->sum = 0;
+                             st->count = 0;
                          }
                      } else {
                          ESP_LOGW(TAG, "Invalid data [%s_%"PRIu32"_%"PRIx32"]", unit, chan_num, data);
                      }
                  }
+                 stats->samples += ret_num / SOC_ADC_DIGI_RESULT_BYTES;
+                 stats->busy_us += esp_timer_get_time() - busy_start;
 
                  /* Add a short delay to prevent task watchdog timeout as needed */
                  vTaskDelay(1);
@@ -155,27 +566,170 @@
                  break;
              }
          }
+         power_busy_end();
      }
      
-     ESP_ERROR_CHECK(adc_continuous_stop(handle));
+     if (current_rate != 0) {
+         ESP_ERROR_CHECK(adc_continuous_stop(handle));
+     }
+     sensor_events_teardown();
+     if (lp_running) {
+         light_sensor_lp_stop();
+     }
      ESP_ERROR_CHECK(adc_continuous_deinit(handle));
+     // The ADC is released: only now may stop_light_sensor_task() let a new task start
+     s_task_handle = NULL;
      vTaskDelete(NULL);  // Delete itself
  }
 
  void start_light_sensor_task(void)
 {
     if (s_task_handle == NULL){
+        s_stop_task = false;
         xTaskCreate(light_sensor_rtos_task, "light_sensor_rtos_task", 8168, NULL, 3, &s_task_handle);
     }
 }
 
- void stop_light_sensor_task(void)
+ bool stop_light_sensor_task(void)
+{
+    TaskHandle_t task = s_task_handle;
+    if (task == NULL) {
+        return true;
+    }
+    s_stop_task = true;  // Signal the task to stop
+    xTaskNotifyGive(task);  // Wake the task if it's waiting for a notification
+    /* It clears the handle once the ADC is released; an event read can take a couple of frames */
+    for (int i = 0; i < SENSOR_STOP_TIMEOUT_MS / 10 && s_task_handle != NULL; i++) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return s_task_handle == NULL;
+}
+
+int light_sensor_set_channels(const adc_channel_t *channels, int count)
+{
+    if (count < 1 || count > SENSOR_MAX_CHANNELS) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (channels[i] >= SOC_ADC_CHANNEL_NUM(EXAMPLE_ADC_UNIT)) {
+            return -1;
+        }
+        /* Its pin is the LP I2C SDA line (light_sensor_lp.h) */
+        if (channels[i] == LP_SENSOR_SDA_ADC_CHANNEL &&
+            (s_mode == SENSOR_MODE_LP || light_sensor_lp_pins_claimed())) {
+            ESP_LOGW(TAG, "ADC channel %d is the LP I2C SDA pin %s", LP_SENSOR_SDA_ADC_CHANNEL,
+                     s_mode == SENSOR_MODE_LP ? "in LP mode" : "until reboot");
+            return -1;
+        }
+    }
+
+    bool running = (s_task_handle != NULL);
+    if (running && !stop_light_sensor_task()) {
+        ESP_LOGE(TAG, "Sensor task did not stop, channels unchanged");
+        return -1;
+    }
+    memcpy(s_channels, channels, count * sizeof(adc_channel_t));
+    s_channel_count = count;
+    if (running) {
+        start_light_sensor_task();
+    }
+    return 0;
+}
+
+int light_sensor_get_channels(adc_channel_t *channels)
+{
+    memcpy(channels, s_channels, s_channel_count * sizeof(adc_channel_t));
+    return s_channel_count;
+}
+
+int light_sensor_get_history(int index, uint16_t *out, int max)
+{
+    if (index < 0 || index >= s_channel_count) {
+        return 0;
+    }
+    const sensor_channel_state_t *st = &s_channel_state[index];
+    uint32_t head = st->history_head;
+    int n = head < SENSOR_HISTORY_LEN ? head : SENSOR_HISTORY_LEN;
+    if (n > max) {
+        n = max;
+    }
+    for (int i = 0; i < n; i++) {
+        out[i] = st->history[(head - n + i) % SENSOR_HISTORY_LEN];
+    }
+    return n;
+}
+
+int light_sensor_set_mode(sensor_mode_t mode)
 {
+    if (mode >= SENSOR_MODE_COUNT) {
+        return -1;
+    }
+    if (mode == SENSOR_MODE_LP) {
+        for (int i = 0; i < s_channel_count; i++) {
+            if (s_channels[i] == LP_SENSOR_SDA_ADC_CHANNEL) {
+                ESP_LOGW(TAG, "LP mode needs GPIO6 for LP I2C SDA; take ADC channel %d out of sensor_channels first",
+                         LP_SENSOR_SDA_ADC_CHANNEL);
+                return -1;
+            }
+        }
+    }
+    s_mode = mode;
     if (s_task_handle != NULL) {
-        s_stop_task = true;  // Signal the task to stop
-        xTaskNotifyGive(s_task_handle);  // Wake the task if it's waiting for a notification
-        vTaskDelay(100 / portTICK_PERIOD_MS);  // Wait a brief period to ensure task cleanup
-        s_task_handle = NULL;
-        s_stop_task = false;
+        xTaskNotifyGive(s_task_handle);  // Let the task re-evaluate its sample rate
+    }
+    return 0;
+}
+
+sensor_mode_t light_sensor_get_mode(void)
+{
+    return s_mode;
+}
+
+const char *light_sensor_mode_name(sensor_mode_t mode)
+{
+    return mode < SENSOR_MODE_COUNT ? s_mode_names[mode] : "?";
+}
+
+void light_sensor_set_lp_thresholds(uint16_t low, uint16_t high)
+{
+    s_lp_threshold_low = low;
+    s_lp_threshold_high = high;
+    light_sensor_lp_set_thresholds(low, high);
+    if (s_mode == SENSOR_MODE_EVENT && s_task_handle != NULL) {
+        s_event_rearm = true;
+        xTaskNotifyGive(s_task_handle);
+    }
+}
+
+void light_sensor_segment_boundary(void)
+{
+    if (s_mode != SENSOR_MODE_SEGMENT || s_task_handle == NULL) {
+        return;
+    }
+    s_burst_until_us = esp_timer_get_time() + SENSOR_BURST_MS * 1000;
+    xTaskNotifyGive(s_task_handle);
+}
+
+void light_sensor_print_stats(void)
+{
+    printf("Sensor mode: %s\n", s_mode_names[s_mode]);
+    printf("mode        time_s  cpu_%%  wakeups/s  samples/s\n");
+    for (int m = 0; m < SENSOR_MODE_COUNT; m++) {
+        const sensor_mode_stats_t *st = &s_stats[m];
+        if (st->wall_us == 0) {
+            continue;
+        }
+        printf("%-11s %6" PRId64 " %6.2f %10.1f %10.1f\n", s_mode_names[m],
+               st->wall_us / 1000000,
+               100.0 * st->busy_us / st->wall_us,
+               st->wakeups * 1e6 / st->wall_us,
+               st->samples * 1e6 / st->wall_us);
+    }
+    if (s_mode == SENSOR_MODE_LP) {
+        light_sensor_lp_print_status();
     }
-}
\ No newline at end of file
+    if (s_mode == SENSOR_MODE_EVENT) {
+        printf("  monitor events %" PRIu32 ", %s\n", s_event_count,
+               s_lp_threshold_high > s_lp_threshold_low ? "bright/dark band" : "tracking changes");
+    }
+}
@@ -1,5 +1,76 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_adc/adc_continuous.h"
+
+#define SENSOR_MAX_CHANNELS 4     /* photodiodes sampled in one ADC pattern */
+#define SENSOR_HISTORY_LEN  40    /* averages kept per channel (2 s) */
+#define SENSOR_AVERAGE_WINDOW_MS 50 /* one published value per window */
+
+/**
+ * @brief How the ADC follows demand.
+ */
+typedef enum {
+    SENSOR_MODE_STREAM,      // 20 kHz all the time (web UI graph)
+    SENSOR_MODE_SEGMENT,     // 20 kHz bursts after fade segment boundaries, ADC stopped in between
+    SENSOR_MODE_BACKGROUND,  // low-rate continuous sampling
+    SENSOR_MODE_LP,          // LP core samples and averages, HP core only reads result blocks
+    SENSOR_MODE_EVENT,       // low rate through the ADC's IIR filters, wakes on monitor thresholds and a 1 s read
+    SENSOR_MODE_COUNT
+} sensor_mode_t;
+
 long int get_current_value(void);
+
+/**
+ * @brief Latest average of sensor `index` (position in the channel list).
+ */
+long int get_sensor_value(int index);
+
+/**
+ * @brief esp_timer time at which that average was published (0 = none yet).
+ */
+int64_t light_sensor_value_time_us(int index);
+
+/**
+ * @brief Copy up to `max` most recent averages of sensor `index`, oldest first.
+ */
+int light_sensor_get_history(int index, uint16_t *out, int max);
+
+/**
+ * @brief Set the ADC channels to sample together; restarts the task if running.
+ *        -1 for a bad channel, or if the running task did not stop.
+ */
+int light_sensor_set_channels(const adc_channel_t *channels, int count);
+int light_sensor_get_channels(adc_channel_t *channels);
 void start_light_sensor_task(void);
-void stop_light_sensor_task(void);
\ No newline at end of file
+
+/**
+ * @brief Stop the sampling task and wait for it to release the ADC; false if
+ *        it is still running after a second (it stops later on its own).
+ */
+bool stop_light_sensor_task(void);
+
+/**
+ * @brief Switch the sampling mode; -1 if invalid, or LP while ADC channel 6
+ *        (the LP I2C SDA pin) is in the channel list.
+ */
+int light_sensor_set_mode(sensor_mode_t mode);
+sensor_mode_t light_sensor_get_mode(void);
+const char *light_sensor_mode_name(sensor_mode_t mode);
+
+/**
+ * @brief Brightness band for LP and event modes: crossing it wakes the HP core at once (0/0 = off;
+ *        event mode then wakes on any sizeable change instead).
+ */
+void light_sensor_set_lp_thresholds(uint16_t low, uint16_t high);
+
+/**
+ * @brief Called by the fade engine when a segment starts; opens a capture burst in segment mode.
+ */
+void light_sensor_segment_boundary(void);
+
+/**
+ * @brief Print CPU load, wake-up rate and sample rate per mode.
+ */
+void light_sensor_print_stats(void);
@@ -0,0 +1,128 @@
+#include "light_sensor_lp.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "ulp_lp_core.h"
+#include "lp_core_i2c.h"
+#include "ulp_lp_sensor.h"
+
+static const char *TAG = "LIGHT_SENSOR_LP";
+
+extern const uint8_t lp_sensor_bin_start[] asm("_binary_lp_sensor_bin_start");
+extern const uint8_t lp_sensor_bin_end[] asm("_binary_lp_sensor_bin_end");
+
+/* The LP program's `lp_sensor` variable, seen from the HP core */
+static volatile lp_sensor_shared_t *const s_shared = (volatile lp_sensor_shared_t *)&ulp_lp_sensor;
+
+static bool s_i2c_ready;
+static bool s_running;
+static uint32_t s_read_seq;
+static uint32_t s_window;
+
+esp_err_t light_sensor_lp_start(uint32_t average_ms, uint16_t threshold_low, uint16_t threshold_high)
+{
+    esp_err_t err;
+
+    if (s_running)
+    {
+        light_sensor_lp_stop();
+    }
+
+    if (!s_i2c_ready)
+    {
+        const lp_core_i2c_cfg_t i2c_cfg = LP_CORE_I2C_DEFAULT_CONFIG();
+        if ((err = lp_core_i2c_master_init(LP_I2C_NUM_0, &i2c_cfg)) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "LP I2C init failed: %s", esp_err_to_name(err));
+            return err;
+        }
+        s_i2c_ready = true;
+    }
+
+    if ((err = ulp_lp_core_load_binary(lp_sensor_bin_start, lp_sensor_bin_end - lp_sensor_bin_start)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Loading LP program failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Loading clears .bss, so the shared block is configured afterwards
+    s_window = average_ms * 1000 / LP_SENSOR_PERIOD_US;
+    s_shared->i2c_addr = LP_SENSOR_I2C_ADDR;
+    lp_sensor_filter_init(&s_shared->filter, s_window, threshold_low, threshold_high);
+    s_read_seq = 0;
+
+    ulp_lp_core_cfg_t cfg = {
+        .wakeup_source = ULP_LP_CORE_WAKEUP_SOURCE_LP_TIMER,
+        .lp_timer_sleep_duration_us = LP_SENSOR_PERIOD_US,
+    };
+    if ((err = ulp_lp_core_run(&cfg)) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Starting LP core failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    // Result blocks and threshold crossings also end a light sleep
+    esp_sleep_enable_ulp_wakeup();
+    s_running = true;
+    return ESP_OK;
+}
+
+void light_sensor_lp_stop(void)
+{
+    if (!s_running)
+        return;
+
+    ulp_lp_core_stop();
+    esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ULP);
+    s_running = false;
+}
+
+bool light_sensor_lp_pins_claimed(void)
+{
+    return s_i2c_ready;
+}
+
+void light_sensor_lp_set_thresholds(uint16_t threshold_low, uint16_t threshold_high)
+{
+    if (!s_running)
+        return;
+    // The LP core reads these on every average; a torn update only delays a crossing by one average
+    s_shared->filter.threshold_low = threshold_low;
+    s_shared->filter.threshold_high = threshold_high;
+}
+
+int light_sensor_lp_read(uint16_t *out, int max)
+{
+    if (!s_running)
+        return 0;
+    return lp_sensor_filter_read(&s_shared->filter, &s_read_seq, out, max);
+}
+
+uint32_t light_sensor_lp_block_ms(void)
+{
+    return s_window * LP_SENSOR_RING_LEN * LP_SENSOR_PERIOD_US / 1000;
+}
+
+uint32_t light_sensor_lp_crossings(bool *bright)
+{
+    if (bright != NULL)
+        *bright = s_shared->filter.bright != 0;
+    return s_shared->filter.crossings;
+}
+
+void light_sensor_lp_print_status(void)
+{
+    if (!s_running)
+    {
+        printf("LP sensor: stopped\n");
+        return;
+    }
+    printf("LP sensor: ADS1115 at 0x%02x, %s\n", LP_SENSOR_I2C_ADDR,
+           s_shared->configured ? "configured" : "not responding");
+    printf("  samples %" PRIu32 ", I2C errors %" PRIu32 ", averages %" PRIu32 " of %" PRIu32 " samples\n",
+           s_shared->samples, s_shared->i2c_errors, s_shared->filter.seq, s_shared->filter.window);
+    printf("  HP wake-ups requested %" PRIu32 ", threshold %" PRIu32 "/%" PRIu32 ", crossings %" PRIu32 ", now %s\n",
+           s_shared->wakeups, s_shared->filter.threshold_low, s_shared->filter.threshold_high,
+           s_shared->filter.crossings, s_shared->filter.bright ? "bright" : "dark");
+}
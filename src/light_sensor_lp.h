@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "lp_sensor_filter.h"
+
+/*
+ * The C6 LP core cannot reach the SAR ADC, so in LP mode the photodiode is
+ * read through an ADS1115 on the LP I2C bus (fixed pins: SDA GPIO6, SCL GPIO7).
+ * GPIO6 is also ADC1 channel 6, the default photodiode input of the other
+ * modes, and the LP I2C driver has no deinit: LP mode is refused while
+ * channel 6 is in the sensor channel list, and once LP mode has claimed the
+ * pin, channel 6 stays unavailable until the next reboot.
+ */
+#define LP_SENSOR_I2C_ADDR   0x48
+#define LP_SENSOR_SDA_ADC_CHANNEL 6     /* ADC1 channel on the SDA pin */
+#define LP_SENSOR_PERIOD_US  2000    /* one sample per LP timer wake-up */
+
+/**
+ * @brief Load and start the LP program.
+ *
+ * @param average_ms      averaging window
+ * @param threshold_low   wake the HP core when the average falls below this...
+ * @param threshold_high  ...after having been above this (0/0 disables)
+ */
+esp_err_t light_sensor_lp_start(uint32_t average_ms, uint16_t threshold_low, uint16_t threshold_high);
+
+void light_sensor_lp_stop(void);
+
+/**
+ * @brief True once the LP I2C bus owns GPIO6/GPIO7 (for the rest of this boot).
+ */
+bool light_sensor_lp_pins_claimed(void);
+
+/**
+ * @brief Change the threshold band of the running LP program.
+ */
+void light_sensor_lp_set_thresholds(uint16_t threshold_low, uint16_t threshold_high);
+
+/**
+ * @brief Averages completed since the last call, oldest first.
+ */
+int light_sensor_lp_read(uint16_t *out, int max);
+
+/**
+ * @brief How long the HP side may sleep between reads without losing averages.
+ */
+uint32_t light_sensor_lp_block_ms(void);
+
+/**
+ * @brief Threshold crossings seen so far, and whether the light is currently "bright".
+ */
+uint32_t light_sensor_lp_crossings(bool *bright);
+
+void light_sensor_lp_print_status(void);
@@ -0,0 +1,119 @@
+#pragma once
+
+/*
+ * Block averaging and threshold detection for the LP-core sensor mode.
+ * Shared by the LP program (src/ulp/lp_sensor_main.c), which runs it on
+ * every sample, and the HP side, which configures it and reads the results
+ * out of LP RAM. Plain C with no ESP-IDF dependencies, so it also builds
+ * on the host.
+ */
+
+#include <stdint.h>
+
+#define LP_SENSOR_RING_LEN 8      /* averages per result block, the HP core reads them in one go */
+
+#define LP_SENSOR_EVT_AVERAGE  (1 << 0)   /* one more average in the ring */
+#define LP_SENSOR_EVT_BLOCK    (1 << 1)   /* the ring holds a full block of new averages */
+#define LP_SENSOR_EVT_CROSSED  (1 << 2)   /* the average left the threshold band */
+
+typedef struct {
+    /* Configuration, written by the HP core before the LP core starts */
+    uint32_t window;            // samples per average
+    uint32_t threshold_low;     // "dark" below this...
+    uint32_t threshold_high;    // ...and "bright" above this; off unless high > low
+
+    /* Running state */
+    uint32_t sum;
+    uint32_t count;
+    uint32_t bright;
+
+    /* Results */
+    uint32_t seq;               // averages completed so far
+    uint32_t crossings;
+    uint16_t ring[LP_SENSOR_RING_LEN];
+} lp_sensor_filter_t;
+
+static inline void lp_sensor_filter_init(volatile lp_sensor_filter_t *f, uint32_t window,
+                                         uint32_t threshold_low, uint32_t threshold_high)
+{
+    f->window = window ? window : 1;
+    f->threshold_low = threshold_low;
+    f->threshold_high = threshold_high;
+    f->sum = 0;
+    f->count = 0;
+    f->bright = 0;
+    f->seq = 0;
+    f->crossings = 0;
+}
+
+/**
+ * @brief Add one sample; returns LP_SENSOR_EVT_* bits for what happened.
+ */
+static inline uint32_t lp_sensor_filter_push(volatile lp_sensor_filter_t *f, uint32_t sample)
+{
+    f->sum += sample;
+    if (++f->count < f->window)
+        return 0;
+
+    uint32_t average = f->sum / f->count;
+    f->sum = 0;
+    f->count = 0;
+    f->ring[f->seq % LP_SENSOR_RING_LEN] = (uint16_t)average;
+    f->seq++;
+
+    uint32_t events = LP_SENSOR_EVT_AVERAGE;
+    if (f->seq % LP_SENSOR_RING_LEN == 0)
+        events |= LP_SENSOR_EVT_BLOCK;
+
+    // Hysteresis: the band between low and high never toggles the state
+    if (f->threshold_high > f->threshold_low)
+    {
+        if (!f->bright && average > f->threshold_high)
+        {
+            f->bright = 1;
+            f->crossings++;
+            events |= LP_SENSOR_EVT_CROSSED;
+        }
+        else if (f->bright && average < f->threshold_low)
+        {
+            f->bright = 0;
+            f->crossings++;
+            events |= LP_SENSOR_EVT_CROSSED;
+        }
+    }
+    return events;
+}
+
+/**
+ * @brief Copy the averages completed after `*read_seq` (at most a ring's worth), oldest first.
+ *
+ * Advances `*read_seq`. Averages that were overwritten before being read are skipped.
+ */
+static inline int lp_sensor_filter_read(const volatile lp_sensor_filter_t *f, uint32_t *read_seq,
+                                        uint16_t *out, int max)
+{
+    uint32_t seq = f->seq;
+    uint32_t first = *read_seq;
+    if (seq - first > LP_SENSOR_RING_LEN)
+        first = seq - LP_SENSOR_RING_LEN;
+
+    int n = 0;
+    for (uint32_t s = first; s != seq && n < max; s++)
+    {
+        out[n++] = f->ring[s % LP_SENSOR_RING_LEN];
+    }
+    *read_seq = first + n;
+    return n;
+}
+
+/**
+ * @brief State shared between the LP program and the HP core (lives in LP RAM).
+ */
+typedef struct {
+    uint32_t i2c_addr;          // external ADC on the LP I2C bus
+    uint32_t configured;        // LP side has programmed the ADC
+    uint32_t samples;
+    uint32_t i2c_errors;
+    uint32_t wakeups;           // times the LP core woke the HP core
+    lp_sensor_filter_t filter;
+} lp_sensor_shared_t;
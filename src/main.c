@@ -3,18 +3,28 @@
 #include "esp_console.h"
 #include "nvs_flash.h"
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 #include "app_config.h"
 #include "zigbee_main.h"
 #include "light_control.h"
 #include "console_cmd.h"
 #include "light_sensor.h"
+#include "deferred_log.h"
+#include "power.h"
+#include "time_sync_espnow.h"
+#include "brightness_loop.h"
+#include "light_output.h"
+#include "metrics_store.h"
+#include "fade_stats.h"
 
 #include "linenoise/linenoise.h"
 
 static const char *TAG = "APP_MAIN";
 
 #define PROMPT_STR "ZB_Dimmer"
+#define NETWORK_WAIT_MS 30000
 
 /* Example of configuring two pins for some special purpose (like your original code). */
 static void configure_gpio_pins(void)
@@ -39,6 +49,15 @@ static void configure_gpio_pins(void)
     gpio_set_level(GPIO_NUM_1, 0);
 }
 
+/* Without a network at boot the fades start as soon as it comes up, however long pairing takes */
+static void start_lights_task(void *pvParameters)
+{
+    zigbee_wait_for_network_ready(portMAX_DELAY);
+    ESP_LOGI(TAG, "Network up, starting the fades");
+    lights_init();
+    vTaskDelete(NULL);
+}
+
 void app_main() {
 
     ESP_LOGI(TAG, "Starting application...");
@@ -48,6 +67,18 @@ void app_main() {
 
     load_light_config_from_nvs();
 
+    // Frequency scaling / light sleep as selected with the `pm` command
+    power_init();
+
+    // Formatting of hot-path log lines happens in a low-priority task
+    deferred_log_init();
+
+    // Per-minute history in its own flash partition
+    metrics_store_init();
+
+    // Per-segment sensor statistics, fed by the sensor and fade tasks
+    fade_stats_init();
+
     // Initialize console REPL (UART or USB-JTAG, etc.)
     esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
     repl_config.prompt = PROMPT_STR ">";
@@ -72,9 +103,26 @@ void app_main() {
     // Start the console REPL so we can type commands (get, set, start_calibration, etc.)
     ESP_ERROR_CHECK(esp_console_start_repl(repl));
 
-    // Optionally, you can start the default fade tasks right away:
-    lights_init();
-
     // Send config over serial
     cmd_get_config(0, NULL);
+
+    // Closed-loop brightness, if a target is configured
+    brightness_loop_apply_config();
+
+    // Master or slave clock for multi-coordinator installations, if configured
+    time_sync_espnow_init();
+
+    // Commands sent before the network is restored are lost, so the fades start
+    // once the stack reports it (picking up the old phase after a soft reset);
+    // LEDs on the local PWM output need no network. The wait is bounded so
+    // app_main returns even when pairing never succeeds.
+    if (!light_output_uses_radio() || zigbee_wait_for_network_ready(pdMS_TO_TICKS(NETWORK_WAIT_MS)))
+    {
+        lights_init();
+    }
+    else
+    {
+        ESP_LOGW(TAG, "No Zigbee network after %d s, the fades start when it comes up", NETWORK_WAIT_MS / 1000);
+        xTaskCreate(start_lights_task, "start_lights", 3072, NULL, 5, NULL);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,177 @@
+#include "metrics_codec.h"
+#include <string.h>
+
+#define HEADER_SIZE sizeof(metrics_page_header_t)
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *out)
+{
+    uint32_t v = 0;
+    for (int shift = 0; p < end && shift < 35; shift += 7)
+    {
+        uint8_t b = *p++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *out = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Small deltas of either sign become small unsigned numbers: 0, -1, 1, -2... -> 0, 1, 2, 3... */
+static uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+uint32_t metrics_crc32(const uint8_t *data, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--)
+    {
+        crc ^= *data++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+    }
+    return ~crc;
+}
+
+void metrics_page_begin(metrics_page_builder_t *builder, uint32_t seq, uint32_t boot, int fields)
+{
+    memset(builder->page, 0xFF, sizeof(builder->page));
+    metrics_page_header_t header = {
+        .magic = METRICS_PAGE_MAGIC,
+        .seq = seq,
+        .boot = boot,
+        .fields = (uint8_t)(fields < METRICS_MAX_FIELDS ? fields : METRICS_MAX_FIELDS),
+    };
+    memcpy(builder->page, &header, HEADER_SIZE);
+    builder->minute = 0;
+    memset(builder->last, 0, sizeof(builder->last));
+}
+
+bool metrics_page_append(metrics_page_builder_t *builder, uint32_t minute, const int32_t *values)
+{
+    metrics_page_header_t *header = (metrics_page_header_t *)builder->page;
+    uint8_t record[METRICS_MAX_RECORD];
+
+    // Minutes only go forward within a page; a clock that went back starts a new one
+    if (header->records > 0 && minute < builder->minute)
+        return false;
+
+    uint32_t base_minute = header->records > 0 ? builder->minute : minute;
+    uint8_t *p = put_varint(record, minute - base_minute);
+    for (int i = 0; i < header->fields; i++)
+        p = put_varint(p, zigzag((int32_t)((uint32_t)values[i] - (uint32_t)builder->last[i])));
+
+    uint32_t len = p - record;
+    if (HEADER_SIZE + header->bytes + len > METRICS_PAGE_SIZE)
+        return false;
+
+    memcpy(builder->page + HEADER_SIZE + header->bytes, record, len);
+    header->bytes += len;
+    if (header->records == 0)
+        header->first_minute = minute;
+    header->last_minute = minute;
+    header->records++;
+    builder->minute = minute;
+    memcpy(builder->last, values, header->fields * sizeof(int32_t));
+    return true;
+}
+
+void metrics_page_finish(metrics_page_builder_t *builder)
+{
+    metrics_page_header_t *header = (metrics_page_header_t *)builder->page;
+    header->crc = metrics_crc32(builder->page + HEADER_SIZE, header->bytes);
+}
+
+bool metrics_page_valid(const uint8_t *page, uint32_t size)
+{
+    metrics_page_header_t header;
+    memcpy(&header, page, HEADER_SIZE);
+    if (header.magic != METRICS_PAGE_MAGIC || header.fields > METRICS_MAX_FIELDS || header.records == 0 ||
+        HEADER_SIZE + header.bytes > size)
+        return false;
+    return metrics_crc32(page + HEADER_SIZE, header.bytes) == header.crc;
+}
+
+int metrics_page_recover(uint8_t *page, uint32_t size)
+{
+    metrics_page_header_t header;
+    memcpy(&header, page, HEADER_SIZE);
+    if (header.seq == 0xFFFFFFFFu || header.first_minute == 0xFFFFFFFFu || header.fields > METRICS_MAX_FIELDS ||
+        size <= HEADER_SIZE)
+        return 0;
+
+    // Erased flash never ends a varint, so decoding stops at the first record not written in full
+    metrics_page_cursor_t cursor = {
+        .pos = page + HEADER_SIZE,
+        .end = page + (size < METRICS_PAGE_SIZE ? size : METRICS_PAGE_SIZE),
+        .fields = header.fields,
+        .minute = header.first_minute,
+    };
+    int records = 0;
+    const uint8_t *end = cursor.pos;
+    uint32_t last_minute = 0;
+    while (records < UINT16_MAX && metrics_page_cursor_next(&cursor))
+    {
+        records++;
+        end = cursor.pos;
+        last_minute = cursor.minute;
+    }
+    if (records == 0)
+        return 0;
+
+    header.magic = METRICS_PAGE_MAGIC;
+    header.records = (uint16_t)records;
+    header.bytes = (uint16_t)(end - (page + HEADER_SIZE));
+    header.last_minute = last_minute;
+    header.crc = metrics_crc32(page + HEADER_SIZE, header.bytes);
+    memcpy(page, &header, HEADER_SIZE);
+    return records;
+}
+
+void metrics_page_cursor_init(metrics_page_cursor_t *cursor, const uint8_t *page)
+{
+    const metrics_page_header_t *header = metrics_page_header(page);
+    cursor->pos = page + HEADER_SIZE;
+    cursor->end = cursor->pos + header->bytes;
+    cursor->fields = header->fields;
+    cursor->minute = header->first_minute;
+    memset(cursor->values, 0, sizeof(cursor->values));
+}
+
+bool metrics_page_cursor_next(metrics_page_cursor_t *cursor)
+{
+    uint32_t v;
+    const uint8_t *p = get_varint(cursor->pos, cursor->end, &v);
+    if (p == NULL)
+        return false;
+    // The first record's delta is 0, so the minute starts from first_minute
+    cursor->minute += v;
+    for (int i = 0; i < cursor->fields; i++)
+    {
+        if ((p = get_varint(p, cursor->end, &v)) == NULL)
+            return false;
+        cursor->values[i] = (int32_t)((uint32_t)cursor->values[i] + (uint32_t)unzigzag(v));
+    }
+    cursor->pos = p;
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/*
+ * Page format of the metrics store: one flash sector holds a header and a
+ * run of per-minute records, each the minute delta (unsigned varint) and
+ * then every field as the zigzag varint of its delta to the previous
+ * record. The first record of a page is relative to zero, so every page
+ * decodes on its own. Plain C with no ESP-IDF dependencies, so it also
+ * builds on the host.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define METRICS_PAGE_SIZE   4096            /* one flash sector */
+#define METRICS_PAGE_MAGIC  0x5254454Du     /* "METR" little-endian */
+#define METRICS_MAX_FIELDS  16
+#define METRICS_MAX_RECORD  (5 + 5 * METRICS_MAX_FIELDS)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;           // pages written since the store was created
+    uint32_t boot;          // boot the records are from (minutes restart with the clock)
+    uint32_t first_minute;  // minute of the first and last record
+    uint32_t last_minute;
+    uint16_t records;
+    uint16_t bytes;         // payload after the header
+    uint8_t fields;
+    uint8_t reserved[3];
+    uint32_t crc;           // CRC-32 of the payload
+} metrics_page_header_t;
+
+typedef struct {
+    uint8_t page[METRICS_PAGE_SIZE];    // header, then payload
+    uint32_t minute;                    // of the last record
+    int32_t last[METRICS_MAX_FIELDS];
+} metrics_page_builder_t;
+
+typedef struct {
+    const uint8_t *pos, *end;
+    int fields;
+    uint32_t minute;
+    int32_t values[METRICS_MAX_FIELDS];
+} metrics_page_cursor_t;
+
+/**
+ * @brief Start an empty page (erased-flash 0xFF after the payload).
+ */
+void metrics_page_begin(metrics_page_builder_t *builder, uint32_t seq, uint32_t boot, int fields);
+
+/**
+ * @brief Append a record, false if it does not fit (the page is unchanged).
+ */
+bool metrics_page_append(metrics_page_builder_t *builder, uint32_t minute, const int32_t *values);
+
+/**
+ * @brief Fill in the payload length and CRC; the page can then be written
+ *        (header plus payload is enough).
+ */
+void metrics_page_finish(metrics_page_builder_t *builder);
+
+static inline const metrics_page_header_t *metrics_page_header(const uint8_t *page)
+{
+    return (const metrics_page_header_t *)page;
+}
+
+/**
+ * @brief Finish a page read back from flash that was never finished (power
+ *        lost while it was open): keep the records that decode in full in
+ *        front of the erased space and fill in the header around them.
+ *
+ * Needs seq, boot, fields and first_minute in the header, which are written
+ * before the payload; the rest of the header may still be erased.
+ *
+ * @return records kept; with 0 the page stays invalid
+ */
+int metrics_page_recover(uint8_t *page, uint32_t size);
+
+/**
+ * @brief True if `page` holds a finished page whose payload matches its CRC.
+ */
+bool metrics_page_valid(const uint8_t *page, uint32_t size);
+
+/**
+ * @brief Decode the records of a valid page in order.
+ */
+void metrics_page_cursor_init(metrics_page_cursor_t *cursor, const uint8_t *page);
+bool metrics_page_cursor_next(metrics_page_cursor_t *cursor);
+
+uint32_t metrics_crc32(const uint8_t *data, uint32_t len);
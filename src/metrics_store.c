@@ -0,0 +1,357 @@
+#include "metrics_store.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "driver/uart.h"
+#include "metrics_codec.h"
+#include "lamp_state.h"
+#include "light_control.h"
+
+static const char *TAG = "METRICS";
+
+#define METRICS_UART_NUM    CONFIG_ESP_CONSOLE_UART_NUM
+#define METRICS_SENSORS     2
+#define HEADER_SIZE         sizeof(metrics_page_header_t)
+
+#define METRICS_FIELD_NAME(name) #name,
+static const char *s_field_names[METRICS_FIELD_COUNT] = {METRICS_FIELD_LIST(METRICS_FIELD_NAME)};
+#undef METRICS_FIELD_NAME
+
+static const esp_partition_t *s_partition;
+static uint32_t s_sectors;
+static uint32_t s_sector;           // of the open page; the one after it is the oldest
+static uint32_t s_seq, s_boot;
+static uint32_t s_pages_written;
+static metrics_page_builder_t s_builder;    // copy of the open page
+static uint16_t s_flushed;                  // of its payload bytes, those already in flash
+static uint8_t s_page_buf[METRICS_PAGE_SIZE];   // scans and dumps
+static SemaphoreHandle_t s_mutex;   // builder, ring position and s_page_buf
+
+static uint64_t s_sensor_sum[METRICS_SENSORS];
+static uint32_t s_sensor_count[METRICS_SENSORS];
+static portMUX_TYPE s_sensor_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_last_sent, s_last_failed;
+
+/* Read a sector's page into s_page_buf; false unless it is a valid page */
+static bool read_page(uint32_t sector)
+{
+    metrics_page_header_t *header = (metrics_page_header_t *)s_page_buf;
+    if (esp_partition_read(s_partition, sector * METRICS_PAGE_SIZE, s_page_buf, HEADER_SIZE) != ESP_OK ||
+        header->magic != METRICS_PAGE_MAGIC || HEADER_SIZE + header->bytes > METRICS_PAGE_SIZE)
+        return false;
+    if (esp_partition_read(s_partition, sector * METRICS_PAGE_SIZE + HEADER_SIZE, s_page_buf + HEADER_SIZE,
+                           header->bytes) != ESP_OK)
+        return false;
+    return metrics_page_valid(s_page_buf, METRICS_PAGE_SIZE);
+}
+
+/* Call with s_mutex held. Erase the sector and write the parts of the header
+   known up front; the rest stays erased until the page is closed. */
+static esp_err_t open_page(void)
+{
+    metrics_page_begin(&s_builder, s_seq, s_boot, METRICS_FIELD_COUNT);
+    s_flushed = 0;
+    metrics_page_header_t header = *metrics_page_header(s_builder.page);
+    header.magic = 0xFFFFFFFFu;
+    header.first_minute = header.last_minute = 0xFFFFFFFFu;
+    header.records = header.bytes = 0xFFFF;
+    header.crc = 0xFFFFFFFFu;
+
+    size_t offset = s_sector * METRICS_PAGE_SIZE;
+    esp_err_t err = esp_partition_erase_range(s_partition, offset, METRICS_PAGE_SIZE);
+    if (err == ESP_OK)
+        err = esp_partition_write(s_partition, offset, &header, HEADER_SIZE);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Opening page %" PRIu32 " in sector %" PRIu32 " failed: %s", s_seq, s_sector,
+                 esp_err_to_name(err));
+    return err;
+}
+
+/* Call with s_mutex held. Complete the header and open the next sector; a
+   bad sector is skipped rather than retried forever. */
+static esp_err_t close_page(void)
+{
+    const metrics_page_header_t *header = metrics_page_header(s_builder.page);
+    if (header->records == 0)
+        return ESP_OK;
+
+    metrics_page_finish(&s_builder);
+    esp_err_t err = esp_partition_write(s_partition, s_sector * METRICS_PAGE_SIZE, s_builder.page, HEADER_SIZE);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Closing page %" PRIu32 " in sector %" PRIu32 " failed: %s", s_seq, s_sector,
+                 esp_err_to_name(err));
+
+    s_sector = (s_sector + 1) % s_sectors;
+    s_seq++;
+    s_pages_written++;
+    open_page();
+    return err;
+}
+
+/* Call with s_mutex held. Each record goes to flash as it is added, into the
+   erased space after the previous one, so a power cut loses no finished minute. */
+static void append_record(uint32_t minute, const int32_t *values)
+{
+    const metrics_page_header_t *header = metrics_page_header(s_builder.page);
+    if (!metrics_page_append(&s_builder, minute, values))
+    {
+        close_page();
+        metrics_page_append(&s_builder, minute, values);
+    }
+
+    size_t offset = s_sector * METRICS_PAGE_SIZE;
+    uint16_t bytes = header->bytes;
+    uint16_t len = bytes - s_flushed;
+    esp_err_t err = ESP_OK;
+    if (header->records == 1)
+        err = esp_partition_write(s_partition, offset + offsetof(metrics_page_header_t, first_minute),
+                                  &header->first_minute, sizeof(header->first_minute));
+    if (err == ESP_OK)
+        err = esp_partition_write(s_partition, offset + HEADER_SIZE + s_flushed,
+                                  s_builder.page + HEADER_SIZE + s_flushed, len);
+    if (err != ESP_OK)
+        ESP_LOGW(TAG, "Appending to page %" PRIu32 " failed: %s", s_seq, esp_err_to_name(err));
+    s_flushed = bytes;
+}
+
+static void collect(int32_t *values)
+{
+    portENTER_CRITICAL(&s_sensor_lock);
+    for (int slot = 0; slot < METRICS_SENSORS; slot++)
+    {
+        values[METRICS_FIELD_sensor_0 + slot] =
+            s_sensor_count[slot] ? (int32_t)(s_sensor_sum[slot] / s_sensor_count[slot]) : -1;
+        s_sensor_sum[slot] = 0;
+        s_sensor_count[slot] = 0;
+    }
+    portEXIT_CRITICAL(&s_sensor_lock);
+
+    values[METRICS_FIELD_level_1] = lights_last_level(1);
+    values[METRICS_FIELD_level_2] = lights_last_level(2);
+
+    lamp_state_t lamps[MAX_LAMPS];
+    int n = lamp_state_list(lamps, MAX_LAMPS);
+    uint32_t sent = 0, failed = 0, confirm_us = 0;
+    int confirming = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sent += lamps[i].sent;
+        failed += lamps[i].failed;
+        if (lamps[i].confirms)
+        {
+            confirm_us += lamps[i].confirm_ema_us;
+            confirming++;
+        }
+    }
+    values[METRICS_FIELD_commands] = (int32_t)(sent - s_last_sent);
+    values[METRICS_FIELD_failures] = (int32_t)(failed - s_last_failed);
+    values[METRICS_FIELD_confirm_ms] = confirming ? (int32_t)(confirm_us / confirming / 1000) : 0;
+    s_last_sent = sent;
+    s_last_failed = failed;
+}
+
+static void metrics_task(void *pvParameters)
+{
+    while (1)
+    {
+        // Wake just after each minute of the RTC clock
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        int64_t wait_ms = (METRICS_PERIOD_S - tv.tv_sec % METRICS_PERIOD_S) * 1000LL - tv.tv_usec / 1000;
+        vTaskDelay(pdMS_TO_TICKS(wait_ms) + 1);
+
+        // The record is for the minute that just ended
+        gettimeofday(&tv, NULL);
+        uint32_t minute = (uint32_t)(tv.tv_sec / METRICS_PERIOD_S) - 1;
+        int32_t values[METRICS_FIELD_COUNT];
+        collect(values);
+
+        xSemaphoreTake(s_mutex, portMAX_DELAY);
+        append_record(minute, values);
+        xSemaphoreGive(s_mutex);
+    }
+}
+
+esp_err_t metrics_store_init(void)
+{
+    s_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, METRICS_PARTITION_SUBTYPE,
+                                           METRICS_PARTITION_LABEL);
+    if (s_partition == NULL)
+    {
+        ESP_LOGW(TAG, "No \"%s\" partition, metrics are not kept", METRICS_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_sectors = s_partition->size / METRICS_PAGE_SIZE;
+    s_mutex = xSemaphoreCreateMutex();
+
+    // Carry on after the newest page; its boot number tells this boot's records apart.
+    // A page still open when the power went is closed around the records it has.
+    bool found = false, open = false;
+    uint32_t newest_sector = 0, newest_seq = 0, newest_boot = 0;
+    for (uint32_t sector = 0; sector < s_sectors; sector++)
+    {
+        bool closed = read_page(sector);
+        const metrics_page_header_t *header = metrics_page_header(s_page_buf);
+        if (!closed && (header->magic != 0xFFFFFFFFu || header->seq == 0xFFFFFFFFu))
+            continue;
+        if (!found || header->seq > newest_seq)
+        {
+            newest_sector = sector;
+            newest_seq = header->seq;
+            open = !closed;
+        }
+        if (!found || header->boot > newest_boot)
+            newest_boot = header->boot;
+        found = true;
+    }
+    if (open && esp_partition_read(s_partition, newest_sector * METRICS_PAGE_SIZE, s_page_buf,
+                                   METRICS_PAGE_SIZE) == ESP_OK)
+    {
+        int records = metrics_page_recover(s_page_buf, METRICS_PAGE_SIZE);
+        if (records > 0 &&
+            esp_partition_write(s_partition, newest_sector * METRICS_PAGE_SIZE, s_page_buf, HEADER_SIZE) == ESP_OK)
+            ESP_LOGI(TAG, "Closed page %" PRIu32 " of boot %" PRIu32 " with %d records", newest_seq,
+                     metrics_page_header(s_page_buf)->boot, records);
+    }
+    s_sector = found ? (newest_sector + 1) % s_sectors : 0;
+    s_seq = found ? newest_seq + 1 : 0;
+    s_boot = found ? newest_boot + 1 : 0;
+    open_page();
+
+    // Counters the lamp mirror had before we started are not this boot's first minute
+    lamp_state_t lamps[MAX_LAMPS];
+    int n = lamp_state_list(lamps, MAX_LAMPS);
+    for (int i = 0; i < n; i++)
+    {
+        s_last_sent += lamps[i].sent;
+        s_last_failed += lamps[i].failed;
+    }
+
+    xTaskCreate(metrics_task, "metrics_task", 4096, NULL, 2, NULL);
+    ESP_LOGI(TAG, "%" PRIu32 " sectors, boot %" PRIu32 ", page %" PRIu32 " open in sector %" PRIu32, s_sectors,
+             s_boot, s_seq, s_sector);
+    return ESP_OK;
+}
+
+void metrics_store_sensor_sample(int slot, uint32_t average)
+{
+    if (slot >= METRICS_SENSORS)
+        return;
+    portENTER_CRITICAL(&s_sensor_lock);
+    s_sensor_sum[slot] += average;
+    s_sensor_count[slot]++;
+    portEXIT_CRITICAL(&s_sensor_lock);
+}
+
+esp_err_t metrics_store_flush(void)
+{
+    if (s_partition == NULL)
+        return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    esp_err_t err = close_page();
+    xSemaphoreGive(s_mutex);
+    return err;
+}
+
+static bool overlaps(const metrics_page_header_t *header, uint32_t from_minute, uint32_t to_minute)
+{
+    return header->records > 0 && header->first_minute <= to_minute && header->last_minute >= from_minute;
+}
+
+/* Call with s_mutex held. Oldest first; the open page last, from its RAM copy. Returns the pages sent (or that would be). */
+static int send_pages(uint32_t from_minute, uint32_t to_minute, bool send)
+{
+    int pages = 0;
+    for (uint32_t i = 0; i < s_sectors; i++)
+    {
+        uint32_t sector = (s_sector + 1 + i) % s_sectors;
+        if (!read_page(sector) || !overlaps(metrics_page_header(s_page_buf), from_minute, to_minute))
+            continue;
+        if (send)
+            uart_write_bytes(METRICS_UART_NUM, s_page_buf, HEADER_SIZE + metrics_page_header(s_page_buf)->bytes);
+        pages++;
+    }
+
+    const metrics_page_header_t *header = metrics_page_header(s_builder.page);
+    if (overlaps(header, from_minute, to_minute))
+    {
+        if (send)
+        {
+            metrics_page_finish(&s_builder);
+            uart_write_bytes(METRICS_UART_NUM, s_builder.page, HEADER_SIZE + header->bytes);
+        }
+        pages++;
+    }
+    return pages;
+}
+
+esp_err_t metrics_store_dump(uint32_t from_minute, uint32_t to_minute)
+{
+    if (s_partition == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    int pages = send_pages(from_minute, to_minute, false);
+    printf("METRICS BEGIN %d ", pages);
+    for (int i = 0; i < METRICS_FIELD_COUNT; i++)
+        printf("%s%s", i ? "," : "", s_field_names[i]);
+    printf("\n");
+    fflush(stdout);
+
+    send_pages(from_minute, to_minute, true);
+    uart_wait_tx_done(METRICS_UART_NUM, pdMS_TO_TICKS(1000));
+    xSemaphoreGive(s_mutex);
+
+    printf("\nMETRICS END %d\n", pages);
+    return ESP_OK;
+}
+
+void metrics_store_print_status(void)
+{
+    if (s_partition == NULL)
+    {
+        printf("No \"%s\" partition\n", METRICS_PARTITION_LABEL);
+        return;
+    }
+
+    int pages = 0;
+    uint32_t records = 0, bytes = 0;
+    uint32_t oldest_minute = 0, oldest_boot = 0;
+    xSemaphoreTake(s_mutex, portMAX_DELAY);
+    for (uint32_t i = 0; i < s_sectors; i++)
+    {
+        if (!read_page((s_sector + 1 + i) % s_sectors))
+            continue;
+        const metrics_page_header_t *header = metrics_page_header(s_page_buf);
+        if (pages++ == 0)
+        {
+            oldest_minute = header->first_minute;
+            oldest_boot = header->boot;
+        }
+        records += header->records;
+        bytes += header->bytes;
+    }
+    metrics_page_header_t current = *metrics_page_header(s_builder.page);
+    xSemaphoreGive(s_mutex);
+
+    printf("Partition \"%s\": %" PRIu32 " KB at 0x%" PRIx32 ", %d of %" PRIu32 " pages in use, %" PRIu32
+           " written this boot\n",
+           METRICS_PARTITION_LABEL, (uint32_t)(s_partition->size / 1024), (uint32_t)s_partition->address, pages,
+           s_sectors, s_pages_written);
+    printf("Boot %" PRIu32 ", open page: %u records, %u bytes\n", s_boot, current.records, current.bytes);
+    if (pages > 0)
+    {
+        float per_record = (float)bytes / records;
+        printf("Stored: %" PRIu32 " records from minute %" PRIu32 " (boot %" PRIu32 "), %.1f bytes each, "
+               "about %.0f days when full\n",
+               records, oldest_minute, oldest_boot, per_record,
+               s_sectors * (METRICS_PAGE_SIZE - HEADER_SIZE) / per_record * METRICS_PERIOD_S / 86400);
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Per-minute metrics kept in the "metrics" data partition as a ring of
+ * metrics_codec pages, one per flash sector. Each record is appended to
+ * the open page's sector as it is made, into erased flash, and the header
+ * is completed when the page fills, so each sector is erased once per trip
+ * round the ring and a power cut loses no finished minute: at boot a page
+ * left open is closed around the records it holds. At about 8 bytes a
+ * minute 256 KB hold three weeks. Minutes come from the RTC clock (time
+ * since power-on unless it was set) and every page carries the boot it was
+ * written in.
+ */
+#define METRICS_PARTITION_LABEL   "metrics"
+#define METRICS_PARTITION_SUBTYPE 0x40
+#define METRICS_PERIOD_S          60
+
+#define METRICS_FIELD_LIST(X) \
+    X(sensor_0)     /* mean sensor average over the minute, -1 if none */ \
+    X(sensor_1)     \
+    X(level_1)      /* last level sent to the lamp */ \
+    X(level_2)      \
+    X(commands)     /* level frames sent during the minute */ \
+    X(failures)     /* of which the confirm failed */ \
+    X(confirm_ms)   /* smoothed APS confirm round trip, mean of the lamps */
+
+#define METRICS_FIELD_ENUM(name) METRICS_FIELD_##name,
+typedef enum {
+    METRICS_FIELD_LIST(METRICS_FIELD_ENUM)
+    METRICS_FIELD_COUNT
+} metrics_field_t;
+#undef METRICS_FIELD_ENUM
+
+/**
+ * @brief Find the partition, close a page left open, open one after the
+ *        newest page and start the collector.
+ */
+esp_err_t metrics_store_init(void);
+
+/**
+ * @brief Sensor task: one published average of sensor `slot`.
+ */
+void metrics_store_sensor_sample(int slot, uint32_t average);
+
+/**
+ * @brief Close the partly filled page now and open the next sector (costs
+ *        the rest of its sector; the records are in flash already).
+ */
+esp_err_t metrics_store_flush(void);
+
+/**
+ * @brief Stream the pages overlapping [from_minute, to_minute] over the console UART.
+ *
+ * Framing: a "METRICS BEGIN <pages> <field,...>" line, then every page as
+ * its header and payload in one write (the magic and CRC let the reader
+ * skip log lines that slip in between), then "METRICS END <pages>".
+ * tools/metrics_dump.py reads it.
+ */
+esp_err_t metrics_store_dump(uint32_t from_minute, uint32_t to_minute);
+
+/**
+ * @brief Print partition use, the span of minutes stored and the bytes per record.
+ */
+void metrics_store_print_status(void);
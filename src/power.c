@@ -0,0 +1,231 @@
+#include "power.h"
+#include <stdio.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_pm.h"
+#include "esp_timer.h"
+#include "esp_sleep.h"
+#include "driver/uart.h"
+#include "app_config.h"
+
+static const char *TAG = "POWER";
+
+static const char *s_mode_names[POWER_MODE_COUNT] = {
+    [POWER_MODE_OFF] = "off",
+    [POWER_MODE_DFS] = "dfs",
+    [POWER_MODE_LIGHT_SLEEP] = "sleep",
+};
+
+static power_mode_t s_mode = POWER_MODE_OFF;
+static esp_pm_lock_handle_t s_busy_lock;
+
+static portMUX_TYPE s_stats_lock = portMUX_INITIALIZER_UNLOCKED;
+static int s_busy_depth;
+static int64_t s_busy_since_us;
+static int64_t s_busy_total_us;
+static int64_t s_sleep_total_us;
+static uint32_t s_sleep_count;
+static int64_t s_stats_since_us;
+
+/* Runs on the way out of every automatic light sleep, interrupts still masked */
+static IRAM_ATTR esp_err_t light_sleep_exit_cb(int64_t sleep_time_us, void *arg)
+{
+    portENTER_CRITICAL_ISR(&s_stats_lock);
+    s_sleep_total_us += sleep_time_us;
+    s_sleep_count++;
+    portEXIT_CRITICAL_ISR(&s_stats_lock);
+    return ESP_OK;
+}
+
+static void reset_stats(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_stats_lock);
+    s_busy_total_us = 0;
+    s_busy_since_us = now;
+    s_sleep_total_us = 0;
+    s_sleep_count = 0;
+    s_stats_since_us = now;
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+static esp_err_t apply_mode(power_mode_t mode)
+{
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = POWER_MAX_FREQ_MHZ,
+        .min_freq_mhz = (mode == POWER_MODE_OFF) ? POWER_MAX_FREQ_MHZ : POWER_MIN_FREQ_MHZ,
+        .light_sleep_enable = (mode == POWER_MODE_LIGHT_SLEEP),
+    };
+    esp_err_t err = esp_pm_configure(&pm_config);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_pm_configure failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (mode == POWER_MODE_LIGHT_SLEEP)
+    {
+        // Let console input wake the chip (the first few characters are lost)
+        uart_set_wakeup_threshold(CONFIG_ESP_CONSOLE_UART_NUM, 3);
+        esp_sleep_enable_uart_wakeup(CONFIG_ESP_CONSOLE_UART_NUM);
+    }
+
+    s_mode = mode;
+    reset_stats();
+    return ESP_OK;
+}
+
+void power_init(void)
+{
+    ESP_ERROR_CHECK(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "busy", &s_busy_lock));
+
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = light_sleep_exit_cb,
+    };
+    ESP_ERROR_CHECK(esp_pm_light_sleep_register_cbs(&cbs));
+
+    uint8_t mode = POWER_MODE_OFF;
+    load_power_mode_from_nvs(&mode);
+    apply_mode(mode < POWER_MODE_COUNT ? (power_mode_t)mode : POWER_MODE_OFF);
+}
+
+esp_err_t power_set_mode(power_mode_t mode)
+{
+    if (mode >= POWER_MODE_COUNT)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = apply_mode(mode);
+    if (err == ESP_OK)
+    {
+        err = save_power_mode_to_nvs(mode);
+    }
+    return err;
+}
+
+power_mode_t power_get_mode(void)
+{
+    return s_mode;
+}
+
+const char *power_mode_name(power_mode_t mode)
+{
+    return mode < POWER_MODE_COUNT ? s_mode_names[mode] : "?";
+}
+
+void power_busy_begin(void)
+{
+    esp_pm_lock_acquire(s_busy_lock);
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_stats_lock);
+    if (s_busy_depth++ == 0)
+    {
+        s_busy_since_us = now;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+}
+
+void power_busy_end(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_stats_lock);
+    if (s_busy_depth > 0 && --s_busy_depth == 0)
+    {
+        s_busy_total_us += now - s_busy_since_us;
+    }
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    esp_pm_lock_release(s_busy_lock);
+}
+
+typedef struct {
+    TaskHandle_t task;
+    int64_t fired_us;
+} wake_probe_t;
+
+static void wake_probe_cb(void *arg)
+{
+    wake_probe_t *probe = arg;
+    probe->fired_us = esp_timer_get_time();
+    xTaskNotifyGive(probe->task);
+}
+
+void power_measure_wake_latency(int samples, int period_ms)
+{
+    if (samples <= 0)
+        samples = 20;
+    if (period_ms <= 0)
+        period_ms = 100;
+
+    wake_probe_t probe = {.task = xTaskGetCurrentTaskHandle()};
+    esp_timer_create_args_t args = {
+        .callback = wake_probe_cb,
+        .arg = &probe,
+        .name = "wake_probe",
+    };
+    esp_timer_handle_t timer;
+    ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
+
+    int64_t timer_sum = 0, task_sum = 0, task_min = INT64_MAX, task_max = 0;
+    int done = 0;
+    for (int i = 0; i < samples; i++)
+    {
+        int64_t due = esp_timer_get_time() + period_ms * 1000;
+        esp_timer_start_once(timer, period_ms * 1000);
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(2 * period_ms + 100)) == 0)
+        {
+            continue;
+        }
+        int64_t task_latency = esp_timer_get_time() - due;
+        timer_sum += probe.fired_us - due;
+        task_sum += task_latency;
+        if (task_latency < task_min)
+            task_min = task_latency;
+        if (task_latency > task_max)
+            task_max = task_latency;
+        done++;
+    }
+    esp_timer_stop(timer);
+    esp_timer_delete(timer);
+
+    if (done == 0)
+    {
+        printf("No wake-ups measured\n");
+        return;
+    }
+    printf("Mode %s, %d wake-ups after %d ms idle\n", power_mode_name(s_mode), done, period_ms);
+    printf("Timer callback late by %" PRId64 " us on average\n", timer_sum / done);
+    printf("Task running after min %" PRId64 " / avg %" PRId64 " / max %" PRId64 " us\n",
+           task_min, task_sum / done, task_max);
+}
+
+void power_print_stats(void)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_stats_lock);
+    int64_t total_us = now - s_stats_since_us;
+    int64_t busy_us = s_busy_total_us + (s_busy_depth > 0 ? now - s_busy_since_us : 0);
+    int64_t sleep_us = s_sleep_total_us;
+    uint32_t sleep_count = s_sleep_count;
+    portEXIT_CRITICAL(&s_stats_lock);
+
+    int64_t idle_us = total_us - busy_us - sleep_us;
+    if (idle_us < 0)
+        idle_us = 0;
+    if (total_us <= 0)
+        total_us = 1;
+
+    // Without DFS the CPU idles at full speed
+    float idle_ma = (s_mode == POWER_MODE_OFF) ? POWER_EST_ACTIVE_MA : POWER_EST_IDLE_MA;
+    float avg_ma = (busy_us * POWER_EST_ACTIVE_MA + idle_us * idle_ma + sleep_us * POWER_EST_SLEEP_MA) / total_us;
+
+    printf("Mode: %s, over the last %" PRId64 " s\n", power_mode_name(s_mode), total_us / 1000000);
+    printf("  busy (%d MHz):  %5.1f%%\n", POWER_MAX_FREQ_MHZ, 100.0f * busy_us / total_us);
+    printf("  idle:           %5.1f%%\n", 100.0f * idle_us / total_us);
+    printf("  light sleep:    %5.1f%% (%" PRIu32 " times)\n", 100.0f * sleep_us / total_us, sleep_count);
+    printf("  estimated average current: %.1f mA\n", avg_ma);
+    esp_pm_dump_locks(stdout);
+}
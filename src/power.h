@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/**
+ * @brief Power management modes.
+ *
+ * OFF keeps the CPU at full speed (the old behaviour). DFS drops to
+ * POWER_MIN_FREQ_MHZ whenever nothing holds a busy lock. LIGHT_SLEEP adds
+ * automatic light sleep on top; it only happens when no driver (the radio in
+ * particular) holds a no-sleep lock, and `pm stats` shows how much it did.
+ */
+typedef enum {
+    POWER_MODE_OFF,
+    POWER_MODE_DFS,
+    POWER_MODE_LIGHT_SLEEP,
+    POWER_MODE_COUNT
+} power_mode_t;
+
+#define POWER_MAX_FREQ_MHZ 160
+#define POWER_MIN_FREQ_MHZ 40
+
+/* Typical ESP32-C6 supply current with the 802.15.4 receiver on, used for the
+   estimate in `pm stats`. Calibrate against an external meter before sizing a supply. */
+#define POWER_EST_ACTIVE_MA 82.0f  /* 160 MHz */
+#define POWER_EST_IDLE_MA   68.0f  /* 40 MHz, waiting */
+#define POWER_EST_SLEEP_MA  0.2f   /* light sleep */
+
+/**
+ * @brief Create the locks and apply the mode stored in NVS.
+ */
+void power_init(void);
+
+esp_err_t power_set_mode(power_mode_t mode);
+power_mode_t power_get_mode(void);
+const char *power_mode_name(power_mode_t mode);
+
+/**
+ * @brief Hold the CPU at full speed around a burst of work (nestable, any task).
+ */
+void power_busy_begin(void);
+void power_busy_end(void);
+
+/**
+ * @brief Time `samples` timer wake-ups `period_ms` apart and print the latency.
+ */
+void power_measure_wake_latency(int samples, int period_ms);
+
+/**
+ * @brief Print time at full speed / idle / asleep, estimated current and the PM lock table.
+ */
+void power_print_stats(void);
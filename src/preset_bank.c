@@ -0,0 +1,189 @@
+#include "preset_bank.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "nvs.h"
+#include "app_config.h"
+#include "light_control.h"
+
+static const char *TAG = "PRESET_BANK";
+
+/* One slot at a time; too big for the console task's stack */
+static preset_t s_preset;
+
+static void slot_key(int slot, char *key, size_t size)
+{
+    snprintf(key, size, "preset%d", slot);
+}
+
+static void params_from_config(preset_params_t *p)
+{
+    p->offset_1 = g_light_config.offset_1;
+    p->offset_2 = g_light_config.offset_2;
+    p->level_min = g_light_config.level_min;
+    p->level_max = g_light_config.level_max;
+    p->on_time = g_light_config.on_time;
+    p->off_time = g_light_config.off_time;
+    p->transition_time = g_light_config.transition_time;
+    p->gamma_mode = g_light_config.gamma_mode;
+    p->gamma_pow_value = g_light_config.gamma_pow_value;
+    p->gamma_pow_scale = g_light_config.gamma_pow_scale;
+    p->gamma_log_value = g_light_config.gamma_log_value;
+    p->curve_type = g_light_config.curve_type;
+    p->step_table_size = g_light_config.step_table_size;
+}
+
+static void params_to_config(const preset_params_t *p)
+{
+    g_light_config.offset_1 = p->offset_1;
+    g_light_config.offset_2 = p->offset_2;
+    g_light_config.level_min = p->level_min;
+    g_light_config.level_max = p->level_max;
+    g_light_config.on_time = p->on_time;
+    g_light_config.off_time = p->off_time;
+    g_light_config.transition_time = p->transition_time;
+    g_light_config.gamma_mode = p->gamma_mode;
+    g_light_config.gamma_pow_value = p->gamma_pow_value;
+    g_light_config.gamma_pow_scale = p->gamma_pow_scale;
+    g_light_config.gamma_log_value = p->gamma_log_value;
+    g_light_config.curve_type = p->curve_type;
+    g_light_config.step_table_size = p->step_table_size;
+}
+
+static esp_err_t load_from_nvs(int slot, preset_t *out)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+    char key[16];
+    slot_key(slot, key, sizeof(key));
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs_handle)) == ESP_OK)
+    {
+        size_t size = sizeof(preset_t);
+        if ((err = nvs_get_blob(nvs_handle, key, out, &size)) == ESP_OK)
+        {
+            // Only as many table entries as the preset has are stored
+            if (out->segments < 2 || out->segments > MAX_SEGMENTS || size != PRESET_STORED_SIZE(out->segments))
+                err = ESP_ERR_INVALID_SIZE;
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t preset_bank_get(int slot, preset_t *out)
+{
+    if (slot < 0 || slot >= PRESET_SLOTS)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t err = load_from_nvs(slot, out);
+    if (err == ESP_OK)
+        return ESP_OK;
+    if (err != ESP_ERR_NVS_NOT_FOUND && err != ESP_ERR_NVS_NOT_INITIALIZED)
+        ESP_LOGW(TAG, "Preset %d in NVS is unreadable (%s)", slot, esp_err_to_name(err));
+
+    if (slot < PRESET_DEFAULT_COUNT)
+    {
+        memcpy(out, &g_preset_defaults[slot], PRESET_STORED_SIZE(g_preset_defaults[slot].segments));
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t preset_bank_save(int slot, const char *name)
+{
+    if (slot < 0 || slot >= PRESET_SLOTS || strlen(name) >= PRESET_NAME_LEN)
+        return ESP_ERR_INVALID_ARG;
+
+    preset_t *p = &s_preset;
+    memset(p, 0, sizeof(*p));
+    strcpy(p->params.name, name);
+    params_from_config(&p->params);
+
+    int segments = p->params.step_table_size;
+    if (segments < 2)
+        segments = 2;
+    if (segments > MAX_SEGMENTS)
+        segments = MAX_SEGMENTS;
+    fade_curve_params_t curve = {
+        .level_min = g_light_config.level_min,
+        .level_max = g_light_config.level_max,
+        .curve_type = g_light_config.curve_type,
+        .gamma_mode = g_light_config.gamma_mode,
+        .gamma_pow_value = g_light_config.gamma_pow_value,
+        .gamma_pow_scale = g_light_config.gamma_pow_scale,
+        .gamma_log_value = g_light_config.gamma_log_value,
+    };
+    fade_curve_build_table(&curve, segments, p->table);
+    p->segments = segments;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+    char key[16];
+    slot_key(slot, key, sizeof(key));
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle)) == ESP_OK)
+    {
+        if ((err = nvs_set_blob(nvs_handle, key, p, PRESET_STORED_SIZE(segments))) == ESP_OK)
+        {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t preset_bank_erase(int slot)
+{
+    if (slot < 0 || slot >= PRESET_SLOTS)
+        return ESP_ERR_INVALID_ARG;
+
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+    char key[16];
+    slot_key(slot, key, sizeof(key));
+
+    if ((err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs_handle)) == ESP_OK)
+    {
+        if ((err = nvs_erase_key(nvs_handle, key)) == ESP_OK)
+        {
+            err = nvs_commit(nvs_handle);
+        }
+        nvs_close(nvs_handle);
+    }
+
+    return err;
+}
+
+esp_err_t preset_bank_apply(int slot)
+{
+    esp_err_t err = preset_bank_get(slot, &s_preset);
+    if (err != ESP_OK)
+        return err;
+
+    params_to_config(&s_preset.params);
+    lights_apply_table(s_preset.table, s_preset.segments);
+    ESP_LOGI(TAG, "Running preset %d \"%s\"", slot, s_preset.params.name);
+    return ESP_OK;
+}
+
+void preset_bank_print(void)
+{
+    static const char *gamma_names[GAMMA_MODE_COUNT] = {"linear", "exp", "log"};
+    static const char *curve_names[CURVE_TYPE_COUNT] = {"linear", "sine", "quad", "cubic", "quartic"};
+
+    printf("slot name             source   levels   fade_s gamma  curve   segments\n");
+    for (int slot = 0; slot < PRESET_SLOTS; slot++)
+    {
+        bool saved = load_from_nvs(slot, &s_preset) == ESP_OK;
+        if (!saved && preset_bank_get(slot, &s_preset) != ESP_OK)
+            continue;
+        const preset_params_t *p = &s_preset.params;
+        printf("%4d %-16s %-8s %3d..%-3d %6.1f %-6s %-7s %8d\n", slot, p->name, saved ? "nvs" : "built-in",
+               p->level_min, p->level_max, p->transition_time,
+               p->gamma_mode < GAMMA_MODE_COUNT ? gamma_names[p->gamma_mode] : "?",
+               p->curve_type < CURVE_TYPE_COUNT ? curve_names[p->curve_type] : "?", s_preset.segments);
+    }
+}
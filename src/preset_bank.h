@@ -0,0 +1,36 @@
+#pragma once
+
+#include "esp_err.h"
+#include "preset_defs.h"
+
+/*
+ * Numbered preset slots. A slot saved with preset_bank_save() lives in NVS
+ * ("preset<n>") with its fade table; an unsaved slot below
+ * PRESET_DEFAULT_COUNT falls back to the built-in preset of that number.
+ */
+#define PRESET_SLOTS 8
+
+/**
+ * @brief Read a slot (NVS first, then the built-in default).
+ *
+ * @return ESP_ERR_NOT_FOUND if the slot is empty
+ */
+esp_err_t preset_bank_get(int slot, preset_t *out);
+
+/**
+ * @brief Store g_light_config and its fade table, computed now, in a slot.
+ */
+esp_err_t preset_bank_save(int slot, const char *name);
+
+/**
+ * @brief Remove a saved slot, bringing back its built-in default if it has one.
+ */
+esp_err_t preset_bank_erase(int slot);
+
+/**
+ * @brief Make a slot the running fade: copies its parameters into
+ *        g_light_config and switches the fade tasks to its table.
+ */
+esp_err_t preset_bank_apply(int slot);
+
+void preset_bank_print(void);
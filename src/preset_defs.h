@@ -0,0 +1,62 @@
+#pragma once
+
+/*
+ * Fade presets: the schedule parameters plus the fade table computed from
+ * them, so switching presets needs no curve math. Shared by the firmware
+ * (preset_bank.c) and the build-time generator tools/preset_gen.c, which
+ * turns PRESET_DEFAULT_LIST into the rodata table g_preset_defaults.
+ * Plain C with no ESP-IDF dependencies.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fade_curve.h"
+
+#define PRESET_NAME_LEN 16
+
+typedef struct {
+    char name[PRESET_NAME_LEN];
+    double offset_1;
+    double offset_2;
+    uint8_t level_min;
+    uint8_t level_max;
+    double on_time;
+    double off_time;
+    double transition_time;
+    gamma_mode_t gamma_mode;
+    double gamma_pow_value;
+    double gamma_pow_scale;
+    double gamma_log_value;
+    curve_type_t curve_type;
+    uint16_t step_table_size;
+} preset_params_t;
+
+/**
+ * @brief A preset with its table. Only the first `segments` entries of
+ *        `table` are stored (PRESET_STORED_SIZE).
+ */
+typedef struct {
+    preset_params_t params;
+    uint16_t segments;
+    fade_segment_t table[MAX_SEGMENTS];
+} preset_t;
+
+#define PRESET_STORED_SIZE(segments) (offsetof(preset_t, table) + (segments) * sizeof(fade_segment_t))
+
+/*
+ * Built-in presets. Columns: name, offset_1, offset_2, level_min, level_max,
+ * on_time, off_time, transition_time, gamma_mode, gamma_pow_value,
+ * gamma_pow_scale, gamma_log_value, curve_type, step_table_size.
+ * The first one matches g_light_config_default.
+ */
+#define PRESET_DEFAULT_LIST(X)                                                                                   \
+    X("default",   0, 0.5,  0, 255, 0.0, 0.0, 10.0, GAMMA_MODE_LINEAR,      2.2, 1.1, 5,  CURVE_TYPE_LINEAR, 30)    \
+    X("breathe",   0, 0.5,  5, 255, 0.2, 0.5,  4.0, GAMMA_MODE_EXPONENTIAL, 2.2, 1.0, 5,  CURVE_TYPE_SINE,   40)    \
+    X("slow_wave", 0, 0.5, 10, 220, 0.0, 0.0, 60.0, GAMMA_MODE_LOGARITHMIC, 2.2, 1.0, 8,  CURVE_TYPE_SINE,   60)    \
+    X("pulse",     0, 0.0,  0, 255, 0.5, 1.0,  1.0, GAMMA_MODE_EXPONENTIAL, 2.8, 1.0, 5,  CURVE_TYPE_CUBIC,  12)    \
+    X("candle",    0, 0.25, 60, 180, 0.0, 0.0, 2.5, GAMMA_MODE_LINEAR,      2.2, 1.0, 5,  CURVE_TYPE_QUADRATIC, 8)
+
+#define PRESET_COUNT_ONE(...) +1
+#define PRESET_DEFAULT_COUNT (0 PRESET_DEFAULT_LIST(PRESET_COUNT_ONE))
+
+extern const preset_t g_preset_defaults[PRESET_DEFAULT_COUNT];
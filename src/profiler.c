@@ -0,0 +1,232 @@
+#include "profiler.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "driver/gptimer.h"
+#include "riscv/csr.h"
+
+static const char *TAG = "PROFILER";
+
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+} profiler_bucket_t;
+
+static profiler_bucket_t s_buckets[PROFILER_BUCKETS];
+static volatile uint32_t s_samples;
+static volatile uint32_t s_dropped;
+static gptimer_handle_t s_timer;
+static bool s_running;
+static uint32_t s_period_us;
+
+/* ---- top ---- */
+
+typedef struct {
+    const char *name;
+    UBaseType_t priority;
+    uint32_t runtime;
+} task_runtime_t;
+
+static int compare_runtime_desc(const void *a, const void *b)
+{
+    const task_runtime_t *ta = a, *tb = b;
+    return (ta->runtime < tb->runtime) - (ta->runtime > tb->runtime);
+}
+
+void profiler_top(uint32_t window_ms, int repeat)
+{
+    if (window_ms == 0)
+        window_ms = 1000;
+    if (repeat <= 0)
+        repeat = 1;
+
+    // Room for a few tasks created while we wait
+    int max = uxTaskGetNumberOfTasks() + 4;
+    TaskStatus_t *before = malloc(max * sizeof(TaskStatus_t));
+    TaskStatus_t *after = malloc(max * sizeof(TaskStatus_t));
+    task_runtime_t *rows = malloc(max * sizeof(task_runtime_t));
+    if (before == NULL || after == NULL || rows == NULL)
+    {
+        ESP_LOGE(TAG, "Out of memory");
+        goto out;
+    }
+
+    uint32_t total_before, total_after;
+    int n_before = uxTaskGetSystemState(before, max, &total_before);
+
+    for (int r = 0; r < repeat; r++)
+    {
+        vTaskDelay(pdMS_TO_TICKS(window_ms));
+        int n_after = uxTaskGetSystemState(after, max, &total_after);
+        uint32_t total = total_after - total_before;
+        if (total == 0)
+            total = 1;
+
+        // Match by handle; tasks that did not exist before count from zero
+        int rows_n = 0;
+        for (int i = 0; i < n_after; i++)
+        {
+            uint32_t start = 0;
+            for (int j = 0; j < n_before; j++)
+            {
+                if (before[j].xHandle == after[i].xHandle)
+                {
+                    start = before[j].ulRunTimeCounter;
+                    break;
+                }
+            }
+            rows[rows_n++] = (task_runtime_t){
+                .name = after[i].pcTaskName,
+                .priority = after[i].uxCurrentPriority,
+                .runtime = after[i].ulRunTimeCounter - start,
+            };
+        }
+        qsort(rows, rows_n, sizeof(task_runtime_t), compare_runtime_desc);
+
+        printf("TOP %" PRIu32 " ms window\n", window_ms);
+        printf("%-16s %4s %10s %6s\n", "task", "prio", "us", "cpu%");
+        for (int i = 0; i < rows_n; i++)
+        {
+            printf("%-16s %4u %10" PRIu32 " %6.2f\n", rows[i].name, (unsigned)rows[i].priority,
+                   rows[i].runtime, 100.0f * rows[i].runtime / total);
+        }
+
+        // Slide the window: this snapshot is the start of the next one
+        memcpy(before, after, n_after * sizeof(TaskStatus_t));
+        n_before = n_after;
+        total_before = total_after;
+    }
+
+out:
+    free(before);
+    free(after);
+    free(rows);
+}
+
+/* ---- PC sampler ---- */
+
+static bool IRAM_ATTR profiler_alarm_cb(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    // mepc still holds the PC this interrupt was taken at
+    uint32_t pc = RV_READ_CSR(mepc);
+    uint32_t slot = (pc >> 1) * 2654435761u % PROFILER_BUCKETS;
+
+    // Open addressing with a short probe; give up rather than spend time in the ISR
+    for (int probe = 0; probe < 8; probe++)
+    {
+        profiler_bucket_t *b = &s_buckets[(slot + probe) % PROFILER_BUCKETS];
+        if (b->pc == pc)
+        {
+            b->count++;
+            s_samples++;
+            return false;
+        }
+        if (b->pc == 0)
+        {
+            b->pc = pc;
+            b->count = 1;
+            s_samples++;
+            return false;
+        }
+    }
+    s_dropped++;
+    return false;
+}
+
+esp_err_t profiler_start(uint32_t period_us)
+{
+    esp_err_t err;
+
+    if (s_running)
+        return ESP_ERR_INVALID_STATE;
+    if (period_us == 0)
+        period_us = PROFILER_DEFAULT_PERIOD_US;
+
+    if (s_timer == NULL)
+    {
+        gptimer_config_t timer_config = {
+            .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+            .direction = GPTIMER_COUNT_UP,
+            .resolution_hz = 1000 * 1000,
+            .intr_priority = 3, // above the other peripherals, so fewer samples land inside their ISRs
+        };
+        ESP_RETURN_ON_ERROR(gptimer_new_timer(&timer_config, &s_timer), TAG, "timer");
+
+        gptimer_event_callbacks_t cbs = {
+            .on_alarm = profiler_alarm_cb,
+        };
+        ESP_RETURN_ON_ERROR(gptimer_register_event_callbacks(s_timer, &cbs, NULL), TAG, "callbacks");
+        ESP_RETURN_ON_ERROR(gptimer_enable(s_timer), TAG, "enable");
+    }
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = period_us,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    ESP_RETURN_ON_ERROR(gptimer_set_alarm_action(s_timer, &alarm_config), TAG, "alarm");
+    if ((err = gptimer_start(s_timer)) == ESP_OK)
+    {
+        s_running = true;
+        s_period_us = period_us;
+    }
+    return err;
+}
+
+esp_err_t profiler_stop(void)
+{
+    if (!s_running)
+        return ESP_ERR_INVALID_STATE;
+
+    s_running = false;
+    return gptimer_stop(s_timer);
+}
+
+void profiler_clear(void)
+{
+    bool was_running = s_running;
+    if (was_running)
+        profiler_stop();
+
+    memset(s_buckets, 0, sizeof(s_buckets));
+    s_samples = 0;
+    s_dropped = 0;
+
+    if (was_running)
+        profiler_start(s_period_us);
+}
+
+static int compare_count_desc(const void *a, const void *b)
+{
+    const profiler_bucket_t *ba = a, *bb = b;
+    return (ba->count < bb->count) - (ba->count > bb->count);
+}
+
+void profiler_dump(void)
+{
+    if (s_running)
+    {
+        ESP_LOGW(TAG, "Stopping the sampler for the dump");
+        profiler_stop();
+    }
+
+    // Sorting breaks the hash layout, so the histogram starts over afterwards
+    qsort(s_buckets, PROFILER_BUCKETS, sizeof(profiler_bucket_t), compare_count_desc);
+
+    printf("PROF_BEGIN %" PRIu32 " samples %" PRIu32 " dropped\n", s_samples, s_dropped);
+    for (int i = 0; i < PROFILER_BUCKETS && s_buckets[i].count > 0; i++)
+    {
+        printf("PROF 0x%08" PRIx32 " %" PRIu32 "\n", s_buckets[i].pc, s_buckets[i].count);
+    }
+    printf("PROF_END\n");
+
+    memset(s_buckets, 0, sizeof(s_buckets));
+    s_samples = 0;
+    s_dropped = 0;
+}
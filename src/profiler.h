@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+
+#define PROFILER_BUCKETS 1024          /* distinct PCs the sampler can hold */
+#define PROFILER_DEFAULT_PERIOD_US 997 /* prime, so sampling does not lock onto the 100 Hz tick */
+
+/**
+ * @brief Print per-task CPU share over the next `window_ms`, `repeat` times.
+ */
+void profiler_top(uint32_t window_ms, int repeat);
+
+/**
+ * @brief Start sampling the interrupted PC every `period_us` from a timer interrupt.
+ */
+esp_err_t profiler_start(uint32_t period_us);
+
+esp_err_t profiler_stop(void);
+
+/**
+ * @brief Forget all samples.
+ */
+void profiler_clear(void);
+
+/**
+ * @brief Print the histogram as "PROF <pc> <count>" lines, busiest first.
+ *
+ * Feed the output to tools/prof_symbolize.py to map PCs to functions.
+ */
+void profiler_dump(void);
@@ -0,0 +1,121 @@
+#include "scene_plan.h"
+
+/* Where the lamp is at cycle time `t_ms` of its own phase: holds are flat,
+   segments a straight line from the previous table entry to the next */
+static uint8_t level_at(const fade_cycle_t *cycle, const fade_segment_t *table, int segments, uint32_t t_ms)
+{
+    fade_step_t step;
+    fade_curve_step_at(cycle, table, segments, t_ms, &step);
+    if (step.segment < 0)
+        return step.level;
+
+    int from = step.rising ? step.segment - 1 : step.segment + 1;
+    float span = (table[step.segment].fraction_of_fade - table[from].fraction_of_fade) * cycle->fade_ms;
+    if (span < 0)
+        span = -span;
+    if (span < 1 || step.transition_ms >= span)
+        return table[from].level;
+    float left = step.transition_ms / span;
+    return (uint8_t)(table[step.segment].level + (table[from].level - table[step.segment].level) * left + 0.5f);
+}
+
+/* Insert `t` into the sorted set `cuts`; false if it is full */
+static bool add_cut(uint32_t *cuts, int *count, uint32_t t)
+{
+    int i = 0;
+    while (i < *count && cuts[i] < t)
+        i++;
+    if (i < *count && cuts[i] == t)
+        return true;
+    if (*count == SCENE_PLAN_MAX_SLOTS)
+        return false;
+    for (int j = *count; j > i; j--)
+        cuts[j] = cuts[j - 1];
+    cuts[i] = t;
+    (*count)++;
+    return true;
+}
+
+bool scene_plan_build(scene_plan_t *plan, const fade_cycle_t *cycle, const fade_segment_t *table, int segments,
+                      const uint32_t *phase_ms, int lamps)
+{
+    uint32_t length = fade_cycle_length_ms(cycle);
+    if (length == 0 || segments < 2 || lamps < 1 || lamps > SCENE_PLAN_MAX_LAMPS)
+        return false;
+
+    // Every step start of every lamp, in the common cycle time
+    uint32_t cuts[SCENE_PLAN_MAX_SLOTS];
+    int count = 0;
+    for (int lamp = 0; lamp < lamps; lamp++)
+    {
+        uint32_t phase = phase_ms[lamp] % length;
+        uint32_t t_ms = 0;
+        while (t_ms < length)
+        {
+            fade_step_t step;
+            fade_curve_step_at(cycle, table, segments, t_ms, &step);
+            if (!add_cut(cuts, &count, (t_ms + length - phase) % length))
+                return false;
+            if (step.end_ms <= t_ms)
+                break;
+            t_ms = step.end_ms;
+        }
+    }
+
+    plan->cycle_ms = length;
+    plan->lamps = lamps;
+    plan->slots = count;
+    for (int k = 0; k < count; k++)
+    {
+        scene_slot_t *slot = &plan->slot[k];
+        uint32_t end = k + 1 < count ? cuts[k + 1] : cuts[0] + length;
+        slot->start_ms = cuts[k];
+        slot->length_ms = end - cuts[k];
+        for (int lamp = 0; lamp < lamps; lamp++)
+            slot->level[lamp] = level_at(cycle, table, segments, (end + phase_ms[lamp]) % length);
+    }
+
+    // A short slot is only a problem if some lamp has to move in it
+    for (int k = 0; k < count; k++)
+    {
+        const scene_slot_t *prev = &plan->slot[(k + count - 1) % count];
+        if (plan->slot[k].length_ms >= SCENE_PLAN_MIN_SLOT_MS)
+            continue;
+        for (int lamp = 0; lamp < lamps; lamp++)
+        {
+            if (plan->slot[k].level[lamp] != prev->level[lamp])
+                return false;
+        }
+    }
+    return true;
+}
+
+int scene_plan_slot_at(const scene_plan_t *plan, uint32_t t_ms)
+{
+    if (plan->slots == 0)
+        return -1;
+    t_ms %= plan->cycle_ms;
+    // Before the first cut is the tail of the last slot, which wraps round the cycle end
+    int k = plan->slots - 1;
+    while (k > 0 && plan->slot[k].start_ms > t_ms)
+        k--;
+    return plan->slot[0].start_ms > t_ms ? plan->slots - 1 : k;
+}
+
+int scene_plan_stepped_commands(const fade_cycle_t *cycle, const fade_segment_t *table, int segments)
+{
+    uint32_t length = fade_cycle_length_ms(cycle);
+    int commands = 0;
+    uint32_t t_ms = 0;
+    while (t_ms < length)
+    {
+        fade_step_t step;
+        fade_curve_step_at(cycle, table, segments, t_ms, &step);
+        if (step.segment >= 0)
+            commands++;
+        if (step.end_ms <= t_ms)
+            break;
+        t_ms = step.end_ms;
+    }
+    return commands;
+}
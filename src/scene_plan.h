@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ * Scene timeline for driving every lamp with one Recall Scene groupcast per
+ * step. All lamps follow the same table, each at its own phase; the cycle
+ * is cut wherever any lamp starts a new step, and slot k becomes scene k:
+ * per lamp, the level to reach by the end of the slot, with the slot length
+ * as transition time. A lamp whose segment spans a cut gets the interpolated
+ * level there, so its path is unchanged. Plain C with no ESP-IDF
+ * dependencies, so it also builds on the host.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fade_curve.h"
+
+#define SCENE_PLAN_MAX_LAMPS 2
+#define SCENE_PLAN_MAX_SLOTS 16     /* scenes per group that lamps commonly guarantee */
+#define SCENE_PLAN_MIN_SLOT_MS 1000 /* Add Scene carries whole seconds of transition */
+
+typedef struct {
+    uint32_t start_ms;                      // cycle time of the recall
+    uint32_t length_ms;                     // until the next recall, the transition of every lamp
+    uint8_t level[SCENE_PLAN_MAX_LAMPS];    // level each lamp reaches at the end of the slot
+} scene_slot_t;
+
+typedef struct {
+    uint32_t cycle_ms;
+    int lamps;
+    int slots;
+    scene_slot_t slot[SCENE_PLAN_MAX_SLOTS];
+} scene_plan_t;
+
+/**
+ * @brief Cut the cycle for `lamps` lamps, lamp i running `phase_ms[i]` ahead.
+ *
+ * @return false if the cycle is empty, needs more than SCENE_PLAN_MAX_SLOTS
+ *         scenes, or has a lamp change level in a slot shorter than
+ *         SCENE_PLAN_MIN_SLOT_MS, which would round to a jump
+ */
+bool scene_plan_build(scene_plan_t *plan, const fade_cycle_t *cycle, const fade_segment_t *table, int segments,
+                      const uint32_t *phase_ms, int lamps);
+
+/**
+ * @brief Slot covering cycle time `t_ms` (taken modulo the cycle length).
+ */
+int scene_plan_slot_at(const scene_plan_t *plan, uint32_t t_ms);
+
+/**
+ * @brief Level commands one lamp gets per cycle when every step of the table is sent.
+ */
+int scene_plan_stepped_commands(const fade_cycle_t *cycle, const fade_segment_t *table, int segments);
@@ -0,0 +1,199 @@
+#include "segment_stats.h"
+#include <string.h>
+
+void p2_quantile_init(p2_quantile_t *est, float p)
+{
+    memset(est, 0, sizeof(*est));
+    est->p = p;
+    est->dn[1] = p / 2;
+    est->dn[2] = p;
+    est->dn[3] = (1 + p) / 2;
+    est->dn[4] = 1;
+}
+
+static void sort5(float *v, int n)
+{
+    for (int i = 1; i < n; i++)
+    {
+        float x = v[i];
+        int j = i;
+        for (; j > 0 && v[j - 1] > x; j--)
+            v[j] = v[j - 1];
+        v[j] = x;
+    }
+}
+
+static float p2_parabolic(const p2_quantile_t *est, int i, int d)
+{
+    const float *q = est->q;
+    const int32_t *n = est->n;
+    return q[i] + (float)d / (n[i + 1] - n[i - 1]) *
+                      ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+                       (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+void p2_quantile_add(p2_quantile_t *est, float x)
+{
+    float *q = est->q;
+    int32_t *n = est->n;
+
+    if (est->count < 5)
+    {
+        q[est->count++] = x;
+        if (est->count == 5)
+        {
+            sort5(q, 5);
+            for (int i = 0; i < 5; i++)
+                n[i] = i + 1;
+            est->np[0] = 1;
+            est->np[1] = 1 + 2 * est->p;
+            est->np[2] = 1 + 4 * est->p;
+            est->np[3] = 3 + 2 * est->p;
+            est->np[4] = 5;
+        }
+        return;
+    }
+    est->count++;
+
+    // Cell the value falls into; the extreme markers follow min and max
+    int k;
+    if (x < q[0])
+    {
+        q[0] = x;
+        k = 0;
+    }
+    else if (x >= q[4])
+    {
+        q[4] = x;
+        k = 3;
+    }
+    else
+    {
+        for (k = 0; k < 3 && x >= q[k + 1]; k++)
+            ;
+    }
+    for (int i = k + 1; i < 5; i++)
+        n[i]++;
+    for (int i = 0; i < 5; i++)
+        est->np[i] += est->dn[i];
+
+    // Move the middle markers towards their desired positions
+    for (int i = 1; i < 4; i++)
+    {
+        float delta = est->np[i] - n[i];
+        if ((delta >= 1 && n[i + 1] - n[i] > 1) || (delta <= -1 && n[i - 1] - n[i] < -1))
+        {
+            int d = delta > 0 ? 1 : -1;
+            float candidate = p2_parabolic(est, i, d);
+            if (q[i - 1] < candidate && candidate < q[i + 1])
+                q[i] = candidate;
+            else
+                q[i] += d * (q[i + d] - q[i]) / (n[i + d] - n[i]);
+            n[i] += d;
+        }
+    }
+}
+
+float p2_quantile_get(const p2_quantile_t *est)
+{
+    if (est->count >= 5)
+        return est->q[2];
+    if (est->count == 0)
+        return 0;
+
+    float sorted[5];
+    memcpy(sorted, est->q, est->count * sizeof(float));
+    sort5(sorted, est->count);
+    return sorted[(int)((est->count - 1) * est->p + 0.5f)];
+}
+
+void segment_stats_begin(segment_stats_t *s, bool rising, int64_t now_us)
+{
+    memset(s, 0, sizeof(*s));
+    s->rising = rising;
+    s->start_us = now_us;
+    p2_quantile_init(&s->delta_p95, 0.95f);
+}
+
+void segment_stats_add(segment_stats_t *s, uint16_t value, int64_t now_us)
+{
+    double t = (now_us - s->start_us) / 1e6;
+    double y = value;
+
+    if (s->count == 0)
+    {
+        s->min = s->max = value;
+    }
+    else
+    {
+        float delta = value > s->last ? value - s->last : s->last - value;
+        s->abs_delta_sum += delta;
+        p2_quantile_add(&s->delta_p95, delta);
+        if (value < s->min)
+            s->min = value;
+        if (value > s->max)
+            s->max = value;
+    }
+    s->last = value;
+    s->count++;
+    s->sum_t += t;
+    s->sum_tt += t * t;
+    s->sum_y += y;
+    s->sum_ty += t * y;
+}
+
+bool segment_stats_end(const segment_stats_t *s, segment_stats_result_t *out)
+{
+    if (s->count < SEGMENT_STATS_MIN_SAMPLES)
+        return false;
+
+    double n = s->count;
+    double var_t = s->sum_tt - s->sum_t * s->sum_t / n;
+    double slope = var_t > 0 ? (s->sum_ty - s->sum_t * s->sum_y / n) / var_t : 0;
+    if (slope > INT16_MAX)
+        slope = INT16_MAX;
+    if (slope < INT16_MIN)
+        slope = INT16_MIN;
+
+    double delta_mean = s->abs_delta_sum / (s->count - 1);
+    double visibility = delta_mean >= 1 ? 100 * p2_quantile_get(&s->delta_p95) / delta_mean : 0;
+
+    out->samples = s->count > UINT16_MAX ? UINT16_MAX : s->count;
+    out->mean = (uint16_t)(s->sum_y / n + 0.5);
+    out->slope = (int16_t)slope;
+    out->overshoot = s->rising ? s->max - s->last : s->last - s->min;
+    out->visibility = visibility > UINT16_MAX ? UINT16_MAX : (uint16_t)(visibility + 0.5);
+    return true;
+}
+
+void segment_stats_cycle_reset(segment_stats_cycle_t *c, uint32_t cycle)
+{
+    memset(c, 0, sizeof(*c));
+    c->cycle = cycle;
+    c->worst_segment = -1;
+}
+
+void segment_stats_cycle_add(segment_stats_cycle_t *c, int segment, bool rising,
+                             const segment_stats_result_t *result)
+{
+    c->segments++;
+    c->visibility_sum += result->visibility;
+    if (result->visibility > c->visibility_max)
+    {
+        c->visibility_max = result->visibility;
+        c->worst_segment = segment;
+        c->worst_rising = rising;
+    }
+    if (result->overshoot > c->overshoot_max)
+        c->overshoot_max = result->overshoot;
+}
+
+void segment_stats_cycle_skip(segment_stats_cycle_t *c)
+{
+    c->skipped++;
+}
+
+uint16_t segment_stats_cycle_visibility_mean(const segment_stats_cycle_t *c)
+{
+    return c->segments ? c->visibility_sum / c->segments : 0;
+}
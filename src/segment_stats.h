@@ -0,0 +1,86 @@
+#pragma once
+
+/*
+ * Streaming statistics of the sensor reading during one fade segment, in
+ * constant memory: mean, least-squares slope, overshoot past the settled
+ * end value, and a step-visibility figure from a P² quantile sketch of the
+ * sample-to-sample changes. Plain C with no ESP-IDF dependencies, so it
+ * also builds on the host.
+ *
+ * Step visibility is p95(|delta|) / mean(|delta|) in percent. An even ramp
+ * spreads the change over every sample and scores about 100; a staircase
+ * puts it into a few jumps and scores well above.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SEGMENT_STATS_MIN_SAMPLES 4   /* fewer samples give no result */
+
+/**
+ * @brief P² estimate of one quantile (Jain & Chlamtac, 1985): five markers, no sample buffer.
+ */
+typedef struct {
+    float p;
+    uint32_t count;
+    float q[5];     // marker heights
+    int32_t n[5];   // marker positions
+    float np[5];    // desired positions
+    float dn[5];    // desired position increments
+} p2_quantile_t;
+
+void p2_quantile_init(p2_quantile_t *est, float p);
+void p2_quantile_add(p2_quantile_t *est, float x);
+
+/**
+ * @brief Current estimate (exact while fewer than five values were added, 0 if none).
+ */
+float p2_quantile_get(const p2_quantile_t *est);
+
+typedef struct {
+    bool rising;
+    int64_t start_us;
+    uint32_t count;
+    double sum_t, sum_tt, sum_y, sum_ty;   // t in seconds since start_us
+    uint16_t min, max, last;
+    double abs_delta_sum;
+    p2_quantile_t delta_p95;
+} segment_stats_t;
+
+typedef struct {
+    uint16_t samples;
+    uint16_t mean;
+    int16_t slope;          // counts per second
+    uint16_t overshoot;     // counts past the value the segment ended on
+    uint16_t visibility;    // percent, 0 if the reading did not move
+} segment_stats_result_t;
+
+void segment_stats_begin(segment_stats_t *s, bool rising, int64_t now_us);
+void segment_stats_add(segment_stats_t *s, uint16_t value, int64_t now_us);
+
+/**
+ * @brief Compute the result of the segment.
+ *
+ * @return false if it saw fewer than SEGMENT_STATS_MIN_SAMPLES samples
+ */
+bool segment_stats_end(const segment_stats_t *s, segment_stats_result_t *out);
+
+/**
+ * @brief Running summary of one fade cycle, folded segment by segment.
+ */
+typedef struct {
+    uint32_t cycle;
+    uint16_t segments;          // segments with a result
+    uint16_t skipped;           // segments with too few samples
+    uint32_t visibility_sum;
+    uint16_t visibility_max;
+    int16_t worst_segment;      // where visibility_max was seen, -1 if none
+    bool worst_rising;
+    uint16_t overshoot_max;
+} segment_stats_cycle_t;
+
+void segment_stats_cycle_reset(segment_stats_cycle_t *c, uint32_t cycle);
+void segment_stats_cycle_add(segment_stats_cycle_t *c, int segment, bool rising,
+                             const segment_stats_result_t *result);
+void segment_stats_cycle_skip(segment_stats_cycle_t *c);
+uint16_t segment_stats_cycle_visibility_mean(const segment_stats_cycle_t *c);
@@ -0,0 +1,244 @@
+#include "serial_ota.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
+#include "driver/uart.h"
+#include "miniz.h"
+
+static const char *TAG = "SERIAL_OTA";
+
+#define OTA_UART_NUM CONFIG_ESP_CONSOLE_UART_NUM
+#define OTA_CHUNK_TIMEOUT_MS 5000
+#define OTA_MAX_RETRIES 5
+
+typedef struct {
+    esp_ota_handle_t ota_handle;
+    bool compressed;
+    tinfl_decompressor *inflator;
+    uint8_t *dict;          // TINFL_LZ_DICT_SIZE circular output window
+    size_t dict_ofs;
+    bool inflate_done;
+    uint32_t written;
+} ota_sink_t;
+
+static bool read_exact(uint8_t *buf, size_t len)
+{
+    size_t got = 0;
+    while (got < len)
+    {
+        int n = uart_read_bytes(OTA_UART_NUM, buf + got, len - got, pdMS_TO_TICKS(OTA_CHUNK_TIMEOUT_MS));
+        if (n <= 0)
+            return false;
+        got += n;
+    }
+    return true;
+}
+
+static esp_err_t sink_write(ota_sink_t *sink, const uint8_t *data, size_t len)
+{
+    if (!sink->compressed)
+    {
+        sink->written += len;
+        return esp_ota_write(sink->ota_handle, data, len);
+    }
+
+    while (len > 0 || !sink->inflate_done)
+    {
+        size_t in_bytes = len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - sink->dict_ofs;
+        tinfl_status status = tinfl_decompress(sink->inflator, data, &in_bytes,
+                                               sink->dict, sink->dict + sink->dict_ofs, &out_bytes,
+                                               TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_bytes;
+        len -= in_bytes;
+
+        if (out_bytes > 0)
+        {
+            esp_err_t err = esp_ota_write(sink->ota_handle, sink->dict + sink->dict_ofs, out_bytes);
+            if (err != ESP_OK)
+                return err;
+            sink->written += out_bytes;
+            sink->dict_ofs = (sink->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+
+        if (status == TINFL_STATUS_DONE)
+        {
+            sink->inflate_done = true;
+            break;
+        }
+        if (status < TINFL_STATUS_DONE)
+        {
+            ESP_LOGE(TAG, "Inflate failed: %d", status);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && len == 0)
+            break;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t receive_chunks(ota_sink_t *sink, uint32_t stream_size)
+{
+    uint8_t *chunk = malloc(SERIAL_OTA_CHUNK_SIZE);
+    if (chunk == NULL)
+        return ESP_ERR_NO_MEM;
+
+    esp_err_t err = ESP_OK;
+    uint32_t received = 0;
+    uint32_t seq = 0;
+    int retries = 0;
+
+    while (1)
+    {
+        uint8_t header[8];
+        if (!read_exact(header, sizeof(header)))
+        {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        uint16_t len = header[0] | header[1] << 8;
+        uint16_t frame_seq = header[2] | header[3] << 8;
+        uint32_t crc = header[4] | header[5] << 8 | header[6] << 16 | (uint32_t)header[7] << 24;
+
+        if (len == 0)
+            break;
+        if (len > SERIAL_OTA_CHUNK_SIZE || !read_exact(chunk, len) ||
+            esp_rom_crc32_le(esp_rom_crc32_le(0, header, 4), chunk, len) != crc)
+        {
+            uart_flush_input(OTA_UART_NUM);
+            printf("OTA NAK %" PRIu32 "\n", seq);
+            if (++retries > OTA_MAX_RETRIES)
+            {
+                err = ESP_ERR_INVALID_CRC;
+                break;
+            }
+            continue;
+        }
+
+        /* The sender repeats a chunk whose ACK it missed: confirm it again, but write it once */
+        if (seq > 0 && frame_seq == (uint16_t)(seq - 1))
+        {
+            printf("OTA ACK %" PRIu32 "\n", seq - 1);
+            continue;
+        }
+        if (frame_seq != (uint16_t)seq)
+        {
+            printf("OTA NAK %" PRIu32 "\n", seq);
+            if (++retries > OTA_MAX_RETRIES)
+            {
+                err = ESP_ERR_INVALID_STATE;
+                break;
+            }
+            continue;
+        }
+        retries = 0;
+
+        if ((err = sink_write(sink, chunk, len)) != ESP_OK)
+            break;
+
+        received += len;
+        printf("OTA ACK %" PRIu32 "\n", seq++);
+    }
+
+    free(chunk);
+    if (err == ESP_OK && received != stream_size)
+    {
+        ESP_LOGE(TAG, "Received %" PRIu32 " of %" PRIu32 " bytes", received, stream_size);
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK && sink->compressed && !sink->inflate_done)
+    {
+        ESP_LOGE(TAG, "Compressed stream ended early");
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    return err;
+}
+
+esp_err_t serial_ota_receive(uint32_t stream_size, bool compressed, uint32_t baud_rate)
+{
+    const esp_partition_t *update_partition = esp_ota_get_next_update_partition(NULL);
+    if (update_partition == NULL)
+    {
+        ESP_LOGE(TAG, "No OTA partition available");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ota_sink_t sink = {.compressed = compressed};
+    if (compressed)
+    {
+        sink.inflator = malloc(sizeof(tinfl_decompressor));
+        sink.dict = malloc(TINFL_LZ_DICT_SIZE);
+        if (sink.inflator == NULL || sink.dict == NULL)
+        {
+            free(sink.inflator);
+            free(sink.dict);
+            return ESP_ERR_NO_MEM;
+        }
+        tinfl_init(sink.inflator);
+    }
+
+    /* Sequential writes erase sector by sector, so nothing blocks for the whole slot up front */
+    esp_err_t err = esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &sink.ota_handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        free(sink.inflator);
+        free(sink.dict);
+        return err;
+    }
+
+    uint32_t old_baud = 0;
+    uart_get_baudrate(OTA_UART_NUM, &old_baud);
+
+    printf("OTA READY %d %s\n", SERIAL_OTA_CHUNK_SIZE, update_partition->label);
+    fflush(stdout);
+    uart_wait_tx_done(OTA_UART_NUM, pdMS_TO_TICKS(100));
+    if (baud_rate != 0)
+    {
+        uart_set_baudrate(OTA_UART_NUM, baud_rate);
+    }
+    uart_flush_input(OTA_UART_NUM);
+
+    int64_t start_us = esp_timer_get_time();
+    err = receive_chunks(&sink, stream_size);
+    free(sink.inflator);
+    free(sink.dict);
+
+    if (err != ESP_OK)
+    {
+        esp_ota_abort(sink.ota_handle);
+    }
+    else if ((err = esp_ota_end(sink.ota_handle)) == ESP_OK)
+    {
+        err = esp_ota_set_boot_partition(update_partition);
+    }
+    int64_t elapsed_ms = (esp_timer_get_time() - start_us) / 1000;
+
+    /* Report at the transfer rate, the sender is still listening there */
+    if (err == ESP_OK)
+    {
+        printf("OTA DONE %" PRIu32 " bytes received, %" PRIu32 " bytes written, %" PRId64 " ms\n",
+               stream_size, sink.written, elapsed_ms);
+    }
+    else
+    {
+        printf("OTA FAIL %s\n", esp_err_to_name(err));
+    }
+
+    if (baud_rate != 0)
+    {
+        fflush(stdout);
+        uart_wait_tx_done(OTA_UART_NUM, pdMS_TO_TICKS(100));
+        uart_set_baudrate(OTA_UART_NUM, old_baud);
+    }
+    if (err != ESP_OK)
+        return err;
+
+    ESP_LOGI(TAG, "Image written to %s, restart to boot it", update_partition->label);
+    return ESP_OK;
+}
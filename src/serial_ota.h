@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define SERIAL_OTA_CHUNK_SIZE 1024
+
+/**
+ * @brief Receive a firmware image over the console UART into the inactive OTA slot.
+ *
+ * Runs inside the console command, so the REPL is not reading the UART meanwhile.
+ * Framing, per chunk: u16 length, u16 sequence number (chunk index mod
+ * 65536), u32 CRC32 over those four bytes and the payload (all
+ * little-endian), payload. The device answers with "OTA ACK <n>" once chunk
+ * n is written, or "OTA NAK <n>" to ask for chunk n again. A repeat of the
+ * chunk just written is ACKed again but not written twice, so the sender
+ * can resend whenever an ACK is lost. A zero-length chunk ends the transfer. With `compressed`, the payload stream
+ * is zlib data that is inflated straight into flash.
+ *
+ * @param stream_size  bytes that will be sent (compressed size if compressed)
+ * @param compressed   payload is zlib-compressed
+ * @param baud_rate    switch the UART to this rate for the transfer (0 = keep)
+ */
+esp_err_t serial_ota_receive(uint32_t stream_size, bool compressed, uint32_t baud_rate);
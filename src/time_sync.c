@@ -0,0 +1,165 @@
+#include "time_sync.h"
+#include <string.h>
+#include <math.h>
+
+/* Samples whose delay exceeds the window minimum by more than this are
+   queued behind other traffic (or the radio was busy on the other protocol);
+   their offset is off by up to half the extra delay, so they are skipped. */
+#define DELAY_SLACK_US 200
+
+static double clamp_ppm(double ppm)
+{
+    if (ppm > TIME_SYNC_MAX_PPM)
+        return TIME_SYNC_MAX_PPM;
+    if (ppm < -TIME_SYNC_MAX_PPM)
+        return -TIME_SYNC_MAX_PPM;
+    return ppm;
+}
+
+void time_sync_init(time_sync_t *ts, time_sync_role_t role, uint8_t domain)
+{
+    memset(ts, 0, sizeof(*ts));
+    ts->role = role;
+    ts->domain = domain;
+}
+
+int64_t time_sync_now(const time_sync_t *ts, int64_t local_us)
+{
+    int64_t elapsed_us = local_us - ts->base_local_us;
+    return ts->base_synced_us + elapsed_us + (int64_t)(elapsed_us * ts->freq_ppm / 1e6);
+}
+
+/* Move the base to `local_us` so a new frequency only applies from now on */
+static void rebase(time_sync_t *ts, int64_t local_us)
+{
+    ts->base_synced_us = time_sync_now(ts, local_us);
+    ts->base_local_us = local_us;
+}
+
+void time_sync_make_request(time_sync_t *ts, int64_t local_us, time_sync_msg_t *msg)
+{
+    memset(msg, 0, sizeof(*msg));
+    msg->magic = TIME_SYNC_MAGIC;
+    msg->type = TIME_SYNC_MSG_REQUEST;
+    msg->domain = ts->domain;
+    msg->seq = ++ts->seq;
+    msg->t1 = time_sync_now(ts, local_us);
+
+    ts->pending_t1 = msg->t1;
+    ts->pending = true;
+    ts->requests++;
+}
+
+bool time_sync_make_reply(const time_sync_t *ts, const time_sync_msg_t *request,
+                          int64_t rx_ref_us, int64_t tx_ref_us, time_sync_msg_t *reply)
+{
+    if (request->magic != TIME_SYNC_MAGIC || request->type != TIME_SYNC_MSG_REQUEST ||
+        request->domain != ts->domain)
+        return false;
+
+    *reply = *request;
+    reply->type = TIME_SYNC_MSG_REPLY;
+    reply->t2 = rx_ref_us;
+    reply->t3 = tx_ref_us;
+    return true;
+}
+
+static int64_t window_min_delay(const time_sync_t *ts)
+{
+    int64_t min_us = INT64_MAX;
+    for (int i = 0; i < ts->window_count; i++)
+    {
+        if (ts->window[i].delay_us < min_us)
+            min_us = ts->window[i].delay_us;
+    }
+    return min_us;
+}
+
+uint32_t time_sync_handle_reply(time_sync_t *ts, const time_sync_msg_t *reply, int64_t local_us)
+{
+    if (reply->magic != TIME_SYNC_MAGIC || reply->type != TIME_SYNC_MSG_REPLY || reply->domain != ts->domain)
+        return 0;
+    // Only the answer to the request in flight; a late one would pair with the wrong t1
+    if (!ts->pending || reply->seq != ts->seq || reply->t1 != ts->pending_t1)
+    {
+        ts->stale++;
+        return 0;
+    }
+    ts->pending = false;
+    ts->replies++;
+
+    int64_t t4 = time_sync_now(ts, local_us);
+    int64_t offset_us = ((reply->t2 - reply->t1) + (reply->t3 - t4)) / 2;
+    int64_t delay_us = (t4 - reply->t1) - (reply->t3 - reply->t2);
+    if (delay_us < 0)
+        delay_us = 0;
+    ts->last_offset_us = offset_us;
+    ts->last_delay_us = delay_us;
+
+    // First sample, or the master's clock jumped (re-started schedule): step
+    if (!ts->locked || offset_us > TIME_SYNC_STEP_US || offset_us < -TIME_SYNC_STEP_US)
+    {
+        rebase(ts, local_us);
+        ts->base_synced_us += offset_us;
+        ts->window_count = 0;
+        ts->window_next = 0;
+        ts->offset_sq_sum = 0;
+        ts->offset_count = 0;
+        ts->last_update_local_us = local_us;
+        ts->locked = true;
+        ts->steps++;
+        return TIME_SYNC_SAMPLE | TIME_SYNC_STEPPED;
+    }
+
+    ts->window[ts->window_next] = (time_sync_sample_t){offset_us, delay_us};
+    ts->window_next = (ts->window_next + 1) % TIME_SYNC_FILTER_LEN;
+    if (ts->window_count < TIME_SYNC_FILTER_LEN)
+        ts->window_count++;
+
+    if (delay_us > window_min_delay(ts) * 3 / 2 + DELAY_SLACK_US)
+        return 0;
+
+    // PI on frequency: offset / interval is the rate that would cancel the
+    // offset in one interval (1 us/s = 1 ppm)
+    double interval_s = (local_us - ts->last_update_local_us) / 1e6;
+    if (interval_s <= 0)
+        interval_s = 1;
+    double rate_ppm = offset_us / interval_s;
+
+    // Fast gains pull in the initial frequency error; once settled, the
+    // per-sample asymmetry of the path delay dominates and slow gains average it out
+    bool acquiring = ts->offset_count < TIME_SYNC_ACQUIRE_SAMPLES;
+    double kp = acquiring ? TIME_SYNC_KP : TIME_SYNC_TRACK_KP;
+    double ki = acquiring ? TIME_SYNC_KI : TIME_SYNC_TRACK_KI;
+
+    rebase(ts, local_us);
+    ts->drift_ppm = clamp_ppm(ts->drift_ppm + ki * rate_ppm);
+    ts->freq_ppm = clamp_ppm(ts->drift_ppm + kp * rate_ppm);
+    ts->last_update_local_us = local_us;
+
+    ts->offset_sq_sum += (double)offset_us * offset_us;
+    ts->offset_count++;
+    return TIME_SYNC_SAMPLE;
+}
+
+double time_sync_rms_offset_us(const time_sync_t *ts)
+{
+    if (ts->offset_count == 0)
+        return 0;
+    return sqrt(ts->offset_sq_sum / ts->offset_count);
+}
+
+const char *time_sync_role_name(time_sync_role_t role)
+{
+    switch (role)
+    {
+    case TIME_SYNC_ROLE_OFF:
+        return "off";
+    case TIME_SYNC_ROLE_MASTER:
+        return "master";
+    case TIME_SYNC_ROLE_SLAVE:
+        return "slave";
+    default:
+        return "?";
+    }
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+/*
+ * Master/slave time synchronisation between coordinators. An NTP-style
+ * four-timestamp exchange measures offset and path delay; the slave keeps
+ * the lowest-delay sample of a short window and disciplines its clock with
+ * a PI loop on frequency, stepping only when it is far off. Plain C with no
+ * ESP-IDF dependencies: the transport and the local clock are handed in, so
+ * tools/time_sync_sim.c runs several simulated nodes on a Linux host.
+ *
+ * All times are microseconds. "Local" is the node's free-running clock
+ * (esp_timer on the target); "synced" is the disciplined clock, which on
+ * the master is simply its own reference.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TIME_SYNC_MAGIC      0x5453      /* "TS" */
+#define TIME_SYNC_FILTER_LEN 8           /* samples searched for the lowest delay */
+#define TIME_SYNC_STEP_US    50000       /* offsets beyond this are stepped, not slewed */
+#define TIME_SYNC_MAX_PPM    500.0       /* frequency correction limit */
+#define TIME_SYNC_KP         0.2         /* PI gains per exchange while acquiring; ~10 s settling */
+#define TIME_SYNC_KI         0.02
+#define TIME_SYNC_ACQUIRE_SAMPLES 60     /* samples after a step that use the acquiring gains */
+#define TIME_SYNC_TRACK_KP   0.05        /* then lower gains average out the radio's delay asymmetry */
+#define TIME_SYNC_TRACK_KI   0.002
+
+typedef enum {
+    TIME_SYNC_ROLE_OFF,
+    TIME_SYNC_ROLE_MASTER,
+    TIME_SYNC_ROLE_SLAVE,
+    TIME_SYNC_ROLE_COUNT
+} time_sync_role_t;
+
+typedef enum {
+    TIME_SYNC_MSG_REQUEST = 1,
+    TIME_SYNC_MSG_REPLY = 2
+} time_sync_msg_type_t;
+
+/**
+ * @brief On-air message, sent as-is (both ends are little-endian RISC-V).
+ */
+typedef struct __attribute__((packed)) {
+    uint16_t magic;
+    uint8_t type;
+    uint8_t domain;   // installations sharing the air keep apart by domain
+    uint32_t seq;
+    int64_t t1;       // slave send time (slave synced clock)
+    int64_t t2;       // master receive time (master clock)
+    int64_t t3;       // master send time (master clock)
+} time_sync_msg_t;
+
+/* Result flags of time_sync_handle_reply() */
+#define TIME_SYNC_SAMPLE  (1 << 0)   /* the reply was used */
+#define TIME_SYNC_STEPPED (1 << 1)   /* the synced clock jumped; anything scheduled on it should re-plan */
+
+typedef struct {
+    int64_t offset_us;
+    int64_t delay_us;
+} time_sync_sample_t;
+
+typedef struct {
+    time_sync_role_t role;
+    uint8_t domain;
+
+    /* synced = base_synced + (local - base_local) * (1 + freq_ppm / 1e6) */
+    int64_t base_local_us;
+    int64_t base_synced_us;
+    double freq_ppm;
+    double drift_ppm;       // integral term
+    bool locked;
+
+    /* Outstanding request */
+    uint32_t seq;
+    int64_t pending_t1;
+    bool pending;
+
+    /* Clock filter */
+    time_sync_sample_t window[TIME_SYNC_FILTER_LEN];
+    int window_count;
+    int window_next;
+    int64_t last_update_local_us;
+
+    /* Statistics */
+    int64_t last_offset_us;
+    int64_t last_delay_us;
+    uint32_t requests;
+    uint32_t replies;
+    uint32_t stale;
+    uint32_t steps;
+    double offset_sq_sum;   // for the RMS of the offsets the loop acted on
+    uint32_t offset_count;
+} time_sync_t;
+
+void time_sync_init(time_sync_t *ts, time_sync_role_t role, uint8_t domain);
+
+/**
+ * @brief Disciplined time at local time `local_us`.
+ */
+int64_t time_sync_now(const time_sync_t *ts, int64_t local_us);
+
+/**
+ * @brief Slave: fill in the next request, stamped at `local_us`.
+ */
+void time_sync_make_request(time_sync_t *ts, int64_t local_us, time_sync_msg_t *msg);
+
+/**
+ * @brief Master: turn a request into a reply.
+ *
+ * @param rx_ref_us  master clock when the request arrived
+ * @param tx_ref_us  master clock just before the reply goes out
+ * @return false if the message is not a request for this domain
+ */
+bool time_sync_make_reply(const time_sync_t *ts, const time_sync_msg_t *request,
+                          int64_t rx_ref_us, int64_t tx_ref_us, time_sync_msg_t *reply);
+
+/**
+ * @brief Slave: feed a reply that arrived at `local_us`.
+ *
+ * @return TIME_SYNC_* flags, 0 if the reply was ignored
+ */
+uint32_t time_sync_handle_reply(time_sync_t *ts, const time_sync_msg_t *reply, int64_t local_us);
+
+/**
+ * @brief RMS of the measured offsets since init (or since the last step).
+ */
+double time_sync_rms_offset_us(const time_sync_t *ts);
+
+const char *time_sync_role_name(time_sync_role_t role);
@@ -0,0 +1,262 @@
+#include "time_sync_espnow.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "app_config.h"
+#include "light_control.h"
+
+static const char *TAG = "TIME_SYNC";
+
+#define RX_QUEUE_LEN 8
+
+typedef struct {
+    time_sync_msg_t msg;
+    int64_t rx_us;      // master: fade clock, slave: esp_timer
+    uint8_t src[ESP_NOW_ETH_ALEN];
+} rx_item_t;
+
+static const uint8_t s_broadcast[ESP_NOW_ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+static time_sync_t s_sync;
+static portMUX_TYPE s_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t s_rx_queue;
+static TaskHandle_t s_task;
+static bool s_link_up;
+static uint32_t s_served;
+static uint32_t s_rx_dropped;
+
+/* Runs in the Wi-Fi task: stamp the arrival and hand over */
+static void espnow_recv_cb(const esp_now_recv_info_t *info, const uint8_t *data, int len)
+{
+    rx_item_t item;
+    item.rx_us = s_sync.role == TIME_SYNC_ROLE_MASTER ? lights_clock_now_us() : esp_timer_get_time();
+    if (len != sizeof(time_sync_msg_t))
+        return;
+    memcpy(&item.msg, data, sizeof(item.msg));
+    memcpy(item.src, info->src_addr, ESP_NOW_ETH_ALEN);
+    if (xQueueSend(s_rx_queue, &item, 0) != pdTRUE)
+        s_rx_dropped++;
+}
+
+static esp_err_t add_peer(const uint8_t *mac)
+{
+    if (esp_now_is_peer_exist(mac))
+        return ESP_OK;
+
+    esp_now_peer_info_t peer = {
+        .channel = 0, // whatever the interface is on
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    return esp_now_add_peer(&peer);
+}
+
+static void serve_request(const rx_item_t *item)
+{
+    // Nothing to serve until the fade clock has an origin
+    if (!lights_running())
+        return;
+
+    if (add_peer(item->src) != ESP_OK)
+        return;
+
+    time_sync_msg_t reply;
+    if (!time_sync_make_reply(&s_sync, &item->msg, item->rx_us, lights_clock_now_us(), &reply))
+        return;
+    if (esp_now_send(item->src, (const uint8_t *)&reply, sizeof(reply)) == ESP_OK)
+        s_served++;
+}
+
+static void handle_reply(const rx_item_t *item)
+{
+    portENTER_CRITICAL(&s_sync_lock);
+    uint32_t flags = time_sync_handle_reply(&s_sync, &item->msg, item->rx_us);
+    portEXIT_CRITICAL(&s_sync_lock);
+
+    if (flags & TIME_SYNC_STEPPED)
+    {
+        ESP_LOGI(TAG, "Clock stepped by %" PRId64 " us to the master's", s_sync.last_offset_us);
+        // Re-plan the fades on the new time base
+        lights_clock_changed();
+    }
+}
+
+static void send_request(void)
+{
+    time_sync_msg_t request;
+
+    portENTER_CRITICAL(&s_sync_lock);
+    time_sync_make_request(&s_sync, esp_timer_get_time(), &request);
+    portEXIT_CRITICAL(&s_sync_lock);
+
+    esp_now_send(s_broadcast, (const uint8_t *)&request, sizeof(request));
+}
+
+static void time_sync_task(void *pvParameters)
+{
+    TickType_t next_request = xTaskGetTickCount();
+
+    while (1)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (s_sync.role == TIME_SYNC_ROLE_SLAVE)
+        {
+            TickType_t now = xTaskGetTickCount();
+            wait = (int32_t)(next_request - now) > 0 ? next_request - now : 0;
+        }
+
+        rx_item_t item;
+        if (xQueueReceive(s_rx_queue, &item, wait) == pdTRUE)
+        {
+            if (s_sync.role == TIME_SYNC_ROLE_MASTER)
+                serve_request(&item);
+            else
+                handle_reply(&item);
+        }
+
+        if (s_sync.role == TIME_SYNC_ROLE_SLAVE && (int32_t)(xTaskGetTickCount() - next_request) >= 0)
+        {
+            send_request();
+            next_request += pdMS_TO_TICKS(TIME_SYNC_INTERVAL_MS);
+        }
+    }
+}
+
+static esp_err_t link_start(void)
+{
+    esp_err_t err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+        return err;
+
+    wifi_init_config_t wifi_cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_wifi_init(&wifi_cfg), TAG, "wifi init");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_storage(WIFI_STORAGE_RAM), TAG, "wifi storage");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_mode(WIFI_MODE_STA), TAG, "wifi mode");
+    ESP_RETURN_ON_ERROR(esp_wifi_start(), TAG, "wifi start");
+    ESP_RETURN_ON_ERROR(esp_wifi_set_channel(TIME_SYNC_WIFI_CHANNEL, WIFI_SECOND_CHAN_NONE), TAG, "wifi channel");
+
+    ESP_RETURN_ON_ERROR(esp_now_init(), TAG, "esp-now init");
+    ESP_RETURN_ON_ERROR(esp_now_register_recv_cb(espnow_recv_cb), TAG, "esp-now callback");
+    ESP_RETURN_ON_ERROR(add_peer(s_broadcast), TAG, "broadcast peer");
+    s_link_up = true;
+    return ESP_OK;
+}
+
+static void link_stop(void)
+{
+    if (s_task != NULL)
+    {
+        vTaskDelete(s_task);
+        s_task = NULL;
+    }
+    if (s_link_up)
+    {
+        esp_now_deinit();
+        esp_wifi_stop();
+        esp_wifi_deinit();
+        s_link_up = false;
+    }
+}
+
+static esp_err_t start(time_sync_role_t role, uint8_t domain)
+{
+    link_stop();
+
+    portENTER_CRITICAL(&s_sync_lock);
+    time_sync_init(&s_sync, role, domain);
+    portEXIT_CRITICAL(&s_sync_lock);
+    s_served = 0;
+    s_rx_dropped = 0;
+
+    if (role == TIME_SYNC_ROLE_OFF)
+        return ESP_OK;
+
+    if (s_rx_queue == NULL)
+        s_rx_queue = xQueueCreate(RX_QUEUE_LEN, sizeof(rx_item_t));
+    xQueueReset(s_rx_queue);
+
+    esp_err_t err = link_start();
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "ESP-NOW link failed: %s", esp_err_to_name(err));
+        link_stop();
+        return err;
+    }
+
+    // Above the fade tasks, so timestamps are taken and answered promptly
+    xTaskCreate(time_sync_task, "time_sync", 3072, NULL, 5, &s_task);
+    ESP_LOGI(TAG, "Started as %s, domain %d, Wi-Fi channel %d", time_sync_role_name(role), domain,
+             TIME_SYNC_WIFI_CHANNEL);
+    return ESP_OK;
+}
+
+void time_sync_espnow_init(void)
+{
+    uint8_t role = TIME_SYNC_ROLE_OFF, domain = TIME_SYNC_DEFAULT_DOMAIN;
+    load_time_sync_from_nvs(&role, &domain);
+    if (role < TIME_SYNC_ROLE_COUNT)
+        start((time_sync_role_t)role, domain);
+}
+
+esp_err_t time_sync_espnow_set_role(time_sync_role_t role, uint8_t domain)
+{
+    if (role >= TIME_SYNC_ROLE_COUNT)
+        return ESP_ERR_INVALID_ARG;
+
+    save_time_sync_to_nvs(role, domain);
+    esp_err_t err = start(role, domain);
+
+    // Back on the local clock
+    if (role != TIME_SYNC_ROLE_SLAVE)
+        lights_clock_changed();
+    return err;
+}
+
+time_sync_role_t time_sync_espnow_get_role(void)
+{
+    return s_sync.role;
+}
+
+bool time_sync_espnow_now_us(int64_t *synced_us)
+{
+    bool locked;
+
+    portENTER_CRITICAL(&s_sync_lock);
+    locked = s_sync.role == TIME_SYNC_ROLE_SLAVE && s_sync.locked;
+    if (locked)
+        *synced_us = time_sync_now(&s_sync, esp_timer_get_time());
+    portEXIT_CRITICAL(&s_sync_lock);
+
+    return locked;
+}
+
+void time_sync_espnow_print_status(void)
+{
+    printf("Time sync: %s, domain %d, Wi-Fi channel %d\n", time_sync_role_name(s_sync.role), s_sync.domain,
+           TIME_SYNC_WIFI_CHANNEL);
+
+    if (s_sync.role == TIME_SYNC_ROLE_MASTER)
+    {
+        printf("  requests served %" PRIu32 ", queue drops %" PRIu32 "\n", s_served, s_rx_dropped);
+    }
+    else if (s_sync.role == TIME_SYNC_ROLE_SLAVE)
+    {
+        printf("  %s, last offset %" PRId64 " us, delay %" PRId64 " us, rms offset %.0f us\n",
+               s_sync.locked ? "locked" : "searching", s_sync.last_offset_us, s_sync.last_delay_us,
+               time_sync_rms_offset_us(&s_sync));
+        printf("  frequency %+.2f ppm (drift %+.2f), steps %" PRIu32 "\n", s_sync.freq_ppm, s_sync.drift_ppm,
+               s_sync.steps);
+        printf("  requests %" PRIu32 ", replies %" PRIu32 ", stale %" PRIu32 ", queue drops %" PRIu32 "\n",
+               s_sync.requests, s_sync.replies, s_sync.stale, s_rx_dropped);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "time_sync.h"
+
+/*
+ * Time sync between coordinators over ESP-NOW broadcast. Wi-Fi shares the
+ * C6 radio with 802.15.4 through software coexistence, so exchanges are
+ * sometimes held back; the delay filter in time_sync.c drops those.
+ */
+#define TIME_SYNC_WIFI_CHANNEL  1      /* every coordinator of an installation must use the same */
+#define TIME_SYNC_INTERVAL_MS   1000   /* slave request period */
+#define TIME_SYNC_DEFAULT_DOMAIN 1
+
+/**
+ * @brief Start in the role stored in NVS (nothing happens if it is off).
+ */
+void time_sync_espnow_init(void);
+
+/**
+ * @brief Change role and domain, store them in NVS and restart the link.
+ */
+esp_err_t time_sync_espnow_set_role(time_sync_role_t role, uint8_t domain);
+
+time_sync_role_t time_sync_espnow_get_role(void);
+
+/**
+ * @brief The master's clock as seen from here.
+ *
+ * @return true if this node is a locked slave and `synced_us` is valid
+ */
+bool time_sync_espnow_now_us(int64_t *synced_us);
+
+void time_sync_espnow_print_status(void);
@@ -0,0 +1,69 @@
+/*
+ * LP-core program for SENSOR_MODE_LP. Runs once per LP timer period: reads
+ * one sample from the external ADC on the LP I2C bus, feeds the shared
+ * filter and wakes the HP core when a block of averages is ready or the
+ * light level crossed a threshold.
+ *
+ * Built separately by ulp_embed_binary (see src/CMakeLists.txt).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ulp_lp_core_utils.h"
+#include "ulp_lp_core_i2c.h"
+#include "../lp_sensor_filter.h"
+
+/* ADS1115: AIN0 single-ended, +-4.096 V, continuous conversion at 860 SPS, comparator off */
+#define ADS1115_REG_CONVERSION 0x00
+#define ADS1115_REG_CONFIG     0x01
+#define ADS1115_CONFIG_HI      0x42
+#define ADS1115_CONFIG_LO      0xE3
+
+#define I2C_TIMEOUT_CYCLES 5000
+
+/* Exported to the HP core as ulp_lp_sensor */
+volatile lp_sensor_shared_t lp_sensor;
+
+static bool ads1115_configure(void)
+{
+    const uint8_t cmd[3] = {ADS1115_REG_CONFIG, ADS1115_CONFIG_HI, ADS1115_CONFIG_LO};
+    return lp_core_i2c_master_write_to_device(LP_I2C_NUM_0, lp_sensor.i2c_addr,
+                                              cmd, sizeof(cmd), I2C_TIMEOUT_CYCLES) == ESP_OK;
+}
+
+int main(void)
+{
+    if (!lp_sensor.configured)
+    {
+        if (!ads1115_configure())
+        {
+            lp_sensor.i2c_errors++;
+            return 0;
+        }
+        lp_sensor.configured = 1;
+    }
+
+    const uint8_t reg = ADS1115_REG_CONVERSION;
+    uint8_t data[2];
+    if (lp_core_i2c_master_write_read_device(LP_I2C_NUM_0, lp_sensor.i2c_addr, &reg, 1,
+                                             data, sizeof(data), I2C_TIMEOUT_CYCLES) != ESP_OK)
+    {
+        lp_sensor.i2c_errors++;
+        return 0;
+    }
+
+    // 16-bit signed result; keep the positive range at 12 bits like the SAR ADC path
+    int16_t raw = (int16_t)((data[0] << 8) | data[1]);
+    uint32_t sample = raw > 0 ? (uint32_t)raw >> 3 : 0;
+    lp_sensor.samples++;
+
+    uint32_t events = lp_sensor_filter_push(&lp_sensor.filter, sample);
+    if (events & (LP_SENSOR_EVT_BLOCK | LP_SENSOR_EVT_CROSSED))
+    {
+        lp_sensor.wakeups++;
+        ulp_lp_core_wakeup_main_processor();
+    }
+
+    // Returning halts the LP core until the next LP timer wake-up
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include "zb_bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define LEVEL_LOW  64
+#define LEVEL_HIGH 192
+#define STALL_POLL_US 1000
+
+void zb_bench_init(zb_bench_t *bench, const zb_bench_config_t *config)
+{
+    memset(bench, 0, sizeof(*bench));
+    bench->config = *config;
+    if (bench->config.lamps == 0)
+        bench->config.lamps = 1;
+    if (bench->config.lamps > ZB_BENCH_MAX_LAMPS)
+        bench->config.lamps = ZB_BENCH_MAX_LAMPS;
+    if (bench->config.lamp >= bench->config.lamps)
+        bench->config.lamp = 0;
+    // TSNs are 8 bits; more in flight than that cannot be matched
+    if (bench->config.max_inflight == 0 || bench->config.max_inflight > 255)
+        bench->config.max_inflight = 255;
+}
+
+bool zb_bench_next(zb_bench_t *bench, int64_t now_us, uint8_t *lamp, uint8_t *level, int64_t *due_us)
+{
+    const zb_bench_config_t *cfg = &bench->config;
+    if (bench->next_index >= cfg->count)
+        return false;
+
+    // Alternate levels per lamp, so every frame is a real change
+    uint32_t round = bench->next_index;
+    if (cfg->pattern == ZB_BENCH_ROUND_ROBIN)
+    {
+        *lamp = bench->next_index % cfg->lamps;
+        round /= cfg->lamps;
+    }
+    else
+    {
+        *lamp = cfg->lamp;
+    }
+    *level = (round & 1) ? LEVEL_HIGH : LEVEL_LOW;
+
+    if (bench->inflight >= cfg->max_inflight)
+    {
+        if (!bench->stalled)
+            bench->result.stalls++;
+        bench->stalled = true;
+        *due_us = now_us + STALL_POLL_US;
+        return true;
+    }
+    bench->stalled = false;
+
+    bool paced = cfg->pattern == ZB_BENCH_PACED || (cfg->pattern == ZB_BENCH_ROUND_ROBIN && cfg->rate_hz > 0);
+    if (paced && cfg->rate_hz > 0 && bench->next_index > 0)
+        *due_us = bench->start_us + (int64_t)bench->next_index * 1000000 / cfg->rate_hz;
+    else
+        *due_us = now_us;
+    return true;
+}
+
+void zb_bench_sent(zb_bench_t *bench, uint8_t lamp, int tsn, int64_t now_us)
+{
+    zb_bench_result_t *res = &bench->result;
+
+    if (bench->next_index == 0)
+        bench->start_us = now_us;
+    bench->next_index++;
+    bench->last_send_us = now_us;
+
+    if (tsn < 0)
+    {
+        res->send_errors++;
+        return;
+    }
+    if (bench->pending[tsn])
+    {
+        // TSN wrapped while the old frame was still out: it will never be matched
+        bench->pending[tsn] = false;
+        bench->inflight--;
+        res->missing++;
+    }
+
+    bench->pending[tsn] = true;
+    bench->sent_at_us[tsn] = now_us;
+    bench->lamp_of[tsn] = lamp;
+    bench->inflight++;
+    if (bench->inflight > res->max_inflight)
+        res->max_inflight = bench->inflight;
+    res->sent++;
+    res->per_lamp_sent[lamp]++;
+}
+
+void zb_bench_confirmed(zb_bench_t *bench, uint8_t tsn, bool ok, int64_t now_us)
+{
+    zb_bench_result_t *res = &bench->result;
+
+    if (!bench->pending[tsn])
+        return;
+    bench->pending[tsn] = false;
+    bench->inflight--;
+    bench->last_confirm_us = now_us;
+
+    if (!ok)
+    {
+        res->failed++;
+        res->per_lamp_failed[bench->lamp_of[tsn]]++;
+        return;
+    }
+    res->confirmed++;
+    if (bench->latency_count < ZB_BENCH_MAX_SAMPLES)
+        bench->latency_us[bench->latency_count++] = (uint32_t)(now_us - bench->sent_at_us[tsn]);
+}
+
+bool zb_bench_done(const zb_bench_t *bench, int64_t now_us)
+{
+    if (bench->next_index < bench->config.count)
+        return false;
+    return bench->inflight == 0 || now_us - bench->last_send_us >= (int64_t)bench->config.timeout_ms * 1000;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(const uint32_t *sorted, uint32_t count, int pct)
+{
+    if (count == 0)
+        return 0;
+    return sorted[(uint64_t)(count - 1) * pct / 100];
+}
+
+const zb_bench_result_t *zb_bench_finish(zb_bench_t *bench)
+{
+    zb_bench_result_t *res = &bench->result;
+
+    for (int tsn = 0; tsn < 256; tsn++)
+    {
+        if (bench->pending[tsn])
+        {
+            bench->pending[tsn] = false;
+            res->missing++;
+            res->per_lamp_failed[bench->lamp_of[tsn]]++;
+        }
+    }
+    bench->inflight = 0;
+
+    // Frames sent within one tick share a timestamp; with no send span to
+    // measure, the span up to the last confirm bounds the offered rate instead
+    uint32_t offered = res->sent + res->send_errors;
+    int64_t send_span_us = bench->last_send_us - bench->start_us;
+    int64_t confirm_span_us = bench->last_confirm_us - bench->start_us;
+    if (offered > 1 && send_span_us > 0)
+        res->send_rate_hz = (offered - 1) * 1e6 / send_span_us;
+    else if (offered > 0 && confirm_span_us > 0)
+        res->send_rate_hz = offered * 1e6 / confirm_span_us;
+    else
+        res->send_rate_hz = -1;
+    res->confirm_rate_hz = confirm_span_us > 0 ? res->confirmed * 1e6 / confirm_span_us : -1;
+
+    qsort(bench->latency_us, bench->latency_count, sizeof(uint32_t), compare_u32);
+    res->p50_us = percentile(bench->latency_us, bench->latency_count, 50);
+    res->p90_us = percentile(bench->latency_us, bench->latency_count, 90);
+    res->p99_us = percentile(bench->latency_us, bench->latency_count, 99);
+    res->max_us = bench->latency_count ? bench->latency_us[bench->latency_count - 1] : 0;
+    return res;
+}
+
+const char *zb_bench_pattern_name(zb_bench_pattern_t pattern)
+{
+    static const char *names[ZB_BENCH_PATTERN_COUNT] = {"burst", "paced", "rr"};
+    return pattern < ZB_BENCH_PATTERN_COUNT ? names[pattern] : "?";
+}
+
+void zb_bench_print(const zb_bench_config_t *config, const zb_bench_result_t *result)
+{
+    printf("ZBBENCH pattern %s count %" PRIu32 " rate %" PRIu32 " lamps %u inflight_limit %u\n",
+           zb_bench_pattern_name(config->pattern), config->count, config->rate_hz, config->lamps,
+           config->max_inflight);
+    printf("ZBBENCH sent %" PRIu32 " send_errors %" PRIu32 " confirmed %" PRIu32 " failed %" PRIu32
+           " missing %" PRIu32 "\n",
+           result->sent, result->send_errors, result->confirmed, result->failed, result->missing);
+    char send_rate[16] = "n/a", confirm_rate[16] = "n/a";
+    if (result->send_rate_hz >= 0)
+        snprintf(send_rate, sizeof(send_rate), "%.1f", result->send_rate_hz);
+    if (result->confirm_rate_hz >= 0)
+        snprintf(confirm_rate, sizeof(confirm_rate), "%.1f", result->confirm_rate_hz);
+    printf("ZBBENCH send_rate %s confirm_rate %s max_inflight %u stalls %" PRIu32 "\n",
+           send_rate, confirm_rate, result->max_inflight, result->stalls);
+    printf("ZBBENCH latency_us p50 %" PRIu32 " p90 %" PRIu32 " p99 %" PRIu32 " max %" PRIu32 "\n",
+           result->p50_us, result->p90_us, result->p99_us, result->max_us);
+    for (int i = 0; i < config->lamps; i++)
+    {
+        printf("ZBBENCH lamp %d sent %" PRIu32 " failed %" PRIu32 "\n", i, result->per_lamp_sent[i],
+               result->per_lamp_failed[i]);
+    }
+}
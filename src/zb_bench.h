@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ * Zigbee command throughput benchmark: pacing, in-flight accounting and
+ * confirm-latency statistics. Plain C with no ESP-IDF dependencies; the
+ * caller sends the frames and reports their TSNs and send confirms, so the
+ * firmware (zb_bench_zigbee.c) and the host queue model in
+ * tools/zb_bench_sim.c run exactly the same bookkeeping.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define ZB_BENCH_MAX_SAMPLES 1024   /* confirm latencies kept for the percentiles */
+#define ZB_BENCH_MAX_LAMPS   16
+
+typedef enum {
+    ZB_BENCH_BURST,         // back to back to one lamp
+    ZB_BENCH_PACED,         // at rate_hz to one lamp
+    ZB_BENCH_ROUND_ROBIN,   // at rate_hz (0 = back to back) cycling over all lamps
+    ZB_BENCH_PATTERN_COUNT
+} zb_bench_pattern_t;
+
+typedef struct {
+    zb_bench_pattern_t pattern;
+    uint32_t count;          // frames to send
+    uint32_t rate_hz;        // paced / round-robin rate
+    uint8_t lamps;           // lamps available to round-robin
+    uint8_t lamp;            // target of burst / paced
+    uint16_t max_inflight;   // frames without a confirm before sending stalls (0 = no limit)
+    uint32_t timeout_ms;     // how long to wait for the last confirms
+} zb_bench_config_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t send_errors;    // the stack refused the frame
+    uint32_t confirmed;
+    uint32_t failed;         // confirm with an error status
+    uint32_t missing;        // no confirm before the timeout
+    uint32_t stalls;         // times the in-flight limit held sending back
+    uint16_t max_inflight;
+    double send_rate_hz;     // frames offered to the stack per second, refused ones included (< 0: n/a)
+    double confirm_rate_hz;  // successful confirms per second, first send to last confirm (< 0: n/a)
+    uint32_t p50_us, p90_us, p99_us, max_us;
+    uint32_t per_lamp_sent[ZB_BENCH_MAX_LAMPS];
+    uint32_t per_lamp_failed[ZB_BENCH_MAX_LAMPS];
+} zb_bench_result_t;
+
+typedef struct {
+    zb_bench_config_t config;
+
+    uint32_t next_index;
+    int64_t start_us;
+    int64_t last_send_us;
+    int64_t last_confirm_us;
+    uint16_t inflight;
+    bool stalled;
+
+    /* Outstanding frames by TSN (8 bits, so at most 256 in flight can be told apart) */
+    int64_t sent_at_us[256];
+    uint8_t lamp_of[256];
+    bool pending[256];
+
+    uint32_t latency_us[ZB_BENCH_MAX_SAMPLES];
+    uint32_t latency_count;
+
+    zb_bench_result_t result;
+} zb_bench_t;
+
+void zb_bench_init(zb_bench_t *bench, const zb_bench_config_t *config);
+
+/**
+ * @brief Which lamp gets the next frame and when it is due.
+ *
+ * @return false once every frame has been sent
+ */
+bool zb_bench_next(zb_bench_t *bench, int64_t now_us, uint8_t *lamp, uint8_t *level, int64_t *due_us);
+
+/**
+ * @brief The frame went to the stack with `tsn`, or < 0 if it never got there
+ *        (no buffer in the host model, stack lock timeout on the device).
+ */
+void zb_bench_sent(zb_bench_t *bench, uint8_t lamp, int tsn, int64_t now_us);
+
+/**
+ * @brief The stack reported the send status of `tsn`; unknown TSNs are ignored.
+ */
+void zb_bench_confirmed(zb_bench_t *bench, uint8_t tsn, bool ok, int64_t now_us);
+
+/**
+ * @brief True when nothing is in flight any more, or the confirm timeout has passed.
+ */
+bool zb_bench_done(const zb_bench_t *bench, int64_t now_us);
+
+/**
+ * @brief Count what never got a confirm and compute rates and percentiles.
+ */
+const zb_bench_result_t *zb_bench_finish(zb_bench_t *bench);
+
+const char *zb_bench_pattern_name(zb_bench_pattern_t pattern);
+
+/**
+ * @brief Print the summary table ("ZBBENCH" lines, one key per line).
+ */
+void zb_bench_print(const zb_bench_config_t *config, const zb_bench_result_t *result);
@@ -0,0 +1,126 @@
+#include "zb_bench_zigbee.h"
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "zigbee_main.h"
+#include "lamp_state.h"
+#include "light_control.h"
+
+static const char *TAG = "ZB_BENCH";
+
+static zb_bench_t s_bench;
+static volatile bool s_active;
+static portMUX_TYPE s_bench_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void send_frame(const lamp_state_t *lamp, uint8_t index, uint8_t level)
+{
+    esp_zb_zcl_move_to_level_cmd_t cmd = {0};
+    cmd.zcl_basic_cmd.src_endpoint = 1;
+    cmd.zcl_basic_cmd.dst_endpoint = 1;
+    cmd.address_mode = ESP_ZB_APS_ADDR_MODE_64_ENDP_PRESENT;
+    memcpy(cmd.zcl_basic_cmd.dst_addr_u.addr_long, lamp->address, sizeof(esp_zb_ieee_addr_t));
+    cmd.level = level;
+    cmd.transition_time = 0;
+
+    // The confirm comes from the Zigbee task, which outranks us: record the
+    // TSN before releasing the stack lock so it cannot arrive first
+    // The request itself returns only the TSN; a stack too busy to take the
+    // frame within ZB_BENCH_LOCK_TIMEOUT_MS is what counts as a refusal here
+    if (!esp_zb_lock_acquire(pdMS_TO_TICKS(ZB_BENCH_LOCK_TIMEOUT_MS)))
+    {
+        portENTER_CRITICAL(&s_bench_lock);
+        zb_bench_sent(&s_bench, index, -1, esp_timer_get_time());
+        portEXIT_CRITICAL(&s_bench_lock);
+        return;
+    }
+    int tsn = esp_zb_zcl_level_move_to_level_cmd_req(&cmd);
+    portENTER_CRITICAL(&s_bench_lock);
+    zb_bench_sent(&s_bench, index, tsn, esp_timer_get_time());
+    portEXIT_CRITICAL(&s_bench_lock);
+    esp_zb_lock_release();
+
+    lamp_state_invalidate_command(lamp->address);
+}
+
+esp_err_t zb_bench_zigbee_run(zb_bench_config_t *config)
+{
+    static lamp_state_t lamps[ZB_BENCH_MAX_LAMPS];
+
+    if (s_active)
+        return ESP_ERR_INVALID_STATE;
+    int n = lamp_state_list(lamps, ZB_BENCH_MAX_LAMPS);
+    if (n == 0)
+    {
+        ESP_LOGW(TAG, "No lamps registered");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (config->lamp >= n)
+    {
+        ESP_LOGW(TAG, "Lamp %d not registered (%d lamps)", config->lamp, n);
+        return ESP_ERR_INVALID_ARG;
+    }
+    config->lamps = n;
+
+    bool resume_fades = lights_running();
+    lights_stop();
+
+    zb_bench_init(&s_bench, config);
+    s_active = true;
+
+    // Frames due within the current tick go out together, so rates above
+    // the tick rate are reached on average, in per-tick bursts
+    const int64_t tick_us = portTICK_PERIOD_MS * 1000;
+    while (true)
+    {
+        uint8_t index, level;
+        int64_t due_us, now_us = esp_timer_get_time();
+
+        portENTER_CRITICAL(&s_bench_lock);
+        bool more = zb_bench_next(&s_bench, now_us, &index, &level, &due_us);
+        bool stalled = s_bench.stalled;
+        portEXIT_CRITICAL(&s_bench_lock);
+        if (!more)
+            break;
+
+        if (stalled)
+        {
+            vTaskDelay(1);
+            continue;
+        }
+        if (due_us - now_us >= tick_us)
+        {
+            vTaskDelay((due_us - now_us) / tick_us);
+            continue;
+        }
+        send_frame(&lamps[index], index, level);
+    }
+
+    while (true)
+    {
+        portENTER_CRITICAL(&s_bench_lock);
+        bool done = zb_bench_done(&s_bench, esp_timer_get_time());
+        if (done)
+            s_active = false;
+        portEXIT_CRITICAL(&s_bench_lock);
+        if (done)
+            break;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    zb_bench_print(&s_bench.config, zb_bench_finish(&s_bench));
+
+    if (resume_fades)
+        lights_init();
+    return ESP_OK;
+}
+
+void zb_bench_zigbee_on_send_status(uint8_t tsn, bool ok)
+{
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&s_bench_lock);
+    if (s_active)
+        zb_bench_confirmed(&s_bench, tsn, ok, now_us);
+    portEXIT_CRITICAL(&s_bench_lock);
+}
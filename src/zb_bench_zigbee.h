@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "zb_bench.h"
+
+/*
+ * Runs a zb_bench pattern of move_to_level frames against the registered
+ * lamps and matches the stack's send confirms to the frames by TSN. The
+ * fades are stopped for the run and restarted afterwards.
+ */
+#define ZB_BENCH_DEFAULT_COUNT        200
+#define ZB_BENCH_DEFAULT_RATE_HZ      20
+#define ZB_BENCH_DEFAULT_MAX_INFLIGHT 8
+#define ZB_BENCH_CONFIRM_TIMEOUT_MS   3000
+#define ZB_BENCH_LOCK_TIMEOUT_MS      500    /* stack lock wait before a frame counts as refused */
+
+/**
+ * @brief Run the benchmark (blocks until the last confirm or the timeout)
+ *        and print the summary table.
+ *
+ * `config->lamps` is filled in from the lamp mirror.
+ */
+esp_err_t zb_bench_zigbee_run(zb_bench_config_t *config);
+
+/**
+ * @brief Feed a send confirm; called from the Zigbee send status handler.
+ */
+void zb_bench_zigbee_on_send_status(uint8_t tsn, bool ok);
@@ -1,13 +1,31 @@
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
 #include "esp_log.h"
 #include "esp_check.h"
+#include "freertos/event_groups.h"
 #include "zigbee_main.h"
 #include "light_control.h"
 #include "app_config.h"
+#include "channel_select.h"
+#include "lamp_state.h"
+#include "zb_bench_zigbee.h"
+#include "zigbee_topology.h"
 
 static const char *TAG = "ZIGBEE_MAIN";
 
+#define CHANNEL_RESCAN_MIN_INTERVAL_MS (10 * 60 * 1000)
+#define NETWORK_READY_BIT BIT0
+
+static channel_monitor_t s_channel_monitor;
+static channel_energy_t s_scan_results[ZB_CHANNEL_MAX - ZB_CHANNEL_MIN + 1];
+static int s_scan_count;
+static bool s_channel_auto_migrate = ESP_ZB_CHANNEL_AUTO_MIGRATE;
+static bool s_rescan_pending;
+static bool s_rescanned;            // s_last_rescan is only valid once set
+static TickType_t s_last_rescan;
+static EventGroupHandle_t s_network_events;
+
 /*
  * For demonstration, we define example lamp addresses here.
  * Replace with your actual lamp addresses or discover them dynamically.
@@ -29,6 +47,247 @@ static void bdb_start_top_level_commissioning_cb(uint8_t mode_mask)
     }
 }
 
+static void store_scan_results(uint16_t count, esp_zb_energy_detect_channel_info_t *channel_info)
+{
+    s_scan_count = 0;
+    for (int i = 0; i < count && s_scan_count < sizeof(s_scan_results) / sizeof(s_scan_results[0]); i++)
+    {
+        s_scan_results[s_scan_count].channel = channel_info[i].channel_number;
+        s_scan_results[s_scan_count].energy = channel_info[i].energy_detected;
+        s_scan_count++;
+        ESP_LOGI(TAG, "Channel %d energy %d", channel_info[i].channel_number, channel_info[i].energy_detected);
+    }
+}
+
+static void formation_energy_detect_cb(esp_zb_zdp_status_t status, uint16_t count,
+                                       esp_zb_energy_detect_channel_info_t *channel_info)
+{
+    int channel = -1;
+
+    if (status == ESP_ZB_ZDP_STATUS_SUCCESS)
+    {
+        store_scan_results(count, channel_info);
+        channel = channel_select_quietest(s_scan_results, s_scan_count, ESP_ZB_ALLOWED_CHANNEL_MASK);
+    }
+
+    if (channel > 0)
+    {
+        ESP_LOGI(TAG, "Forming on quietest channel %d", channel);
+        save_zigbee_channel_to_nvs(channel);
+        esp_zb_set_primary_network_channel_set(1UL << channel);
+    }
+    else
+    {
+        ESP_LOGW(TAG, "Energy scan failed (status %d), forming on any allowed channel", status);
+    }
+
+    esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_FORMATION);
+}
+
+static void migrate_channel(uint8_t channel)
+{
+    /* Scan duration 0xFE turns Mgmt_NWK_Update_req into a channel change for every rx-on device */
+    esp_zb_zdo_mgmt_nwk_update_req_param_t req = {
+        .scan_channels = 1UL << channel,
+        .scan_duration = 0xFE,
+        .scan_count = 0,
+        .dst_addr = 0xFFFD,
+    };
+    esp_zb_zdo_mgmt_nwk_update_req(&req, NULL, NULL);
+
+    save_zigbee_channel_to_nvs(channel);
+    esp_zb_set_primary_network_channel_set(1UL << channel);
+}
+
+static void rescan_energy_detect_cb(esp_zb_zdp_status_t status, uint16_t count,
+                                    esp_zb_energy_detect_channel_info_t *channel_info)
+{
+    s_rescan_pending = false;
+    if (status != ESP_ZB_ZDP_STATUS_SUCCESS)
+    {
+        ESP_LOGW(TAG, "Energy re-scan failed (status %d)", status);
+        return;
+    }
+
+    store_scan_results(count, channel_info);
+
+    uint8_t current = esp_zb_get_current_channel();
+    int best = channel_select_migration(s_scan_results, s_scan_count, ESP_ZB_ALLOWED_CHANNEL_MASK, current,
+                                        ESP_ZB_CHANNEL_MIGRATE_MARGIN);
+
+    if (best > 0)
+    {
+        ESP_LOGW(TAG, "Migrating network from channel %d to %d", current, best);
+        migrate_channel(best);
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Staying on channel %d", current);
+    }
+}
+
+/* Must run in Zigbee context (stack task or with the lock held). */
+static void start_channel_rescan(void)
+{
+    if (s_rescan_pending)
+        return;
+
+    s_rescan_pending = true;
+    s_rescanned = true;
+    s_last_rescan = xTaskGetTickCount();
+    esp_zb_zdo_energy_detect_request(ESP_ZB_ALLOWED_CHANNEL_MASK, ESP_ZB_ENERGY_SCAN_DURATION, rescan_energy_detect_cb);
+}
+
+static void zcl_send_status_handler(esp_zb_zcl_command_send_status_message_t message)
+{
+    bool over_threshold = channel_monitor_record(&s_channel_monitor, message.status == ESP_OK);
+    zb_bench_zigbee_on_send_status(message.tsn, message.status == ESP_OK);
+    lamp_state_on_send_status(message.tsn, message.status == ESP_OK);
+
+    if (over_threshold)
+    {
+        ESP_LOGW(TAG, "Send failure rate %d%% on channel %d",
+                 s_channel_monitor.last_failure_pct, esp_zb_get_current_channel());
+
+        // No interval to wait out before the first re-scan: interference right after boot counts too
+        if (s_channel_auto_migrate &&
+            (!s_rescanned || xTaskGetTickCount() - s_last_rescan > pdMS_TO_TICKS(CHANNEL_RESCAN_MIN_INTERVAL_MS)))
+        {
+            start_channel_rescan();
+        }
+    }
+}
+
+void zigbee_channel_rescan(void)
+{
+    esp_zb_lock_acquire(portMAX_DELAY);
+    start_channel_rescan();
+    esp_zb_lock_release();
+}
+
+void zigbee_channel_set_auto_migrate(bool enable)
+{
+    s_channel_auto_migrate = enable;
+}
+
+void zigbee_channel_print_status(void)
+{
+    printf("Channel: %d\n", esp_zb_get_current_channel());
+    printf("Auto migrate: %s\n", s_channel_auto_migrate ? "on" : "off");
+    printf("Frames sent: %" PRIu32 ", failed: %" PRIu32 ", last window failure rate: %d%%\n",
+           s_channel_monitor.total_sent, s_channel_monitor.total_failed, s_channel_monitor.last_failure_pct);
+    for (int i = 0; i < s_scan_count; i++)
+    {
+        printf("  ch %d energy %d\n", s_scan_results[i].channel, s_scan_results[i].energy);
+    }
+}
+
+static void configure_lamps_cb(uint8_t param)
+{
+    lamp_state_configure_all();
+    zigbee_topology_start();
+}
+
+/* A bound switch drove our override endpoint: take both lamps off the fade */
+static void override_attribute_changed(const esp_zb_zcl_set_attr_value_message_t *message)
+{
+    if (message->info.dst_endpoint != ESP_ZB_OVERRIDE_ENDPOINT || message->attribute.data.value == NULL)
+        return;
+
+    if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL &&
+        message->attribute.id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID)
+    {
+        lights_override(0, *(const uint8_t *)message->attribute.data.value, 0);
+    }
+    else if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF &&
+             message->attribute.id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID)
+    {
+        bool on = *(const bool *)message->attribute.data.value;
+        esp_zb_zcl_attr_t *level = esp_zb_zcl_get_attribute(ESP_ZB_OVERRIDE_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                                                            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+                                                            ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID);
+        uint8_t on_level = (level != NULL && level->data_p != NULL) ? *(uint8_t *)level->data_p : g_light_config.level_max;
+        lights_override(0, on ? on_level : 0, 0);
+    }
+}
+
+/* Answers to the scene fade's group and scene setup, passed on by the lamp's long address */
+static void scene_setup_response(const esp_zb_zcl_cmd_info_t *info, int scene_id, uint8_t status)
+{
+    esp_zb_ieee_addr_t address;
+    if (esp_zb_ieee_address_by_short(info->src_address.u.short_addr, address) == ESP_OK)
+        lights_scene_response(address, scene_id, status);
+}
+
+static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id, const void *message)
+{
+    switch (callback_id)
+    {
+    case ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID:
+        override_attribute_changed(message);
+        break;
+    case ESP_ZB_CORE_REPORT_ATTR_CB_ID:
+    {
+        const esp_zb_zcl_report_attr_message_t *report = message;
+        lamp_state_on_attribute(report->src_address.u.short_addr, report->cluster,
+                                report->attribute.id, report->attribute.data.value);
+        break;
+    }
+    case ESP_ZB_CORE_CMD_READ_ATTR_RESP_CB_ID:
+    {
+        const esp_zb_zcl_cmd_read_attr_resp_message_t *resp = message;
+        for (esp_zb_zcl_read_attr_resp_variable_t *var = resp->variables; var != NULL; var = var->next)
+        {
+            if (var->status == ESP_ZB_ZCL_STATUS_SUCCESS)
+            {
+                lamp_state_on_attribute(resp->info.src_address.u.short_addr, resp->info.cluster,
+                                        var->attribute.id, var->attribute.data.value);
+            }
+        }
+        break;
+    }
+    case ESP_ZB_CORE_CMD_REPORT_CONFIG_RESP_CB_ID:
+    {
+        const esp_zb_zcl_cmd_config_report_resp_message_t *resp = message;
+        lamp_state_on_report_config(resp->info.src_address.u.short_addr, resp->info.cluster,
+                                    resp->info.status == ESP_ZB_ZCL_STATUS_SUCCESS);
+        if (resp->info.status != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            ESP_LOGW(TAG, "Configure reporting for cluster 0x%04x on 0x%04x failed: 0x%x",
+                     resp->info.cluster, resp->info.src_address.u.short_addr, resp->info.status);
+        }
+        break;
+    }
+    case ESP_ZB_CORE_CMD_OPERATE_GROUP_RESP_CB_ID:
+    {
+        const esp_zb_zcl_groups_operate_group_resp_message_t *resp = message;
+        scene_setup_response(&resp->info, 0, resp->info.status);
+        break;
+    }
+    case ESP_ZB_CORE_CMD_OPERATE_SCENE_RESP_CB_ID:
+    {
+        const esp_zb_zcl_scenes_operate_scene_resp_message_t *resp = message;
+        scene_setup_response(&resp->info, resp->scene_id, resp->info.status);
+        break;
+    }
+    case ESP_ZB_CORE_CMD_DEFAULT_RESP_CB_ID:
+    {
+        // How a lamp without the Groups or Scenes server refuses the setup
+        const esp_zb_zcl_cmd_default_resp_message_t *resp = message;
+        if ((resp->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_GROUPS || resp->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_SCENES) &&
+            resp->status_code != ESP_ZB_ZCL_STATUS_SUCCESS)
+        {
+            scene_setup_response(&resp->info, -1, resp->status_code);
+        }
+        break;
+    }
+    default:
+        ESP_LOGD(TAG, "Unhandled Zigbee action callback 0x%x", callback_id);
+        break;
+    }
+    return ESP_OK;
+}
+
 /**
  * @brief Zigbee application signal handler.
  */
@@ -51,9 +310,16 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
         {
             ESP_LOGI(TAG, "Device started or rebooted. Factory-new? %s",
                      esp_zb_bdb_is_factory_new() ? "Yes" : "No");
-            if (esp_zb_bdb_is_factory_new())
+            uint8_t channel;
+            if (esp_zb_bdb_is_factory_new() && load_zigbee_channel_from_nvs(&channel) != ESP_OK)
             {
-                ESP_LOGI(TAG, "Start network formation");
+                ESP_LOGI(TAG, "Scanning channels before network formation");
+                esp_zb_zdo_energy_detect_request(ESP_ZB_ALLOWED_CHANNEL_MASK, ESP_ZB_ENERGY_SCAN_DURATION,
+                                                 formation_energy_detect_cb);
+            }
+            else if (esp_zb_bdb_is_factory_new())
+            {
+                ESP_LOGI(TAG, "Start network formation on stored channel %d", channel);
                 esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_FORMATION);
             }
             else
@@ -61,6 +327,8 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
                 // Already part of a network
                 ESP_LOGI(TAG, "Opening network for steering...");
                 esp_zb_bdb_open_network(180);
+                esp_zb_scheduler_alarm((esp_zb_callback_t)configure_lamps_cb, 0, 3000);
+                xEventGroupSetBits(s_network_events, NETWORK_READY_BIT);
             }
         }
         else
@@ -78,6 +346,8 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
             esp_zb_get_extended_pan_id(extended_pan_id);
             ESP_LOGI(TAG, "Formed network successfully");
             esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_NETWORK_STEERING);
+            esp_zb_scheduler_alarm((esp_zb_callback_t)configure_lamps_cb, 0, 3000);
+            xEventGroupSetBits(s_network_events, NETWORK_READY_BIT);
         }
         else
         {
@@ -95,9 +365,13 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
         break;
 
     case ESP_ZB_ZDO_SIGNAL_DEVICE_ANNCE:
-        /* You could capture the newly announced device address if needed */
-        // ...
+    {
+        esp_zb_zdo_signal_device_annce_params_t *dev_annce_params =
+            (esp_zb_zdo_signal_device_annce_params_t *)esp_zb_app_signal_get_params(p_sg_p);
+        ESP_LOGI(TAG, "Device 0x%04x announced", dev_annce_params->device_short_addr);
+        lamp_state_on_device_annce(dev_annce_params->device_short_addr, dev_annce_params->ieee_addr);
         break;
+    }
 
     case ESP_ZB_NWK_SIGNAL_PERMIT_JOIN_STATUS:
         if (err_status == ESP_OK)
@@ -130,8 +404,18 @@ static void zigbee_task(void *pvParameters)
     esp_zb_cfg_t zb_nwk_cfg = ESP_ZB_ZC_CONFIG();
     esp_zb_init(&zb_nwk_cfg);
 
-    /* Set channels, register endpoints, etc. */
-    esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
+    /* Set channels, register endpoints, etc.
+       Use the channel picked at first formation, or let the energy scan choose. */
+    uint8_t channel;
+    if (load_zigbee_channel_from_nvs(&channel) == ESP_OK)
+    {
+        esp_zb_set_primary_network_channel_set(1UL << channel);
+    }
+    else
+    {
+        esp_zb_set_primary_network_channel_set(ESP_ZB_ALLOWED_CHANNEL_MASK);
+    }
+    channel_monitor_init(&s_channel_monitor, ESP_ZB_CHANNEL_MONITOR_WINDOW, ESP_ZB_CHANNEL_RETRY_THRESHOLD_PCT);
 
     esp_zb_ep_list_t *ep_list = esp_zb_ep_list_create();
     esp_zb_cluster_list_t *cluster_list = esp_zb_zcl_cluster_list_create();
@@ -147,8 +431,36 @@ static void zigbee_task(void *pvParameters)
     esp_zb_basic_cluster_add_attr(basic_cluster, ESP_ZB_ZCL_ATTR_BASIC_MODEL_IDENTIFIER_ID, ESP_MODEL_IDENTIFIER);
     esp_zb_cluster_list_add_basic_cluster(cluster_list, basic_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_identify_cluster(cluster_list, esp_zb_identify_cluster_create(NULL), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    /* Client roles so the lamps' On/Off and Level reports are accepted */
+    esp_zb_cluster_list_add_on_off_cluster(cluster_list, esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_ON_OFF),
+                                           ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE);
+    esp_zb_cluster_list_add_level_cluster(cluster_list, esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL),
+                                          ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE);
+    /* Groups and Scenes clients for the scene-recall fade (DIMMING_STRATEGY_SCENE_RECALL) */
+    esp_zb_cluster_list_add_groups_cluster(cluster_list, esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_GROUPS),
+                                           ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE);
+    esp_zb_cluster_list_add_scenes_cluster(cluster_list, esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_SCENES),
+                                           ESP_ZB_ZCL_CLUSTER_CLIENT_ROLE);
     esp_zb_ep_list_add_ep(ep_list, cluster_list, endpoint_config);
+
+    /* Server On/Off and Level on a second endpoint: a switch bound here overrides the fade */
+    esp_zb_cluster_list_t *override_clusters = esp_zb_zcl_cluster_list_create();
+    esp_zb_endpoint_config_t override_config = {
+        .endpoint = ESP_ZB_OVERRIDE_ENDPOINT,
+        .app_profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .app_device_id = ESP_ZB_HA_DIMMABLE_LIGHT_DEVICE_ID,
+        .app_device_version = 0,
+    };
+    esp_zb_on_off_cluster_cfg_t on_off_cfg = {.on_off = ESP_ZB_ZCL_ON_OFF_ON_OFF_DEFAULT_VALUE};
+    esp_zb_level_cluster_cfg_t level_cfg = {.current_level = ESP_ZB_ZCL_LEVEL_CONTROL_CURRENT_LEVEL_DEFAULT_VALUE};
+    esp_zb_cluster_list_add_on_off_cluster(override_clusters, esp_zb_on_off_cluster_create(&on_off_cfg),
+                                           ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_cluster_list_add_level_cluster(override_clusters, esp_zb_level_cluster_create(&level_cfg),
+                                          ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+    esp_zb_ep_list_add_ep(ep_list, override_clusters, override_config);
     esp_zb_device_register(ep_list);
+    esp_zb_zcl_command_send_status_handler_register(zcl_send_status_handler);
+    esp_zb_core_action_handler_register(zb_action_handler);
 
     /* Start Zigbee Stack in non-blocking mode.
        The main loop is in esp_zb_stack_main_loop(). */
@@ -162,5 +474,12 @@ static void zigbee_task(void *pvParameters)
  */
 void zigbee_start_stack(void)
 {
+    s_network_events = xEventGroupCreate();
     xTaskCreate(&zigbee_task, "zigbee_task", 4096, NULL, 5, NULL);
 }
+
+bool zigbee_wait_for_network_ready(TickType_t timeout)
+{
+    EventBits_t bits = xEventGroupWaitBits(s_network_events, NETWORK_READY_BIT, pdFALSE, pdTRUE, timeout);
+    return (bits & NETWORK_READY_BIT) != 0;
+}
@@ -10,8 +10,14 @@ extern "C" {
 #define INSTALLCODE_POLICY_ENABLE false     /* enable the install code policy for security */
 #define HA_COLOR_DIMMABLE_SWITCH_ENDPOINT 1 /* esp light switch device endpoint */
 #define HA_GATEWAY_ENDPOINT 2
-#define ESP_ZB_PRIMARY_CHANNEL_MASK (1l << 13) /* Zigbee primary channel mask use in the example */
+#define ESP_ZB_ALLOWED_CHANNEL_MASK ESP_ZB_TRANSCEIVER_ALL_CHANNELS_MASK /* channels the energy scan may pick from */
+#define ESP_ZB_ENERGY_SCAN_DURATION 3          /* (2^n + 1) * 15.36 ms per channel */
+#define ESP_ZB_CHANNEL_MONITOR_WINDOW 200      /* frames per failure-rate window */
+#define ESP_ZB_CHANNEL_RETRY_THRESHOLD_PCT 20  /* failure rate that triggers a re-scan */
+#define ESP_ZB_CHANNEL_MIGRATE_MARGIN 10       /* required energy improvement before migrating */
+#define ESP_ZB_CHANNEL_AUTO_MIGRATE false      /* re-scan and migrate automatically */
 #define ESP_ZB_GATEWAY_ENDPOINT 1              /* Gateway endpoint identifier */
+#define ESP_ZB_OVERRIDE_ENDPOINT 10            /* dimmable-light endpoint a wall switch can bind to */
 #define APP_PROD_CFG_CURRENT_VERSION 0x0001    /* Production configuration version */
 
 /* Basic manufacturer information */
@@ -44,6 +50,28 @@ extern "C" {
  */
 void zigbee_start_stack(void);
 
+/**
+ * @brief Block until the network has been formed or restored after a reboot.
+ *
+ * @return true if the network is up, false on timeout.
+ */
+bool zigbee_wait_for_network_ready(TickType_t timeout);
+
+/**
+ * @brief Run an energy scan now and migrate the network if a clearly quieter channel exists.
+ */
+void zigbee_channel_rescan(void);
+
+/**
+ * @brief Enable/disable automatic re-scan when the failure rate exceeds the threshold.
+ */
+void zigbee_channel_set_auto_migrate(bool enable);
+
+/**
+ * @brief Print channel, scan results and send/failure counters.
+ */
+void zigbee_channel_print_status(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,391 @@
+#include "zigbee_topology.h"
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "lamp_state.h"
+
+static const char *TAG = "TOPOLOGY";
+
+#define COORDINATOR_ADDR   0x0000
+#define NODE_ROUTER        1   /* ZDO device type */
+#define RELATION_CHILD     1   /* ZDO neighbour relationship */
+#define RELATION_PREVIOUS_CHILD 4
+
+typedef struct {
+    uint16_t from, to;
+    uint8_t lqi;
+    uint8_t depth;
+    uint8_t device_type;
+    uint8_t relationship;
+} topology_link_t;
+
+typedef struct {
+    uint16_t dest, next_hop;
+} topology_route_t;
+
+typedef struct {
+    esp_zb_ieee_addr_t address;
+    uint8_t id;
+    uint16_t short_addr;
+    uint16_t via;
+    uint8_t slot;
+} topology_lamp_t;
+
+/* Level frames and confirms over the time spent in one slotting setting */
+typedef struct {
+    int64_t time_us;
+    uint32_t sent, failed, confirms;
+    uint64_t confirm_total_us;
+} topology_stats_t;
+
+/* The walk in progress, touched from the Zigbee context only */
+static struct {
+    topology_link_t links[TOPOLOGY_MAX_LINKS];
+    int link_count;
+    topology_route_t routes[TOPOLOGY_MAX_ROUTES];
+    int route_count;
+    uint16_t routers[TOPOLOGY_MAX_ROUTERS];
+    int router_count, router_next;
+    int failed_queries;
+    bool running;
+    int64_t started_us;
+} s_walk;
+
+/* The last finished map, read by the fade tasks and the console */
+static topology_link_t s_links[TOPOLOGY_MAX_LINKS];
+static int s_link_count;
+static int s_routers_queried, s_failed_queries;
+static topology_lamp_t s_lamps[MAX_LAMPS];
+static int s_lamp_count;
+static int s_slots_used;
+static int64_t s_refreshed_us;
+static bool s_slotting = true;
+static bool s_started;
+static portMUX_TYPE s_topology_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static topology_stats_t s_stats[2];   // [0] back to back, [1] slotted
+static topology_stats_t s_last_totals;
+static int64_t s_last_sample_us;
+
+static void walk_next_router(void);
+
+/* Slotting only changes anything once two lamps share a path */
+static bool slotting_active(void)
+{
+    return s_slotting && s_slots_used > 1;
+}
+
+/**
+ * Charge the lamps' counters since the last call to the setting that was in
+ * force. Call with s_topology_lock held: the console and the Zigbee task both
+ * sample, and the counters must be read under the same lock as the totals
+ * they are taken from, or an older read could land after a newer one.
+ */
+static void sample_stats_locked(void)
+{
+    topology_stats_t totals = {0};
+    lamp_state_totals(&totals.sent, &totals.failed, &totals.confirms, &totals.confirm_total_us);
+    int64_t now_us = esp_timer_get_time();
+
+    topology_stats_t *stats = &s_stats[slotting_active() ? 1 : 0];
+    stats->time_us += now_us - s_last_sample_us;
+    stats->sent += totals.sent - s_last_totals.sent;
+    stats->failed += totals.failed - s_last_totals.failed;
+    stats->confirms += totals.confirms - s_last_totals.confirms;
+    stats->confirm_total_us += totals.confirm_total_us - s_last_totals.confirm_total_us;
+    s_last_totals = totals;
+    s_last_sample_us = now_us;
+}
+
+static void walk_add_link(uint16_t from, uint16_t to, uint8_t lqi, uint8_t depth, uint8_t device_type,
+                          uint8_t relationship)
+{
+    if (s_walk.link_count < TOPOLOGY_MAX_LINKS)
+    {
+        s_walk.links[s_walk.link_count++] = (topology_link_t){
+            .from = from, .to = to, .lqi = lqi, .depth = depth,
+            .device_type = device_type, .relationship = relationship,
+        };
+    }
+    if (device_type != NODE_ROUTER || to == COORDINATOR_ADDR)
+        return;
+    for (int i = 0; i < s_walk.router_count; i++)
+    {
+        if (s_walk.routers[i] == to)
+            return;
+    }
+    if (s_walk.router_count < TOPOLOGY_MAX_ROUTERS)
+        s_walk.routers[s_walk.router_count++] = to;
+}
+
+/**
+ * The router a lamp's frames pass through last, or the lamp itself if it
+ * hears us directly or no walked router has it as a neighbour. Only the
+ * coordinator's route is known, not the routers', so the last hop is the
+ * walked router with the best link to the lamp; the route's next hop wins
+ * when it is one of them, since the frames are known to reach it.
+ */
+static uint16_t walk_lamp_via(uint16_t short_addr)
+{
+    uint16_t next_hop = SHORT_ADDR_UNKNOWN;
+    for (int i = 0; i < s_walk.route_count; i++)
+    {
+        if (s_walk.routes[i].dest == short_addr)
+            next_hop = s_walk.routes[i].next_hop;
+    }
+    const topology_link_t *best = NULL;
+    for (int i = 0; i < s_walk.link_count; i++)
+    {
+        const topology_link_t *link = &s_walk.links[i];
+        if (link->to != short_addr || link->relationship == RELATION_PREVIOUS_CHILD)
+            continue;
+        if (link->from == COORDINATOR_ADDR)
+            return short_addr;
+        if (best == NULL || (link->from == next_hop) > (best->from == next_hop) ||
+            ((link->from == next_hop) == (best->from == next_hop) && link->lqi > best->lqi))
+            best = link;
+    }
+    return best != NULL ? best->from : short_addr;
+}
+
+static void walk_finish(void)
+{
+    static lamp_state_t lamps[MAX_LAMPS];
+    topology_lamp_t assigned[MAX_LAMPS];
+    int n = lamp_state_list(lamps, MAX_LAMPS);
+    int slots_used = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        memcpy(assigned[i].address, lamps[i].address, sizeof(esp_zb_ieee_addr_t));
+        assigned[i].id = lamps[i].id;
+        assigned[i].short_addr = lamps[i].short_addr;
+        // A lamp we have no short address for yet gets a path of its own
+        assigned[i].via = lamps[i].short_addr != SHORT_ADDR_UNKNOWN ? walk_lamp_via(lamps[i].short_addr)
+                                                                     : SHORT_ADDR_UNKNOWN - 1 - i;
+        // Next free slot among the lamps behind the same node
+        assigned[i].slot = 0;
+        for (int j = 0; j < i; j++)
+        {
+            if (assigned[j].via == assigned[i].via)
+                assigned[i].slot++;
+        }
+        if (assigned[i].slot + 1 > slots_used)
+            slots_used = assigned[i].slot + 1;
+    }
+
+    portENTER_CRITICAL(&s_topology_lock);
+    sample_stats_locked();
+    memcpy(s_links, s_walk.links, s_walk.link_count * sizeof(topology_link_t));
+    s_link_count = s_walk.link_count;
+    s_routers_queried = s_walk.router_count;
+    s_failed_queries = s_walk.failed_queries;
+    memcpy(s_lamps, assigned, n * sizeof(topology_lamp_t));
+    s_lamp_count = n;
+    s_slots_used = slots_used;
+    s_refreshed_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&s_topology_lock);
+
+    s_walk.running = false;
+    ESP_LOGI(TAG, "%d links, %d routers queried (%d failed), %d slots for %d lamps",
+             s_walk.link_count, s_walk.router_count, s_walk.failed_queries, slots_used, n);
+}
+
+static void walk_request_lqi(uint16_t dst_addr, uint8_t start_index);
+
+static void walk_lqi_rsp_cb(const esp_zb_zdo_mgmt_lqi_rsp_t *rsp, void *user_ctx)
+{
+    uint16_t from = (uint16_t)(uintptr_t)user_ctx;
+
+    // A walk that timed out and was restarted must not take stale answers
+    if (!s_walk.running || s_walk.router_next >= s_walk.router_count || s_walk.routers[s_walk.router_next] != from)
+        return;
+
+    if (rsp->status == ESP_ZB_ZDP_STATUS_SUCCESS)
+    {
+        for (int i = 0; i < rsp->neighbor_table_list_count; i++)
+        {
+            const esp_zb_zdo_neighbor_table_list_record_t *record = &rsp->neighbor_table_list[i];
+            walk_add_link(from, record->network_addr, record->lqi, record->depth, record->device_type,
+                          record->relationship);
+        }
+        // The table comes in pages of a few entries
+        int next_index = rsp->start_index + rsp->neighbor_table_list_count;
+        if (rsp->neighbor_table_list_count > 0 && next_index < rsp->neighbor_table_entries)
+        {
+            walk_request_lqi(from, (uint8_t)next_index);
+            return;
+        }
+    }
+    else
+    {
+        ESP_LOGD(TAG, "Mgmt_Lqi to 0x%04x failed: 0x%x", from, rsp->status);
+        s_walk.failed_queries++;
+    }
+    s_walk.router_next++;
+    walk_next_router();
+}
+
+static void walk_request_lqi(uint16_t dst_addr, uint8_t start_index)
+{
+    esp_zb_zdo_mgmt_lqi_req_param_t req = {
+        .dst_addr = dst_addr,
+        .start_index = start_index,
+    };
+    esp_zb_zdo_mgmt_lqi_req(&req, walk_lqi_rsp_cb, (void *)(uintptr_t)dst_addr);
+}
+
+/* One router at a time, so the walk itself does not crowd the lamps' traffic */
+static void walk_next_router(void)
+{
+    if (s_walk.router_next >= s_walk.router_count)
+        walk_finish();
+    else
+        walk_request_lqi(s_walk.routers[s_walk.router_next], 0);
+}
+
+/* Zigbee context */
+static void walk_start(void)
+{
+    memset(&s_walk, 0, sizeof(s_walk));
+    s_walk.running = true;
+    s_walk.started_us = esp_timer_get_time();
+
+    esp_zb_nwk_info_iterator_t it = ESP_ZB_NWK_INFO_ITERATOR_INIT;
+    esp_zb_nwk_neighbor_info_t neighbor;
+    while (esp_zb_nwk_get_next_neighbor(&it, &neighbor) == ESP_OK)
+    {
+        walk_add_link(COORDINATOR_ADDR, neighbor.short_addr, neighbor.lqi, neighbor.depth, neighbor.device_type,
+                      neighbor.relationship);
+    }
+
+    it = ESP_ZB_NWK_INFO_ITERATOR_INIT;
+    esp_zb_nwk_route_info_t route;
+    while (esp_zb_nwk_get_next_route(&it, &route) == ESP_OK && s_walk.route_count < TOPOLOGY_MAX_ROUTES)
+    {
+        s_walk.routes[s_walk.route_count++] = (topology_route_t){
+            .dest = route.dest_addr,
+            .next_hop = route.next_hop_addr,
+        };
+    }
+
+    walk_next_router();
+}
+
+static void refresh_cb(uint8_t param)
+{
+    if (!s_walk.running || esp_timer_get_time() - s_walk.started_us > TOPOLOGY_REFRESH_TIMEOUT_MS * 1000LL)
+        walk_start();
+    esp_zb_scheduler_alarm((esp_zb_callback_t)refresh_cb, 0, TOPOLOGY_REFRESH_MS);
+}
+
+void zigbee_topology_start(void)
+{
+    if (s_started)
+        return;
+    s_started = true;
+    s_last_sample_us = esp_timer_get_time();
+    esp_zb_scheduler_alarm((esp_zb_callback_t)refresh_cb, 0, TOPOLOGY_FIRST_REFRESH_MS);
+}
+
+void zigbee_topology_refresh(void)
+{
+    esp_zb_lock_acquire(portMAX_DELAY);
+    walk_start();
+    esp_zb_lock_release();
+}
+
+void zigbee_topology_set_slotting(bool enable)
+{
+    portENTER_CRITICAL(&s_topology_lock);
+    sample_stats_locked();
+    s_slotting = enable;
+    portEXIT_CRITICAL(&s_topology_lock);
+}
+
+uint32_t zigbee_topology_slot_ms(const esp_zb_ieee_addr_t address)
+{
+    uint32_t slot_ms = 0;
+    portENTER_CRITICAL(&s_topology_lock);
+    for (int i = 0; i < s_lamp_count && s_slotting; i++)
+    {
+        if (memcmp(s_lamps[i].address, address, sizeof(esp_zb_ieee_addr_t)) == 0)
+        {
+            slot_ms = s_lamps[i].slot * TOPOLOGY_SLOT_MS;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&s_topology_lock);
+    return slot_ms;
+}
+
+static void print_stats(const char *name, const topology_stats_t *stats)
+{
+    printf("  %-12s %8" PRId64 " s %7" PRIu32 " frames %6" PRIu32 " failed (%.2f%%), confirm %.1f ms\n", name,
+           stats->time_us / 1000000, stats->sent, stats->failed,
+           stats->sent > 0 ? 100.0 * stats->failed / stats->sent : 0.0,
+           stats->confirms > 0 ? stats->confirm_total_us / 1000.0 / stats->confirms : 0.0);
+}
+
+static bool map_has_link(const topology_link_t *links, int link_count, uint16_t from, uint16_t to)
+{
+    for (int i = 0; i < link_count; i++)
+    {
+        if (links[i].from == from && links[i].to == to)
+            return true;
+    }
+    return false;
+}
+
+void zigbee_topology_print(void)
+{
+    static topology_link_t links[TOPOLOGY_MAX_LINKS];
+    topology_lamp_t lamps[MAX_LAMPS];
+    topology_stats_t stats[2];
+
+    portENTER_CRITICAL(&s_topology_lock);
+    sample_stats_locked();
+    int link_count = s_link_count, lamp_count = s_lamp_count, slots_used = s_slots_used;
+    int routers_queried = s_routers_queried, failed_queries = s_failed_queries;
+    int64_t refreshed_us = s_refreshed_us;
+    memcpy(links, s_links, link_count * sizeof(topology_link_t));
+    memcpy(lamps, s_lamps, lamp_count * sizeof(topology_lamp_t));
+    memcpy(stats, s_stats, sizeof(stats));
+    bool slotting = s_slotting, active = slotting_active();
+    portEXIT_CRITICAL(&s_topology_lock);
+
+    if (refreshed_us == 0)
+        printf("Topology: no map yet%s\n", s_walk.running ? " (walking the mesh)" : "");
+    else
+        printf("Topology: refreshed %" PRId64 " s ago, %d links, %d routers queried (%d failed)%s\n",
+               (esp_timer_get_time() - refreshed_us) / 1000000, link_count, routers_queried, failed_queries,
+               s_walk.running ? ", refreshing" : "");
+    printf("Slotting: %s, %d ms slots, %d in use%s\n", slotting ? "on" : "off", TOPOLOGY_SLOT_MS, slots_used,
+           slotting && !active ? " (no two lamps share a path)" : "");
+
+    for (int i = 0; i < link_count; i++)
+    {
+        printf("  0x%04x -> 0x%04x lqi %3d depth %d %s%s\n", links[i].from, links[i].to, links[i].lqi,
+               links[i].depth, links[i].device_type == NODE_ROUTER ? "router" : "node",
+               links[i].relationship == RELATION_CHILD ? ", child" : "");
+    }
+    for (int i = 0; i < lamp_count; i++)
+    {
+        if (lamps[i].short_addr == SHORT_ADDR_UNKNOWN)
+            printf("  lamp %d: short address unknown, slot %d\n", lamps[i].id, lamps[i].slot);
+        else if (lamps[i].via == lamps[i].short_addr)
+            printf("  lamp %d 0x%04x: %s, slot %d\n", lamps[i].id, lamps[i].short_addr,
+                   map_has_link(links, link_count, COORDINATOR_ADDR, lamps[i].short_addr) ? "direct" : "last hop unknown",
+                   lamps[i].slot);
+        else
+            printf("  lamp %d 0x%04x: via 0x%04x, slot %d\n", lamps[i].id, lamps[i].short_addr, lamps[i].via,
+                   lamps[i].slot);
+    }
+
+    printf("Level frames:\n");
+    print_stats("back to back", &stats[0]);
+    print_stats("slotted", &stats[1]);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "zigbee_main.h"
+
+/*
+ * Map of the mesh as the coordinator sees it, and time slots derived from it.
+ *
+ * Every refresh reads the coordinator's own neighbour and routing tables and
+ * walks the routers it finds with ZDO Mgmt_Lqi requests. Each lamp is then
+ * filed under the router its frames pass through last: of the walked routers
+ * that list it as a neighbour, the next hop of its route if that is one of
+ * them, else the one with the best link. A lamp that is our direct
+ * neighbour, or that no walked router lists, is filed under itself. Lamps
+ * filed under the same router get consecutive slots, so at a segment
+ * boundary their commands leave TOPOLOGY_SLOT_MS apart instead of queueing
+ * together at that router; lamps on different paths share slot 0.
+ */
+#define TOPOLOGY_SLOT_MS             60
+#define TOPOLOGY_REFRESH_MS          (10 * 60 * 1000)
+#define TOPOLOGY_FIRST_REFRESH_MS    15000
+#define TOPOLOGY_REFRESH_TIMEOUT_MS  60000   /* a walk still running then is restarted */
+#define TOPOLOGY_MAX_LINKS           64
+#define TOPOLOGY_MAX_ROUTES          32
+#define TOPOLOGY_MAX_ROUTERS         8       /* Mgmt_Lqi targets per refresh */
+
+/**
+ * @brief Schedule the first refresh and the periodic ones (Zigbee context,
+ *        once the network is up; later calls do nothing).
+ */
+void zigbee_topology_start(void);
+
+/**
+ * @brief Walk the mesh again now.
+ */
+void zigbee_topology_refresh(void);
+
+/**
+ * @brief Turn the slot offsets on or off; the link statistics are kept per setting.
+ */
+void zigbee_topology_set_slotting(bool enable);
+
+/**
+ * @brief How long after a segment boundary the lamp's command should go out,
+ *        0 with slotting off or before the first map.
+ */
+uint32_t zigbee_topology_slot_ms(const esp_zb_ieee_addr_t address);
+
+/**
+ * @brief Print the map, each lamp's path and slot, and the failure rate and
+ *        confirm time of the level frames with slotting off and on.
+ */
+void zigbee_topology_print(void);
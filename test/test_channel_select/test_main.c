@@ -0,0 +1,182 @@
+/*
+ * Host tests of src/channel_select.c against a fake radio: every channel
+ * has a noise level, an energy scan reports it, and frames sent on a
+ * channel fail with a probability that grows with its noise. This is the
+ * loop zigbee_main.c runs with the real stack: form on the quietest
+ * channel, count send confirms, re-scan when a window fails too often
+ * and migrate if a clearly quieter channel exists.
+ *
+ *   pio test -e native -f test_channel_select
+ */
+
+#include <unity.h>
+#include "channel_select.h"
+
+#define ALL_CHANNELS  0x07FFF800UL
+#define WINDOW        200
+#define THRESHOLD_PCT 20
+#define MARGIN        10
+
+typedef struct {
+    int8_t noise[ZB_CHANNEL_MAX + 1];
+    uint8_t channel;
+    uint32_t seed;
+} fake_radio_t;
+
+static fake_radio_t s_radio;
+
+void setUp(void)
+{
+    for (int ch = ZB_CHANNEL_MIN; ch <= ZB_CHANNEL_MAX; ch++)
+        s_radio.noise[ch] = 30;
+    s_radio.channel = 0;
+    s_radio.seed = 12345;
+}
+
+void tearDown(void)
+{
+}
+
+static int fake_scan(channel_energy_t *results, uint32_t mask)
+{
+    int count = 0;
+    for (int ch = ZB_CHANNEL_MIN; ch <= ZB_CHANNEL_MAX; ch++)
+    {
+        if (mask & (1UL << ch))
+            results[count++] = (channel_energy_t){.channel = (uint8_t)ch, .energy = s_radio.noise[ch]};
+    }
+    return count;
+}
+
+/* A frame fails with noise/2 percent probability (so noise 60 is 30% failures) */
+static bool fake_send(void)
+{
+    s_radio.seed = s_radio.seed * 1103515245u + 12345u;
+    return (s_radio.seed >> 16) % 100 >= (uint32_t)s_radio.noise[s_radio.channel] / 2;
+}
+
+static void form(void)
+{
+    channel_energy_t results[ZB_CHANNEL_MAX - ZB_CHANNEL_MIN + 1];
+    int count = fake_scan(results, ALL_CHANNELS);
+    s_radio.channel = (uint8_t)channel_select_quietest(results, count, ALL_CHANNELS);
+}
+
+/* Send `frames`, re-scanning and migrating like zigbee_main.c; returns the migrations */
+static int run(channel_monitor_t *monitor, int frames)
+{
+    int migrations = 0;
+    for (int i = 0; i < frames; i++)
+    {
+        if (!channel_monitor_record(monitor, fake_send()))
+            continue;
+        channel_energy_t results[ZB_CHANNEL_MAX - ZB_CHANNEL_MIN + 1];
+        int count = fake_scan(results, ALL_CHANNELS);
+        int target = channel_select_migration(results, count, ALL_CHANNELS, s_radio.channel, MARGIN);
+        if (target > 0)
+        {
+            s_radio.channel = (uint8_t)target;
+            migrations++;
+        }
+    }
+    return migrations;
+}
+
+static void test_forms_on_quietest_channel(void)
+{
+    s_radio.noise[13] = 90;
+    s_radio.noise[20] = 5;
+    form();
+    TEST_ASSERT_EQUAL_INT(20, s_radio.channel);
+}
+
+static void test_tie_broken_by_neighbours_then_number(void)
+{
+    channel_energy_t results[] = {{11, 10}, {12, 40}, {15, 10}, {16, 5}, {18, 10}, {19, 5}, {20, 5}};
+    // 16, 19 and 20 tie at 5; their neighbours sum to 10, 15 and 5
+    TEST_ASSERT_EQUAL_INT(20, channel_select_quietest(results, 7, ALL_CHANNELS));
+    channel_energy_t flat[] = {{14, 7}, {22, 7}, {18, 7}};
+    TEST_ASSERT_EQUAL_INT(14, channel_select_quietest(flat, 3, ALL_CHANNELS));
+}
+
+static void test_mask_is_respected(void)
+{
+    channel_energy_t results[] = {{11, 0}, {15, 20}, {25, 10}};
+    TEST_ASSERT_EQUAL_INT(25, channel_select_quietest(results, 3, (1UL << 15) | (1UL << 25)));
+    TEST_ASSERT_EQUAL_INT(-1, channel_select_quietest(results, 3, 1UL << 26));
+}
+
+static void test_quiet_channel_never_triggers(void)
+{
+    channel_monitor_t monitor;
+    channel_monitor_init(&monitor, WINDOW, THRESHOLD_PCT);
+    form();
+    uint8_t formed = s_radio.channel;
+    TEST_ASSERT_EQUAL_INT(0, run(&monitor, 10 * WINDOW));
+    TEST_ASSERT_EQUAL_INT(formed, s_radio.channel);
+    TEST_ASSERT_TRUE(monitor.last_failure_pct <= THRESHOLD_PCT);
+}
+
+/* Wi-Fi starts next to our channel: the monitor trips and the network moves away once */
+static void test_interference_migrates_to_quietest(void)
+{
+    channel_monitor_t monitor;
+    channel_monitor_init(&monitor, WINDOW, THRESHOLD_PCT);
+    s_radio.noise[24] = 10;
+    form();
+    TEST_ASSERT_EQUAL_INT(24, s_radio.channel);
+
+    s_radio.noise[24] = 80;
+    s_radio.noise[17] = 12;
+    TEST_ASSERT_EQUAL_INT(1, run(&monitor, 3 * WINDOW));
+    TEST_ASSERT_EQUAL_INT(17, s_radio.channel);
+    TEST_ASSERT_EQUAL_INT(0, run(&monitor, 10 * WINDOW));
+}
+
+/* Everything is busy: re-scans happen, but no channel is better by the margin */
+static void test_no_migration_within_margin(void)
+{
+    channel_monitor_t monitor;
+    channel_monitor_init(&monitor, WINDOW, THRESHOLD_PCT);
+    for (int ch = ZB_CHANNEL_MIN; ch <= ZB_CHANNEL_MAX; ch++)
+        s_radio.noise[ch] = 70;
+    s_radio.noise[15] = 62;
+    s_radio.channel = 11;
+    TEST_ASSERT_EQUAL_INT(0, run(&monitor, 5 * WINDOW));
+    TEST_ASSERT_EQUAL_INT(11, s_radio.channel);
+    TEST_ASSERT_TRUE(monitor.last_failure_pct > THRESHOLD_PCT);
+
+    channel_energy_t results[] = {{11, 70}, {15, 62}};
+    TEST_ASSERT_EQUAL_INT(-1, channel_select_migration(results, 2, ALL_CHANNELS, 11, MARGIN));
+    TEST_ASSERT_EQUAL_INT(15, channel_select_migration(results, 2, ALL_CHANNELS, 11, 5));
+    TEST_ASSERT_EQUAL_INT(-1, channel_select_migration(results, 2, ALL_CHANNELS, 20, 5));
+}
+
+static void test_monitor_windows(void)
+{
+    channel_monitor_t monitor;
+    channel_monitor_init(&monitor, 10, 20);
+    for (int i = 0; i < 9; i++)
+        TEST_ASSERT_FALSE(channel_monitor_record(&monitor, i >= 3));
+    TEST_ASSERT_TRUE(channel_monitor_record(&monitor, true));
+    TEST_ASSERT_EQUAL_INT(30, monitor.last_failure_pct);
+    for (int i = 0; i < 9; i++)
+        TEST_ASSERT_FALSE(channel_monitor_record(&monitor, i >= 2));
+    TEST_ASSERT_FALSE(channel_monitor_record(&monitor, true));
+    TEST_ASSERT_EQUAL_INT(20, monitor.last_failure_pct);
+    TEST_ASSERT_EQUAL_UINT32(20, monitor.total_sent);
+    TEST_ASSERT_EQUAL_UINT32(5, monitor.total_failed);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_forms_on_quietest_channel);
+    RUN_TEST(test_tie_broken_by_neighbours_then_number);
+    RUN_TEST(test_mask_is_respected);
+    RUN_TEST(test_quiet_channel_never_triggers);
+    RUN_TEST(test_interference_migrates_to_quietest);
+    RUN_TEST(test_no_migration_within_margin);
+    RUN_TEST(test_monitor_windows);
+    return UNITY_END();
+}
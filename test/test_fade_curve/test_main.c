@@ -0,0 +1,188 @@
+/*
+ * Host tests of src/fade_curve.c: table properties for every gamma mode,
+ * curve type and table size, and the step lookup over a whole cycle.
+ *
+ *   pio test -e native -f test_fade_curve
+ */
+
+#include <unity.h>
+#include "fade_curve.h"
+
+static const int s_sizes[] = {2, 3, 8, 16, 30, 64, 128, MAX_SEGMENTS};
+static fade_segment_t s_table[MAX_SEGMENTS];
+
+static fade_curve_params_t default_params(void)
+{
+    fade_curve_params_t params = {
+        .level_min = 1,
+        .level_max = 254,
+        .curve_type = CURVE_TYPE_LINEAR,
+        .gamma_mode = GAMMA_MODE_LINEAR,
+        .gamma_pow_value = 2.2,
+        .gamma_pow_scale = 1.0,
+        .gamma_log_value = 10.0,
+    };
+    return params;
+}
+
+void setUp(void)
+{
+}
+
+void tearDown(void)
+{
+}
+
+/* Monotonic, inside [level_min, level_max], fractions from 0 to 1 */
+static void check_properties(const fade_curve_params_t *params)
+{
+    char msg[96];
+    for (int s = 0; s < sizeof(s_sizes) / sizeof(s_sizes[0]); s++)
+    {
+        int n = s_sizes[s];
+        fade_curve_build_table(params, n, s_table);
+        snprintf(msg, sizeof(msg), "gamma %d curve %d size %d min %d max %d", params->gamma_mode,
+                 params->curve_type, n, params->level_min, params->level_max);
+
+        TEST_ASSERT_TRUE_MESSAGE(fade_curve_check_table(params, s_table, n), msg);
+        TEST_ASSERT_EQUAL_UINT8_MESSAGE(params->level_max, s_table[n - 1].level, msg);
+        for (int i = 1; i < n; i++)
+        {
+            TEST_ASSERT_TRUE_MESSAGE(s_table[i].level >= s_table[i - 1].level, msg);
+            TEST_ASSERT_TRUE_MESSAGE(s_table[i].level >= params->level_min, msg);
+            TEST_ASSERT_TRUE_MESSAGE(s_table[i].level <= params->level_max, msg);
+            TEST_ASSERT_TRUE_MESSAGE(s_table[i].fraction_of_fade > s_table[i - 1].fraction_of_fade, msg);
+        }
+    }
+}
+
+static void test_all_modes_and_curves(void)
+{
+    fade_curve_params_t params = default_params();
+    for (int gamma = 0; gamma < GAMMA_MODE_COUNT; gamma++)
+    {
+        for (int curve = 0; curve < CURVE_TYPE_COUNT; curve++)
+        {
+            params.gamma_mode = (gamma_mode_t)gamma;
+            params.curve_type = (curve_type_t)curve;
+            check_properties(&params);
+        }
+    }
+}
+
+static void test_narrowed_range(void)
+{
+    fade_curve_params_t params = default_params();
+    params.level_min = 40;
+    params.level_max = 120;
+    for (int gamma = 0; gamma < GAMMA_MODE_COUNT; gamma++)
+    {
+        params.gamma_mode = (gamma_mode_t)gamma;
+        check_properties(&params);
+        TEST_ASSERT_EQUAL_UINT8(40, s_table[0].level);
+    }
+}
+
+static void test_max_below_min_is_flat(void)
+{
+    fade_curve_params_t params = default_params();
+    params.level_min = 100;
+    params.level_max = 50;
+    fade_curve_build_table(&params, 16, s_table);
+    for (int i = 0; i < 16; i++)
+        TEST_ASSERT_EQUAL_UINT8(100, s_table[i].level);
+    TEST_ASSERT_TRUE(fade_curve_check_table(&params, s_table, 16));
+}
+
+static void test_linear_midpoint(void)
+{
+    fade_curve_params_t params = default_params();
+    params.level_min = 0;
+    params.level_max = 200;
+    fade_curve_build_table(&params, 3, s_table);
+    TEST_ASSERT_EQUAL_UINT8(0, s_table[0].level);
+    TEST_ASSERT_EQUAL_UINT8(100, s_table[1].level);
+    TEST_ASSERT_EQUAL_UINT8(200, s_table[2].level);
+}
+
+/* gamma_pow_scale below 1 lifts entry 0 to (1 - scale) of the range */
+static void test_exponential_scale_lifts_first_entry(void)
+{
+    fade_curve_params_t params = default_params();
+    params.level_min = 0;
+    params.level_max = 250;
+    params.gamma_mode = GAMMA_MODE_EXPONENTIAL;
+    params.gamma_pow_scale = 0.5;
+    fade_curve_build_table(&params, 16, s_table);
+    TEST_ASSERT_EQUAL_UINT8(125, s_table[0].level);
+    TEST_ASSERT_EQUAL_UINT8(250, s_table[15].level);
+    TEST_ASSERT_TRUE(fade_curve_check_table(&params, s_table, 16));
+
+    params.gamma_pow_scale = 2.0;
+    fade_curve_build_table(&params, 16, s_table);
+    TEST_ASSERT_EQUAL_UINT8(0, s_table[0].level);
+    check_properties(&params);
+}
+
+static void test_check_table_rejects_broken_tables(void)
+{
+    fade_curve_params_t params = default_params();
+    fade_curve_build_table(&params, 16, s_table);
+    s_table[8].level = s_table[7].level - 1;
+    TEST_ASSERT_FALSE(fade_curve_check_table(&params, s_table, 16));
+
+    fade_curve_build_table(&params, 16, s_table);
+    s_table[15].level = params.level_max - 1;
+    TEST_ASSERT_FALSE(fade_curve_check_table(&params, s_table, 16));
+}
+
+/* Every step ends where the next begins, levels follow the table up and down */
+static void test_step_at_covers_cycle(void)
+{
+    fade_curve_params_t params = default_params();
+    fade_cycle_t cycle = {.fade_ms = 10000, .on_ms = 2000, .off_ms = 3000};
+    uint32_t length = fade_cycle_length_ms(&cycle);
+    fade_curve_build_table(&params, 30, s_table);
+    TEST_ASSERT_EQUAL_UINT32(25000, length);
+
+    uint32_t t = 0;
+    int steps = 0;
+    fade_step_t step;
+    while (t < length)
+    {
+        fade_curve_step_at(&cycle, s_table, 30, t, &step);
+        TEST_ASSERT_TRUE(step.end_ms > t);
+        TEST_ASSERT_TRUE(step.end_ms <= length);
+        if (step.segment >= 0)
+        {
+            TEST_ASSERT_EQUAL_UINT8(s_table[step.segment].level, step.level);
+            TEST_ASSERT_EQUAL_UINT32(step.end_ms - t, step.transition_ms);
+        }
+        t = step.end_ms;
+        steps++;
+    }
+    // 29 segments each way and the two holds
+    TEST_ASSERT_EQUAL_INT(2 * 29 + 2, steps);
+
+    // Mid-segment start: same target, only the remaining transition
+    fade_step_t start, mid;
+    fade_curve_step_at(&cycle, s_table, 30, 1000, &start);
+    fade_curve_step_at(&cycle, s_table, 30, start.end_ms - 50, &mid);
+    TEST_ASSERT_EQUAL_INT(start.segment, mid.segment);
+    TEST_ASSERT_EQUAL_UINT32(50, mid.transition_ms);
+    fade_curve_step_at(&cycle, s_table, 30, length + 1000, &mid);
+    TEST_ASSERT_EQUAL_INT(start.segment, mid.segment);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_all_modes_and_curves);
+    RUN_TEST(test_narrowed_range);
+    RUN_TEST(test_max_below_min_is_flat);
+    RUN_TEST(test_linear_midpoint);
+    RUN_TEST(test_exponential_scale_lifts_first_entry);
+    RUN_TEST(test_check_table_rejects_broken_tables);
+    RUN_TEST(test_step_at_covers_cycle);
+    return UNITY_END();
+}
@@ -0,0 +1,139 @@
+/*
+ * Host tests of src/flicker.c against the definition of percent flicker,
+ * 100 * (max - min) / (max + min): a sine and PWM square waves of the same
+ * swing must read the same, a fade's ramp and ADC noise must not read as
+ * flicker, and the per-level table must step around flickering levels.
+ *
+ *   pio test -e native -f test_flicker
+ */
+
+#include <math.h>
+#include <unity.h>
+#include "flicker.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define SAMPLE_HZ 20000
+#define BLOCK     1000
+
+static flicker_bank_t s_bank;
+
+void setUp(void)
+{
+    flicker_bank_init(&s_bank, SAMPLE_HZ, BLOCK);
+}
+
+void tearDown(void)
+{
+}
+
+typedef double (*waveform_t)(uint32_t n);
+
+/* Run two blocks of the waveform, so the second starts from a settled DC, and return the second */
+static flicker_result_t run_blocks(waveform_t wave)
+{
+    flicker_result_t result = {0};
+    int blocks = 0;
+    for (uint32_t n = 0; blocks < 2; n++)
+    {
+        double x = wave(n);
+        if (flicker_bank_push(&s_bank, (uint16_t)lround(x), &result))
+            blocks++;
+    }
+    return result;
+}
+
+static double sine_100hz(uint32_t n)
+{
+    return 2000 + 600 * sin(2 * M_PI * 100 * n / SAMPLE_HZ);
+}
+
+/* 1 kHz PWM between 1400 and 2600: 30 % flicker whatever the duty */
+static double pwm_duty_30(uint32_t n)
+{
+    return n % 20 < 6 ? 2600 : 1400;
+}
+
+static double pwm_duty_10(uint32_t n)
+{
+    return n % 20 < 2 ? 2600 : 1400;
+}
+
+/* Small deterministic noise of about +-3 counts */
+static double steady_noisy(uint32_t n)
+{
+    static const int8_t noise[] = {0, 2, -1, 3, -2, 1, -3, 0, 2, -2, 1, -1};
+    return 2000 + noise[n % sizeof(noise)];
+}
+
+/* The sine on a fade ramping 200 counts per block */
+static double sine_on_ramp(uint32_t n)
+{
+    return sine_100hz(n) + 200.0 * n / BLOCK;
+}
+
+static void test_sine_reads_its_swing(void)
+{
+    flicker_result_t r = run_blocks(sine_100hz);
+    TEST_ASSERT_EQUAL_UINT16(2000, r.mean);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 30.0f, r.flicker_pct);
+    TEST_ASSERT_EQUAL_UINT16(100, r.dominant_hz);
+}
+
+static void test_square_wave_reads_its_swing(void)
+{
+    // An RMS conversion that assumes a sine reads 44 % here
+    flicker_result_t r = run_blocks(pwm_duty_30);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 30.0f, r.flicker_pct);
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, 30.0f, r.peak_pct);
+    TEST_ASSERT_EQUAL_UINT16(1000, r.dominant_hz);
+}
+
+static void test_short_duty_reads_its_swing(void)
+{
+    flicker_result_t r = run_blocks(pwm_duty_10);
+    TEST_ASSERT_FLOAT_WITHIN(1.0f, 30.0f, r.flicker_pct);
+}
+
+static void test_noise_is_not_flicker(void)
+{
+    flicker_result_t r = run_blocks(steady_noisy);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 0.0f, r.flicker_pct);
+    TEST_ASSERT_TRUE(r.peak_pct > 0);
+    TEST_ASSERT_EQUAL_UINT16(0, r.dominant_hz);
+}
+
+static void test_ramp_is_not_flicker(void)
+{
+    // 1200 counts of swing around 2300 in the second block; the sine's extremes
+    // fall short of the block ends, so taking the whole ramp off reads a little low
+    flicker_result_t r = run_blocks(sine_on_ramp);
+    TEST_ASSERT_FLOAT_WITHIN(2.0f, 100.0f * 1200 / 4600, r.flicker_pct);
+}
+
+static void test_avoid_prefers_brighter(void)
+{
+    static flicker_table_t table;
+    flicker_result_t bad = {.flicker_pct = 40, .dominant_hz = 1000};
+    flicker_result_t good = {.flicker_pct = 2};
+    flicker_table_add(&table, 20, &bad);
+    flicker_table_add(&table, 21, &good);
+
+    TEST_ASSERT_EQUAL_UINT8(21, flicker_table_avoid(&table, 20, 0, 254, 100));
+    TEST_ASSERT_EQUAL_UINT8(19, flicker_table_avoid(&table, 20, 0, 20, 100));
+    TEST_ASSERT_EQUAL_UINT8(20, flicker_table_avoid(&table, 20, 0, 254, 400));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_sine_reads_its_swing);
+    RUN_TEST(test_square_wave_reads_its_swing);
+    RUN_TEST(test_short_duty_reads_its_swing);
+    RUN_TEST(test_noise_is_not_flicker);
+    RUN_TEST(test_ramp_is_not_flicker);
+    RUN_TEST(test_avoid_prefers_brighter);
+    return UNITY_END();
+}
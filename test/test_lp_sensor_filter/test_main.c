@@ -0,0 +1,162 @@
+/*
+ * Host tests of src/lp_sensor_filter.h, the averaging and threshold logic
+ * the LP core runs on every sample (src/ulp/lp_sensor_main.c) and the HP
+ * core reads back: block averages, the result ring and its overrun, and
+ * the hysteresis of the brightness band.
+ *
+ *   pio test -e native -f test_lp_sensor_filter
+ */
+
+#include <unity.h>
+#include "lp_sensor_filter.h"
+
+static lp_sensor_filter_t s_filter;
+
+void setUp(void)
+{
+    lp_sensor_filter_init(&s_filter, 4, 0, 0);
+}
+
+void tearDown(void)
+{
+}
+
+/* Push `count` copies of `sample`, returning the OR of the events */
+static uint32_t push_n(uint32_t sample, int count)
+{
+    uint32_t events = 0;
+    for (int i = 0; i < count; i++)
+        events |= lp_sensor_filter_push(&s_filter, sample);
+    return events;
+}
+
+static void test_average_per_window(void)
+{
+    TEST_ASSERT_EQUAL_UINT32(0, lp_sensor_filter_push(&s_filter, 10));
+    TEST_ASSERT_EQUAL_UINT32(0, lp_sensor_filter_push(&s_filter, 20));
+    TEST_ASSERT_EQUAL_UINT32(0, lp_sensor_filter_push(&s_filter, 30));
+    TEST_ASSERT_EQUAL_UINT32(LP_SENSOR_EVT_AVERAGE, lp_sensor_filter_push(&s_filter, 41));
+    TEST_ASSERT_EQUAL_UINT32(1, s_filter.seq);
+    TEST_ASSERT_EQUAL_UINT32(25, s_filter.ring[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, s_filter.sum);
+    TEST_ASSERT_EQUAL_UINT32(0, s_filter.count);
+}
+
+static void test_zero_window_is_one(void)
+{
+    lp_sensor_filter_init(&s_filter, 0, 0, 0);
+    TEST_ASSERT_EQUAL_UINT32(LP_SENSOR_EVT_AVERAGE, lp_sensor_filter_push(&s_filter, 7));
+    TEST_ASSERT_EQUAL_UINT32(7, s_filter.ring[0]);
+}
+
+static void test_block_event_every_ring(void)
+{
+    for (int block = 1; block <= 3; block++)
+    {
+        for (int i = 1; i < LP_SENSOR_RING_LEN; i++)
+            TEST_ASSERT_FALSE(push_n(100, 4) & LP_SENSOR_EVT_BLOCK);
+        TEST_ASSERT_TRUE(push_n(100, 4) & LP_SENSOR_EVT_BLOCK);
+        TEST_ASSERT_EQUAL_UINT32(block * LP_SENSOR_RING_LEN, s_filter.seq);
+    }
+}
+
+static void test_read_in_order(void)
+{
+    uint32_t read_seq = 0;
+    uint16_t out[LP_SENSOR_RING_LEN];
+
+    for (int i = 0; i < 3; i++)
+        push_n(100 + i, 4);
+    TEST_ASSERT_EQUAL_INT(3, lp_sensor_filter_read(&s_filter, &read_seq, out, LP_SENSOR_RING_LEN));
+    TEST_ASSERT_EQUAL_UINT32(100, out[0]);
+    TEST_ASSERT_EQUAL_UINT32(102, out[2]);
+    TEST_ASSERT_EQUAL_UINT32(3, read_seq);
+    TEST_ASSERT_EQUAL_INT(0, lp_sensor_filter_read(&s_filter, &read_seq, out, LP_SENSOR_RING_LEN));
+
+    // A smaller buffer leaves the rest for the next read
+    for (int i = 3; i < 6; i++)
+        push_n(100 + i, 4);
+    TEST_ASSERT_EQUAL_INT(2, lp_sensor_filter_read(&s_filter, &read_seq, out, 2));
+    TEST_ASSERT_EQUAL_UINT32(103, out[0]);
+    TEST_ASSERT_EQUAL_INT(1, lp_sensor_filter_read(&s_filter, &read_seq, out, 2));
+    TEST_ASSERT_EQUAL_UINT32(105, out[0]);
+}
+
+/* A reader that fell more than a ring behind gets the newest ring, oldest first */
+static void test_read_after_overrun(void)
+{
+    uint32_t read_seq = 0;
+    uint16_t out[LP_SENSOR_RING_LEN];
+
+    for (int i = 0; i < LP_SENSOR_RING_LEN + 5; i++)
+        push_n(i, 4);
+    TEST_ASSERT_EQUAL_INT(LP_SENSOR_RING_LEN, lp_sensor_filter_read(&s_filter, &read_seq, out, LP_SENSOR_RING_LEN));
+    TEST_ASSERT_EQUAL_UINT32(5, out[0]);
+    TEST_ASSERT_EQUAL_UINT32(LP_SENSOR_RING_LEN + 4, out[LP_SENSOR_RING_LEN - 1]);
+    TEST_ASSERT_EQUAL_UINT32(LP_SENSOR_RING_LEN + 5, read_seq);
+}
+
+static void test_read_across_seq_wrap(void)
+{
+    uint32_t read_seq = UINT32_MAX - 1;
+    uint16_t out[LP_SENSOR_RING_LEN];
+
+    s_filter.seq = UINT32_MAX - 1;
+    for (int i = 0; i < 4; i++)
+        push_n(50 + i, 4);
+    TEST_ASSERT_EQUAL_INT(4, lp_sensor_filter_read(&s_filter, &read_seq, out, LP_SENSOR_RING_LEN));
+    TEST_ASSERT_EQUAL_UINT32(50, out[0]);
+    TEST_ASSERT_EQUAL_UINT32(53, out[3]);
+    TEST_ASSERT_EQUAL_UINT32(2, read_seq);
+}
+
+static void test_threshold_hysteresis(void)
+{
+    lp_sensor_filter_init(&s_filter, 2, 100, 200);
+
+    // Inside the band and below it: stays dark
+    TEST_ASSERT_FALSE(push_n(150, 2) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_FALSE(push_n(50, 2) & LP_SENSOR_EVT_CROSSED);
+    // Above high: bright, once
+    TEST_ASSERT_TRUE(push_n(250, 2) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_EQUAL_UINT32(1, s_filter.bright);
+    TEST_ASSERT_FALSE(push_n(250, 2) & LP_SENSOR_EVT_CROSSED);
+    // Back into the band: still bright
+    TEST_ASSERT_FALSE(push_n(120, 2) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_EQUAL_UINT32(1, s_filter.bright);
+    // Below low: dark
+    TEST_ASSERT_TRUE(push_n(90, 2) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_EQUAL_UINT32(0, s_filter.bright);
+    TEST_ASSERT_EQUAL_UINT32(2, s_filter.crossings);
+}
+
+/* The crossing is decided on the average, not on single samples */
+static void test_threshold_uses_average(void)
+{
+    lp_sensor_filter_init(&s_filter, 4, 100, 200);
+    TEST_ASSERT_FALSE((lp_sensor_filter_push(&s_filter, 600) | push_n(0, 3)) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_TRUE(push_n(300, 4) & LP_SENSOR_EVT_CROSSED);
+}
+
+static void test_band_off_unless_high_above_low(void)
+{
+    lp_sensor_filter_init(&s_filter, 1, 200, 100);
+    TEST_ASSERT_FALSE(push_n(1000, 3) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_FALSE(push_n(0, 3) & LP_SENSOR_EVT_CROSSED);
+    TEST_ASSERT_EQUAL_UINT32(0, s_filter.crossings);
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_average_per_window);
+    RUN_TEST(test_zero_window_is_one);
+    RUN_TEST(test_block_event_every_ring);
+    RUN_TEST(test_read_in_order);
+    RUN_TEST(test_read_after_overrun);
+    RUN_TEST(test_read_across_seq_wrap);
+    RUN_TEST(test_threshold_hysteresis);
+    RUN_TEST(test_threshold_uses_average);
+    RUN_TEST(test_band_off_unless_high_above_low);
+    return UNITY_END();
+}
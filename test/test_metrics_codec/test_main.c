@@ -0,0 +1,131 @@
+/*
+ * Host tests of src/metrics_codec.c: pages round-trip through the cursor,
+ * and a page left open in flash (header partly erased, records appended
+ * one by one) is closed around the records written in full, as
+ * metrics_store_init() does after a power cut.
+ *
+ *   pio test -e native -f test_metrics_codec
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <unity.h>
+#include "metrics_codec.h"
+
+#define FIELDS 3
+#define HEADER_SIZE sizeof(metrics_page_header_t)
+
+static metrics_page_builder_t s_builder;
+static uint8_t s_flash[METRICS_PAGE_SIZE];
+
+void setUp(void)
+{
+    metrics_page_begin(&s_builder, 7, 3, FIELDS);
+}
+
+void tearDown(void)
+{
+}
+
+static void append(uint32_t minute, int32_t a, int32_t b, int32_t c)
+{
+    int32_t values[FIELDS] = {a, b, c};
+    TEST_ASSERT_TRUE(metrics_page_append(&s_builder, minute, values));
+}
+
+/* The flash image of the open page: what metrics_store writes before closing it */
+static void write_open_page(uint32_t payload_bytes)
+{
+    metrics_page_header_t header = *metrics_page_header(s_builder.page);
+    memset(s_flash, 0xFF, sizeof(s_flash));
+    header.magic = 0xFFFFFFFFu;
+    header.last_minute = 0xFFFFFFFFu;
+    header.records = header.bytes = 0xFFFF;
+    header.crc = 0xFFFFFFFFu;
+    memcpy(s_flash, &header, HEADER_SIZE);
+    memcpy(s_flash + HEADER_SIZE, s_builder.page + HEADER_SIZE, payload_bytes);
+}
+
+static void test_round_trip(void)
+{
+    append(1000, 5, -1, 0);
+    append(1001, 7, -1, 3);
+    append(1003, 6, 200, 3);
+    metrics_page_finish(&s_builder);
+    TEST_ASSERT_TRUE(metrics_page_valid(s_builder.page, METRICS_PAGE_SIZE));
+
+    metrics_page_cursor_t cursor;
+    metrics_page_cursor_init(&cursor, s_builder.page);
+    TEST_ASSERT_TRUE(metrics_page_cursor_next(&cursor));
+    TEST_ASSERT_EQUAL_UINT32(1000, cursor.minute);
+    TEST_ASSERT_TRUE(metrics_page_cursor_next(&cursor));
+    TEST_ASSERT_TRUE(metrics_page_cursor_next(&cursor));
+    TEST_ASSERT_EQUAL_UINT32(1003, cursor.minute);
+    TEST_ASSERT_EQUAL_INT32(200, cursor.values[1]);
+    TEST_ASSERT_FALSE(metrics_page_cursor_next(&cursor));
+}
+
+static void test_recover_matches_finished_page(void)
+{
+    append(1000, 5, -1, 0);
+    append(1001, 7, -1, 3);
+    // A delta whose first varint byte is 0xFF must not read as erased flash
+    append(1256, 6, 200, 3);
+    const metrics_page_header_t *header = metrics_page_header(s_builder.page);
+    write_open_page(header->bytes);
+    metrics_page_finish(&s_builder);
+
+    TEST_ASSERT_EQUAL_INT(3, metrics_page_recover(s_flash, sizeof(s_flash)));
+    TEST_ASSERT_TRUE(metrics_page_valid(s_flash, sizeof(s_flash)));
+    const metrics_page_header_t *recovered = metrics_page_header(s_flash);
+    TEST_ASSERT_EQUAL_UINT32(header->crc, recovered->crc);
+    TEST_ASSERT_EQUAL_UINT32(header->bytes, recovered->bytes);
+    TEST_ASSERT_EQUAL_UINT32(1000, recovered->first_minute);
+    TEST_ASSERT_EQUAL_UINT32(1256, recovered->last_minute);
+    TEST_ASSERT_EQUAL_UINT32(7, recovered->seq);
+    TEST_ASSERT_EQUAL_UINT32(3, recovered->boot);
+}
+
+static void test_recover_drops_torn_record(void)
+{
+    append(1000, 5, -1, 0);
+    append(1001, 7, -1, 3);
+    uint16_t two_records = metrics_page_header(s_builder.page)->bytes;
+    append(1002, 300000, 200, 3);
+    write_open_page(two_records + 2);   // power lost two bytes into the third
+
+    TEST_ASSERT_EQUAL_INT(2, metrics_page_recover(s_flash, sizeof(s_flash)));
+    TEST_ASSERT_EQUAL_UINT32(two_records, metrics_page_header(s_flash)->bytes);
+    TEST_ASSERT_EQUAL_UINT32(1001, metrics_page_header(s_flash)->last_minute);
+    TEST_ASSERT_TRUE(metrics_page_valid(s_flash, sizeof(s_flash)));
+}
+
+static void test_recover_needs_a_first_minute(void)
+{
+    // Opened, but the power went before the first record
+    write_open_page(0);
+    metrics_page_header_t header;
+    memcpy(&header, s_flash, HEADER_SIZE);
+    header.first_minute = 0xFFFFFFFFu;
+    memcpy(s_flash, &header, HEADER_SIZE);
+
+    TEST_ASSERT_EQUAL_INT(0, metrics_page_recover(s_flash, sizeof(s_flash)));
+    TEST_ASSERT_FALSE(metrics_page_valid(s_flash, sizeof(s_flash)));
+}
+
+static void test_recover_erased_sector(void)
+{
+    memset(s_flash, 0xFF, sizeof(s_flash));
+    TEST_ASSERT_EQUAL_INT(0, metrics_page_recover(s_flash, sizeof(s_flash)));
+}
+
+int main(int argc, char **argv)
+{
+    UNITY_BEGIN();
+    RUN_TEST(test_round_trip);
+    RUN_TEST(test_recover_matches_finished_page);
+    RUN_TEST(test_recover_drops_torn_record);
+    RUN_TEST(test_recover_needs_a_first_minute);
+    RUN_TEST(test_recover_erased_sector);
+    return UNITY_END();
+}
@@ -0,0 +1,67 @@
+/*
+ * Host microbenchmark of src/fade_curve.c, the counterpart of the firmware's
+ * `curve_bench` command: builds the fade table for every gamma mode, curve
+ * type and table size, and prints the time per table and per point and
+ * whether the table passes fade_curve_check_table().
+ *
+ *   cc -O2 -Wall -Isrc tools/curve_bench.c src/fade_curve.c -lm -o curve_bench
+ *   ./curve_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "fade_curve.h"
+
+static const char *s_gamma_names[GAMMA_MODE_COUNT] = {"linear", "exp", "log"};
+static const char *s_curve_names[CURVE_TYPE_COUNT] = {"linear", "sine", "quad", "cubic", "quartic"};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    static const int sizes[] = {8, 16, 30, 64, 128, MAX_SEGMENTS};
+    static fade_segment_t table[MAX_SEGMENTS];
+    int iterations = argc > 1 ? atoi(argv[1]) : 10000;
+    int failed = 0;
+
+    if (iterations <= 0)
+        iterations = 1;
+
+    fade_curve_params_t params = {
+        .level_min = 1,
+        .level_max = 254,
+        .gamma_pow_value = 2.2,
+        .gamma_pow_scale = 1.0,
+        .gamma_log_value = 10.0,
+    };
+
+    printf("%-7s %-8s %4s %12s %12s %s\n", "gamma", "curve", "size", "ns/table", "ns/point", "ok");
+    for (int gamma = 0; gamma < GAMMA_MODE_COUNT; gamma++)
+    {
+        for (int curve = 0; curve < CURVE_TYPE_COUNT; curve++)
+        {
+            for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++)
+            {
+                params.gamma_mode = (gamma_mode_t)gamma;
+                params.curve_type = (curve_type_t)curve;
+
+                double start = now_ns();
+                for (int i = 0; i < iterations; i++)
+                    fade_curve_build_table(&params, sizes[s], table);
+                double ns = (now_ns() - start) / iterations;
+
+                int ok = fade_curve_check_table(&params, table, sizes[s]);
+                failed += !ok;
+                printf("%-7s %-8s %4d %12.0f %12.1f %s\n", s_gamma_names[gamma], s_curve_names[curve], sizes[s],
+                       ns, ns / sizes[s], ok ? "yes" : "NO");
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Read the per-minute metrics history off the controller as CSV.
+
+Drives the `metrics dump` console command (src/metrics_store.c): the device
+streams its stored pages in binary, each a header plus delta/zigzag varint
+records (src/metrics_codec.h), and this decodes them. Log lines that slip in
+between pages are skipped by looking for the page magic and checking the CRC.
+
+    pip install pyserial
+    python tools/metrics_dump.py /dev/ttyUSB0 > metrics.csv
+    python tools/metrics_dump.py /dev/ttyUSB0 --from 29100000 --to 29101440
+"""
+import argparse
+import csv
+import datetime
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+CONSOLE_BAUD = 115200
+HEADER = struct.Struct("<IIIIIHHB3xI")
+MAGIC = b"METR"
+UNIX_2020_MINUTE = 1577836800 // 60   # smaller minutes are time since power-on
+
+
+def wait_for(port, prefix, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        line = port.readline().decode(errors="replace").strip()
+        if line.startswith(prefix):
+            return line
+    raise TimeoutError(f"no '{prefix}' from device")
+
+
+def read_pages(port, count, timeout):
+    """Collect `count` valid pages from the stream, skipping anything else."""
+    buf = b""
+    pages = []
+    deadline = time.monotonic() + timeout
+    while len(pages) < count and time.monotonic() < deadline:
+        buf += port.read(4096)
+        while True:
+            start = buf.find(MAGIC)
+            if start < 0:
+                buf = buf[-(len(MAGIC) - 1):]
+                break
+            if len(buf) - start < HEADER.size:
+                buf = buf[start:]
+                break
+            header = HEADER.unpack_from(buf, start)
+            size = header[6]
+            if len(buf) - start < HEADER.size + size:
+                buf = buf[start:]
+                break
+            payload = buf[start + HEADER.size:start + HEADER.size + size]
+            if zlib.crc32(payload) == header[8]:
+                pages.append((header, payload))
+                buf = buf[start + HEADER.size + size:]
+            else:
+                buf = buf[start + 1:]
+    return pages
+
+
+def varints(payload):
+    value = shift = 0
+    for byte in payload:
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            yield value
+            value = shift = 0
+
+
+def decode(header, payload):
+    _, seq, boot, first_minute, _, records, _, fields, _ = header
+    stream = varints(payload)
+    minute = first_minute
+    values = [0] * fields
+    for _ in range(records):
+        minute += next(stream)
+        for i in range(fields):
+            v = next(stream)
+            values[i] = (values[i] + ((v >> 1) ^ -(v & 1)) + 2**31) % 2**32 - 2**31
+        yield boot, minute, list(values)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("--from", dest="from_minute", type=int, default=0)
+    parser.add_argument("--to", dest="to_minute", type=int, default=2**32 - 1)
+    args = parser.parse_args()
+
+    with serial.Serial(args.port, CONSOLE_BAUD, timeout=0.5) as port:
+        port.reset_input_buffer()
+        port.write(f"\rmetrics dump {args.from_minute} {args.to_minute}\r\n".encode())
+        begin = wait_for(port, "METRICS BEGIN", 10).split()
+        count, names = int(begin[2]), begin[3].split(",")
+        # 4 KB pages at 115200 baud take about 0.4 s each
+        pages = read_pages(port, count, 5 + count)
+    if len(pages) < count:
+        print(f"got {len(pages)} of {count} pages", file=sys.stderr)
+
+    out = csv.writer(sys.stdout)
+    out.writerow(["boot", "minute", "time"] + names)
+    rows = 0
+    for header, payload in sorted(pages, key=lambda page: page[0][1]):
+        for boot, minute, values in decode(header, payload):
+            if not args.from_minute <= minute <= args.to_minute:
+                continue
+            when = ""
+            if minute >= UNIX_2020_MINUTE:
+                when = datetime.datetime.fromtimestamp(minute * 60, datetime.timezone.utc).isoformat()
+            out.writerow([boot, minute, when] + values[:len(names)])
+            rows += 1
+    print(f"{len(pages)} pages, {rows} records", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
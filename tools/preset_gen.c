@@ -0,0 +1,108 @@
+/*
+ * Build-time generator for the built-in preset bank: computes the fade
+ * table of every PRESET_DEFAULT_LIST entry with the firmware's own
+ * src/fade_curve.c and writes them out as the rodata array
+ * g_preset_defaults. src/CMakeLists.txt builds and runs it with the host
+ * compiler at configure time.
+ *
+ *   cc -O2 -Wall -Isrc tools/preset_gen.c src/fade_curve.c -lm -o preset_gen
+ *   ./preset_gen preset_defaults.c
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "preset_defs.h"
+
+#define PRESET_PARAMS(name_, off1, off2, lmin, lmax, on, off, trans, gmode, gpow, gscale, glog, curve, steps) \
+    {.name = name_, .offset_1 = off1, .offset_2 = off2, .level_min = lmin, .level_max = lmax,               \
+     .on_time = on, .off_time = off, .transition_time = trans, .gamma_mode = gmode,                         \
+     .gamma_pow_value = gpow, .gamma_pow_scale = gscale, .gamma_log_value = glog,                           \
+     .curve_type = curve, .step_table_size = steps},
+
+static const preset_params_t s_defaults[] = {PRESET_DEFAULT_LIST(PRESET_PARAMS)};
+
+static const char *gamma_mode_name(gamma_mode_t mode)
+{
+    static const char *names[GAMMA_MODE_COUNT] = {"GAMMA_MODE_LINEAR", "GAMMA_MODE_EXPONENTIAL",
+                                                  "GAMMA_MODE_LOGARITHMIC"};
+    return names[mode];
+}
+
+static const char *curve_type_name(curve_type_t type)
+{
+    static const char *names[CURVE_TYPE_COUNT] = {"CURVE_TYPE_LINEAR", "CURVE_TYPE_SINE", "CURVE_TYPE_QUADRATIC",
+                                                  "CURVE_TYPE_CUBIC", "CURVE_TYPE_QUARTIC"};
+    return names[type];
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: preset_gen <output.c>\n");
+        return 1;
+    }
+    FILE *out = fopen(argv[1], "w");
+    if (out == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by tools/preset_gen.c from PRESET_DEFAULT_LIST in src/preset_defs.h; do not edit. */\n\n");
+    fprintf(out, "#include \"preset_defs.h\"\n\n");
+    fprintf(out, "const preset_t g_preset_defaults[PRESET_DEFAULT_COUNT] = {\n");
+
+    for (size_t i = 0; i < sizeof(s_defaults) / sizeof(s_defaults[0]); i++)
+    {
+        const preset_params_t *p = &s_defaults[i];
+        int segments = p->step_table_size;
+        if (segments < 2 || segments > MAX_SEGMENTS || strlen(p->name) >= PRESET_NAME_LEN)
+        {
+            fprintf(stderr, "preset_gen: preset \"%s\" is invalid\n", p->name);
+            return 1;
+        }
+
+        fade_curve_params_t params = {
+            .level_min = p->level_min,
+            .level_max = p->level_max,
+            .curve_type = p->curve_type,
+            .gamma_mode = p->gamma_mode,
+            .gamma_pow_value = p->gamma_pow_value,
+            .gamma_pow_scale = p->gamma_pow_scale,
+            .gamma_log_value = p->gamma_log_value,
+        };
+        fade_segment_t table[MAX_SEGMENTS];
+        fade_curve_build_table(&params, segments, table);
+        if (!fade_curve_check_table(&params, table, segments))
+        {
+            fprintf(stderr, "preset_gen: table of preset \"%s\" is not monotonic\n", p->name);
+            return 1;
+        }
+
+        fprintf(out, "    {\n        .params = {\n");
+        fprintf(out, "            .name = \"%s\",\n", p->name);
+        fprintf(out, "            .offset_1 = %.17g,\n            .offset_2 = %.17g,\n", p->offset_1, p->offset_2);
+        fprintf(out, "            .level_min = %u,\n            .level_max = %u,\n", p->level_min, p->level_max);
+        fprintf(out, "            .on_time = %.17g,\n            .off_time = %.17g,\n", p->on_time, p->off_time);
+        fprintf(out, "            .transition_time = %.17g,\n", p->transition_time);
+        fprintf(out, "            .gamma_mode = %s,\n", gamma_mode_name(p->gamma_mode));
+        fprintf(out, "            .gamma_pow_value = %.17g,\n", p->gamma_pow_value);
+        fprintf(out, "            .gamma_pow_scale = %.17g,\n", p->gamma_pow_scale);
+        fprintf(out, "            .gamma_log_value = %.17g,\n", p->gamma_log_value);
+        fprintf(out, "            .curve_type = %s,\n", curve_type_name(p->curve_type));
+        fprintf(out, "            .step_table_size = %d,\n        },\n", segments);
+        fprintf(out, "        .segments = %d,\n        .table = {\n", segments);
+        for (int s = 0; s < segments; s++)
+            fprintf(out, "            {%.9g, %u},\n", table[s].fraction_of_fade, table[s].level);
+        fprintf(out, "        },\n    },\n");
+    }
+
+    fprintf(out, "};\n");
+    if (fclose(out) != 0)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}
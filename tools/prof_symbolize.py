@@ -0,0 +1,54 @@
+#!/usr/bin/env python3
+"""Turn `prof dump` output into a per-function profile.
+
+Capture the console output of `prof dump` (everything between PROF_BEGIN and
+PROF_END) into a file, then:
+
+    python tools/prof_symbolize.py prof.txt .pio/build/esp32-c6-devkitm-1/firmware.elf
+
+Needs riscv32-esp-elf-addr2line on PATH (it ships with the ESP-IDF toolchain),
+or pass --addr2line.
+"""
+import argparse
+import collections
+import re
+import subprocess
+
+PROF_LINE = re.compile(r"PROF (0x[0-9a-fA-F]+) (\d+)")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump")
+    parser.add_argument("elf")
+    parser.add_argument("--addr2line", default="riscv32-esp-elf-addr2line")
+    parser.add_argument("--top", type=int, default=30)
+    args = parser.parse_args()
+
+    samples = []
+    with open(args.dump, errors="replace") as f:
+        for line in f:
+            m = PROF_LINE.search(line)
+            if m:
+                samples.append((m.group(1), int(m.group(2))))
+    if not samples:
+        raise SystemExit("no PROF lines found")
+
+    out = subprocess.run([args.addr2line, "-f", "-C", "-e", args.elf] + [pc for pc, _ in samples],
+                         capture_output=True, text=True, check=True).stdout.splitlines()
+
+    by_function = collections.Counter()
+    location = {}
+    for (pc, count), function, where in zip(samples, out[0::2], out[1::2]):
+        by_function[function] += count
+        location.setdefault(function, where.split(" ")[0])
+
+    total = sum(count for _, count in samples)
+    print(f"{total} samples")
+    print(f"{'%':>6} {'samples':>8}  function")
+    for function, count in by_function.most_common(args.top):
+        print(f"{100.0 * count / total:6.2f} {count:8d}  {function}  ({location[function]})")
+
+
+if __name__ == "__main__":
+    main()
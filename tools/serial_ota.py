@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Send a firmware image to the controller over its console UART.
+
+Drives the `ota_recv` console command (src/serial_ota.c): the image is
+zlib-compressed, split into CRC-protected chunks and written into the spare
+OTA slot while the lamps keep fading. Reboot the board afterwards to run it.
+
+    pip install pyserial
+    python tools/serial_ota.py /dev/ttyUSB0 .pio/build/esp32-c6-devkitm-1/firmware.bin --baud 921600
+"""
+import argparse
+import struct
+import sys
+import time
+import zlib
+
+import serial
+
+CONSOLE_BAUD = 115200
+MAX_RETRIES = 5
+ACK_TIMEOUT = 2  # s; below the device's 5 s chunk timeout, so a lost ACK is resent in time
+
+
+def wait_for(port, prefix, timeout):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        line = port.readline().decode(errors="replace").strip()
+        if line.startswith(prefix) or line.startswith("OTA FAIL"):
+            return line
+    raise TimeoutError(f"no '{prefix}' from device")
+
+
+def send_chunk(port, seq, payload):
+    """Send until the device ACKs `seq`; it ACKs a repeat of a chunk it already wrote without writing it again"""
+    header = struct.pack("<HH", len(payload), seq & 0xFFFF)
+    frame = header + struct.pack("<I", zlib.crc32(payload, zlib.crc32(header))) + payload
+    for _ in range(MAX_RETRIES):
+        port.write(frame)
+        try:
+            reply = wait_for(port, "OTA ", ACK_TIMEOUT)
+            # A late ACK of the previous chunk is not an answer to this one
+            while reply == f"OTA ACK {seq - 1}":
+                reply = wait_for(port, "OTA ", ACK_TIMEOUT)
+        except TimeoutError:
+            continue
+        if reply == f"OTA ACK {seq}":
+            return
+        if reply.startswith("OTA FAIL"):
+            raise RuntimeError(reply)
+    raise RuntimeError(f"chunk {seq} rejected {MAX_RETRIES} times")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("port")
+    parser.add_argument("image")
+    parser.add_argument("--baud", type=int, default=0, help="switch to this baud rate for the transfer")
+    parser.add_argument("--raw", action="store_true", help="send the image uncompressed")
+    args = parser.parse_args()
+
+    image = open(args.image, "rb").read()
+    stream = image if args.raw else zlib.compress(image, 9)
+    print(f"image {len(image)} bytes, sending {len(stream)} bytes")
+
+    with serial.Serial(args.port, CONSOLE_BAUD, timeout=0.5) as port:
+        port.reset_input_buffer()
+        mode = "raw" if args.raw else "z"
+        port.write(f"\rota_recv {len(stream)} {mode} {args.baud}\r\n".encode())
+        ready = wait_for(port, "OTA READY", 10)
+        if ready.startswith("OTA FAIL"):
+            sys.exit(ready)
+        chunk_size = int(ready.split()[2])
+        print(ready)
+
+        if args.baud:
+            time.sleep(0.05)
+            port.baudrate = args.baud
+
+        start = time.monotonic()
+        for seq, offset in enumerate(range(0, len(stream), chunk_size)):
+            send_chunk(port, seq, stream[offset:offset + chunk_size])
+            print(f"\r{offset * 100 // len(stream)}%", end="", flush=True)
+        port.write(struct.pack("<HHI", 0, 0, 0))
+        done = wait_for(port, "OTA DONE", 30)
+        elapsed = time.monotonic() - start
+
+        print(f"\r{done}")
+        print(f"host: {elapsed:.1f} s, {len(stream) / elapsed / 1024:.1f} KiB/s on the wire, "
+              f"{len(image) / elapsed / 1024:.1f} KiB/s of image")
+        if done.startswith("OTA FAIL"):
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,127 @@
+/*
+ * Host simulation of src/time_sync.c: one master and several slaves with
+ * drifting oscillators, a lossy link with jitter and occasional long
+ * delays (the radio busy on 802.15.4), exchanging one request per second.
+ * Prints how far each slave's synced clock is from the master's: RMS and
+ * maximum after the warm-up, and the maximum once settled (the loop has
+ * switched to its tracking gains and pulled in the oscillator error).
+ *
+ *   cc -O2 -Wall -Isrc tools/time_sync_sim.c src/time_sync.c -lm -o time_sync_sim
+ *   ./time_sync_sim [nodes] [seconds] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "time_sync.h"
+
+#define MAX_NODES 32
+#define WARMUP_S 60
+#define SETTLED_S 300
+
+typedef struct {
+    double ppm;         // oscillator error
+    int64_t start_us;   // local clock reading at true time 0
+    time_sync_t ts;
+    double err_sq_sum;
+    double err_max;
+    double err_max_settled;
+    int err_count;
+} sim_node_t;
+
+static double uniform(void)
+{
+    return (rand() + 1.0) / (RAND_MAX + 2.0);
+}
+
+/* One-way air time: 1-3 ms of queueing, exponential jitter, and every 20th
+   frame held back by up to 40 ms as if the radio were serving Zigbee */
+static int64_t link_delay_us(void)
+{
+    double us = 1000 + 2000 * uniform() - 300 * log(uniform());
+    if (uniform() < 0.05)
+        us += 40000 * uniform();
+    return (int64_t)us;
+}
+
+static int64_t local_at(const sim_node_t *node, int64_t true_us)
+{
+    return node->start_us + true_us + (int64_t)(true_us * node->ppm / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    int nodes = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 3600;
+    srand(argc > 3 ? atoi(argv[3]) : 1);
+    if (nodes < 2)
+        nodes = 2;
+    if (nodes > MAX_NODES)
+        nodes = MAX_NODES;
+
+    // Node 0 is the master; its local clock is the reference
+    static sim_node_t node[MAX_NODES];
+    for (int i = 0; i < nodes; i++)
+    {
+        node[i].ppm = (uniform() - 0.5) * 80;   // +-40 ppm, a typical crystal
+        node[i].start_us = (int64_t)(uniform() * 1e9);
+        time_sync_init(&node[i].ts, i == 0 ? TIME_SYNC_ROLE_MASTER : TIME_SYNC_ROLE_SLAVE, 1);
+    }
+
+    int lost = 0;
+    for (int s = 0; s < seconds; s++)
+    {
+        for (int i = 1; i < nodes; i++)
+        {
+            // Slaves are not aligned to each other
+            int64_t t1_true = (int64_t)s * 1000000 + i * 7919;
+            time_sync_msg_t request, reply;
+            time_sync_make_request(&node[i].ts, local_at(&node[i], t1_true), &request);
+
+            if (uniform() < 0.05)
+            {
+                lost++;
+                continue;
+            }
+            int64_t t2_true = t1_true + link_delay_us();
+            int64_t t3_true = t2_true + 200 + (int64_t)(800 * uniform());
+            time_sync_make_reply(&node[0].ts, &request, local_at(&node[0], t2_true),
+                                 local_at(&node[0], t3_true), &reply);
+            if (uniform() < 0.05)
+            {
+                lost++;
+                continue;
+            }
+            int64_t t4_true = t3_true + link_delay_us();
+            time_sync_handle_reply(&node[i].ts, &reply, local_at(&node[i], t4_true));
+
+            // Error half a second later, between exchanges
+            int64_t check_true = t4_true + 500000;
+            double err = (double)(time_sync_now(&node[i].ts, local_at(&node[i], check_true)) -
+                                  local_at(&node[0], check_true));
+            if (s >= WARMUP_S)
+            {
+                node[i].err_sq_sum += err * err;
+                node[i].err_count++;
+                if (fabs(err) > node[i].err_max)
+                    node[i].err_max = fabs(err);
+                if (s >= SETTLED_S && fabs(err) > node[i].err_max_settled)
+                    node[i].err_max_settled = fabs(err);
+            }
+        }
+    }
+
+    printf("%d nodes, %d s, %d frames lost, statistics after %d s warm-up\n", nodes, seconds, lost, WARMUP_S);
+    printf("node  osc ppm  freq err   rms us   max us  settled  steps  replies\n");
+    for (int i = 1; i < nodes; i++)
+    {
+        // The slave must run at (1 + ppm_master) / (1 + ppm_slave)
+        double want_ppm = ((1 + node[0].ppm / 1e6) / (1 + node[i].ppm / 1e6) - 1) * 1e6;
+        printf("%4d %8.2f %9.2f %8.1f %8.0f %8.0f %6u %8u\n", i, node[i].ppm - node[0].ppm,
+               node[i].ts.drift_ppm - want_ppm,
+               node[i].err_count ? sqrt(node[i].err_sq_sum / node[i].err_count) : 0.0,
+               node[i].err_max, node[i].err_max_settled, (unsigned)node[i].ts.steps,
+               (unsigned)node[i].ts.replies);
+    }
+    return 0;
+}
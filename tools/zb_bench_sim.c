@@ -0,0 +1,145 @@
+/*
+ * Host run of the zbbench harness (src/zb_bench.c) against a model of the
+ * coordinator's Zigbee stack: a bounded pool of APS buffers, one radio that
+ * sends frames in turn, APS acks after a per-hop round trip, and lost
+ * frames retried after the ack timeout. Prints the same ZBBENCH table as
+ * the firmware, so results can be diffed between builds.
+ *
+ *   cc -O2 -Wall -Isrc tools/zb_bench_sim.c src/zb_bench.c -o zb_bench_sim
+ *   ./zb_bench_sim <burst|paced|rr> [count] [rate_hz] [max_inflight] [lamps] [loss_pct] [seed]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zb_bench.h"
+
+#define STEP_US          100
+#define APS_BUFFERS      16       // frames the stack holds at once; more are refused
+#define TX_US            4000     // CSMA + air time + MAC ack
+#define HOP_RTT_US       12000    // APS ack round trip per hop
+#define ACK_TIMEOUT_US   1600000  // APS ack wait before a retry
+#define APS_RETRIES      3
+#define TIMEOUT_MS       (ACK_TIMEOUT_US * (APS_RETRIES + 1) / 1000 + 1000)
+
+typedef struct {
+    uint8_t tsn;
+    uint8_t lamp;
+    uint8_t attempts;
+    bool queued;        // waiting for the radio
+    int64_t at_us;      // not queued: ack (or retry) time
+    bool delivered;
+} aps_frame_t;
+
+static aps_frame_t s_frames[APS_BUFFERS];
+static int s_frame_count;
+static int64_t s_radio_free_us;
+static uint8_t s_next_tsn;
+static int s_loss_pct;
+
+static double uniform(void)
+{
+    return (rand() + 1.0) / (RAND_MAX + 2.0);
+}
+
+/* Lamps further down the list are one hop further away */
+static int hops(uint8_t lamp)
+{
+    return 1 + lamp % 3;
+}
+
+/* esp_zb_zcl_level_move_to_level_cmd_req: the TSN, or -1 without a buffer */
+static int stack_send(uint8_t lamp)
+{
+    if (s_frame_count == APS_BUFFERS)
+        return -1;
+    aps_frame_t *f = &s_frames[s_frame_count++];
+    memset(f, 0, sizeof(*f));
+    f->tsn = s_next_tsn++;
+    f->lamp = lamp;
+    f->queued = true;
+    return f->tsn;
+}
+
+static void stack_step(zb_bench_t *bench, int64_t now_us)
+{
+    for (int i = 0; i < s_frame_count; i++)
+    {
+        aps_frame_t *f = &s_frames[i];
+        if (f->queued && now_us >= s_radio_free_us)
+        {
+            // Each hop is a chance to lose the frame or its ack
+            s_radio_free_us = now_us + TX_US + (int64_t)(TX_US * uniform());
+            f->queued = false;
+            f->attempts++;
+            f->delivered = true;
+            for (int h = 0; h < 2 * hops(f->lamp); h++)
+                f->delivered &= uniform() * 100 >= s_loss_pct;
+            f->at_us = f->delivered ? s_radio_free_us + hops(f->lamp) * HOP_RTT_US : now_us + ACK_TIMEOUT_US;
+        }
+        else if (!f->queued && now_us >= f->at_us)
+        {
+            if (!f->delivered && f->attempts <= APS_RETRIES)
+            {
+                f->queued = true;
+                continue;
+            }
+            zb_bench_confirmed(bench, f->tsn, f->delivered, now_us);
+            s_frames[i--] = s_frames[--s_frame_count];
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static const char *usage = "usage: zb_bench_sim <burst|paced|rr> [count] [rate_hz] [max_inflight] [lamps] [loss_pct] [seed]\n";
+    zb_bench_config_t config = {.count = 200, .rate_hz = 20, .max_inflight = 8, .lamps = 2, .timeout_ms = TIMEOUT_MS};
+
+    int pattern = -1;
+    for (int i = 0; argc > 1 && i < ZB_BENCH_PATTERN_COUNT; i++)
+    {
+        if (strcmp(argv[1], zb_bench_pattern_name(i)) == 0)
+            pattern = i;
+    }
+    if (pattern < 0)
+    {
+        fputs(usage, stderr);
+        return 1;
+    }
+    config.pattern = pattern;
+    if (argc > 2)
+        config.count = strtoul(argv[2], NULL, 10);
+    if (argc > 3)
+        config.rate_hz = strtoul(argv[3], NULL, 10);
+    if (argc > 4)
+        config.max_inflight = atoi(argv[4]);
+    if (argc > 5)
+        config.lamps = atoi(argv[5]);
+    s_loss_pct = argc > 6 ? atoi(argv[6]) : 2;
+    srand(argc > 7 ? atoi(argv[7]) : 1);
+    if (config.pattern == ZB_BENCH_BURST)
+        config.rate_hz = 0;
+
+    static zb_bench_t bench;
+    zb_bench_init(&bench, &config);
+
+    int64_t now_us = 0;
+    bool sending = true;
+    while (sending || !zb_bench_done(&bench, now_us))
+    {
+        uint8_t lamp, level;
+        int64_t due_us;
+        while (sending)
+        {
+            sending = zb_bench_next(&bench, now_us, &lamp, &level, &due_us);
+            if (!sending || bench.stalled || due_us > now_us)
+                break;
+            zb_bench_sent(&bench, lamp, stack_send(lamp), now_us);
+        }
+        stack_step(&bench, now_us);
+        now_us += STEP_US;
+    }
+
+    zb_bench_print(&bench.config, zb_bench_finish(&bench));
+    return 0;
+}
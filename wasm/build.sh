@@ -0,0 +1,18 @@
+#!/bin/sh
+# Build the firmware's fade kernel (src/fade_curve.c) to WebAssembly, to
+# check the JavaScript port in controller2.html against the C: the page
+# draws with the port, and with this module when opened with ?kernel. Both
+# should give the same picture. Needs Emscripten (emcc on the PATH); the
+# result is a standalone module with no JavaScript glue and no imports.
+#
+#     wasm/build.sh
+#     python3 -m http.server    # then open http://localhost:8000/controller2.html?kernel
+set -e
+cd "$(dirname "$0")/.."
+
+emcc -O2 -std=c99 -Isrc \
+    src/fade_curve.c wasm/fade_curve_wasm.c \
+    --no-entry -sSTANDALONE_WASM -sFILESYSTEM=0 -sINITIAL_MEMORY=1MB -sSTACK_SIZE=64KB \
+    -o wasm/fade_curve.wasm
+
+echo "wasm/fade_curve.wasm: $(wc -c < wasm/fade_curve.wasm) bytes"
@@ -0,0 +1,133 @@
+/*
+ * WebAssembly exports of the firmware's fade kernel for the controller
+ * preview (controller2.html). The curve, gamma and step planner are the
+ * firmware's own src/fade_curve.c; this file only holds the state the
+ * page reads back: the table lights_init() would build and the commands a
+ * fade task would send over one cycle. Built by wasm/build.sh.
+ */
+#include "fade_curve.h"
+
+#define EXPORT(name) __attribute__((export_name(#name)))
+
+/* One command per table entry on the way up and on the way down, plus the holds */
+#define WASM_MAX_STEPS (2 * MAX_SEGMENTS + 4)
+
+static fade_curve_params_t s_params;
+static fade_segment_t s_table[MAX_SEGMENTS];
+static int s_segments;
+
+static uint32_t s_step_start_ms[WASM_MAX_STEPS];
+static uint32_t s_step_transition_ms[WASM_MAX_STEPS];
+static uint8_t s_step_level[WASM_MAX_STEPS];
+static int16_t s_step_segment[WASM_MAX_STEPS];
+
+EXPORT(fade_set_params)
+void fade_set_params(int level_min, int level_max, int curve_type, int gamma_mode, double gamma_pow_value,
+                     double gamma_pow_scale, double gamma_log_value)
+{
+    s_params.level_min = (uint8_t)level_min;
+    s_params.level_max = (uint8_t)level_max;
+    s_params.curve_type = curve_type < CURVE_TYPE_COUNT ? (curve_type_t)curve_type : CURVE_TYPE_LINEAR;
+    s_params.gamma_mode = gamma_mode < GAMMA_MODE_COUNT ? (gamma_mode_t)gamma_mode : GAMMA_MODE_LINEAR;
+    s_params.gamma_pow_value = gamma_pow_value;
+    s_params.gamma_pow_scale = gamma_pow_scale;
+    s_params.gamma_log_value = gamma_log_value;
+}
+
+/* Same clamp as lights_init(); returns the number of entries built */
+EXPORT(fade_build_table)
+int fade_build_table(int step_table_size)
+{
+    s_segments = step_table_size;
+    if (s_segments < 2)
+        s_segments = 2;
+    if (s_segments > MAX_SEGMENTS)
+        s_segments = MAX_SEGMENTS;
+    fade_curve_build_table(&s_params, s_segments, s_table);
+    return s_segments;
+}
+
+EXPORT(fade_table_level)
+int fade_table_level(int i)
+{
+    return i >= 0 && i < s_segments ? s_table[i].level : 0;
+}
+
+EXPORT(fade_table_fraction)
+float fade_table_fraction(int i)
+{
+    return i >= 0 && i < s_segments ? s_table[i].fraction_of_fade : 0;
+}
+
+EXPORT(fade_table_monotonic)
+int fade_table_monotonic(void)
+{
+    return fade_curve_check_table(&s_params, s_table, s_segments);
+}
+
+EXPORT(fade_gamma)
+float fade_gamma(float fraction)
+{
+    return fade_curve_gamma(&s_params, fraction);
+}
+
+EXPORT(fade_shape)
+float fade_shape(int curve_type, float x)
+{
+    return fade_curve_shape(curve_type < CURVE_TYPE_COUNT ? (curve_type_t)curve_type : CURVE_TYPE_LINEAR, x);
+}
+
+/*
+ * Walk one cycle from phase 0 the way a fade task does: take the step due
+ * now, then jump to its end. Steps with segment -1 are holds, which send
+ * nothing once the fade is running. Returns the number of steps; read
+ * them with the fade_step_* functions. 0 if the cycle is empty.
+ */
+EXPORT(fade_plan_cycle)
+int fade_plan_cycle(uint32_t fade_ms, uint32_t on_ms, uint32_t off_ms)
+{
+    fade_cycle_t cycle = {.fade_ms = fade_ms, .on_ms = on_ms, .off_ms = off_ms};
+    uint32_t cycle_ms = fade_cycle_length_ms(&cycle);
+    if (cycle_ms == 0 || s_segments == 0)
+        return 0;
+
+    int n = 0;
+    uint32_t t_ms = 0;
+    while (t_ms < cycle_ms && n < WASM_MAX_STEPS)
+    {
+        fade_step_t step;
+        fade_curve_step_at(&cycle, s_table, s_segments, t_ms, &step);
+        s_step_start_ms[n] = t_ms;
+        s_step_transition_ms[n] = step.segment >= 0 ? step.transition_ms : 0;
+        s_step_level[n] = step.level;
+        s_step_segment[n] = (int16_t)step.segment;
+        n++;
+        // A zero-length hold ends where it starts; the task moves on a tick later
+        t_ms = step.end_ms > t_ms ? step.end_ms : t_ms + 1;
+    }
+    return n;
+}
+
+EXPORT(fade_step_start_ms)
+uint32_t fade_step_start_ms(int i)
+{
+    return i >= 0 && i < WASM_MAX_STEPS ? s_step_start_ms[i] : 0;
+}
+
+EXPORT(fade_step_transition_ms)
+uint32_t fade_step_transition_ms(int i)
+{
+    return i >= 0 && i < WASM_MAX_STEPS ? s_step_transition_ms[i] : 0;
+}
+
+EXPORT(fade_step_level)
+int fade_step_level(int i)
+{
+    return i >= 0 && i < WASM_MAX_STEPS ? s_step_level[i] : 0;
+}
+
+EXPORT(fade_step_segment)
+int fade_step_segment(int i)
+{
+    return i >= 0 && i < WASM_MAX_STEPS ? s_step_segment[i] : -1;
+}